@@ -0,0 +1,121 @@
+#include "sim/ecat_sim.h"
+#include "drivers/eth_mac.h"
+#include "utils/timer.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_CYCLES 20000
+#define BENCH_STARTUP_LIMIT 1000
+#define BENCH_PERIOD_US 500U
+
+static ethcat_master_t s_master;
+static ecat_sim_t s_sim;
+static cia402_axis_t s_axes[ECAT_MAX_SLAVES];
+
+static void exchange(q16_16_t target)
+{
+    for (int slave = 0; slave < s_master.slave_count; ++slave) {
+        if (!ethcat_master_is_drive(&s_master.slaves[slave])) {
+            continue;
+        }
+        q16_16_t targets[3] = {target, 0, 0};
+        cia402_axis_update(&s_axes[slave], &s_master.slaves[slave].txpdo);
+        cia402_axis_command(&s_axes[slave], targets, CIA402_MODE_CSP);
+        ethcat_rxpdo_t rx;
+        cia402_axis_build_rxpdo(&s_axes[slave], &rx);
+        ethcat_master_set_target(&s_master, slave, &rx);
+    }
+    ethcat_master_send_process_data(&s_master);
+    ethcat_master_process(&s_master);
+}
+
+static bool all_enabled(void)
+{
+    if (!s_master.process_data_valid) {
+        return false;
+    }
+    for (int slave = 0; slave < s_master.slave_count; ++slave) {
+        if (ethcat_master_is_drive(&s_master.slaves[slave]) && !cia402_axis_is_enabled(&s_axes[slave])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool setup(int drives)
+{
+    board_runtime_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.control_period_us = BENCH_PERIOD_US;
+    config.default_mode_of_operation = CIA402_MODE_CSP;
+    config.slave_count = (uint8_t)drives;
+    for (int i = 0; i < drives; ++i) {
+        config.slaves[i] = (ecat_slave_descriptor_t){0xabU, 0x1000U + (uint32_t)i, (uint16_t)(i + 1),
+                                                     i < DELTA_JOINT_COUNT ? ECAT_ROLE_JOINT : ECAT_ROLE_AUX_AXIS,
+                                                     (uint8_t)(i < DELTA_JOINT_COUNT ? i : i - DELTA_JOINT_COUNT), 0U, 0U};
+    }
+    eth_mac_config_t mac = {.mac_address = {0x02, 0, 0, 0, 0, 1}, .phy_address = 0U, .cycle_time_ns = BENCH_PERIOD_US * 1000U};
+    eth_mac_init(&mac, NULL, NULL);
+    ethcat_master_init(&s_master, &config);
+    if (!ethcat_master_scan(&s_master)) {
+        return false;
+    }
+    ecat_sim_dynamics_t dynamics = {8U, q16_16_from_float(0.0005f), Q16_16_ONE, 20U};
+    ecat_sim_init(&s_sim, &dynamics);
+    return ecat_sim_attach(&s_sim, &s_master) && ethcat_master_configure(&s_master);
+}
+
+static void run(int drives)
+{
+    if (!setup(drives)) {
+        printf("ecat_sim drives=%d: setup failed\n", drives);
+        return;
+    }
+
+    /* the enable sequencer drives every axis through the state graph at once */
+    for (int slave = 0; slave < drives; ++slave) {
+        cia402_axis_init(&s_axes[slave], CIA402_MODE_CSP);
+        cia402_axis_enable(&s_axes[slave]);
+    }
+    int startup = 0;
+    while (startup < BENCH_STARTUP_LIMIT && !all_enabled()) {
+        exchange(0);
+        ++startup;
+    }
+
+    q16_16_t worst = 0;
+    uint64_t total_ns = 0U;
+    uint32_t max_ns = 0U;
+    for (int cycle = 0; cycle < BENCH_CYCLES; ++cycle) {
+        float t = (float)cycle * (float)BENCH_PERIOD_US * 1e-6f;
+        q16_16_t target = q16_16_from_float(0.5f * sinf(2.0f * 3.14159265f * t));
+        uint32_t start = timer_get_cycles();
+        exchange(target);
+        uint32_t ns = timer_cycles_to_ns(timer_get_cycles() - start);
+        total_ns += ns;
+        if (ns > max_ns) {
+            max_ns = ns;
+        }
+        if (cycle >= BENCH_CYCLES / 10) {
+            /* the drives answer with last cycle's command, compare against that */
+            q16_16_t error = q16_16_abs(s_master.slaves[0].rxpdo.target_position - s_master.slaves[0].txpdo.position_actual);
+            if (error > worst) {
+                worst = error;
+            }
+        }
+    }
+
+    printf("ecat_sim drives=%d: startup %d cycles, cycle avg %lu ns max %lu ns, tracking error max %.6f rad\n",
+           drives, all_enabled() ? startup : -1, (unsigned long)(total_ns / BENCH_CYCLES), (unsigned long)max_ns,
+           (double)q16_16_to_float(worst));
+    ecat_sim_detach(&s_sim);
+}
+
+int main(void)
+{
+    timer_init();
+    run(DELTA_JOINT_COUNT);
+    run(DELTA_JOINT_COUNT + ECAT_MAX_AUX_AXES);
+    return 0;
+}
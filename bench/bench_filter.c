@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 199309L
+#include "utils/filter.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_FRAMES 1024U
+#define BENCH_ROUNDS 2000U
+#define BENCH_CHANNELS 3U
+#define BENCH_PERIOD_US 250U
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double seconds, q16_16_t checksum)
+{
+    double samples = (double)BENCH_FRAMES * BENCH_ROUNDS * BENCH_CHANNELS;
+    printf("filter %-22s %6.2f ns/sample, %6.1f ns/tick (%ld)\n", name, seconds / samples * 1e9,
+           seconds / ((double)BENCH_FRAMES * BENCH_ROUNDS) * 1e9, (long)checksum);
+}
+
+/* float transposed direct form II, the reference an FPU target would run */
+static void float_biquad(const float *c, float (*z)[2], float *samples, size_t frames)
+{
+    for (size_t frame = 0U; frame < frames; ++frame) {
+        for (unsigned channel = 0U; channel < BENCH_CHANNELS; ++channel) {
+            float x = samples[frame * BENCH_CHANNELS + channel];
+            float y = c[0] * x + z[channel][0];
+            z[channel][0] = c[1] * x - c[3] * y + z[channel][1];
+            z[channel][1] = c[2] * x - c[4] * y;
+            samples[frame * BENCH_CHANNELS + channel] = y;
+        }
+    }
+}
+
+int main(void)
+{
+    /* the controller's load: a notch and a lowpass over the three joints */
+    static biquad_bank_t bank;
+    biquad_coeffs_t coeffs;
+    biquad_bank_init(&bank, BENCH_CHANNELS);
+    biquad_design(&coeffs, BIQUAD_NOTCH, q16_16_from_int(30), q16_16_from_int(2), BENCH_PERIOD_US);
+    biquad_bank_add_stage(&bank, &coeffs);
+    biquad_design(&coeffs, BIQUAD_LOWPASS, q16_16_from_int(100), q16_16_from_float(0.7071f), BENCH_PERIOD_US);
+    biquad_bank_add_stage(&bank, &coeffs);
+
+    static q16_16_t input[BENCH_FRAMES][BENCH_CHANNELS];
+    static q16_16_t samples[BENCH_FRAMES][BENCH_CHANNELS];
+    static float input_f[BENCH_FRAMES][BENCH_CHANNELS];
+    static float samples_f[BENCH_FRAMES][BENCH_CHANNELS];
+    for (unsigned n = 0U; n < BENCH_FRAMES; ++n) {
+        for (unsigned channel = 0U; channel < BENCH_CHANNELS; ++channel) {
+            input_f[n][channel] = sinf(0.05f * (float)n * (float)(channel + 1U));
+            input[n][channel] = q16_16_from_float(input_f[n][channel]);
+        }
+    }
+
+    /* once per control tick, as motion_controller_tick runs it */
+    q16_16_t checksum = 0;
+    double start = now_s();
+    for (unsigned round = 0U; round < BENCH_ROUNDS; ++round) {
+        for (unsigned n = 0U; n < BENCH_FRAMES; ++n) {
+            q16_16_t frame[BENCH_CHANNELS] = {input[n][0], input[n][1], input[n][2]};
+            biquad_bank_process(&bank, frame, 1U);
+            checksum += frame[0];
+        }
+    }
+    report("q16 per tick", now_s() - start, checksum);
+
+    /* offline, a block of recorded frames at once */
+    biquad_bank_reset(&bank, NULL);
+    checksum = 0;
+    start = now_s();
+    for (unsigned round = 0U; round < BENCH_ROUNDS; ++round) {
+        for (unsigned n = 0U; n < BENCH_FRAMES; ++n) {
+            for (unsigned channel = 0U; channel < BENCH_CHANNELS; ++channel) {
+                samples[n][channel] = input[n][channel];
+            }
+        }
+        biquad_bank_process(&bank, &samples[0][0], BENCH_FRAMES);
+        checksum += samples[BENCH_FRAMES - 1U][0];
+    }
+    report("q16 block", now_s() - start, checksum);
+
+    float notch[5];
+    float lowpass[5];
+    const biquad_coeffs_t *stages[2] = {&bank.stages[0], &bank.stages[1]};
+    float *designs[2] = {notch, lowpass};
+    for (int stage = 0; stage < 2; ++stage) {
+        const int32_t raw[5] = {stages[stage]->b0, stages[stage]->b1, stages[stage]->b2, stages[stage]->a1, stages[stage]->a2};
+        for (int i = 0; i < 5; ++i) {
+            designs[stage][i] = (float)raw[i] / (float)(1L << BIQUAD_COEFF_BITS);
+        }
+    }
+    float z[2][BENCH_CHANNELS][2] = {{{0}}};
+    float sum = 0.0f;
+    start = now_s();
+    for (unsigned round = 0U; round < BENCH_ROUNDS; ++round) {
+        for (unsigned n = 0U; n < BENCH_FRAMES; ++n) {
+            for (unsigned channel = 0U; channel < BENCH_CHANNELS; ++channel) {
+                samples_f[n][channel] = input_f[n][channel];
+            }
+        }
+        float_biquad(notch, z[0], &samples_f[0][0], BENCH_FRAMES);
+        float_biquad(lowpass, z[1], &samples_f[0][0], BENCH_FRAMES);
+        sum += samples_f[BENCH_FRAMES - 1U][0];
+    }
+    report("float block", now_s() - start, q16_16_from_float(sum));
+    return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 199309L
+#include "kinematics/delta_batch.h"
+#include "board/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* reachability map of the soft-limit box, 128^3 poses */
+#define BENCH_GRID 128U
+#define BENCH_COUNT (BENCH_GRID * BENCH_GRID * BENCH_GRID)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double seconds, size_t valid)
+{
+    printf("kinematics %-12s %8.1f ms, %7.1f Mposes/s, valid %zu\n", name, seconds * 1e3, (double)BENCH_COUNT / seconds * 1e-6, valid);
+}
+
+int main(void)
+{
+    board_load_configuration();
+    const delta_cfg_t *cfg = &g_board_config.delta;
+    delta_init(cfg);
+
+    float *xyz[3];
+    float *theta[3];
+    float *back[3];
+    double *xyz_f64[3];
+    double *theta_f64[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        xyz[axis] = malloc(BENCH_COUNT * sizeof(float));
+        theta[axis] = malloc(BENCH_COUNT * sizeof(float));
+        back[axis] = malloc(BENCH_COUNT * sizeof(float));
+        xyz_f64[axis] = malloc(BENCH_COUNT * sizeof(double));
+        theta_f64[axis] = malloc(BENCH_COUNT * sizeof(double));
+        if (xyz[axis] == NULL || theta[axis] == NULL || back[axis] == NULL || xyz_f64[axis] == NULL || theta_f64[axis] == NULL) {
+            return 1;
+        }
+    }
+    for (uint32_t n = 0U; n < BENCH_COUNT; ++n) {
+        uint32_t index[3] = {n % BENCH_GRID, (n / BENCH_GRID) % BENCH_GRID, n / (BENCH_GRID * BENCH_GRID)};
+        for (int axis = 0; axis < 3; ++axis) {
+            float lo = q16_16_to_float(cfg->soft_xyz_min[axis]);
+            float hi = q16_16_to_float(cfg->soft_xyz_max[axis]);
+            xyz[axis][n] = lo + (hi - lo) * (float)index[axis] / (float)(BENCH_GRID - 1U);
+            xyz_f64[axis][n] = xyz[axis][n];
+        }
+    }
+
+    /* the firmware path, one Q16.16 pose at a time */
+    double start = now_s();
+    size_t reachable = 0U;
+    for (uint32_t n = 0U; n < BENCH_COUNT; ++n) {
+        delta_pose_t pose = {{q16_16_from_float(xyz[0][n]), q16_16_from_float(xyz[1][n]), q16_16_from_float(xyz[2][n])}};
+        delta_joint_t joints;
+        reachable += delta_inverse_kinematics(&pose, &joints) ? 1U : 0U;
+    }
+    report("delta.c ik", now_s() - start, reachable);
+    /* the scalar forward kinematics iterate on the inverse, a slice is enough */
+    start = now_s();
+    size_t solved = 0U;
+    for (uint32_t n = 0U; n < BENCH_COUNT; n += 16U) {
+        delta_pose_t pose = {{q16_16_from_float(xyz[0][n]), q16_16_from_float(xyz[1][n]), q16_16_from_float(xyz[2][n])}};
+        delta_joint_t joints;
+        delta_pose_t solution;
+        solved += delta_inverse_kinematics(&pose, &joints) && delta_forward_kinematics(&joints, &solution) ? 1U : 0U;
+    }
+    double fk_s = (now_s() - start) * 16.0;
+    printf("kinematics %-12s %8.1f ms (extrapolated from 1/16), solved %zu\n", "delta.c fk", fk_s * 1e3, solved);
+
+    static const char *const names[] = {"scalar", "sse2", "avx2"};
+    delta_batch_t batch;
+    delta_batch_init(&batch, cfg);
+    unsigned threads = batch.threads;
+    const float *const in[3] = {xyz[0], xyz[1], xyz[2]};
+    float *const out[3] = {theta[0], theta[1], theta[2]};
+    const double *const in_f64[3] = {xyz_f64[0], xyz_f64[1], xyz_f64[2]};
+    double *const out_f64[3] = {theta_f64[0], theta_f64[1], theta_f64[2]};
+    for (int isa = DELTA_BATCH_SCALAR; isa <= DELTA_BATCH_AVX2; ++isa) {
+        if (!delta_batch_set_isa(&batch, (delta_batch_isa_t)isa)) {
+            continue;
+        }
+        char name[32];
+        delta_batch_set_threads(&batch, 1U);
+        start = now_s();
+        reachable = delta_batch_inverse_f32(&batch, in, out, NULL, BENCH_COUNT);
+        snprintf(name, sizeof(name), "%s f32", names[isa]);
+        report(name, now_s() - start, reachable);
+        start = now_s();
+        reachable = delta_batch_inverse_f64(&batch, in_f64, out_f64, NULL, BENCH_COUNT);
+        snprintf(name, sizeof(name), "%s f64", names[isa]);
+        report(name, now_s() - start, reachable);
+        const float *const joints[3] = {theta[0], theta[1], theta[2]};
+        float *const poses[3] = {back[0], back[1], back[2]};
+        start = now_s();
+        size_t solved_batch = delta_batch_forward_f32(&batch, joints, poses, NULL, BENCH_COUNT);
+        snprintf(name, sizeof(name), "%s fk f32", names[isa]);
+        report(name, now_s() - start, solved_batch);
+    }
+    if (threads > 1U) {
+        delta_batch_init(&batch, cfg);
+        start = now_s();
+        reachable = delta_batch_inverse_f32(&batch, in, out, NULL, BENCH_COUNT);
+        char name[32];
+        snprintf(name, sizeof(name), "f32 x%u", threads);
+        report(name, now_s() - start, reachable);
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        free(xyz[axis]);
+        free(theta[axis]);
+        free(back[axis]);
+        free(xyz_f64[axis]);
+        free(theta_f64[axis]);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "planner/planner.h"
+#include "board/config.h"
+#include <math.h>
+#include <stdio.h>
+
+/* standard delta cycle: 25 mm up, 305 mm across, 25 mm down, and back */
+#define BENCH_LIFT_M 0.025f
+#define BENCH_TRAVERSE_M 0.305f
+#define BENCH_PICK_Z_M -0.400f
+#define BENCH_PERIOD_US 250U
+
+typedef struct {
+    const char *name;
+    float velocity;
+    float accel;
+    float jerk;
+} bench_limits_t;
+
+static planner_queue_t s_planner;
+
+static int run_arch(const delta_pose_t *target, float radius, const bench_limits_t *limits, int *unreachable)
+{
+    if (!planner_push_arch(&s_planner, target, q16_16_from_float(BENCH_LIFT_M), q16_16_from_float(radius),
+                           q16_16_from_float(limits->velocity), q16_16_from_float(limits->accel), q16_16_from_float(limits->jerk))) {
+        return -1;
+    }
+    int ticks = 0;
+    delta_pose_t pose;
+    while (planner_step(&s_planner, &pose)) {
+        delta_joint_t joints;
+        if (!delta_inverse_kinematics(&pose, &joints)) {
+            ++*unreachable;
+        }
+        ++ticks;
+    }
+    return ticks;
+}
+
+static void run(const bench_limits_t *limits, float radius)
+{
+    delta_pose_t pick = {{q16_16_from_float(-0.5f * BENCH_TRAVERSE_M), 0, q16_16_from_float(BENCH_PICK_Z_M)}};
+    delta_pose_t place = {{q16_16_from_float(0.5f * BENCH_TRAVERSE_M), 0, q16_16_from_float(BENCH_PICK_Z_M)}};
+    planner_init(&s_planner, BENCH_PERIOD_US);
+    s_planner.current_pose = pick;
+    int unreachable = 0;
+    int out = run_arch(&place, radius, limits, &unreachable);
+    int back = run_arch(&pick, radius, limits, &unreachable);
+    if (out < 0 || back < 0) {
+        printf("pick_place %s radius=%.0f mm: planning failed\n", limits->name, (double)(radius * 1000.0f));
+        return;
+    }
+    float cycle_s = (float)(out + back) * (float)BENCH_PERIOD_US * 1e-6f;
+    printf("pick_place %s radius=%2.0f mm: cycle %.1f ms, %.1f cycles/min, unreachable setpoints %d\n",
+           limits->name, (double)(radius * 1000.0f), (double)(cycle_s * 1000.0f), (double)(60.0f / cycle_s), unreachable);
+}
+
+int main(void)
+{
+    board_load_configuration();
+    delta_init(&g_board_config.delta);
+    const bench_limits_t limits[] = {
+        {"parser", 0.5f, 1.0f, 5.0f},
+        {"fast", 4.0f, 100.0f, 5000.0f},
+    };
+    /* radius 0 is the stop-and-go G1 sequence */
+    const float radii[] = {0.0f, 0.010f, 0.025f};
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i) {
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r) {
+            run(&limits[i], radii[r]);
+        }
+    }
+    return 0;
+}
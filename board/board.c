@@ -3,7 +3,7 @@
 #include "drivers/eth_mac.h"
 #include "drivers/uart.h"
 #include <stddef.h>
-#include "utils/fixed.h"
+#include "storage/storage.h"
 
 board_runtime_config_t g_board_config;
 
@@ -22,6 +22,7 @@ void board_emac_init(void)
     eth_mac_config_t cfg = {
         .mac_address = {0x02, 0x12, 0x34, 0x56, 0x78, 0x9A},
         .phy_address = 0U,
+        .interface_name = ETH_MAC_INTERFACE,
     };
     eth_mac_init(&cfg, NULL, NULL);
 }
@@ -33,26 +34,20 @@ void board_console_init(void)
 
 void board_load_configuration(void)
 {
-    g_board_config.delta.R_base = q16_16_from_float(0.300f);
-    g_board_config.delta.r_eff = q16_16_from_float(0.100f);
-    g_board_config.delta.L_upper = q16_16_from_float(0.300f);
-    g_board_config.delta.L_lower = q16_16_from_float(0.400f);
-    g_board_config.delta.z_offset = q16_16_from_float(0.200f);
-    g_board_config.delta.soft_xyz_min[0] = q16_16_from_float(-0.200f);
-    g_board_config.delta.soft_xyz_min[1] = q16_16_from_float(-0.200f);
-    g_board_config.delta.soft_xyz_min[2] = q16_16_from_float(-0.500f);
-    g_board_config.delta.soft_xyz_max[0] = q16_16_from_float(0.200f);
-    g_board_config.delta.soft_xyz_max[1] = q16_16_from_float(0.200f);
-    g_board_config.delta.soft_xyz_max[2] = q16_16_from_float(-0.100f);
-
-    g_board_config.axis_velocity_limit = q16_16_from_float(0.150f);
-    g_board_config.axis_acceleration_limit = q16_16_from_float(1.000f);
-    g_board_config.axis_jerk_limit = q16_16_from_float(5.000f);
-    g_board_config.default_mode_of_operation = 8U; /* CSP */
-
-    for (int i = 0; i < ECAT_MAX_SLAVES; ++i) {
-        g_board_config.slaves[i].vendor_id = 0x000000abU;
-        g_board_config.slaves[i].product_code = 0x00001000U + (uint32_t)i;
-        g_board_config.slaves[i].alias = (uint16_t)(i + 1);
+    /* compiled defaults with the saved parameters on top */
+    storage_load(&g_board_config);
+
+    static const ecat_slave_descriptor_t s_bus[] = {
+        {0x000000abU, 0x00001000U, 1U, ECAT_ROLE_JOINT, 0U, 0U, 0U},
+        {0x000000abU, 0x00001001U, 2U, ECAT_ROLE_JOINT, 1U, 0U, 0U},
+        {0x000000abU, 0x00001002U, 3U, ECAT_ROLE_JOINT, 2U, 0U, 0U},
+        {0x000000abU, 0x00001010U, 4U, ECAT_ROLE_AUX_AXIS, 0U, 0U, 0U}, /* rotary wrist */
+        {0x000000abU, 0x00001020U, 5U, ECAT_ROLE_AUX_AXIS, 1U, 0U, 0U}, /* conveyor */
+        {0x00000002U, 0x07113052U, 6U, ECAT_ROLE_IO, 0U, 0U, 2U},       /* 16 digital inputs */
+        {0x00000002U, 0x0AF93052U, 7U, ECAT_ROLE_IO, 0U, 2U, 0U},       /* 16 digital outputs */
+    };
+    g_board_config.slave_count = (uint8_t)(sizeof(s_bus) / sizeof(s_bus[0]));
+    for (int i = 0; i < g_board_config.slave_count; ++i) {
+        g_board_config.slaves[i] = s_bus[i];
     }
 }
@@ -6,22 +6,65 @@
 
 #define CONTROL_PERIOD_US 1000U
 #define CONTROL_PERIOD_FAST_US 500U
+#define CONTROL_PERIOD_MIN_US 250U
+#define CONTROL_PERIOD_MAX_US 1000U
+#define CONTROL_TICK_BUDGET_PERCENT 70U
+/* host build: SCHED_FIFO priority and core of the control thread, isolate it with isolcpus= */
+#define CONTROL_RT_PRIORITY 80U
+#define CONTROL_RT_CPU 1
 
-#define ECAT_MAX_SLAVES 3
+#define ECAT_MAX_SLAVES 8
+#define ECAT_MAX_AUX_AXES 4
+#define ECAT_IO_MAX_BYTES 8
+#define DELTA_JOINT_COUNT 3
+
+#ifndef ETH_MAC_INTERFACE
+#define ETH_MAC_INTERFACE "eth0" /* raw-socket backend, overridden from CMake */
+#endif
+
+typedef enum {
+    ECAT_ROLE_NONE = 0,
+    ECAT_ROLE_JOINT,
+    ECAT_ROLE_AUX_AXIS,
+    ECAT_ROLE_IO
+} ecat_slave_role_t;
 
 typedef struct {
     uint32_t vendor_id;
     uint32_t product_code;
     uint16_t alias;
+    ecat_slave_role_t role;
+    uint8_t axis_index; /* joint number for ECAT_ROLE_JOINT, auxiliary axis number for ECAT_ROLE_AUX_AXIS */
+    uint8_t io_output_bytes;
+    uint8_t io_input_bytes;
 } ecat_slave_descriptor_t;
 
 typedef struct {
     delta_cfg_t delta;
-    q16_16_t axis_velocity_limit;
-    q16_16_t axis_acceleration_limit;
+    q16_16_t axis_velocity_limit;     /* rad/s, also the path parameterization bound */
+    q16_16_t axis_acceleration_limit; /* rad/s^2 */
     q16_16_t axis_jerk_limit;
+    q16_16_t axis_torque_limit;       /* N m */
+    q16_16_t joint_inertia;           /* kg m^2 reflected at the joint, turns torque into acceleration */
+    q16_16_t path_acceleration_limit; /* m/s^2, Cartesian cap on top of the joint limits */
+    q16_16_t path_jerk_limit;         /* m/s^3 */
+    q16_16_t following_error_warning; /* rad, the feed is scaled down above this */
+    q16_16_t following_error_fault;   /* rad, quick stop */
+    uint8_t input_shaper_type;        /* input_shaper_type_t */
+    q16_16_t input_shaper_frequency_hz[3];
+    q16_16_t input_shaper_damping[3];
+    uint8_t conveyor_axis;            /* auxiliary axis that measures the belt, 0xFF without tracking */
+    q16_16_t conveyor_direction[3];
+    q16_16_t conveyor_scale;          /* m of belt travel per position unit */
+    uint32_t conveyor_latency_us;     /* drive lag behind the setpoint */
+    q16_16_t torque_notch_hz;         /* arm resonance seen by the joints, 0 disables the notch */
+    q16_16_t torque_notch_q;
+    q16_16_t velocity_filter_hz;      /* joint velocity estimate bandwidth */
+    uint16_t opcua_port;              /* OPC UA binary endpoint, 0 disables the server */
     uint8_t default_mode_of_operation;
+    uint32_t control_period_us;
     ecat_slave_descriptor_t slaves[ECAT_MAX_SLAVES];
+    uint8_t slave_count;
 } board_runtime_config_t;
 
 extern board_runtime_config_t g_board_config;
@@ -1,33 +1,40 @@
 #include "cia402.h"
 
+#define CW_SHUTDOWN 0x0006U
+#define CW_SWITCH_ON 0x0007U
+#define CW_ENABLE_OPERATION 0x000FU
+#define CW_QUICK_STOP 0x0002U
+#define CW_DISABLE_VOLTAGE 0x0000U
+#define CW_FAULT_RESET 0x0080U
+#define CW_HALT 0x0100U
+
 static cia402_state_t cia402_decode_state(uint16_t statusword)
 {
-    uint16_t masked = statusword & 0x006FU;
     if ((statusword & 0x004FU) == 0x0000U) {
         return CIA402_STATE_NOT_READY;
     }
-    if ((masked & 0x004FU) == 0x0040U) {
+    if ((statusword & 0x004FU) == 0x0040U) {
         return CIA402_STATE_SWITCH_ON_DISABLED;
     }
-    if ((masked & 0x006FU) == 0x0021U) {
+    if ((statusword & 0x006FU) == 0x0021U) {
         return CIA402_STATE_READY_TO_SWITCH_ON;
     }
-    if ((masked & 0x006FU) == 0x0023U) {
+    if ((statusword & 0x006FU) == 0x0023U) {
         return CIA402_STATE_SWITCHED_ON;
     }
-    if ((masked & 0x006FU) == 0x0027U) {
+    if ((statusword & 0x006FU) == 0x0027U) {
         return CIA402_STATE_OPERATION_ENABLED;
     }
-    if ((masked & 0x006FU) == 0x002BU) {
+    if ((statusword & 0x006FU) == 0x0007U) {
         return CIA402_STATE_QUICK_STOP_ACTIVE;
     }
     if ((statusword & 0x004FU) == 0x000FU) {
-        return CIA402_STATE_FAULT;
-    }
-    if ((statusword & 0x004FU) == 0x0007U) {
         return CIA402_STATE_FAULT_REACTION;
     }
-    return CIA402_STATE_SWITCH_ON_DISABLED;
+    if ((statusword & 0x004FU) == 0x0008U) {
+        return CIA402_STATE_FAULT;
+    }
+    return CIA402_STATE_NOT_READY;
 }
 
 void cia402_axis_init(cia402_axis_t *axis, cia402_mode_t mode)
@@ -41,13 +48,55 @@ void cia402_axis_init(cia402_axis_t *axis, cia402_mode_t mode)
     axis->halt = false;
     axis->quick_stop = false;
     axis->fault_reset_request = false;
+    axis->enable_request = false;
+    axis->enable_timeout = false;
+    axis->reset_phase = 0U;
+    axis->state_cycles = 0U;
+    axis->enable_cycles = 0U;
+    axis->enabled_after_cycles = 0U;
+    cia402_axis_set_period(axis, CONTROL_PERIOD_US);
+}
+
+void cia402_axis_set_period(cia402_axis_t *axis, uint32_t period_us)
+{
+    if (period_us != 0U) {
+        axis->timeout_cycles = (CIA402_TRANSITION_TIMEOUT_MS * 1000U + period_us - 1U) / period_us;
+    }
+}
+
+static bool sequencer_waiting(const cia402_axis_t *axis)
+{
+    /* states where the drive is expected to move on by itself or on our command */
+    if (axis->state == CIA402_STATE_FAULT_REACTION || axis->state == CIA402_STATE_NOT_READY) {
+        return true;
+    }
+    return axis->enable_request && !axis->quick_stop && axis->state != CIA402_STATE_OPERATION_ENABLED;
 }
 
 void cia402_axis_update(cia402_axis_t *axis, const ethcat_txpdo_t *feedback)
 {
+    cia402_state_t previous = axis->state;
     axis->state = cia402_decode_state(feedback->statusword);
-    if (axis->state == CIA402_STATE_FAULT && axis->fault_reset_request) {
-        axis->fault_reset_request = false;
+    axis->state_cycles = axis->state == previous ? axis->state_cycles + 1U : 0U;
+
+    if (axis->state == CIA402_STATE_FAULT && (axis->fault_reset_request || axis->enable_request) && !axis->enable_timeout) {
+        /* fault reset acts on the rising edge: low, then high for a few cycles */
+        axis->reset_phase = (uint8_t)((axis->reset_phase + 1U) % (2U * CIA402_FAULT_RESET_PULSE_CYCLES));
+    } else {
+        axis->reset_phase = 0U;
+        if (previous == CIA402_STATE_FAULT) {
+            axis->fault_reset_request = false;
+        }
+    }
+
+    if (axis->enable_request && axis->enabled_after_cycles == 0U) {
+        axis->enable_cycles++;
+        if (axis->state == CIA402_STATE_OPERATION_ENABLED) {
+            axis->enabled_after_cycles = axis->enable_cycles;
+        }
+    }
+    if (sequencer_waiting(axis) && axis->state_cycles >= axis->timeout_cycles) {
+        axis->enable_timeout = true;
     }
 }
 
@@ -59,21 +108,37 @@ void cia402_axis_command(cia402_axis_t *axis, const q16_16_t *targets, cia402_mo
     axis->target_torque = targets[2];
 }
 
-void cia402_axis_build_rxpdo(const cia402_axis_t *axis, ethcat_rxpdo_t *rxpdo)
+static uint16_t sequencer_controlword(const cia402_axis_t *axis)
 {
-    uint16_t cw = 0U;
-    cw |= 0x0006U; /* enable voltage + quick stop */
-    if (!axis->quick_stop) {
-        cw |= 0x0001U; /* switch on */
+    if (axis->state == CIA402_STATE_FAULT) {
+        return axis->reset_phase >= CIA402_FAULT_RESET_PULSE_CYCLES ? CW_FAULT_RESET : CW_DISABLE_VOLTAGE;
     }
-    if (!axis->halt && !axis->quick_stop) {
-        cw |= 0x0008U; /* enable operation */
+    if (axis->quick_stop) {
+        return axis->state == CIA402_STATE_OPERATION_ENABLED || axis->state == CIA402_STATE_QUICK_STOP_ACTIVE ? CW_QUICK_STOP : CW_DISABLE_VOLTAGE;
     }
-    if (axis->halt) {
-        cw |= 0x0100U;
+    bool enable = axis->enable_request && !axis->enable_timeout;
+    switch (axis->state) {
+    case CIA402_STATE_SWITCH_ON_DISABLED:
+        return enable ? CW_SHUTDOWN : CW_DISABLE_VOLTAGE;
+    case CIA402_STATE_READY_TO_SWITCH_ON:
+        return enable ? CW_SWITCH_ON : CW_SHUTDOWN;
+    case CIA402_STATE_SWITCHED_ON:
+        return enable ? CW_ENABLE_OPERATION : CW_SHUTDOWN;
+    case CIA402_STATE_OPERATION_ENABLED:
+        return enable ? CW_ENABLE_OPERATION : CW_SWITCH_ON;
+    case CIA402_STATE_QUICK_STOP_ACTIVE:
+    case CIA402_STATE_FAULT_REACTION:
+    case CIA402_STATE_NOT_READY:
+    default:
+        return CW_DISABLE_VOLTAGE;
     }
-    if (axis->fault_reset_request) {
-        cw |= 0x0080U;
+}
+
+void cia402_axis_build_rxpdo(const cia402_axis_t *axis, ethcat_rxpdo_t *rxpdo)
+{
+    uint16_t cw = sequencer_controlword(axis);
+    if (axis->halt) {
+        cw |= CW_HALT;
     }
     rxpdo->controlword = cw;
     rxpdo->mode_of_operation = (uint8_t)axis->mode;
@@ -86,3 +151,25 @@ void cia402_axis_fault_reset(cia402_axis_t *axis)
 {
     axis->fault_reset_request = true;
 }
+
+void cia402_axis_enable(cia402_axis_t *axis)
+{
+    axis->enable_request = true;
+    axis->enable_timeout = false;
+    axis->quick_stop = false;
+    axis->halt = false;
+    axis->enable_cycles = 0U;
+    axis->enabled_after_cycles = axis->state == CIA402_STATE_OPERATION_ENABLED ? 1U : 0U;
+    axis->state_cycles = 0U;
+}
+
+void cia402_axis_disable(cia402_axis_t *axis)
+{
+    axis->enable_request = false;
+    axis->enable_timeout = false;
+}
+
+bool cia402_axis_is_enabled(const cia402_axis_t *axis)
+{
+    return axis->state == CIA402_STATE_OPERATION_ENABLED && !axis->quick_stop;
+}
@@ -23,6 +23,9 @@ typedef enum {
     CIA402_STATE_FAULT
 } cia402_state_t;
 
+#define CIA402_TRANSITION_TIMEOUT_MS 2000U /* per state, covers drive boot */
+#define CIA402_FAULT_RESET_PULSE_CYCLES 2U
+
 typedef struct {
     cia402_state_t state;
     cia402_mode_t mode;
@@ -33,12 +36,23 @@ typedef struct {
     bool halt;
     bool quick_stop;
     bool fault_reset_request;
+    bool enable_request;
+    bool enable_timeout;
+    uint8_t reset_phase;
+    uint32_t state_cycles;
+    uint32_t timeout_cycles;       /* CIA402_TRANSITION_TIMEOUT_MS at the control period */
+    uint32_t enable_cycles;
+    uint32_t enabled_after_cycles; /* time to Operation Enabled of the last request */
 } cia402_axis_t;
 
 void cia402_axis_init(cia402_axis_t *axis, cia402_mode_t mode);
+void cia402_axis_set_period(cia402_axis_t *axis, uint32_t period_us);
 void cia402_axis_update(cia402_axis_t *axis, const ethcat_txpdo_t *feedback);
 void cia402_axis_command(cia402_axis_t *axis, const q16_16_t *targets, cia402_mode_t mode);
 void cia402_axis_build_rxpdo(const cia402_axis_t *axis, ethcat_rxpdo_t *rxpdo);
 void cia402_axis_fault_reset(cia402_axis_t *axis);
+void cia402_axis_enable(cia402_axis_t *axis);
+void cia402_axis_disable(cia402_axis_t *axis);
+bool cia402_axis_is_enabled(const cia402_axis_t *axis);
 
 #endif
@@ -14,3 +14,37 @@ void cnc_runtime_set_state(cnc_runtime_t *runtime, cnc_state_t state)
         runtime->alarm_active = true;
     }
 }
+
+/* Sequence lock: the tick never waits, a reader that overlapped an update
+ * copies again. Odd while the tick is writing */
+static cnc_status_t s_status;
+static uint32_t s_sequence = 0U;
+
+void cnc_state_init(void)
+{
+    cnc_status_t cleared = {0};
+    cnc_state_update(&cleared);
+}
+
+void cnc_state_update(const cnc_status_t *status)
+{
+    uint32_t sequence = __atomic_load_n(&s_sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_sequence, sequence + 1U, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s_status = *status;
+    __atomic_store_n(&s_sequence, sequence + 2U, __ATOMIC_RELEASE);
+}
+
+cnc_status_t cnc_state_status(void)
+{
+    cnc_status_t copy;
+    uint32_t begin;
+    uint32_t end;
+    do {
+        begin = __atomic_load_n(&s_sequence, __ATOMIC_ACQUIRE);
+        copy = s_status;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&s_sequence, __ATOMIC_RELAXED);
+    } while ((begin & 1U) != 0U || begin != end);
+    return copy;
+}
@@ -2,6 +2,9 @@
 #define CORE_CNC_STATE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "board/config.h"
+#include "utils/fixed.h"
 
 typedef enum {
     CNC_STATE_IDLE = 0,
@@ -17,7 +20,26 @@ typedef struct {
     bool alarm_active;
 } cnc_runtime_t;
 
+/* telemetry snapshot, written by the control tick and read in the background */
+typedef struct {
+    cnc_state_t state;
+    bool drives_enabled;
+    bool alarm_active;
+    bool drives_ready;
+    q16_16_t position[3];                        /* commanded pose, m */
+    q16_16_t joint_position[DELTA_JOINT_COUNT];  /* drive feedback, rad */
+    q16_16_t following_error[DELTA_JOINT_COUNT]; /* rad */
+    uint32_t cycles;
+    uint32_t missed_cycles;
+    uint32_t lost_frames;
+    uint32_t following_warnings;
+} cnc_status_t;
+
 void cnc_runtime_init(cnc_runtime_t *runtime);
 void cnc_runtime_set_state(cnc_runtime_t *runtime, cnc_state_t state);
 
+void cnc_state_init(void);
+void cnc_state_update(const cnc_status_t *status);
+cnc_status_t cnc_state_status(void);
+
 #endif
@@ -9,6 +9,7 @@ static bool queue_full(const command_queue_t *queue)
 void command_queue_init(command_queue_t *queue)
 {
     queue->head = queue->tail = 0U;
+    queue->error = PLANNER_ERROR_NONE;
 }
 
 bool command_queue_enqueue(command_queue_t *queue, const char *line)
@@ -42,40 +43,91 @@ static void queue_pop(command_queue_t *queue)
     }
 }
 
-bool command_processor_step(command_queue_t *queue, cnc_runtime_t *runtime, gcode_parser_t *parser, planner_queue_t *planner, cia402_axis_t *axes)
+static bool motion_barrier(cnc_runtime_t *runtime, gcode_parser_t *parser, planner_queue_t *planner)
 {
-    if (queue_empty(queue)) {
+    /* G38 and M200/M201 are synchronous: later lines need the position where
+     * the probe stopped or the frame the belt switch left behind */
+    if (planner->probe.state == PLANNER_PROBE_PENDING ||
+        planner->frame == PLANNER_FRAME_ENGAGE || planner->frame == PLANNER_FRAME_RELEASE) {
+        return true;
+    }
+    if (planner->frame_lost) {
+        /* the belt would have carried the tool out of reach: tracking was released
+         * and the belt-frame moves dropped, later lines start from the released pose */
+        planner->frame_lost = false;
+        parser->pose_sync = true;
+        cnc_runtime_set_state(runtime, CNC_STATE_ALARM);
+    }
+    if (planner->pose_pending) {
+        /* later lines start from where the drives are found when enabled */
+        return true;
+    }
+    if (planner->bypassed) {
+        /* a replay moves the arm, the parser continues from where it ends */
+        parser->pose_sync = true;
+        return true;
+    }
+    if (parser->pose_sync) {
+        gcode_parser_sync_pose(parser, &planner->current_pose);
+        if (planner->probe.state == PLANNER_PROBE_MISSED && planner->probe.error_on_miss) {
+            cnc_runtime_set_state(runtime, CNC_STATE_ALARM);
+            planner->probe.error_on_miss = false; /* raised once, not again by a later sync */
+        }
+    }
+    return false;
+}
+
+bool command_processor_step(command_queue_t *queue, cnc_runtime_t *runtime, gcode_parser_t *parser, planner_queue_t *planner, cia402_axis_t *axes, int axis_count)
+{
+    if (motion_barrier(runtime, parser, planner) || queue_empty(queue) || planner_is_full(planner)) {
         return false;
     }
     const char *line = queue_front(queue);
-    gcode_event_t event = gcode_parser_process_line(parser, line, planner);
+    gcode_event_t event = gcode_parser_busy(parser) ? gcode_parser_resume(parser, planner) : gcode_parser_process_line(parser, line, planner);
 
     switch (event) {
     case GCODE_EVENT_ENABLE_DRIVES:
         runtime->drives_enabled = true;
         runtime->state = CNC_STATE_RUN;
-        for (int axis = 0; axis < 3; ++axis) {
-            axes[axis].quick_stop = false;
-            axes[axis].halt = false;
-            cia402_axis_fault_reset(&axes[axis]);
+        planner->pose_pending = true;
+        parser->pose_sync = true;
+        for (int axis = 0; axis < axis_count; ++axis) {
+            /* the sequencer resets faults and walks every drive to Operation Enabled */
+            cia402_axis_enable(&axes[axis]);
         }
         break;
     case GCODE_EVENT_DISABLE_DRIVES:
         runtime->drives_enabled = false;
         runtime->state = CNC_STATE_HOLD;
-        for (int axis = 0; axis < 3; ++axis) {
+        for (int axis = 0; axis < axis_count; ++axis) {
             axes[axis].quick_stop = true;
+            cia402_axis_disable(&axes[axis]);
         }
         break;
     case GCODE_EVENT_ESTOP:
         cnc_runtime_set_state(runtime, CNC_STATE_ESTOP);
-        for (int axis = 0; axis < 3; ++axis) {
+        for (int axis = 0; axis < axis_count; ++axis) {
             axes[axis].quick_stop = true;
         }
         break;
     case GCODE_EVENT_DWELL:
         runtime->state = CNC_STATE_HOLD;
         break;
+    case GCODE_EVENT_PROBE:
+        runtime->state = CNC_STATE_RUN;
+        break;
+    case GCODE_EVENT_BUSY:
+        /* the line stays at the front until the planner has room for the rest of it */
+        return false;
+    case GCODE_EVENT_REJECTED:
+        if (planner->error == PLANNER_ERROR_QUEUE_FULL) {
+            /* nothing of the line was queued, it is retried */
+            return false;
+        }
+        /* the queue runs up to the move before, nothing after it is trusted */
+        queue->error = planner->error;
+        cnc_runtime_set_state(runtime, CNC_STATE_ALARM);
+        break;
     case GCODE_EVENT_NONE:
     default:
         runtime->state = CNC_STATE_RUN;
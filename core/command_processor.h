@@ -13,10 +13,11 @@ typedef struct {
     char lines[COMMAND_QUEUE_LENGTH][COMMAND_MAX_LENGTH];
     uint16_t head;
     uint16_t tail;
+    planner_error_t error; /* last rejected move, reported and cleared by the console */
 } command_queue_t;
 
 void command_queue_init(command_queue_t *queue);
 bool command_queue_enqueue(command_queue_t *queue, const char *line);
-bool command_processor_step(command_queue_t *queue, cnc_runtime_t *runtime, gcode_parser_t *parser, planner_queue_t *planner, cia402_axis_t *axes);
+bool command_processor_step(command_queue_t *queue, cnc_runtime_t *runtime, gcode_parser_t *parser, planner_queue_t *planner, cia402_axis_t *axes, int axis_count);
 
 #endif
@@ -2,12 +2,21 @@
 #include "board/board.h"
 #include "core/cnc_state.h"
 #include "core/command_processor.h"
+#include "core/scheduler.h"
 #include "cia402/cia402.h"
 #include "ethcat/master.h"
 #include "motion/motion_control.h"
 #include "gcode/parser.h"
+#include "gcode/console.h"
 #include "utils/timer.h"
+#include "storage/storage.h"
 #include "drivers/eth_mac.h"
+#include "drivers/uart.h"
+#include "osal/osal.h"
+#ifdef ENABLE_OPCUA
+#include "opcua/server.h"
+#endif
+#include <stddef.h>
 
 static ethcat_master_t g_master;
 static planner_queue_t g_planner;
@@ -16,27 +25,191 @@ static gcode_parser_t g_parser;
 static command_queue_t g_cmd_queue;
 static motion_controller_t g_motion;
 static cnc_runtime_t g_runtime;
+static console_t g_console;
+static trace_t g_trace;
+static scheduler_t g_scheduler;
+static int g_tick_task;
+static int g_bus_task;
+static int g_command_task;
+static uint32_t g_cycles;
+
+/* the bus is polled faster than Sync0, a frame waits at most a quarter cycle */
+#define BUS_POLLS_PER_CYCLE 4U
+#define CONSOLE_PERIOD_NS 1000000ULL
+#define CONSOLE_DEADLINE_NS 10000000ULL
+#define CONSOLE_BUDGET_NS 200000ULL
+#define COMMAND_DEADLINE_NS 2000000ULL
+#define COMMAND_BUDGET_NS 300000ULL
+#define STORAGE_PERIOD_NS 100000000ULL
+#define OPCUA_PERIOD_NS 5000000ULL
+#define TRACE_PERIOD_NS 1000000ULL
+#define TRACE_DUMP_CHUNK 32U /* bytes per run, about what the UART drains in 1 ms */
+
+static void publish_status(void)
+{
+    cnc_status_t status = {0};
+    status.state = g_runtime.state;
+    status.drives_enabled = g_runtime.drives_enabled;
+    status.alarm_active = g_runtime.alarm_active;
+    status.drives_ready = g_motion.drives_ready;
+    for (int axis = 0; axis < 3; ++axis) {
+        status.position[axis] = g_motion.command_pose.xyz[axis];
+    }
+    for (int i = 0; i < g_master.slave_count; ++i) {
+        const ethcat_slave_t *slave = &g_master.slaves[i];
+        if (slave->role == ECAT_ROLE_JOINT && slave->axis_index < DELTA_JOINT_COUNT) {
+            status.joint_position[slave->axis_index] = slave->txpdo.position_actual;
+        }
+    }
+    for (int joint = 0; joint < DELTA_JOINT_COUNT; ++joint) {
+        status.following_error[joint] = g_motion.following.error[joint];
+    }
+    status.cycles = ++g_cycles;
+    status.missed_cycles = g_master.stats.missed_cycles;
+    status.lost_frames = g_master.stats.lost_frames;
+    status.following_warnings = g_motion.following.warning_cycles;
+    cnc_state_update(&status);
+}
+
+static bool drive_fault(void)
+{
+    if (g_motion.following.fault || g_runtime.alarm_active) {
+        return true;
+    }
+    for (int slave = 0; slave < g_master.slave_count; ++slave) {
+        const cia402_axis_t *axis = &g_axes[slave];
+        if (axis->quick_stop || axis->state == CIA402_STATE_FAULT_REACTION || axis->state == CIA402_STATE_FAULT) {
+            return true;
+        }
+    }
+    return false;
+}
 
 static void sync0_callback(void *user)
 {
     (void)user;
     ethcat_master_sync0_handler(&g_master);
+    uint32_t start = timer_get_cycles();
     motion_controller_tick(&g_motion);
+    cycle_stats_record(&g_master.stats, CYCLE_STAT_TICK_DURATION, timer_cycles_to_ns(timer_get_cycles() - start));
+    ethcat_master_send_process_data(&g_master);
+    trace_sample(&g_trace, drive_fault());
+    publish_status();
+}
+
+static void set_rt_periods(uint32_t period_us)
+{
+    uint64_t period_ns = (uint64_t)period_us * 1000U;
+    uint64_t poll_ns = period_ns / BUS_POLLS_PER_CYCLE;
+    scheduler_set_period(&g_scheduler, g_tick_task, period_ns, period_ns, 0U);
+    /* Sync0 and the motion tick run inside the bus poll */
+    scheduler_set_period(&g_scheduler, g_bus_task, poll_ns, poll_ns, period_ns * CONTROL_TICK_BUDGET_PERCENT / 100U);
+}
+
+static void tick_task(void *user)
+{
+    (void)user;
+    timer_tick_isr();
+    /* $CYCLE moved the period */
+    if (g_scheduler.tasks[g_tick_task].period_ns != (uint64_t)timer_get_tick_period_us() * 1000U) {
+        set_rt_periods(timer_get_tick_period_us());
+    }
+}
+
+static void bus_task(void *user)
+{
+    (void)user;
+    ethcat_master_process(&g_master);
+}
+
+static void console_task(void *user)
+{
+    (void)user;
+    console_poll(&g_console);
+    if (g_cmd_queue.head != g_cmd_queue.tail) {
+        scheduler_release(&g_scheduler, g_command_task);
+    }
+}
+
+static void command_task(void *user)
+{
+    (void)user;
+    /* one line per dispatch keeps the bus serviced between lines */
+    if (command_processor_step(&g_cmd_queue, &g_runtime, &g_parser, &g_planner, g_axes, g_master.slave_count)) {
+        scheduler_release(&g_scheduler, g_command_task);
+    }
+}
+
+static void storage_task(void *user)
+{
+    (void)user;
+    /* a page erase stalls the core for tens of ms, only while the drives are off */
+    if (!g_motion.drives_ready) {
+        storage_maintain();
+    }
+}
+
+static void trace_task(void *user)
+{
+    (void)user;
+    uint8_t chunk[TRACE_DUMP_CHUNK];
+    size_t length = trace_dump_read(&g_trace, chunk, sizeof(chunk));
+    if (length > 0U) {
+        uart_write_bytes(chunk, length);
+    }
+}
+
+#ifdef ENABLE_OPCUA
+static void opcua_task(void *user)
+{
+    (void)user;
+    /* clients sample the snapshot, the tick never waits on the network */
+    cnc_status_t status = cnc_state_status();
+    opcua_server_publish(&status);
+    opcua_server_poll(timer_get_ns());
+}
+#endif
+
+#if defined(HOST_OS)
+static void idle_until(uint64_t wake_ns)
+{
+    osal_sleep_until_ns(wake_ns);
+}
+#endif
+
+static void control_loop(void *arg)
+{
+    (void)arg;
+    while (1) {
+        scheduler_poll(&g_scheduler);
+    }
 }
 
 int main(void)
 {
     board_clock_init();
+    timer_init();
     board_gpio_init();
     board_console_init();
     board_emac_init();
+    storage_init(STORAGE_HOST_PATH);
     board_load_configuration();
 
     delta_init(&g_board_config.delta);
-    planner_init(&g_planner, CONTROL_PERIOD_US);
+    timer_set_tick_period_us(g_board_config.control_period_us);
+    planner_init(&g_planner, g_board_config.control_period_us);
+    planner_joint_limits_t joint_limits = {
+        q16_16_to_float(g_board_config.axis_velocity_limit), q16_16_to_float(g_board_config.axis_acceleration_limit),
+        q16_16_to_float(g_board_config.axis_torque_limit), q16_16_to_float(g_board_config.joint_inertia)};
+    planner_set_joint_limits(&g_planner, &joint_limits);
+    planner_set_reach_check(&g_planner, true);
     gcode_parser_init(&g_parser);
+    gcode_parser_set_limits(&g_parser, g_board_config.path_acceleration_limit, g_board_config.path_jerk_limit);
     command_queue_init(&g_cmd_queue);
     cnc_runtime_init(&g_runtime);
+    cnc_state_init();
+    trace_init(&g_trace);
+    console_init(&g_console, &g_cmd_queue, &g_master, &g_motion, &g_board_config);
 
     ethcat_master_init(&g_master, &g_board_config);
     ethcat_master_scan(&g_master);
@@ -47,10 +220,49 @@ int main(void)
         cia402_axis_init(&g_axes[axis], CIA402_MODE_CSP);
     }
     motion_controller_init(&g_motion, &g_planner, &g_master, g_axes);
+    motion_controller_set_following_limits(&g_motion, g_board_config.following_error_warning, g_board_config.following_error_fault);
+    motion_controller_set_input_shaper(&g_motion, (input_shaper_type_t)g_board_config.input_shaper_type,
+                                       g_board_config.input_shaper_frequency_hz, g_board_config.input_shaper_damping);
+    motion_controller_set_conveyor(&g_motion, g_board_config.conveyor_axis, g_board_config.conveyor_direction,
+                                   g_board_config.conveyor_scale, g_board_config.conveyor_latency_us);
+    motion_controller_set_joint_filter(&g_motion, g_board_config.torque_notch_hz, g_board_config.torque_notch_q,
+                                       g_board_config.velocity_filter_hz);
 
-    while (1) {
-        timer_tick_isr();
-        ethcat_master_process(&g_master);
-        command_processor_step(&g_cmd_queue, &g_runtime, &g_parser, &g_planner, g_axes);
+    scheduler_init(&g_scheduler, NULL);
+    uint64_t period_ns = (uint64_t)g_board_config.control_period_us * 1000U;
+    g_tick_task = scheduler_add_periodic(&g_scheduler, "tick", tick_task, NULL, period_ns, period_ns, 0U);
+    g_bus_task = scheduler_add_periodic(&g_scheduler, "bus", bus_task, NULL, period_ns, period_ns, 0U);
+    set_rt_periods(g_board_config.control_period_us);
+    scheduler_add_periodic(&g_scheduler, "console", console_task, NULL, CONSOLE_PERIOD_NS, CONSOLE_DEADLINE_NS, CONSOLE_BUDGET_NS);
+    g_command_task = scheduler_add_deadline(&g_scheduler, "gcode", command_task, NULL, COMMAND_DEADLINE_NS, COMMAND_BUDGET_NS);
+    scheduler_add_periodic(&g_scheduler, "storage", storage_task, NULL, STORAGE_PERIOD_NS, STORAGE_PERIOD_NS, 0U);
+#ifdef ENABLE_OPCUA
+    if (opcua_server_start(&g_board_config)) {
+        scheduler_add_periodic(&g_scheduler, "opcua", opcua_task, NULL, OPCUA_PERIOD_NS, OPCUA_PERIOD_NS, 0U);
+    }
+#endif
+    scheduler_add_periodic(&g_scheduler, "trace", trace_task, NULL, TRACE_PERIOD_NS, TRACE_PERIOD_NS, 0U);
+    console_set_scheduler(&g_console, &g_scheduler);
+    console_set_trace(&g_console, &g_trace);
+
+#if defined(HOST_OS)
+    /* bare metal keeps the default idle: one WFI, any interrupt returns to dispatch */
+    scheduler_set_idle(&g_scheduler, idle_until);
+    /* industrial PC: the whole loop runs on one locked, pinned SCHED_FIFO thread */
+    osal_init(true);
+    osal_thread_attr_t attr = {CONTROL_RT_PRIORITY, CONTROL_RT_CPU, 0U};
+    osal_thread_t thread;
+    bool started = osal_thread_create(&thread, &attr, control_loop, NULL);
+    if (!started) {
+        /* fewer cores than configured */
+        attr.cpu = OSAL_CPU_ANY;
+        started = osal_thread_create(&thread, &attr, control_loop, NULL);
+    }
+    if (started) {
+        osal_thread_join(&thread);
+        return 0;
     }
+#endif
+    control_loop(NULL);
+    return 0;
 }
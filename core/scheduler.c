@@ -0,0 +1,185 @@
+#include "scheduler.h"
+#include <stddef.h>
+#include "utils/timer.h"
+
+void scheduler_init(scheduler_t *scheduler, scheduler_clock_fn_t clock)
+{
+    scheduler->count = 0U;
+    scheduler->clock = clock != NULL ? clock : timer_get_ns;
+    scheduler->idle = timer_idle_until_ns;
+    scheduler->busy_ns = 0U;
+    scheduler->idle_ns = 0U;
+    histogram_reset(&scheduler->wake_latency);
+}
+
+void scheduler_set_idle(scheduler_t *scheduler, scheduler_idle_fn_t idle)
+{
+    scheduler->idle = idle != NULL ? idle : timer_idle_until_ns;
+}
+
+static int add_task(scheduler_t *scheduler, const char *name, scheduler_task_fn_t fn, void *user, scheduler_kind_t kind, uint64_t deadline_ns, uint64_t budget_ns)
+{
+    if (scheduler->count >= SCHEDULER_MAX_TASKS || fn == NULL || deadline_ns == 0U) {
+        return -1;
+    }
+    scheduler_task_t *task = &scheduler->tasks[scheduler->count];
+    task->name = name;
+    task->fn = fn;
+    task->user = user;
+    task->kind = kind;
+    task->period_ns = 0U;
+    task->deadline_ns = deadline_ns;
+    task->budget_ns = budget_ns;
+    task->release_ns = 0U;
+    task->due_ns = 0U;
+    task->pending = false;
+    task->runs = 0U;
+    task->overruns = 0U;
+    task->misses = 0U;
+    task->skipped = 0U;
+    task->max_ns = 0U;
+    return scheduler->count++;
+}
+
+int scheduler_add_periodic(scheduler_t *scheduler, const char *name, scheduler_task_fn_t fn, void *user, uint64_t period_ns, uint64_t deadline_ns, uint64_t budget_ns)
+{
+    if (period_ns == 0U) {
+        return -1;
+    }
+    int id = add_task(scheduler, name, fn, user, SCHEDULER_PERIODIC, deadline_ns, budget_ns);
+    if (id >= 0) {
+        /* first release now */
+        scheduler->tasks[id].period_ns = period_ns;
+        scheduler->tasks[id].release_ns = scheduler->clock();
+    }
+    return id;
+}
+
+int scheduler_add_deadline(scheduler_t *scheduler, const char *name, scheduler_task_fn_t fn, void *user, uint64_t deadline_ns, uint64_t budget_ns)
+{
+    return add_task(scheduler, name, fn, user, SCHEDULER_DEADLINE, deadline_ns, budget_ns);
+}
+
+bool scheduler_set_period(scheduler_t *scheduler, int task, uint64_t period_ns, uint64_t deadline_ns, uint64_t budget_ns)
+{
+    if (task < 0 || task >= scheduler->count || scheduler->tasks[task].kind != SCHEDULER_PERIODIC || period_ns == 0U || deadline_ns == 0U) {
+        return false;
+    }
+    scheduler_task_t *entry = &scheduler->tasks[task];
+    /* the release already due keeps its time, the following ones move */
+    entry->period_ns = period_ns;
+    entry->deadline_ns = deadline_ns;
+    entry->budget_ns = budget_ns;
+    return true;
+}
+
+bool scheduler_release(scheduler_t *scheduler, int task)
+{
+    if (task < 0 || task >= scheduler->count || scheduler->tasks[task].kind != SCHEDULER_DEADLINE) {
+        return false;
+    }
+    scheduler_task_t *entry = &scheduler->tasks[task];
+    if (!entry->pending) {
+        /* a release while pending keeps the earlier deadline */
+        entry->pending = true;
+        entry->due_ns = scheduler->clock() + entry->deadline_ns;
+    }
+    return true;
+}
+
+static bool ready(scheduler_task_t *task, uint64_t now)
+{
+    if (task->kind == SCHEDULER_PERIODIC && !task->pending && now >= task->release_ns) {
+        task->pending = true;
+        task->due_ns = task->release_ns + task->deadline_ns;
+        /* releases missed entirely are counted, not run in a burst */
+        uint64_t behind = (now - task->release_ns) / task->period_ns;
+        task->skipped += (uint32_t)behind;
+        task->release_ns += (behind + 1U) * task->period_ns;
+    }
+    return task->pending;
+}
+
+bool scheduler_dispatch(scheduler_t *scheduler)
+{
+    uint64_t now = scheduler->clock();
+    scheduler_task_t *next = NULL;
+    for (uint8_t i = 0U; i < scheduler->count; ++i) {
+        scheduler_task_t *task = &scheduler->tasks[i];
+        if (ready(task, now) && (next == NULL || task->due_ns < next->due_ns)) {
+            next = task;
+        }
+    }
+    if (next == NULL) {
+        return false;
+    }
+    next->pending = false;
+    next->fn(next->user);
+    uint64_t end = scheduler->clock();
+    uint64_t elapsed = end - now;
+    next->runs++;
+    if (elapsed > next->max_ns) {
+        next->max_ns = elapsed;
+    }
+    if (next->budget_ns != 0U && elapsed > next->budget_ns) {
+        next->overruns++;
+    }
+    if (end > next->due_ns) {
+        next->misses++;
+    }
+    scheduler->busy_ns += elapsed;
+    return true;
+}
+
+uint64_t scheduler_next_release_ns(const scheduler_t *scheduler)
+{
+    uint64_t next = UINT64_MAX;
+    for (uint8_t i = 0U; i < scheduler->count; ++i) {
+        const scheduler_task_t *task = &scheduler->tasks[i];
+        uint64_t release = task->pending ? 0U : (task->kind == SCHEDULER_PERIODIC ? task->release_ns : UINT64_MAX);
+        if (release < next) {
+            next = release;
+        }
+    }
+    return next;
+}
+
+void scheduler_poll(scheduler_t *scheduler)
+{
+    if (scheduler_dispatch(scheduler)) {
+        return;
+    }
+    /* nothing ready: sleep to the next release, interrupts wake early */
+    uint64_t start = scheduler->clock();
+    uint64_t wake = scheduler_next_release_ns(scheduler);
+    if (wake <= start) {
+        /* came due since the dispatch, run it instead of sleeping */
+        return;
+    }
+    if (wake - start > SCHEDULER_MAX_IDLE_NS) {
+        wake = start + SCHEDULER_MAX_IDLE_NS;
+    }
+    scheduler->idle(wake);
+    uint64_t end = scheduler->clock();
+    scheduler->idle_ns += end - start;
+    if (end >= wake) {
+        /* woken early by an interrupt is not latency */
+        uint64_t late = end - wake;
+        histogram_record(&scheduler->wake_latency, late > UINT32_MAX ? UINT32_MAX : (uint32_t)late);
+    }
+}
+
+void scheduler_reset_stats(scheduler_t *scheduler)
+{
+    for (uint8_t i = 0U; i < scheduler->count; ++i) {
+        scheduler_task_t *task = &scheduler->tasks[i];
+        task->runs = 0U;
+        task->overruns = 0U;
+        task->misses = 0U;
+        task->skipped = 0U;
+        task->max_ns = 0U;
+    }
+    scheduler->busy_ns = 0U;
+    scheduler->idle_ns = 0U;
+    histogram_reset(&scheduler->wake_latency);
+}
@@ -0,0 +1,65 @@
+#ifndef CORE_SCHEDULER_H
+#define CORE_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "utils/histogram.h"
+
+/* Cooperative earliest-deadline-first scheduler for the superloop: tasks run
+ * to completion, the ready one with the nearest deadline goes first, ties go
+ * to the earlier registered. All times in ns on the scheduler clock.
+ * Not reentrant: release deadline tasks from the loop, not from an ISR */
+
+#define SCHEDULER_MAX_TASKS 8U
+/* longest idle sleep, bounds how late work released from outside is noticed on host */
+#define SCHEDULER_MAX_IDLE_NS 1000000ULL
+
+typedef void (*scheduler_task_fn_t)(void *user);
+typedef uint64_t (*scheduler_clock_fn_t)(void);
+typedef void (*scheduler_idle_fn_t)(uint64_t wake_ns);
+
+typedef enum {
+    SCHEDULER_PERIODIC = 0, /* released every period */
+    SCHEDULER_DEADLINE      /* released on demand by scheduler_release() */
+} scheduler_kind_t;
+
+typedef struct {
+    const char *name;
+    scheduler_task_fn_t fn;
+    void *user;
+    scheduler_kind_t kind;
+    uint64_t period_ns;
+    uint64_t deadline_ns; /* relative to the release */
+    uint64_t budget_ns;   /* longest expected run, 0 unchecked */
+    uint64_t release_ns;  /* next periodic release */
+    uint64_t due_ns;      /* absolute deadline of the pending job */
+    bool pending;
+    uint32_t runs;
+    uint32_t overruns;    /* runs longer than the budget */
+    uint32_t misses;      /* runs finished after their deadline */
+    uint32_t skipped;     /* periodic releases lost while the loop was late */
+    uint64_t max_ns;
+} scheduler_task_t;
+
+typedef struct {
+    scheduler_task_t tasks[SCHEDULER_MAX_TASKS];
+    uint8_t count;
+    scheduler_clock_fn_t clock;
+    scheduler_idle_fn_t idle;
+    uint64_t busy_ns;
+    uint64_t idle_ns;
+    histogram_t wake_latency; /* ns an idle sleep overshot its release */
+} scheduler_t;
+
+void scheduler_init(scheduler_t *scheduler, scheduler_clock_fn_t clock);
+void scheduler_set_idle(scheduler_t *scheduler, scheduler_idle_fn_t idle);
+int scheduler_add_periodic(scheduler_t *scheduler, const char *name, scheduler_task_fn_t fn, void *user, uint64_t period_ns, uint64_t deadline_ns, uint64_t budget_ns);
+int scheduler_add_deadline(scheduler_t *scheduler, const char *name, scheduler_task_fn_t fn, void *user, uint64_t deadline_ns, uint64_t budget_ns);
+bool scheduler_set_period(scheduler_t *scheduler, int task, uint64_t period_ns, uint64_t deadline_ns, uint64_t budget_ns);
+bool scheduler_release(scheduler_t *scheduler, int task);
+bool scheduler_dispatch(scheduler_t *scheduler);
+void scheduler_poll(scheduler_t *scheduler);
+uint64_t scheduler_next_release_ns(const scheduler_t *scheduler);
+void scheduler_reset_stats(scheduler_t *scheduler);
+
+#endif
@@ -1,75 +1,171 @@
 #include "eth_mac.h"
 #include "utils/timer.h"
+#include <stddef.h>
 #include <string.h>
 
-#define ETH_MAC_TX_QUEUE 8
-#define ETH_MAC_MAX_FRAME 1518
+/* in-flight frames on the ring: one cyclic frame, one mailbox frame and
+ * their returning copies, all sharing the same buffers */
+#define ETH_MAC_POOL_BUFFERS 4U
+#define ETH_MAC_RING_SLOTS (ETH_MAC_POOL_BUFFERS + 1U)
+#define ETH_MAC_NO_SLOT 0xFFU
+
+typedef struct {
+    uint8_t slot[ETH_MAC_RING_SLOTS];
+    uint16_t length[ETH_MAC_RING_SLOTS];
+    uint8_t head;
+    uint8_t tail;
+} descriptor_ring_t;
 
 static struct {
     eth_sync_callback_t sync_cb;
     void *sync_user;
-    uint8_t tx_queue[ETH_MAC_TX_QUEUE][ETH_MAC_MAX_FRAME];
-    uint16_t tx_length[ETH_MAC_TX_QUEUE];
-    uint8_t tx_head;
-    uint8_t tx_tail;
-    uint8_t rx_queue[ETH_MAC_TX_QUEUE][ETH_MAC_MAX_FRAME];
-    uint16_t rx_length[ETH_MAC_TX_QUEUE];
-    uint8_t rx_head;
-    uint8_t rx_tail;
+    eth_ring_handler_t ring_handler;
+    void *ring_user;
+    uint8_t pool[ETH_MAC_POOL_BUFFERS][ETH_MAC_MAX_FRAME];
+    uint8_t free_mask;
+    uint8_t tx_borrowed; /* slots lent out by tx_borrow, not yet submitted */
+    uint8_t rx_borrowed; /* slots lent out by rx_borrow, not yet released */
+    descriptor_ring_t tx;
+    descriptor_ring_t rx;
     uint64_t dc_time_ns;
+    uint32_t cycle_time_ns;
+    uint32_t sync_timestamp;
 } s_mac;
 
 void eth_mac_init(const eth_mac_config_t *config, eth_sync_callback_t sync0_cb, void *user_data)
 {
-    (void)config;
+    s_mac.cycle_time_ns = (config != NULL && config->cycle_time_ns != 0U) ? config->cycle_time_ns : 1000000U;
     s_mac.sync_cb = sync0_cb;
     s_mac.sync_user = user_data;
-    s_mac.tx_head = s_mac.tx_tail = 0U;
-    s_mac.rx_head = s_mac.rx_tail = 0U;
+    s_mac.ring_handler = NULL;
+    s_mac.ring_user = NULL;
+    s_mac.free_mask = (uint8_t)((1U << ETH_MAC_POOL_BUFFERS) - 1U);
+    s_mac.tx_borrowed = 0U;
+    s_mac.rx_borrowed = 0U;
+    s_mac.tx.head = s_mac.tx.tail = 0U;
+    s_mac.rx.head = s_mac.rx.tail = 0U;
     s_mac.dc_time_ns = 0ULL;
+    s_mac.sync_timestamp = 0U;
 }
 
-static bool queue_push(uint8_t queue[ETH_MAC_TX_QUEUE][ETH_MAC_MAX_FRAME],
-                       uint16_t lengths[ETH_MAC_TX_QUEUE],
-                       uint8_t *head,
-                       uint8_t tail,
-                       const uint8_t *data,
-                       uint16_t length)
+static uint8_t slot_of(const uint8_t *buffer)
 {
-    uint8_t next = (uint8_t)((*head + 1U) % ETH_MAC_TX_QUEUE);
-    if (next == tail) {
+    for (uint8_t slot = 0U; slot < ETH_MAC_POOL_BUFFERS; ++slot) {
+        if (buffer == s_mac.pool[slot]) {
+            return slot;
+        }
+    }
+    return ETH_MAC_NO_SLOT;
+}
+
+static void pool_free(uint8_t slot)
+{
+    s_mac.free_mask |= (uint8_t)(1U << slot);
+}
+
+static bool ring_push(descriptor_ring_t *ring, uint8_t slot, uint16_t length)
+{
+    uint8_t next = (uint8_t)((ring->head + 1U) % ETH_MAC_RING_SLOTS);
+    if (next == ring->tail) {
         return false;
     }
-    memcpy(queue[*head], data, length);
-    lengths[*head] = length;
-    *head = next;
+    ring->slot[ring->head] = slot;
+    ring->length[ring->head] = length;
+    ring->head = next;
     return true;
 }
 
-static int queue_pop(uint8_t queue[ETH_MAC_TX_QUEUE][ETH_MAC_MAX_FRAME],
-                     uint16_t lengths[ETH_MAC_TX_QUEUE],
-                     uint8_t head,
-                     uint8_t *tail,
-                     uint8_t *out)
+static uint8_t ring_pop(descriptor_ring_t *ring, uint16_t *length)
 {
-    if (*tail == head) {
-        return 0;
+    if (ring->tail == ring->head) {
+        return ETH_MAC_NO_SLOT;
+    }
+    uint8_t slot = ring->slot[ring->tail];
+    *length = ring->length[ring->tail];
+    ring->tail = (uint8_t)((ring->tail + 1U) % ETH_MAC_RING_SLOTS);
+    return slot;
+}
+
+uint8_t *eth_mac_tx_borrow(uint16_t *capacity)
+{
+    for (uint8_t slot = 0U; slot < ETH_MAC_POOL_BUFFERS; ++slot) {
+        if ((s_mac.free_mask & (1U << slot)) != 0U) {
+            s_mac.free_mask &= (uint8_t)~(1U << slot);
+            s_mac.tx_borrowed |= (uint8_t)(1U << slot);
+            if (capacity != NULL) {
+                *capacity = ETH_MAC_MAX_FRAME;
+            }
+            return s_mac.pool[slot];
+        }
+    }
+    return NULL;
+}
+
+bool eth_mac_tx_submit(uint8_t *buffer, uint16_t length)
+{
+    uint8_t slot = slot_of(buffer);
+    if (slot == ETH_MAC_NO_SLOT || (s_mac.tx_borrowed & (1U << slot)) == 0U) {
+        return false;
+    }
+    s_mac.tx_borrowed &= (uint8_t)~(1U << slot);
+    if (length == 0U || length > ETH_MAC_MAX_FRAME || !ring_push(&s_mac.tx, slot, length)) {
+        pool_free(slot);
+        return false;
+    }
+    return true;
+}
+
+uint8_t *eth_mac_rx_borrow(uint16_t *length)
+{
+    uint16_t frame_length = 0U;
+    uint8_t slot = ring_pop(&s_mac.rx, &frame_length);
+    if (slot == ETH_MAC_NO_SLOT) {
+        return NULL;
+    }
+    s_mac.rx_borrowed |= (uint8_t)(1U << slot);
+    *length = frame_length;
+    return s_mac.pool[slot];
+}
+
+void eth_mac_rx_release(uint8_t *buffer)
+{
+    /* a second release must not free the slot again once it is lent out anew */
+    uint8_t slot = slot_of(buffer);
+    if (slot != ETH_MAC_NO_SLOT && (s_mac.rx_borrowed & (1U << slot)) != 0U) {
+        s_mac.rx_borrowed &= (uint8_t)~(1U << slot);
+        pool_free(slot);
     }
-    uint16_t len = lengths[*tail];
-    memcpy(out, queue[*tail], len);
-    *tail = (uint8_t)((*tail + 1U) % ETH_MAC_TX_QUEUE);
-    return (int)len;
 }
 
 bool eth_mac_send_frame(const uint8_t *data, uint16_t length)
 {
-    return queue_push(s_mac.tx_queue, s_mac.tx_length, &s_mac.tx_head, s_mac.tx_tail, data, length);
+    uint16_t capacity = 0U;
+    uint8_t *buffer = eth_mac_tx_borrow(&capacity);
+    if (buffer == NULL) {
+        return false;
+    }
+    if (length > capacity) {
+        eth_mac_tx_submit(buffer, 0U);
+        return false;
+    }
+    memcpy(buffer, data, length);
+    return eth_mac_tx_submit(buffer, length);
 }
 
 int eth_mac_receive_frame(uint8_t *data, uint16_t max_length)
 {
-    (void)max_length;
-    return queue_pop(s_mac.rx_queue, s_mac.rx_length, s_mac.rx_head, &s_mac.rx_tail, data);
+    uint16_t length = 0U;
+    uint8_t *buffer = eth_mac_rx_borrow(&length);
+    if (buffer == NULL) {
+        return 0;
+    }
+    int result = -1;
+    if (length <= max_length) {
+        memcpy(data, buffer, length);
+        result = (int)length;
+    }
+    eth_mac_rx_release(buffer);
+    return result;
 }
 
 void eth_mac_poll(void)
@@ -79,11 +175,31 @@ void eth_mac_poll(void)
     uint32_t current = timer_get_ticks();
     if (current != last_tick) {
         last_tick = current;
-        s_mac.dc_time_ns += 1000000ULL; /* 1 kHz */
+        s_mac.dc_time_ns += s_mac.cycle_time_ns;
+        s_mac.sync_timestamp = timer_get_cycles();
         if (s_mac.sync_cb != NULL) {
             s_mac.sync_cb(s_mac.sync_user);
         }
     }
+    /* the EtherCAT ring hands every transmitted buffer back to the master */
+    while (s_mac.tx.tail != s_mac.tx.head) {
+        uint8_t next = (uint8_t)((s_mac.rx.head + 1U) % ETH_MAC_RING_SLOTS);
+        if (next == s_mac.rx.tail) {
+            break;
+        }
+        uint16_t len = 0U;
+        uint8_t slot = ring_pop(&s_mac.tx, &len);
+        if (s_mac.ring_handler != NULL) {
+            /* slaves on the segment process the frame in flight */
+            s_mac.ring_handler(s_mac.pool[slot], len, s_mac.ring_user);
+        }
+        ring_push(&s_mac.rx, slot, len);
+    }
+}
+
+uint32_t eth_mac_get_sync_timestamp(void)
+{
+    return s_mac.sync_timestamp;
 }
 
 uint64_t eth_mac_get_time_ns(void)
@@ -96,6 +212,18 @@ void eth_mac_adjust_time(int32_t ns_offset)
     s_mac.dc_time_ns += (int64_t)ns_offset;
 }
 
+void eth_mac_set_cycle_time(uint32_t cycle_time_ns)
+{
+    if (cycle_time_ns != 0U) {
+        s_mac.cycle_time_ns = cycle_time_ns;
+    }
+}
+
+void eth_mac_set_ring_handler(eth_ring_handler_t handler, void *user_data)
+{
+    s_mac.ring_handler = handler;
+    s_mac.ring_user = user_data;
+}
 
 void eth_mac_set_sync_callback(eth_sync_callback_t sync0_cb, void *user_data)
 {
@@ -4,19 +4,35 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define ETH_MAC_MAX_FRAME 1518U
+
 typedef void (*eth_sync_callback_t)(void *user_data);
+typedef void (*eth_ring_handler_t)(uint8_t *frame, uint16_t length, void *user_data);
 
 typedef struct {
     uint8_t mac_address[6];
     uint32_t phy_address;
+    uint32_t cycle_time_ns;
+    const char *interface_name; /* raw-socket backend only */
 } eth_mac_config_t;
 
 void eth_mac_init(const eth_mac_config_t *config, eth_sync_callback_t sync0_cb, void *user_data);
 void eth_mac_set_sync_callback(eth_sync_callback_t sync0_cb, void *user_data);
 void eth_mac_poll(void);
+/* Descriptor API: buffers belong to the MAC pool. A borrowed TX buffer is
+ * filled in place and handed back by submit (length 0 drops it); a borrowed
+ * RX buffer stays valid until it is released. */
+uint8_t *eth_mac_tx_borrow(uint16_t *capacity);
+bool eth_mac_tx_submit(uint8_t *buffer, uint16_t length);
+uint8_t *eth_mac_rx_borrow(uint16_t *length);
+void eth_mac_rx_release(uint8_t *buffer);
+/* copying wrappers; receive drops frames longer than max_length and returns -1 */
 bool eth_mac_send_frame(const uint8_t *data, uint16_t length);
 int  eth_mac_receive_frame(uint8_t *data, uint16_t max_length);
 uint64_t eth_mac_get_time_ns(void);
+uint32_t eth_mac_get_sync_timestamp(void);
 void eth_mac_adjust_time(int32_t ns_offset);
+void eth_mac_set_cycle_time(uint32_t cycle_time_ns);
+void eth_mac_set_ring_handler(eth_ring_handler_t handler, void *user_data);
 
 #endif
@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include "eth_mac.h"
+#include "utils/timer.h"
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* AF_PACKET backend for TARGET_OS=host: RX and TX go through TPACKET_V2 rings
+ * shared with the kernel, so frames are never copied through recv()/send() */
+
+#define ETH_MAC_ETHERTYPE 0x88A4U
+#define ETH_MAC_FRAME_SIZE 2048U
+#define ETH_MAC_BLOCK_SIZE 4096U
+#define ETH_MAC_RING_FRAMES 64U
+#define ETH_MAC_DEFAULT_INTERFACE "eth0"
+
+_Static_assert(ETH_MAC_MAX_FRAME <= ETH_MAC_FRAME_SIZE - TPACKET2_HDRLEN, "ring slot too small for a full frame");
+
+static struct {
+    int fd;
+    uint8_t *ring;
+    size_t ring_bytes;
+    uint8_t *rx_ring;
+    uint8_t *tx_ring;
+    uint32_t rx_index;
+    uint32_t tx_index;
+    bool rx_borrowed;
+    bool tx_borrowed;
+    uint32_t tx_errors; /* slots the kernel rejected and the driver reclaimed */
+    uint8_t mac_address[6];
+    eth_sync_callback_t sync_cb;
+    void *sync_user;
+    eth_ring_handler_t ring_handler;
+    void *ring_user;
+    int64_t clock_offset_ns;
+    uint64_t next_sync_ns;
+    uint32_t cycle_time_ns;
+    uint32_t sync_timestamp;
+} s_mac = {.fd = -1};
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static struct tpacket2_hdr *ring_frame(uint8_t *ring, uint32_t index)
+{
+    return (struct tpacket2_hdr *)(ring + (size_t)index * ETH_MAC_FRAME_SIZE);
+}
+
+static void close_socket(void)
+{
+    if (s_mac.ring != NULL) {
+        munmap(s_mac.ring, s_mac.ring_bytes);
+        s_mac.ring = NULL;
+    }
+    if (s_mac.fd >= 0) {
+        close(s_mac.fd);
+        s_mac.fd = -1;
+    }
+}
+
+static bool open_socket(const char *interface_name)
+{
+    s_mac.fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_MAC_ETHERTYPE));
+    if (s_mac.fd < 0) {
+        return false;
+    }
+    int version = TPACKET_V2;
+    if (setsockopt(s_mac.fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        return false;
+    }
+    int one = 1;
+    /* best effort: the qdisc only adds latency, outgoing copies are filtered below anyway */
+    (void)setsockopt(s_mac.fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#ifdef PACKET_IGNORE_OUTGOING
+    (void)setsockopt(s_mac.fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+    struct tpacket_req req = {
+        .tp_block_size = ETH_MAC_BLOCK_SIZE,
+        .tp_block_nr = ETH_MAC_RING_FRAMES * ETH_MAC_FRAME_SIZE / ETH_MAC_BLOCK_SIZE,
+        .tp_frame_size = ETH_MAC_FRAME_SIZE,
+        .tp_frame_nr = ETH_MAC_RING_FRAMES,
+    };
+    if (setsockopt(s_mac.fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0 ||
+        setsockopt(s_mac.fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) != 0) {
+        return false;
+    }
+    /* the kernel maps the RX ring first and the TX ring right after it */
+    s_mac.ring_bytes = 2U * (size_t)req.tp_block_size * req.tp_block_nr;
+    void *ring = mmap(NULL, s_mac.ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, s_mac.fd, 0);
+    if (ring == MAP_FAILED) {
+        ring = mmap(NULL, s_mac.ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, s_mac.fd, 0);
+        if (ring == MAP_FAILED) {
+            return false;
+        }
+    }
+    s_mac.ring = ring;
+    s_mac.rx_ring = s_mac.ring;
+    s_mac.tx_ring = s_mac.ring + s_mac.ring_bytes / 2U;
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_MAC_ETHERTYPE);
+    addr.sll_ifindex = (int)if_nametoindex(interface_name);
+    if (addr.sll_ifindex == 0 || bind(s_mac.fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        return false;
+    }
+    return true;
+}
+
+void eth_mac_init(const eth_mac_config_t *config, eth_sync_callback_t sync0_cb, void *user_data)
+{
+    close_socket();
+    s_mac.cycle_time_ns = (config != NULL && config->cycle_time_ns != 0U) ? config->cycle_time_ns : 1000000U;
+    s_mac.sync_cb = sync0_cb;
+    s_mac.sync_user = user_data;
+    s_mac.ring_handler = NULL;
+    s_mac.ring_user = NULL;
+    s_mac.rx_index = 0U;
+    s_mac.tx_index = 0U;
+    s_mac.rx_borrowed = false;
+    s_mac.tx_borrowed = false;
+    s_mac.tx_errors = 0U;
+    s_mac.clock_offset_ns = 0;
+    s_mac.sync_timestamp = 0U;
+    if (config != NULL) {
+        memcpy(s_mac.mac_address, config->mac_address, sizeof(s_mac.mac_address));
+    }
+    const char *interface_name = (config != NULL && config->interface_name != NULL) ? config->interface_name : ETH_MAC_DEFAULT_INTERFACE;
+    if (!open_socket(interface_name)) {
+        /* link stays down: sends fail and the master reports its process data as lost */
+        close_socket();
+    }
+    s_mac.next_sync_ns = monotonic_ns() + s_mac.cycle_time_ns;
+}
+
+uint8_t *eth_mac_tx_borrow(uint16_t *capacity)
+{
+    /* the buffer is the TX ring slot itself; one borrow may be outstanding */
+    if (s_mac.ring == NULL || s_mac.tx_borrowed) {
+        return NULL;
+    }
+    struct tpacket2_hdr *hdr = ring_frame(s_mac.tx_ring, s_mac.tx_index);
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if (status == TP_STATUS_WRONG_FORMAT) {
+        /* the kernel never clears a rejected slot; reclaim it or TX wedges here */
+        s_mac.tx_errors++;
+        status = TP_STATUS_AVAILABLE;
+        __atomic_store_n(&hdr->tp_status, status, __ATOMIC_RELEASE);
+    }
+    if (status != TP_STATUS_AVAILABLE) {
+        return NULL;
+    }
+    s_mac.tx_borrowed = true;
+    if (capacity != NULL) {
+        *capacity = ETH_MAC_MAX_FRAME;
+    }
+    return (uint8_t *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+}
+
+bool eth_mac_tx_submit(uint8_t *buffer, uint16_t length)
+{
+    struct tpacket2_hdr *hdr = ring_frame(s_mac.tx_ring, s_mac.tx_index);
+    if (!s_mac.tx_borrowed || buffer != (uint8_t *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll)) {
+        return false;
+    }
+    s_mac.tx_borrowed = false;
+    if (length < 14U || length > ETH_MAC_MAX_FRAME) {
+        return false;
+    }
+    memcpy(buffer + 6, s_mac.mac_address, sizeof(s_mac.mac_address));
+    hdr->tp_len = length;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    s_mac.tx_index = (s_mac.tx_index + 1U) % ETH_MAC_RING_FRAMES;
+    /* kick the ring right away: cyclic frames must not wait for the next poll */
+    return send(s_mac.fd, NULL, 0, MSG_DONTWAIT) >= 0;
+}
+
+static void rx_advance(struct tpacket2_hdr *hdr)
+{
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    s_mac.rx_index = (s_mac.rx_index + 1U) % ETH_MAC_RING_FRAMES;
+}
+
+uint8_t *eth_mac_rx_borrow(uint16_t *length)
+{
+    while (s_mac.ring != NULL && !s_mac.rx_borrowed) {
+        struct tpacket2_hdr *hdr = ring_frame(s_mac.rx_ring, s_mac.rx_index);
+        if ((__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0U) {
+            return NULL;
+        }
+        const struct sockaddr_ll *from = (const struct sockaddr_ll *)((uint8_t *)hdr + TPACKET_ALIGN(sizeof(*hdr)));
+        if (from->sll_pkttype == PACKET_OUTGOING || hdr->tp_snaplen > ETH_MAC_MAX_FRAME) {
+            rx_advance(hdr);
+            continue;
+        }
+        uint8_t *frame = (uint8_t *)hdr + hdr->tp_mac;
+        *length = (uint16_t)hdr->tp_snaplen;
+        if (s_mac.ring_handler != NULL) {
+            s_mac.ring_handler(frame, *length, s_mac.ring_user);
+        }
+        s_mac.rx_borrowed = true;
+        return frame;
+    }
+    return NULL;
+}
+
+void eth_mac_rx_release(uint8_t *buffer)
+{
+    /* only the frame handed out by rx_borrow; a stale or repeated release is ignored */
+    if (!s_mac.rx_borrowed) {
+        return;
+    }
+    struct tpacket2_hdr *hdr = ring_frame(s_mac.rx_ring, s_mac.rx_index);
+    if (buffer != (uint8_t *)hdr + hdr->tp_mac) {
+        return;
+    }
+    s_mac.rx_borrowed = false;
+    rx_advance(hdr);
+}
+
+bool eth_mac_send_frame(const uint8_t *data, uint16_t length)
+{
+    uint16_t capacity = 0U;
+    uint8_t *buffer = eth_mac_tx_borrow(&capacity);
+    if (buffer == NULL) {
+        return false;
+    }
+    if (length > capacity) {
+        eth_mac_tx_submit(buffer, 0U);
+        return false;
+    }
+    memcpy(buffer, data, length);
+    return eth_mac_tx_submit(buffer, length);
+}
+
+int eth_mac_receive_frame(uint8_t *data, uint16_t max_length)
+{
+    uint16_t length = 0U;
+    uint8_t *buffer = eth_mac_rx_borrow(&length);
+    if (buffer == NULL) {
+        return 0;
+    }
+    int result = -1;
+    if (length <= max_length) {
+        memcpy(data, buffer, length);
+        result = (int)length;
+    }
+    eth_mac_rx_release(buffer);
+    return result;
+}
+
+void eth_mac_poll(void)
+{
+    /* Sync0 is derived from the host clock: one event per elapsed cycle, late
+     * events are coalesced so a preempted loop does not fire a burst */
+    uint64_t now = monotonic_ns() + (uint64_t)s_mac.clock_offset_ns;
+    if (now >= s_mac.next_sync_ns) {
+        uint64_t late = now - s_mac.next_sync_ns;
+        s_mac.next_sync_ns += (late / s_mac.cycle_time_ns + 1U) * s_mac.cycle_time_ns;
+        s_mac.sync_timestamp = timer_get_cycles() - (uint32_t)((late % s_mac.cycle_time_ns) * TIMER_CYCLES_PER_US / 1000U);
+        if (s_mac.sync_cb != NULL) {
+            s_mac.sync_cb(s_mac.sync_user);
+        }
+    }
+}
+
+uint32_t eth_mac_get_sync_timestamp(void)
+{
+    return s_mac.sync_timestamp;
+}
+
+uint64_t eth_mac_get_time_ns(void)
+{
+    return monotonic_ns() + (uint64_t)s_mac.clock_offset_ns;
+}
+
+void eth_mac_adjust_time(int32_t ns_offset)
+{
+    s_mac.clock_offset_ns += ns_offset;
+}
+
+void eth_mac_set_cycle_time(uint32_t cycle_time_ns)
+{
+    if (cycle_time_ns != 0U) {
+        s_mac.cycle_time_ns = cycle_time_ns;
+    }
+}
+
+void eth_mac_set_ring_handler(eth_ring_handler_t handler, void *user_data)
+{
+    s_mac.ring_handler = handler;
+    s_mac.ring_user = user_data;
+}
+
+void eth_mac_set_sync_callback(eth_sync_callback_t sync0_cb, void *user_data)
+{
+    s_mac.sync_cb = sync0_cb;
+    s_mac.sync_user = user_data;
+}
@@ -1,4 +1,5 @@
 #include "uart.h"
+#include <stddef.h>
 #include <string.h>
 
 #define UART_BUFFER_SIZE 256
@@ -6,12 +7,16 @@
 static struct {
     char rx_buffer[UART_BUFFER_SIZE];
     int rx_length;
+    bool line_ready;
+    uart_realtime_handler_t realtime;
+    void *realtime_context;
 } s_uart;
 
 void uart_init(uint32_t baudrate)
 {
     (void)baudrate;
     s_uart.rx_length = 0;
+    s_uart.line_ready = false;
 }
 
 void uart_write(const char *str)
@@ -20,14 +25,46 @@ void uart_write(const char *str)
     /* integration point for console output */
 }
 
+void uart_write_bytes(const uint8_t *data, size_t length)
+{
+    (void)data;
+    (void)length;
+    /* binary output on the console port, same integration point */
+}
+
+void uart_set_realtime_handler(uart_realtime_handler_t handler, void *context)
+{
+    s_uart.realtime = handler;
+    s_uart.realtime_context = context;
+}
+
+void uart_rx_byte(uint8_t byte)
+{
+    /* receive interrupt: realtime commands act immediately instead of queueing behind a line */
+    if (s_uart.realtime != NULL && s_uart.realtime(byte, s_uart.realtime_context)) {
+        return;
+    }
+    if (s_uart.line_ready) {
+        return; /* overrun until the console collects the pending line */
+    }
+    if (byte == '\n' || byte == '\r') {
+        s_uart.line_ready = s_uart.rx_length > 0;
+        return;
+    }
+    if (s_uart.rx_length < UART_BUFFER_SIZE - 1) {
+        s_uart.rx_buffer[s_uart.rx_length++] = (char)byte;
+    }
+}
+
 int uart_read_line(char *buffer, int max_len)
 {
-    if (s_uart.rx_length == 0) {
+    if (!s_uart.line_ready) {
         return 0;
     }
     int len = s_uart.rx_length < max_len - 1 ? s_uart.rx_length : max_len - 1;
     memcpy(buffer, s_uart.rx_buffer, (size_t)len);
     buffer[len] = '\0';
     s_uart.rx_length = 0;
+    s_uart.line_ready = false;
     return len;
 }
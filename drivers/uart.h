@@ -1,11 +1,18 @@
 #ifndef DRIVERS_UART_H
 #define DRIVERS_UART_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+/* returns true when the byte was consumed and must not reach the line buffer */
+typedef bool (*uart_realtime_handler_t)(uint8_t byte, void *context);
+
 void uart_init(uint32_t baudrate);
 void uart_write(const char *str);
+void uart_write_bytes(const uint8_t *data, size_t length);
 int  uart_read_line(char *buffer, int max_len);
+void uart_set_realtime_handler(uart_realtime_handler_t handler, void *context);
+void uart_rx_byte(uint8_t byte);
 
 #endif
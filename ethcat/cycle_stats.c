@@ -0,0 +1,64 @@
+#include "cycle_stats.h"
+#include "utils/timer.h"
+
+static const char *const s_names[CYCLE_STAT_COUNT] = {
+    "SYNC0_JITTER",
+    "ISR_LATENCY",
+    "TICK",
+    "FRAME_RTT"
+};
+
+static void clear(cycle_stats_t *stats)
+{
+    for (int i = 0; i < CYCLE_STAT_COUNT; ++i) {
+        histogram_reset(&stats->hist[i]);
+    }
+    stats->missed_cycles = 0U;
+    stats->lost_frames = 0U;
+    stats->have_last_entry = false;
+    stats->reset_request = false;
+}
+
+void cycle_stats_init(cycle_stats_t *stats, uint32_t period_ns)
+{
+    stats->period_ns = period_ns;
+    stats->last_entry_cycles = 0U;
+    clear(stats);
+}
+
+void cycle_stats_request_reset(cycle_stats_t *stats)
+{
+    /* cleared from the Sync0 context so the ISR never sees a half-reset histogram */
+    stats->reset_request = true;
+}
+
+void cycle_stats_sync0(cycle_stats_t *stats, uint32_t event_cycles, uint32_t entry_cycles)
+{
+    if (stats->reset_request) {
+        clear(stats);
+    }
+    histogram_record(&stats->hist[CYCLE_STAT_ISR_LATENCY], timer_cycles_to_ns(entry_cycles - event_cycles));
+    if (stats->have_last_entry) {
+        uint32_t period = timer_cycles_to_ns(entry_cycles - stats->last_entry_cycles);
+        uint32_t nominal = stats->period_ns;
+        uint32_t jitter = period > nominal ? period - nominal : nominal - period;
+        histogram_record(&stats->hist[CYCLE_STAT_SYNC0_JITTER], jitter);
+        if (nominal != 0U && period > nominal + nominal / 2U) {
+            stats->missed_cycles += (period + nominal / 2U) / nominal - 1U;
+        }
+    }
+    stats->last_entry_cycles = entry_cycles;
+    stats->have_last_entry = true;
+}
+
+void cycle_stats_record(cycle_stats_t *stats, cycle_stat_t id, uint32_t value_ns)
+{
+    if (id < CYCLE_STAT_COUNT) {
+        histogram_record(&stats->hist[id], value_ns);
+    }
+}
+
+const char *cycle_stats_name(cycle_stat_t id)
+{
+    return id < CYCLE_STAT_COUNT ? s_names[id] : "?";
+}
@@ -0,0 +1,32 @@
+#ifndef ETHCAT_CYCLE_STATS_H
+#define ETHCAT_CYCLE_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "utils/histogram.h"
+
+typedef enum {
+    CYCLE_STAT_SYNC0_JITTER = 0,
+    CYCLE_STAT_ISR_LATENCY,
+    CYCLE_STAT_TICK_DURATION,
+    CYCLE_STAT_FRAME_RTT,
+    CYCLE_STAT_COUNT
+} cycle_stat_t;
+
+typedef struct {
+    histogram_t hist[CYCLE_STAT_COUNT];
+    uint32_t period_ns;
+    uint32_t missed_cycles;
+    uint32_t lost_frames;
+    uint32_t last_entry_cycles;
+    bool have_last_entry;
+    volatile bool reset_request;
+} cycle_stats_t;
+
+void cycle_stats_init(cycle_stats_t *stats, uint32_t period_ns);
+void cycle_stats_request_reset(cycle_stats_t *stats);
+void cycle_stats_sync0(cycle_stats_t *stats, uint32_t event_cycles, uint32_t entry_cycles);
+void cycle_stats_record(cycle_stats_t *stats, cycle_stat_t id, uint32_t value_ns);
+const char *cycle_stats_name(cycle_stat_t id);
+
+#endif
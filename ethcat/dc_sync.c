@@ -0,0 +1,169 @@
+#include "dc_sync.h"
+#include <stddef.h>
+
+/* integrator limit expressed as a rate: 1000 ppm of the cycle */
+#define DC_SYNC_MAX_DRIFT_DIVISOR 1000U
+
+static int32_t wrap_phase(const dc_sync_t *dc, int64_t value)
+{
+    int64_t cycle = (int64_t)dc->cycle_time_ns;
+    int64_t phase = value % cycle;
+    if (phase < 0) {
+        phase += cycle;
+    }
+    if (phase >= cycle / 2) {
+        phase -= cycle;
+    }
+    return (int32_t)phase;
+}
+
+static int32_t abs_i32(int32_t value)
+{
+    return value < 0 ? -value : value;
+}
+
+static int32_t integral_to_ppb(const dc_sync_t *dc)
+{
+    /* integral / 2^KI is the rate correction in ns per cycle */
+    return (int32_t)((dc->integral * 1000000000LL) / ((int64_t)dc->cycle_time_ns << DC_SYNC_KI_SHIFT));
+}
+
+void dc_sync_init(dc_sync_t *dc, uint32_t cycle_time_ns)
+{
+    dc->state = DC_SYNC_STATE_IDLE;
+    dc->cycle_time_ns = cycle_time_ns == 0U ? 1U : cycle_time_ns;
+    dc->propagation_delay_ns = 0;
+    dc->offset_ns = 0;
+    dc->drift_ppb = 0;
+    dc->last_correction_ns = 0;
+    dc->integral = 0;
+    dc->first_offset_ns = 0;
+    dc->previous_offset_ns = 0;
+    dc->unwrapped_offset_ns = 0;
+    dc->sample_count = 0U;
+    dc->lock_count = 0U;
+    dc->lock_losses = 0U;
+}
+
+void dc_sync_start(dc_sync_t *dc)
+{
+    dc->state = DC_SYNC_STATE_STATIC_COMP;
+    dc->integral = 0;
+    dc->sample_count = 0U;
+    dc->lock_count = 0U;
+    dc->drift_ppb = 0;
+}
+
+bool dc_sync_measure_delays(dc_sync_t *dc, const uint32_t *port0_ns, const uint32_t *port1_ns, int count, int32_t *delays_out)
+{
+    if (count <= 0 || port0_ns == NULL || port1_ns == NULL) {
+        return false;
+    }
+    /* line topology: each slave latches the frame on the way out (port 0) and
+     * on the way back (port 1); the loop-time difference of neighbours is the
+     * round trip of the hop between them */
+    int32_t accumulated = 0;
+    uint32_t previous_loop = port1_ns[0] - port0_ns[0];
+    if (delays_out != NULL) {
+        delays_out[0] = 0;
+    }
+    for (int i = 1; i < count; ++i) {
+        uint32_t loop = port1_ns[i] - port0_ns[i];
+        if (loop > previous_loop) {
+            return false;
+        }
+        accumulated += (int32_t)((previous_loop - loop) / 2U);
+        if (delays_out != NULL) {
+            delays_out[i] = accumulated;
+        }
+        previous_loop = loop;
+    }
+    /* the reference clock is read on the outbound pass of slave 0, the frame
+     * then travels the rest of the ring before reaching the master again */
+    dc->propagation_delay_ns = (int32_t)((port1_ns[0] - port0_ns[0]) / 2U);
+    return true;
+}
+
+static int32_t static_compensation(dc_sync_t *dc, int32_t offset)
+{
+    if (dc->sample_count == 0U) {
+        dc->first_offset_ns = offset;
+        dc->unwrapped_offset_ns = offset;
+    } else {
+        dc->unwrapped_offset_ns += wrap_phase(dc, (int64_t)offset - dc->previous_offset_ns);
+    }
+    dc->previous_offset_ns = offset;
+    dc->sample_count++;
+    if (dc->sample_count < DC_SYNC_STATIC_SAMPLES) {
+        return 0;
+    }
+
+    int64_t travelled = dc->unwrapped_offset_ns - dc->first_offset_ns;
+    dc->integral = (travelled * (1LL << DC_SYNC_KI_SHIFT)) / (int64_t)(DC_SYNC_STATIC_SAMPLES - 1U);
+    dc->drift_ppb = integral_to_ppb(dc);
+    dc->state = DC_SYNC_STATE_TRACKING;
+    /* coarse phase step, the PI loop takes over from the next cycle */
+    return -offset;
+}
+
+int32_t dc_sync_update(dc_sync_t *dc, uint64_t local_time_ns)
+{
+    int32_t offset = wrap_phase(dc, (int64_t)(local_time_ns % dc->cycle_time_ns) - dc->propagation_delay_ns);
+    dc->offset_ns = offset;
+
+    int32_t correction = 0;
+    switch (dc->state) {
+    case DC_SYNC_STATE_STATIC_COMP:
+        correction = static_compensation(dc, offset);
+        break;
+    case DC_SYNC_STATE_TRACKING:
+    case DC_SYNC_STATE_LOCKED:
+        if (abs_i32(offset) > DC_SYNC_STEP_THRESHOLD_NS) {
+            if (dc->state == DC_SYNC_STATE_LOCKED) {
+                dc->lock_losses++;
+            }
+            dc->state = DC_SYNC_STATE_TRACKING;
+            dc->lock_count = 0U;
+            correction = -offset;
+            break;
+        }
+        {
+            int64_t limit = ((int64_t)dc->cycle_time_ns / DC_SYNC_MAX_DRIFT_DIVISOR) * (1LL << DC_SYNC_KI_SHIFT);
+            dc->integral += offset;
+            if (dc->integral > limit) {
+                dc->integral = limit;
+            } else if (dc->integral < -limit) {
+                dc->integral = -limit;
+            }
+            int64_t i_term = dc->integral / (1LL << DC_SYNC_KI_SHIFT);
+            int64_t p_term = offset / (1 << DC_SYNC_KP_SHIFT);
+            correction = (int32_t)-(p_term + i_term);
+            dc->drift_ppb = integral_to_ppb(dc);
+        }
+        if (abs_i32(offset) <= DC_SYNC_LOCK_THRESHOLD_NS) {
+            if (dc->lock_count < DC_SYNC_LOCK_CYCLES) {
+                dc->lock_count++;
+            }
+            if (dc->lock_count >= DC_SYNC_LOCK_CYCLES) {
+                dc->state = DC_SYNC_STATE_LOCKED;
+            }
+        } else if (dc->state != DC_SYNC_STATE_LOCKED || abs_i32(offset) > DC_SYNC_UNLOCK_THRESHOLD_NS) {
+            if (dc->state == DC_SYNC_STATE_LOCKED) {
+                dc->lock_losses++;
+            }
+            dc->lock_count = 0U;
+            dc->state = DC_SYNC_STATE_TRACKING;
+        }
+        break;
+    case DC_SYNC_STATE_IDLE:
+    default:
+        break;
+    }
+    dc->last_correction_ns = correction;
+    return correction;
+}
+
+bool dc_sync_is_locked(const dc_sync_t *dc)
+{
+    return dc->state == DC_SYNC_STATE_LOCKED;
+}
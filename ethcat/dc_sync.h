@@ -0,0 +1,44 @@
+#ifndef ETHCAT_DC_SYNC_H
+#define ETHCAT_DC_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DC_SYNC_STATIC_SAMPLES 16U
+#define DC_SYNC_LOCK_THRESHOLD_NS 200
+#define DC_SYNC_UNLOCK_THRESHOLD_NS (4 * DC_SYNC_LOCK_THRESHOLD_NS)
+#define DC_SYNC_LOCK_CYCLES 100U
+#define DC_SYNC_STEP_THRESHOLD_NS 20000
+#define DC_SYNC_KP_SHIFT 2U
+#define DC_SYNC_KI_SHIFT 5U
+
+typedef enum {
+    DC_SYNC_STATE_IDLE = 0,
+    DC_SYNC_STATE_STATIC_COMP,
+    DC_SYNC_STATE_TRACKING,
+    DC_SYNC_STATE_LOCKED
+} dc_sync_state_t;
+
+typedef struct {
+    dc_sync_state_t state;
+    uint32_t cycle_time_ns;
+    int32_t propagation_delay_ns;
+    int32_t offset_ns;
+    int32_t drift_ppb;
+    int32_t last_correction_ns;
+    int64_t integral;
+    int32_t first_offset_ns;
+    int32_t previous_offset_ns;
+    int64_t unwrapped_offset_ns;
+    uint32_t sample_count;
+    uint32_t lock_count;
+    uint32_t lock_losses;
+} dc_sync_t;
+
+void dc_sync_init(dc_sync_t *dc, uint32_t cycle_time_ns);
+void dc_sync_start(dc_sync_t *dc);
+bool dc_sync_measure_delays(dc_sync_t *dc, const uint32_t *port0_ns, const uint32_t *port1_ns, int count, int32_t *delays_out);
+int32_t dc_sync_update(dc_sync_t *dc, uint64_t local_time_ns);
+bool dc_sync_is_locked(const dc_sync_t *dc);
+
+#endif
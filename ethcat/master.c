@@ -4,30 +4,114 @@
 #include <string.h>
 
 #define SDO_CACHE_MAX 16
+#define ETHCAT_EMU_HOP_DELAY_NS 120U
+
+#define ECAT_ETHERTYPE 0x88A4U
+#define ECAT_CMD_FPRD 4U
+#define ECAT_CMD_FPWR 5U
+#define ECAT_CMD_LRW 12U
+#define ECAT_STATION_BASE 0x1001U
+#define ECAT_MAILBOX_OUT 0x1000U
+#define ECAT_MAILBOX_IN 0x1080U
+#define ECAT_MAILBOX_HEADER 6U
+#define ECAT_MAILBOX_TYPE_COE 0x03U
+#define ECAT_COE_SDO_REQUEST 0x2000U
+#define ECAT_COE_SDO_RESPONSE 0x3000U
+#define ECAT_SDO_DOWNLOAD_EXPEDITED 0x23U /* size in bits 2-3 as 4 - bytes */
+#define ECAT_SDO_DOWNLOAD_RESPONSE 0x60U
+#define ECAT_SDO_ABORT 0x80U
+#define ECAT_SDO_ABORT_TIMEOUT 0x05040000U
+#define ECAT_SDO_REQUEST_BYTES 10U
+#define ECAT_SDO_TIMEOUT_POLLS 100U
+#define ECAT_MAILBOX_DATAGRAM_BYTES (ECAT_DATAGRAM_HEADER + ECAT_MAILBOX_HEADER + ECAT_SDO_REQUEST_BYTES + ECAT_WKC_SIZE)
+#define ECAT_ETH_HEADER 14U
+#define ECAT_FRAME_HEADER 2U
+#define ECAT_DATAGRAM_HEADER 10U
+#define ECAT_WKC_SIZE 2U
+#define ECAT_RXPDO_BYTES 17U
+#define ECAT_TXPDO_BYTES 23U
+#define ECAT_PDO_OFFSET (ECAT_ETH_HEADER + ECAT_FRAME_HEADER + ECAT_DATAGRAM_HEADER)
+
+typedef enum {
+    SDO_DONE = 0,   /* confirmed by the drive, or cached while the link is down */
+    SDO_QUEUED,     /* waiting for the slave mailbox */
+    SDO_SENT,       /* request written, response not read yet */
+    SDO_ABORTED
+} sdo_state_t;
 
 typedef struct {
     uint16_t index;
     uint8_t subindex;
+    uint8_t size;
     uint32_t value;
+    sdo_state_t state;
     bool valid;
 } sdo_cache_entry_t;
 
+typedef struct {
+    int entry;      /* cache entry in flight, -1: mailbox idle */
+    uint16_t polls; /* mailbox-in reads without a response */
+} sdo_mailbox_t;
+
 static board_runtime_config_t s_config;
 static sdo_cache_entry_t s_sdo_cache[ECAT_MAX_SLAVES][SDO_CACHE_MAX];
+static sdo_mailbox_t s_mailbox[ECAT_MAX_SLAVES];
+
+static void put_u16(uint8_t *dst, uint16_t value)
+{
+    dst[0] = (uint8_t)(value & 0xFFU);
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *dst, uint32_t value)
+{
+    put_u16(dst, (uint16_t)(value & 0xFFFFU));
+    put_u16(dst + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *src)
+{
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *src)
+{
+    return (uint32_t)get_u16(src) | ((uint32_t)get_u16(src + 2) << 16);
+}
+
+static uint8_t *put_frame_header(uint8_t *frame, uint16_t datagram_bytes)
+{
+    memset(frame, 0xFF, 6U);
+    memset(frame + 6, 0x00, 6U);
+    frame[12] = (uint8_t)(ECAT_ETHERTYPE >> 8);
+    frame[13] = (uint8_t)(ECAT_ETHERTYPE & 0xFFU);
+    put_u16(frame + ECAT_ETH_HEADER, (uint16_t)(datagram_bytes | 0x1000U));
+    return frame + ECAT_ETH_HEADER + ECAT_FRAME_HEADER;
+}
 
 void ethcat_master_init(ethcat_master_t *master, const board_runtime_config_t *config)
 {
     memset(master, 0, sizeof(*master));
     s_config = *config;
-    master->cycle_time_ns = 1000000U;
+    master->cycle_time_ns = config->control_period_us != 0U ? config->control_period_us * 1000U : CONTROL_PERIOD_US * 1000U;
     master->dc_offset_ns = 0;
     master->dc_drift_ppb = 0;
     master->dc_synchronized = false;
+    master->dc_locked = false;
     master->link_up = false;
+    master->frame_tx_cycles = 0U;
+    master->frame_time_ns = 0ULL;
+    master->input_time_ns = 0ULL;
+    master->time_ns = 0ULL;
+    master->frame_index = 0U;
+    master->frame_pending = false;
+    master->slave_count = 0;
+    master->process_data_bytes = 0U;
+    dc_sync_init(&master->dc, master->cycle_time_ns);
+    cycle_stats_init(&master->stats, master->cycle_time_ns);
+    eth_mac_set_cycle_time(master->cycle_time_ns);
     for (int axis = 0; axis < ECAT_MAX_SLAVES; ++axis) {
-        master->slaves[axis].vendor_id = config->slaves[axis].vendor_id;
-        master->slaves[axis].product_code = config->slaves[axis].product_code;
-        master->slaves[axis].alias = config->slaves[axis].alias;
+        master->slaves[axis].role = ECAT_ROLE_NONE;
         master->slaves[axis].present = false;
         master->slaves[axis].operational = false;
         master->slaves[axis].rxpdo.mode_of_operation = config->default_mode_of_operation;
@@ -41,39 +125,59 @@ void ethcat_master_init(ethcat_master_t *master, const board_runtime_config_t *c
         master->slaves[axis].txpdo.torque_actual = 0;
         master->slaves[axis].txpdo.mode_display = config->default_mode_of_operation;
         master->slaves[axis].txpdo.emcy_code = 0x0000U;
+        master->slaves[axis].dc_port_time_ns[0] = 0U;
+        master->slaves[axis].dc_port_time_ns[1] = 0U;
+        master->slaves[axis].dc_delay_ns = 0;
         for (int entry = 0; entry < SDO_CACHE_MAX; ++entry) {
             s_sdo_cache[axis][entry].valid = false;
         }
+        s_mailbox[axis].entry = -1;
+        s_mailbox[axis].polls = 0U;
     }
 }
 
-static void sdo_cache_store(int axis, uint16_t index, uint8_t subindex, uint32_t value)
+static sdo_cache_entry_t *sdo_cache_slot(int axis, uint16_t index, uint8_t subindex)
 {
     for (int i = 0; i < SDO_CACHE_MAX; ++i) {
         if (s_sdo_cache[axis][i].valid && s_sdo_cache[axis][i].index == index && s_sdo_cache[axis][i].subindex == subindex) {
-            s_sdo_cache[axis][i].value = value;
-            return;
+            return &s_sdo_cache[axis][i];
         }
     }
     for (int i = 0; i < SDO_CACHE_MAX; ++i) {
         if (!s_sdo_cache[axis][i].valid) {
-            s_sdo_cache[axis][i].valid = true;
-            s_sdo_cache[axis][i].index = index;
-            s_sdo_cache[axis][i].subindex = subindex;
-            s_sdo_cache[axis][i].value = value;
-            return;
+            return &s_sdo_cache[axis][i];
+        }
+    }
+    /* a full cache evicts a settled entry, never a download still owed to the drive */
+    for (int i = 0; i < SDO_CACHE_MAX; ++i) {
+        if (s_sdo_cache[axis][i].state == SDO_DONE || s_sdo_cache[axis][i].state == SDO_ABORTED) {
+            return &s_sdo_cache[axis][i];
         }
     }
-    s_sdo_cache[axis][0].index = index;
-    s_sdo_cache[axis][0].subindex = subindex;
-    s_sdo_cache[axis][0].value = value;
-    s_sdo_cache[axis][0].valid = true;
+    return NULL;
+}
+
+static bool sdo_cache_store(int axis, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size, sdo_state_t state)
+{
+    sdo_cache_entry_t *entry = sdo_cache_slot(axis, index, subindex);
+    if (entry == NULL || entry->state == SDO_SENT) {
+        /* the drive has not answered the previous download of this object yet */
+        return false;
+    }
+    entry->valid = true;
+    entry->index = index;
+    entry->subindex = subindex;
+    entry->size = size;
+    entry->value = value;
+    entry->state = state;
+    return true;
 }
 
 static bool sdo_cache_lookup(int axis, uint16_t index, uint8_t subindex, uint32_t *value)
 {
     for (int i = 0; i < SDO_CACHE_MAX; ++i) {
-        if (s_sdo_cache[axis][i].valid && s_sdo_cache[axis][i].index == index && s_sdo_cache[axis][i].subindex == subindex) {
+        if (s_sdo_cache[axis][i].valid && s_sdo_cache[axis][i].index == index && s_sdo_cache[axis][i].subindex == subindex &&
+            s_sdo_cache[axis][i].state != SDO_ABORTED) {
             *value = s_sdo_cache[axis][i].value;
             return true;
         }
@@ -81,91 +185,534 @@ static bool sdo_cache_lookup(int axis, uint16_t index, uint8_t subindex, uint32_
     return false;
 }
 
+static bool emulated_bus_probe(int position, uint32_t *vendor_id, uint32_t *product_code, uint16_t *alias)
+{
+    /* without a physical segment the bus is populated exactly as configured */
+    if (position >= s_config.slave_count) {
+        return false;
+    }
+    *vendor_id = s_config.slaves[position].vendor_id;
+    *product_code = s_config.slaves[position].product_code;
+    *alias = s_config.slaves[position].alias;
+    return true;
+}
+
+static const ecat_slave_descriptor_t *match_descriptor(const ethcat_slave_t *slave)
+{
+    for (int i = 0; i < s_config.slave_count; ++i) {
+        const ecat_slave_descriptor_t *desc = &s_config.slaves[i];
+        if (desc->vendor_id == slave->vendor_id && desc->product_code == slave->product_code && desc->alias == slave->alias) {
+            return desc;
+        }
+    }
+    return NULL;
+}
+
+static void layout_process_image(ethcat_master_t *master)
+{
+    /* LRW image: all outputs first, then all inputs, in bus order */
+    uint16_t offset = 0U;
+    uint16_t wkc = 0U;
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        master->slaves[slave].output_offset = offset;
+        offset = (uint16_t)(offset + master->slaves[slave].output_bytes);
+        wkc = (uint16_t)(wkc + (master->slaves[slave].output_bytes != 0U ? 2U : 0U));
+    }
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        master->slaves[slave].input_offset = offset;
+        offset = (uint16_t)(offset + master->slaves[slave].input_bytes);
+        wkc = (uint16_t)(wkc + (master->slaves[slave].input_bytes != 0U ? 1U : 0U));
+    }
+    master->process_data_bytes = offset;
+    master->expected_wkc = wkc;
+}
+
+static bool axis_index_valid(const ethcat_master_t *master, int count, const ethcat_slave_t *slave)
+{
+    /* the index selects joint and aux arrays in the tick, one drive per axis */
+    int limit = slave->role == ECAT_ROLE_JOINT ? DELTA_JOINT_COUNT : ECAT_MAX_AUX_AXES;
+    if (slave->axis_index >= limit) {
+        return false;
+    }
+    for (int other = 0; other < count; ++other) {
+        if (master->slaves[other].role == slave->role && master->slaves[other].axis_index == slave->axis_index) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool ethcat_master_scan(ethcat_master_t *master)
 {
-    master->link_up = true;
-    for (int axis = 0; axis < ECAT_MAX_SLAVES; ++axis) {
-        master->slaves[axis].present = true;
-        master->slaves[axis].operational = false;
+    uint32_t vendor_id;
+    uint32_t product_code;
+    uint16_t alias;
+    int count = 0;
+    bool valid = true;
+    while (count < ECAT_MAX_SLAVES && emulated_bus_probe(count, &vendor_id, &product_code, &alias)) {
+        ethcat_slave_t *slave = &master->slaves[count];
+        slave->vendor_id = vendor_id;
+        slave->product_code = product_code;
+        slave->alias = alias;
+        slave->station_address = (uint16_t)(ECAT_STATION_BASE + (uint16_t)count);
+        slave->present = true;
+        slave->operational = false;
+        const ecat_slave_descriptor_t *desc = match_descriptor(slave);
+        slave->role = desc != NULL ? desc->role : ECAT_ROLE_NONE;
+        slave->axis_index = desc != NULL ? desc->axis_index : 0U;
+        if (ethcat_master_is_drive(slave) && !axis_index_valid(master, count, slave)) {
+            /* left on the bus without process data, never commanded */
+            slave->role = ECAT_ROLE_NONE;
+            valid = false;
+        }
+        if (ethcat_master_is_drive(slave)) {
+            slave->output_bytes = ECAT_RXPDO_BYTES;
+            slave->input_bytes = ECAT_TXPDO_BYTES;
+        } else if (slave->role == ECAT_ROLE_IO) {
+            slave->output_bytes = desc->io_output_bytes <= ECAT_IO_MAX_BYTES ? desc->io_output_bytes : ECAT_IO_MAX_BYTES;
+            slave->input_bytes = desc->io_input_bytes <= ECAT_IO_MAX_BYTES ? desc->io_input_bytes : ECAT_IO_MAX_BYTES;
+        } else {
+            slave->output_bytes = 0U;
+            slave->input_bytes = 0U;
+        }
+        ++count;
+    }
+    master->slave_count = count;
+    for (int position = 0; position < count; ++position) {
+        /* emulated receive-time latches of the broadcast delay measurement frame */
+        master->slaves[position].dc_port_time_ns[0] = (uint32_t)position * ETHCAT_EMU_HOP_DELAY_NS;
+        master->slaves[position].dc_port_time_ns[1] = (uint32_t)(2 * count - 1 - position) * ETHCAT_EMU_HOP_DELAY_NS;
+    }
+    layout_process_image(master);
+    master->link_up = count > 0;
+
+    for (int joint = 0; joint < DELTA_JOINT_COUNT; ++joint) {
+        if (ethcat_master_find_slave(master, ECAT_ROLE_JOINT, joint) < 0) {
+            return false;
+        }
+    }
+    return valid && master->link_up;
+}
+
+static bool configure_distributed_clocks(ethcat_master_t *master)
+{
+    uint32_t port0[ECAT_MAX_SLAVES];
+    uint32_t port1[ECAT_MAX_SLAVES];
+    int32_t delays[ECAT_MAX_SLAVES];
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        port0[axis] = master->slaves[axis].dc_port_time_ns[0];
+        port1[axis] = master->slaves[axis].dc_port_time_ns[1];
+    }
+    dc_sync_init(&master->dc, master->cycle_time_ns);
+    if (!dc_sync_measure_delays(&master->dc, port0, port1, master->slave_count, delays)) {
+        return false;
     }
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        master->slaves[axis].dc_delay_ns = delays[axis];
+    }
+    dc_sync_start(&master->dc);
     return true;
 }
 
-static void configure_default_sdos(ethcat_master_t *master)
+static bool interpolation_period_encode(uint32_t cycle_time_ns, uint8_t *value, int8_t *index)
 {
-    for (int axis = 0; axis < ECAT_MAX_SLAVES; ++axis) {
-        ethcat_master_sdo_write(master, axis, 0x6081U, 0x00U, (uint32_t)s_config.axis_velocity_limit);
-        ethcat_master_sdo_write(master, axis, 0x6083U, 0x00U, (uint32_t)s_config.axis_acceleration_limit);
-        ethcat_master_sdo_write(master, axis, 0x607F, 0x00U, (uint32_t)s_config.axis_jerk_limit);
+    /* 0x60C2: period = value * 10^index seconds, value is an unsigned byte */
+    uint32_t mantissa = cycle_time_ns;
+    int exponent = -9;
+    while (mantissa != 0U && (mantissa % 10U) == 0U) {
+        mantissa /= 10U;
+        exponent++;
     }
+    if (mantissa == 0U || mantissa > 0xFFU) {
+        return false;
+    }
+    *value = (uint8_t)mantissa;
+    *index = (int8_t)exponent;
+    return true;
+}
+
+static bool configure_interpolation_period(ethcat_master_t *master)
+{
+    uint8_t value;
+    int8_t index;
+    if (!interpolation_period_encode(master->cycle_time_ns, &value, &index)) {
+        return false;
+    }
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        if (!ethcat_master_is_drive(&master->slaves[axis])) {
+            continue;
+        }
+        if (!ethcat_master_sdo_write(master, axis, 0x60C2U, 0x01U, value, 1U) ||
+            !ethcat_master_sdo_write(master, axis, 0x60C2U, 0x02U, (uint32_t)(uint8_t)index, 1U)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool configure_default_sdos(ethcat_master_t *master)
+{
+    if (!configure_interpolation_period(master)) {
+        return false;
+    }
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        if (!ethcat_master_is_drive(&master->slaves[axis])) {
+            continue;
+        }
+        if (!ethcat_master_sdo_write(master, axis, 0x6081U, 0x00U, (uint32_t)s_config.axis_velocity_limit, 4U) ||
+            !ethcat_master_sdo_write(master, axis, 0x6083U, 0x00U, (uint32_t)s_config.axis_acceleration_limit, 4U) ||
+            !ethcat_master_sdo_write(master, axis, 0x607FU, 0x00U, (uint32_t)s_config.axis_jerk_limit, 4U)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool ethcat_master_configure(ethcat_master_t *master)
 {
-    if (!master->link_up) {
+    if (!master->link_up || !configure_default_sdos(master)) {
         return false;
     }
-    configure_default_sdos(master);
-    master->dc_synchronized = true;
     master->dc_offset_ns = 0;
     master->dc_drift_ppb = 0;
-    for (int axis = 0; axis < ECAT_MAX_SLAVES; ++axis) {
+    master->dc_locked = false;
+    master->dc_synchronized = configure_distributed_clocks(master);
+    if (!master->dc_synchronized) {
+        return false;
+    }
+    for (int axis = 0; axis < master->slave_count; ++axis) {
         master->slaves[axis].operational = true;
         master->slaves[axis].txpdo.statusword = 0x1234U;
     }
     return true;
 }
 
+bool ethcat_master_set_cycle_time(ethcat_master_t *master, uint32_t cycle_time_ns)
+{
+    uint32_t previous = master->cycle_time_ns;
+    master->cycle_time_ns = cycle_time_ns;
+    if (!configure_interpolation_period(master)) {
+        master->cycle_time_ns = previous;
+        return false;
+    }
+    eth_mac_set_cycle_time(cycle_time_ns);
+    cycle_stats_init(&master->stats, cycle_time_ns);
+    if (master->dc_synchronized) {
+        master->dc_locked = false;
+        master->dc_synchronized = configure_distributed_clocks(master);
+    } else {
+        dc_sync_init(&master->dc, cycle_time_ns);
+    }
+    return true;
+}
+
 void ethcat_master_sync0_handler(ethcat_master_t *master)
 {
+    cycle_stats_sync0(&master->stats, eth_mac_get_sync_timestamp(), timer_get_cycles());
     if (!master->dc_synchronized) {
         return;
     }
-    uint64_t dc_time = eth_mac_get_time_ns();
-    int32_t error = (int32_t)(dc_time % master->cycle_time_ns);
-    master->dc_offset_ns = error;
-    if (error > (int32_t)(master->cycle_time_ns / 2U)) {
-        eth_mac_adjust_time(-(int32_t)(error / 4));
-    } else if (error < -(int32_t)(master->cycle_time_ns / 2U)) {
-        eth_mac_adjust_time(-(int32_t)(error / 4));
+    int32_t correction = dc_sync_update(&master->dc, eth_mac_get_time_ns());
+    if (correction != 0) {
+        eth_mac_adjust_time(correction);
+    }
+    master->dc_offset_ns = master->dc.offset_ns;
+    master->dc_drift_ppb = master->dc.drift_ppb;
+    master->dc_locked = dc_sync_is_locked(&master->dc);
+}
+
+static void build_cyclic_frame(const ethcat_master_t *master, uint8_t *frame, uint8_t index)
+{
+    uint8_t *datagram = put_frame_header(frame, (uint16_t)(ECAT_DATAGRAM_HEADER + master->process_data_bytes + ECAT_WKC_SIZE));
+    datagram[0] = ECAT_CMD_LRW;
+    datagram[1] = index;
+    put_u32(datagram + 2, 0U); /* logical address of the process image */
+    put_u16(datagram + 6, master->process_data_bytes);
+    put_u16(datagram + 8, 0U);
+
+    uint8_t *image = frame + ECAT_PDO_OFFSET;
+    memset(image, 0, (size_t)master->process_data_bytes + ECAT_WKC_SIZE);
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        const ethcat_slave_t *slave = &master->slaves[axis];
+        uint8_t *pdo = image + slave->output_offset;
+        if (ethcat_master_is_drive(slave)) {
+            put_u16(pdo, slave->rxpdo.controlword);
+            put_u32(pdo + 2, (uint32_t)slave->rxpdo.target_position);
+            put_u32(pdo + 6, (uint32_t)slave->rxpdo.target_velocity);
+            put_u32(pdo + 10, (uint32_t)slave->rxpdo.target_torque);
+            pdo[14] = slave->rxpdo.mode_of_operation;
+            put_u16(pdo + 15, slave->rxpdo.touch_probe_function);
+        } else if (slave->output_bytes != 0U) {
+            memcpy(pdo, slave->io_outputs, slave->output_bytes);
+        }
+    }
+}
+
+bool ethcat_master_send_process_data(ethcat_master_t *master)
+{
+    if (!master->link_up) {
+        return false;
+    }
+    if (master->frame_pending) {
+        /* the inputs of that frame never arrived, the txpdo are older than a cycle */
+        master->stats.lost_frames++;
+        master->process_data_valid = false;
+    }
+    /* the image is written straight into the MAC buffer, it is never copied */
+    uint16_t length = (uint16_t)(ECAT_PDO_OFFSET + master->process_data_bytes + ECAT_WKC_SIZE);
+    uint16_t capacity = 0U;
+    uint8_t *frame = eth_mac_tx_borrow(&capacity);
+    if (frame == NULL || capacity < length) {
+        if (frame != NULL) {
+            eth_mac_tx_submit(frame, 0U);
+        }
+        master->frame_pending = false;
+        return false;
+    }
+    master->frame_index++;
+    build_cyclic_frame(master, frame, master->frame_index);
+    master->frame_tx_cycles = timer_get_cycles();
+    master->frame_time_ns = eth_mac_get_time_ns();
+    master->frame_pending = eth_mac_tx_submit(frame, length);
+    return master->frame_pending;
+}
+
+static uint8_t *put_mailbox_datagram(uint8_t *datagram, uint8_t command, uint16_t station, uint16_t address, bool more)
+{
+    datagram[0] = command;
+    datagram[1] = 0U;
+    put_u16(datagram + 2, station);
+    put_u16(datagram + 4, address);
+    put_u16(datagram + 6, (uint16_t)((ECAT_MAILBOX_HEADER + ECAT_SDO_REQUEST_BYTES) | (more ? 0x8000U : 0U)));
+    put_u16(datagram + 8, 0U);
+    uint8_t *mailbox = datagram + ECAT_DATAGRAM_HEADER;
+    memset(mailbox, 0, ECAT_MAILBOX_HEADER + ECAT_SDO_REQUEST_BYTES + ECAT_WKC_SIZE);
+    return mailbox;
+}
+
+static bool send_mailbox(ethcat_master_t *master, int axis, const sdo_cache_entry_t *request)
+{
+    /* a download is followed by a read of mailbox-in; without a request the frame only polls */
+    uint8_t *frame = eth_mac_tx_borrow(NULL);
+    if (frame == NULL) {
+        return false;
+    }
+    uint16_t station = master->slaves[axis].station_address;
+    uint16_t datagrams = request != NULL ? 2U : 1U;
+    uint8_t *datagram = put_frame_header(frame, (uint16_t)(datagrams * ECAT_MAILBOX_DATAGRAM_BYTES));
+    if (request != NULL) {
+        uint8_t *mailbox = put_mailbox_datagram(datagram, ECAT_CMD_FPWR, station, ECAT_MAILBOX_OUT, true);
+        master->mailbox_counter = (uint8_t)(master->mailbox_counter % 7U + 1U);
+        put_u16(mailbox, (uint16_t)ECAT_SDO_REQUEST_BYTES);
+        mailbox[5] = (uint8_t)(ECAT_MAILBOX_TYPE_COE | (master->mailbox_counter << 4));
+        put_u16(mailbox + 6, ECAT_COE_SDO_REQUEST);
+        mailbox[8] = (uint8_t)(ECAT_SDO_DOWNLOAD_EXPEDITED | ((4U - request->size) << 2));
+        put_u16(mailbox + 9, request->index);
+        mailbox[11] = request->subindex;
+        put_u32(mailbox + 12, request->value);
+        datagram += ECAT_MAILBOX_DATAGRAM_BYTES;
+    }
+    put_mailbox_datagram(datagram, ECAT_CMD_FPRD, station, ECAT_MAILBOX_IN, false);
+    master->mailbox_pending = eth_mac_tx_submit(frame, (uint16_t)(ECAT_ETH_HEADER + ECAT_FRAME_HEADER + datagrams * ECAT_MAILBOX_DATAGRAM_BYTES));
+    return master->mailbox_pending;
+}
+
+static void sdo_settle(ethcat_master_t *master, int axis, sdo_cache_entry_t *entry, uint32_t abort_code)
+{
+    s_mailbox[axis].entry = -1;
+    s_mailbox[axis].polls = 0U;
+    if (abort_code == 0U) {
+        entry->state = SDO_DONE;
+        return;
+    }
+    entry->state = SDO_ABORTED;
+    master->sdo_aborts++;
+    master->sdo_abort_code = abort_code;
+    master->sdo_abort_index = entry->index;
+    master->sdo_abort_subindex = entry->subindex;
+}
+
+static void service_mailbox(ethcat_master_t *master)
+{
+    /* one mailbox frame per cycle next to the cyclic one; a frame not back by now is lost */
+    master->mailbox_pending = false;
+    if (!master->link_up) {
+        return;
+    }
+    for (int step = 0; step < master->slave_count; ++step) {
+        int axis = (master->mailbox_axis + 1 + step) % master->slave_count;
+        sdo_mailbox_t *mailbox = &s_mailbox[axis];
+        if (mailbox->entry >= 0) {
+            if (++mailbox->polls > ECAT_SDO_TIMEOUT_POLLS) {
+                sdo_settle(master, axis, &s_sdo_cache[axis][mailbox->entry], ECAT_SDO_ABORT_TIMEOUT);
+                continue;
+            }
+            master->mailbox_axis = axis;
+            send_mailbox(master, axis, NULL);
+            return;
+        }
+        for (int i = 0; i < SDO_CACHE_MAX; ++i) {
+            sdo_cache_entry_t *entry = &s_sdo_cache[axis][i];
+            if (!entry->valid || entry->state != SDO_QUEUED) {
+                continue;
+            }
+            master->mailbox_axis = axis;
+            if (send_mailbox(master, axis, entry)) {
+                entry->state = SDO_SENT;
+                mailbox->entry = i;
+                mailbox->polls = 0U;
+            }
+            return;
+        }
+    }
+}
+
+static void handle_mailbox_frame(ethcat_master_t *master, const uint8_t *datagram, const uint8_t *end)
+{
+    master->mailbox_pending = false;
+    int axis = -1;
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        if (master->slaves[slave].station_address == get_u16(datagram + 2)) {
+            axis = slave;
+        }
+    }
+    if (axis < 0 || s_mailbox[axis].entry < 0) {
+        return;
+    }
+    sdo_cache_entry_t *entry = &s_sdo_cache[axis][s_mailbox[axis].entry];
+    if (datagram + ECAT_MAILBOX_DATAGRAM_BYTES > end) {
+        return;
+    }
+    if (datagram[0] == ECAT_CMD_FPWR) {
+        if (get_u16(datagram + ECAT_MAILBOX_DATAGRAM_BYTES - ECAT_WKC_SIZE) == 0U) {
+            /* mailbox-out was still full: the request goes out again */
+            entry->state = SDO_QUEUED;
+            s_mailbox[axis].entry = -1;
+            return;
+        }
+        datagram += ECAT_MAILBOX_DATAGRAM_BYTES;
+        if (datagram + ECAT_MAILBOX_DATAGRAM_BYTES > end) {
+            return;
+        }
+    }
+    if (datagram[0] != ECAT_CMD_FPRD || get_u16(datagram + ECAT_MAILBOX_DATAGRAM_BYTES - ECAT_WKC_SIZE) == 0U) {
+        return; /* mailbox-in empty: polled again next cycle */
+    }
+    const uint8_t *mailbox = datagram + ECAT_DATAGRAM_HEADER;
+    if ((mailbox[5] & 0x0FU) != ECAT_MAILBOX_TYPE_COE || get_u16(mailbox + 9) != entry->index || mailbox[11] != entry->subindex) {
+        return;
+    }
+    if (mailbox[8] == ECAT_SDO_ABORT) {
+        sdo_settle(master, axis, entry, get_u32(mailbox + 12));
+    } else if ((get_u16(mailbox + 6) & 0xF000U) == ECAT_COE_SDO_RESPONSE && mailbox[8] == ECAT_SDO_DOWNLOAD_RESPONSE) {
+        sdo_settle(master, axis, entry, 0U);
+    }
+}
+
+static void handle_frame(ethcat_master_t *master, const uint8_t *frame, uint16_t length)
+{
+    if (length < ECAT_PDO_OFFSET) {
+        return;
+    }
+    if (frame[12] != (uint8_t)(ECAT_ETHERTYPE >> 8) || frame[13] != (uint8_t)(ECAT_ETHERTYPE & 0xFFU)) {
+        return;
+    }
+    const uint8_t *datagram = frame + ECAT_ETH_HEADER + ECAT_FRAME_HEADER;
+    if (datagram[0] == ECAT_CMD_FPWR || datagram[0] == ECAT_CMD_FPRD) {
+        handle_mailbox_frame(master, datagram, frame + length);
+        return;
+    }
+    if (datagram[0] != ECAT_CMD_LRW || get_u16(datagram + 6) != master->process_data_bytes) {
+        return;
+    }
+    if (length < ECAT_PDO_OFFSET + master->process_data_bytes + ECAT_WKC_SIZE) {
+        return;
+    }
+    if (!master->frame_pending || datagram[1] != master->frame_index) {
+        return;
+    }
+    master->frame_pending = false;
+    cycle_stats_record(&master->stats, CYCLE_STAT_FRAME_RTT, timer_cycles_to_ns(timer_get_cycles() - master->frame_tx_cycles));
+
+    const uint8_t *image = frame + ECAT_PDO_OFFSET;
+    uint16_t wkc = get_u16(image + master->process_data_bytes);
+    master->process_data_valid = wkc == master->expected_wkc && wkc != 0U;
+    if (!master->process_data_valid) {
+        return;
+    }
+    /* inputs are latched at the Sync0 of the cycle the frame went out in */
+    master->input_time_ns = master->frame_time_ns - master->frame_time_ns % master->cycle_time_ns;
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        ethcat_slave_t *slave = &master->slaves[axis];
+        const uint8_t *pdo = image + slave->input_offset;
+        if (ethcat_master_is_drive(slave)) {
+            slave->txpdo.statusword = get_u16(pdo);
+            slave->txpdo.position_actual = (q16_16_t)get_u32(pdo + 2);
+            slave->txpdo.velocity_actual = (q16_16_t)get_u32(pdo + 6);
+            slave->txpdo.torque_actual = (q16_16_t)get_u32(pdo + 10);
+            slave->txpdo.mode_display = pdo[14];
+            slave->txpdo.emcy_code = get_u16(pdo + 15);
+            slave->txpdo.touch_probe_status = get_u16(pdo + 17);
+            slave->txpdo.touch_probe_position = (q16_16_t)get_u32(pdo + 19);
+        } else if (slave->input_bytes != 0U) {
+            memcpy(slave->io_inputs, pdo, slave->input_bytes);
+        }
     }
 }
 
 void ethcat_master_process(ethcat_master_t *master)
 {
-    (void)master;
     eth_mac_poll();
+    master->time_ns = eth_mac_get_time_ns();
+    uint16_t length = 0U;
+    uint8_t *frame;
+    while ((frame = eth_mac_rx_borrow(&length)) != NULL) {
+        handle_frame(master, frame, length);
+        eth_mac_rx_release(frame);
+    }
+    service_mailbox(master);
 }
 
 void ethcat_master_set_target(ethcat_master_t *master, int axis, const ethcat_rxpdo_t *rxpdo)
 {
-    if (axis < 0 || axis >= ECAT_MAX_SLAVES) {
+    if (axis < 0 || axis >= master->slave_count) {
         return;
     }
     master->slaves[axis].rxpdo = *rxpdo;
-    master->slaves[axis].txpdo.mode_display = rxpdo->mode_of_operation;
-    master->slaves[axis].txpdo.position_actual = rxpdo->target_position;
-    master->slaves[axis].txpdo.velocity_actual = rxpdo->target_velocity;
-    master->slaves[axis].txpdo.torque_actual = rxpdo->target_torque;
-    master->slaves[axis].txpdo.statusword = 0x1437U;
 }
 
 const ethcat_txpdo_t *ethcat_master_get_feedback(const ethcat_master_t *master, int axis)
 {
-    if (axis < 0 || axis >= ECAT_MAX_SLAVES) {
+    if (axis < 0 || axis >= master->slave_count) {
         return NULL;
     }
     return &master->slaves[axis].txpdo;
 }
 
-bool ethcat_master_sdo_write(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t value)
+bool ethcat_master_sdo_write(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size)
 {
-    (void)master;
-    if (axis < 0 || axis >= ECAT_MAX_SLAVES) {
+    if (axis < 0 || axis >= ECAT_MAX_SLAVES || (size != 1U && size != 2U && size != 4U)) {
         return false;
     }
-    sdo_cache_store(axis, index, subindex, value);
-    return true;
+    if (size < 4U) {
+        value &= (1U << (8U * size)) - 1U;
+    }
+    /* queued here, downloaded by the mailbox service in ethcat_master_process */
+    bool online = master->link_up && axis < master->slave_count;
+    return sdo_cache_store(axis, index, subindex, value, size, online ? SDO_QUEUED : SDO_DONE);
+}
+
+bool ethcat_master_sdo_busy(const ethcat_master_t *master)
+{
+    for (int axis = 0; axis < master->slave_count; ++axis) {
+        for (int i = 0; i < SDO_CACHE_MAX; ++i) {
+            const sdo_cache_entry_t *entry = &s_sdo_cache[axis][i];
+            if (entry->valid && (entry->state == SDO_QUEUED || entry->state == SDO_SENT)) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 bool ethcat_master_sdo_read(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t *value)
@@ -189,3 +736,18 @@ void ethcat_master_log_emergency(ethcat_master_t *master, int axis, uint16_t cod
     master->slaves[axis].txpdo.emcy_code = code;
     master->slaves[axis].txpdo.statusword |= 0x0008U;
 }
+
+int ethcat_master_find_slave(const ethcat_master_t *master, ecat_slave_role_t role, int axis_index)
+{
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        if (master->slaves[slave].role == role && master->slaves[slave].axis_index == axis_index) {
+            return slave;
+        }
+    }
+    return -1;
+}
+
+bool ethcat_master_is_drive(const ethcat_slave_t *slave)
+{
+    return slave->role == ECAT_ROLE_JOINT || slave->role == ECAT_ROLE_AUX_AXIS;
+}
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include "board/config.h"
 #include "utils/fixed.h"
+#include "dc_sync.h"
+#include "cycle_stats.h"
 
 typedef struct {
     uint16_t statusword;
@@ -13,6 +15,8 @@ typedef struct {
     q16_16_t torque_actual;
     uint8_t mode_display;
     uint16_t emcy_code;
+    uint16_t touch_probe_status;    /* 0x60B9 */
+    q16_16_t touch_probe_position;  /* 0x60BA, probe 1 positive edge */
 } ethcat_txpdo_t;
 
 typedef struct {
@@ -21,24 +25,56 @@ typedef struct {
     q16_16_t target_velocity;
     q16_16_t target_torque;
     uint8_t mode_of_operation;
+    uint16_t touch_probe_function;  /* 0x60B8 */
 } ethcat_rxpdo_t;
 
 typedef struct {
     uint32_t vendor_id;
     uint32_t product_code;
     uint16_t alias;
+    uint16_t station_address;
+    ecat_slave_role_t role;
+    uint8_t axis_index;
+    uint16_t output_offset;
+    uint16_t output_bytes;
+    uint16_t input_offset;
+    uint16_t input_bytes;
     ethcat_txpdo_t txpdo;
     ethcat_rxpdo_t rxpdo;
+    uint8_t io_outputs[ECAT_IO_MAX_BYTES];
+    uint8_t io_inputs[ECAT_IO_MAX_BYTES];
+    uint32_t dc_port_time_ns[2];
+    int32_t dc_delay_ns;
     bool present;
     bool operational;
 } ethcat_slave_t;
 
 typedef struct {
     ethcat_slave_t slaves[ECAT_MAX_SLAVES];
+    int slave_count;
+    uint16_t process_data_bytes;
+    uint16_t expected_wkc;
+    bool process_data_valid; /* false: the txpdo hold the last inputs received, stale */
+    uint8_t mailbox_counter;
+    int mailbox_axis;           /* slave served last, the mailbox service round-robins */
+    bool mailbox_pending;
+    uint32_t sdo_aborts;        /* downloads the drives refused or never answered */
+    uint32_t sdo_abort_code;    /* last abort, CoE abort code */
+    uint16_t sdo_abort_index;
+    uint8_t sdo_abort_subindex;
     uint32_t cycle_time_ns;
     int32_t dc_offset_ns;
     int32_t dc_drift_ppb;
+    dc_sync_t dc;
+    cycle_stats_t stats;
+    uint32_t frame_tx_cycles;
+    uint64_t frame_time_ns;  /* DC time the cyclic frame was sent */
+    uint64_t input_time_ns;  /* Sync0 the last valid inputs were latched at */
+    uint64_t time_ns;        /* DC time of the last process call */
+    uint8_t frame_index;
+    bool frame_pending;
     bool dc_synchronized;
+    bool dc_locked;
     bool link_up;
 } ethcat_master_t;
 
@@ -47,10 +83,16 @@ bool ethcat_master_scan(ethcat_master_t *master);
 bool ethcat_master_configure(ethcat_master_t *master);
 void ethcat_master_sync0_handler(ethcat_master_t *master);
 void ethcat_master_process(ethcat_master_t *master);
+bool ethcat_master_send_process_data(ethcat_master_t *master);
+bool ethcat_master_set_cycle_time(ethcat_master_t *master, uint32_t cycle_time_ns);
 void ethcat_master_set_target(ethcat_master_t *master, int axis, const ethcat_rxpdo_t *rxpdo);
 const ethcat_txpdo_t *ethcat_master_get_feedback(const ethcat_master_t *master, int axis);
-bool ethcat_master_sdo_write(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t value);
+/* size is the object size in bytes (1, 2 or 4); false: not queued, retry later */
+bool ethcat_master_sdo_write(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t value, uint8_t size);
+bool ethcat_master_sdo_busy(const ethcat_master_t *master);
 bool ethcat_master_sdo_read(ethcat_master_t *master, int axis, uint16_t index, uint8_t subindex, uint32_t *value);
 void ethcat_master_log_emergency(ethcat_master_t *master, int axis, uint16_t code);
+int ethcat_master_find_slave(const ethcat_master_t *master, ecat_slave_role_t role, int axis_index);
+bool ethcat_master_is_drive(const ethcat_slave_t *slave);
 
 #endif
@@ -0,0 +1,556 @@
+#include "console.h"
+#include "drivers/uart.h"
+#include "storage/storage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void reply_ok(void)
+{
+    uart_write("ok\r\n");
+}
+
+static void reply_error(int code)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "error:%d\r\n", code);
+    uart_write(buffer);
+}
+
+static void report_ecat(const ethcat_master_t *master, const motion_controller_t *motion)
+{
+    char buffer[128];
+    const cycle_stats_t *stats = &master->stats;
+    snprintf(buffer, sizeof(buffer), "[ECAT link:%d dc:%d lock:%d offset:%ld drift:%ld missed:%lu lost:%lu]\r\n",
+             master->link_up ? 1 : 0,
+             master->dc_synchronized ? 1 : 0,
+             master->dc_locked ? 1 : 0,
+             (long)master->dc_offset_ns,
+             (long)master->dc_drift_ppb,
+             (unsigned long)stats->missed_cycles,
+             (unsigned long)stats->lost_frames);
+    uart_write(buffer);
+    if (master->sdo_aborts != 0U || ethcat_master_sdo_busy(master)) {
+        snprintf(buffer, sizeof(buffer), "[SDO busy:%d aborts:%lu last:%04X:%02X code:%08lX]\r\n",
+                 ethcat_master_sdo_busy(master) ? 1 : 0,
+                 (unsigned long)master->sdo_aborts,
+                 (unsigned)master->sdo_abort_index,
+                 (unsigned)master->sdo_abort_subindex,
+                 (unsigned long)master->sdo_abort_code);
+        uart_write(buffer);
+    }
+    snprintf(buffer, sizeof(buffer), "[DRIVES ready:%d enable_us:%lu]\r\n",
+             motion->drives_ready ? 1 : 0,
+             (unsigned long)motion_controller_enable_time_us(motion));
+    uart_write(buffer);
+    const following_error_t *following = &motion->following;
+    snprintf(buffer, sizeof(buffer), "[FE urad:%ld,%ld,%ld peak:%ld scale:%ld%% warn:%lu fault:%d]\r\n",
+             (long)(q16_16_to_float(following->error[0]) * 1e6f),
+             (long)(q16_16_to_float(following->error[1]) * 1e6f),
+             (long)(q16_16_to_float(following->error[2]) * 1e6f),
+             (long)(q16_16_to_float(following_error_peak(following)) * 1e6f),
+             (long)((motion->planner->feed_scale * 100) >> 16),
+             (unsigned long)following->warning_cycles,
+             following->fault ? 1 : 0);
+    uart_write(buffer);
+    const joint_filter_t *filter = &motion->joint_filter;
+    snprintf(buffer, sizeof(buffer), "[VEL mrad_s:%ld,%ld,%ld]\r\n",
+             (long)(q16_16_to_float(filter->joint_velocity[0]) * 1e3f),
+             (long)(q16_16_to_float(filter->joint_velocity[1]) * 1e3f),
+             (long)(q16_16_to_float(filter->joint_velocity[2]) * 1e3f));
+    uart_write(buffer);
+    const conveyor_sync_t *conveyor = &motion->conveyor;
+    if (conveyor_sync_enabled(conveyor)) {
+        snprintf(buffer, sizeof(buffer), "[BELT mm_s:%ld offset_um:%ld track:%d stale:%d]\r\n",
+                 (long)(conveyor->velocity * 1e3f),
+                 (long)(conveyor->offset * 1e6f),
+                 (int)motion->planner->frame,
+                 conveyor->stale ? 1 : 0);
+        uart_write(buffer);
+    }
+    for (int id = 0; id < CYCLE_STAT_COUNT; ++id) {
+        const histogram_t *hist = &stats->hist[id];
+        snprintf(buffer, sizeof(buffer), "[%s n:%lu min:%lu mean:%lu p50:%lu p99:%lu p999:%lu max:%lu]\r\n",
+                 cycle_stats_name((cycle_stat_t)id),
+                 (unsigned long)hist->count,
+                 (unsigned long)(hist->count != 0U ? hist->min : 0U),
+                 (unsigned long)histogram_mean(hist),
+                 (unsigned long)histogram_percentile(hist, 500U),
+                 (unsigned long)histogram_percentile(hist, 990U),
+                 (unsigned long)histogram_percentile(hist, 999U),
+                 (unsigned long)hist->max);
+        uart_write(buffer);
+    }
+}
+
+static void report_tasks(const scheduler_t *scheduler)
+{
+    char buffer[192];
+    uint64_t total = scheduler->busy_ns + scheduler->idle_ns;
+    snprintf(buffer, sizeof(buffer), "[LOOP busy:%lu%%]\r\n",
+             (unsigned long)(total != 0U ? scheduler->busy_ns * 100U / total : 0U));
+    uart_write(buffer);
+    const histogram_t *wake = &scheduler->wake_latency;
+    snprintf(buffer, sizeof(buffer), "[WAKE n:%lu mean_us:%lu p99_us:%lu max_us:%lu]\r\n",
+             (unsigned long)wake->count,
+             (unsigned long)(histogram_mean(wake) / 1000U),
+             (unsigned long)(histogram_percentile(wake, 990U) / 1000U),
+             (unsigned long)(wake->max / 1000U));
+    uart_write(buffer);
+    for (uint8_t i = 0U; i < scheduler->count; ++i) {
+        const scheduler_task_t *task = &scheduler->tasks[i];
+        snprintf(buffer, sizeof(buffer), "[TASK %.12s runs:%lu max_us:%lu budget_us:%lu overruns:%lu misses:%lu skipped:%lu]\r\n",
+                 task->name != NULL ? task->name : "?",
+                 (unsigned long)task->runs,
+                 (unsigned long)(task->max_ns / 1000U),
+                 (unsigned long)(task->budget_ns / 1000U),
+                 (unsigned long)task->overruns,
+                 (unsigned long)task->misses,
+                 (unsigned long)task->skipped);
+        uart_write(buffer);
+    }
+}
+
+static void report_cycle(const console_t *console)
+{
+    char buffer[96];
+    const histogram_t *tick = &console->master->stats.hist[CYCLE_STAT_TICK_DURATION];
+    snprintf(buffer, sizeof(buffer), "[CYCLE period_us:%lu tick_max:%lu budget:%lu%%]\r\n",
+             (unsigned long)console->config->control_period_us,
+             (unsigned long)tick->max,
+             (unsigned long)CONTROL_TICK_BUDGET_PERCENT);
+    uart_write(buffer);
+}
+
+static void report_probe(const console_t *console)
+{
+    char buffer[64];
+    const planner_probe_t *probe = &console->motion->planner->probe;
+    snprintf(buffer, sizeof(buffer), "[PRB:%.4f,%.4f,%.4f:%d]\r\n",
+             (double)q16_16_to_float(probe->contact.xyz[0]),
+             (double)q16_16_to_float(probe->contact.xyz[1]),
+             (double)q16_16_to_float(probe->contact.xyz[2]),
+             probe->state == PLANNER_PROBE_TRIGGERED ? 1 : 0);
+    uart_write(buffer);
+}
+
+static void report_overrides(const console_t *console)
+{
+    char buffer[64];
+    const planner_queue_t *planner = console->motion->planner;
+    snprintf(buffer, sizeof(buffer), "[OV feed:%u rapid:%u scale:%ld%% hold:%d]\r\n",
+             (unsigned)planner->feed_override,
+             (unsigned)planner->rapid_override,
+             (long)((planner->feed_scale * 100) >> 16),
+             planner->held ? 1 : 0);
+    uart_write(buffer);
+}
+
+static void report_teach(const replay_cache_t *replay)
+{
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "[TEACH mode:%d valid:%d key:%08lx frames:%lu bytes:%lu]\r\n",
+             (int)replay->mode,
+             replay->valid ? 1 : 0,
+             (unsigned long)replay->program_hash,
+             (unsigned long)replay->frames,
+             (unsigned long)replay->length);
+    uart_write(buffer);
+}
+
+static void report_trace(const trace_t *trace)
+{
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "[TRACE state:%d channels:%u depth:%u pre:%u trigger:%u]\r\n",
+             (int)trace_state(trace),
+             (unsigned)trace->channel_count,
+             (unsigned)trace->depth,
+             (unsigned)trace->pre,
+             (unsigned)trace->trigger);
+    uart_write(buffer);
+}
+
+static uint32_t config_key(const board_runtime_config_t *config)
+{
+    /* the settings that shape the setpoint stream, field by field to skip padding */
+    const q16_16_t shaping[] = {
+        config->axis_velocity_limit, config->axis_acceleration_limit, config->axis_jerk_limit,
+        config->axis_torque_limit, config->joint_inertia, config->path_acceleration_limit, config->path_jerk_limit,
+        (q16_16_t)config->input_shaper_type,
+        config->input_shaper_frequency_hz[0], config->input_shaper_frequency_hz[1], config->input_shaper_frequency_hz[2],
+        config->input_shaper_damping[0], config->input_shaper_damping[1], config->input_shaper_damping[2],
+        (q16_16_t)config->control_period_us,
+    };
+    uint32_t hash = replay_hash(REPLAY_HASH_SEED, &config->delta, sizeof(config->delta));
+    return replay_hash(hash, shaping, sizeof(shaping));
+}
+
+static bool teach(console_t *console, const char *value)
+{
+    motion_controller_t *motion = console->motion;
+    if (strcmp(value, "") == 0) {
+        /* taught from rest, the program text follows */
+        if (console->queue->head != console->queue->tail || !motion_controller_teach(motion, config_key(console->config))) {
+            return false;
+        }
+        console->teach_closing = false;
+        return true;
+    }
+    if (strcmp(value, "=E") == 0) {
+        if (!replay_teaching(&motion->replay)) {
+            return false;
+        }
+        console->teach_closing = true;
+        return true;
+    }
+    if (strcmp(value, "=C") == 0) {
+        replay_cancel(&motion->replay);
+        console->teach_closing = false;
+        return true;
+    }
+    return false;
+}
+
+static bool replay(console_t *console, const char *value)
+{
+    char *end = NULL;
+    unsigned long key = strtoul(value, &end, 16);
+    if (end == value || *end != '\0' || console->queue->head != console->queue->tail) {
+        return false;
+    }
+    return motion_controller_replay(console->motion, (uint32_t)key, config_key(console->config));
+}
+
+static bool trace_channels(console_t *console, const char *list)
+{
+    /* P A: position command/actual, V W: velocity, T Q: torque, E: following error, C: tool pose */
+    static const char letters[TRACE_SIGNAL_COUNT] = {'P', 'A', 'V', 'W', 'T', 'Q', 'E', 'C'};
+    trace_channel_t channels[TRACE_MAX_CHANNELS];
+    int count = 0;
+    const char *p = list;
+    while (count < TRACE_MAX_CHANNELS) {
+        const char *letter = memchr(letters, *p, sizeof(letters));
+        if (*p == '\0' || letter == NULL || p[1] < '0' || p[1] > '9') {
+            return false;
+        }
+        channels[count].signal = (uint8_t)(letter - letters);
+        channels[count].index = (uint8_t)(p[1] - '0');
+        count++;
+        p += 2;
+        if (*p == '\0') {
+            return trace_configure(console->trace, console->motion, channels, count);
+        }
+        if (*p++ != ',') {
+            return false;
+        }
+    }
+    return false;
+}
+
+static bool trace_source(trace_t *trace, const char *value)
+{
+    if (strcmp(value, "M") == 0) {
+        return trace_set_trigger(trace, TRACE_TRIGGER_MANUAL, 0, 0);
+    }
+    if (strcmp(value, "F") == 0) {
+        return trace_set_trigger(trace, TRACE_TRIGGER_FAULT, 0, 0);
+    }
+    /* <channel>><level> or <channel><<level>, the level in the channel's units */
+    char *end = NULL;
+    long channel = strtol(value, &end, 10);
+    if (end == value || (*end != '>' && *end != '<')) {
+        return false;
+    }
+    trace_trigger_t edge = *end == '>' ? TRACE_TRIGGER_RISING : TRACE_TRIGGER_FALLING;
+    const char *level_text = end + 1;
+    float level = strtof(level_text, &end);
+    if (end == level_text || *end != '\0') {
+        return false;
+    }
+    return trace_set_trigger(trace, edge, (int)channel, q16_16_from_float(level));
+}
+
+static bool trace_command(console_t *console, const char *value)
+{
+    trace_t *trace = console->trace;
+    if (strncmp(value, "C:", 2) == 0) {
+        return trace_channels(console, value + 2);
+    }
+    if (strncmp(value, "S:", 2) == 0) {
+        return trace_source(trace, value + 2);
+    }
+    if (strncmp(value, "A:", 2) == 0) {
+        char *end = NULL;
+        unsigned long pre = strtoul(value + 2, &end, 10);
+        return end != value + 2 && *end == '\0' && pre <= 0xFFFFUL &&
+               trace_arm(trace, (uint16_t)pre, console->config->control_period_us);
+    }
+    if (strcmp(value, "T") == 0) {
+        if (trace_state(trace) != TRACE_ARMED) {
+            return false;
+        }
+        trace_trigger(trace);
+        return true;
+    }
+    if (strcmp(value, "D") == 0) {
+        /* streamed by the background after the ok */
+        return trace_dump_begin(trace);
+    }
+    if (strcmp(value, "X") == 0) {
+        trace_stop(trace);
+        return true;
+    }
+    return false;
+}
+
+static bool parse_percent(const char *value, uint16_t *percent)
+{
+    char *end = NULL;
+    unsigned long parsed = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || parsed > 0xFFFFUL) {
+        return false;
+    }
+    *percent = (uint16_t)parsed;
+    return true;
+}
+
+static bool realtime_handler(uint8_t byte, void *context)
+{
+    return console_realtime((console_t *)context, byte);
+}
+
+static bool set_cycle(console_t *console, const char *value)
+{
+    char *end = NULL;
+    unsigned long period_us = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || !motion_controller_set_period(console->motion, (uint32_t)period_us)) {
+        return false;
+    }
+    console->config->control_period_us = (uint32_t)period_us;
+    return true;
+}
+
+void console_init(console_t *console, command_queue_t *queue, ethcat_master_t *master, motion_controller_t *motion, board_runtime_config_t *config)
+{
+    console->queue = queue;
+    console->master = master;
+    console->motion = motion;
+    console->config = config;
+    console->scheduler = NULL;
+    console->trace = NULL;
+    console->teach_closing = false;
+    console->line[0] = '\0';
+    uart_set_realtime_handler(realtime_handler, console);
+}
+
+void console_set_scheduler(console_t *console, scheduler_t *scheduler)
+{
+    console->scheduler = scheduler;
+}
+
+void console_set_trace(console_t *console, trace_t *trace)
+{
+    console->trace = trace;
+}
+
+static void report_rejected(command_queue_t *queue)
+{
+    /* moves are checked when the processor queues them, after the line was acknowledged */
+    switch (queue->error) {
+    case PLANNER_ERROR_NONE:
+        return;
+    case PLANNER_ERROR_UNREACHABLE:
+        reply_error(CONSOLE_ERROR_UNREACHABLE);
+        break;
+    case PLANNER_ERROR_SINGULAR:
+        reply_error(CONSOLE_ERROR_SINGULAR);
+        break;
+    case PLANNER_ERROR_QUEUE_FULL:
+    default:
+        reply_error(CONSOLE_ERROR_QUEUE_FULL);
+        break;
+    }
+    queue->error = PLANNER_ERROR_NONE;
+}
+
+void console_poll(console_t *console)
+{
+    report_rejected(console->queue);
+    if (console->teach_closing && console->queue->head == console->queue->tail) {
+        /* every taught line reached the planner, the tick closes once it settles */
+        motion_controller_end_teach(console->motion);
+        console->teach_closing = false;
+    }
+    if (uart_read_line(console->line, (int)sizeof(console->line)) > 0) {
+        console_execute(console, console->line);
+    }
+}
+
+bool console_realtime(console_t *console, uint8_t byte)
+{
+    planner_queue_t *planner = console->motion->planner;
+    switch (byte) {
+    case CONSOLE_RT_FEED_HOLD:
+        planner_hold(planner);
+        return true;
+    case CONSOLE_RT_CYCLE_START:
+        planner_resume(planner);
+        return true;
+    case CONSOLE_RT_FEED_RESET:
+        planner_set_feed_override(planner, 100U);
+        return true;
+    case CONSOLE_RT_FEED_PLUS_10:
+        planner_set_feed_override(planner, (uint16_t)(planner->feed_override + 10U));
+        return true;
+    case CONSOLE_RT_FEED_MINUS_10:
+        planner_set_feed_override(planner, (uint16_t)(planner->feed_override - 10U));
+        return true;
+    case CONSOLE_RT_FEED_PLUS_1:
+        planner_set_feed_override(planner, (uint16_t)(planner->feed_override + 1U));
+        return true;
+    case CONSOLE_RT_FEED_MINUS_1:
+        planner_set_feed_override(planner, (uint16_t)(planner->feed_override - 1U));
+        return true;
+    case CONSOLE_RT_RAPID_100:
+        planner_set_rapid_override(planner, 100U);
+        return true;
+    case CONSOLE_RT_RAPID_50:
+        planner_set_rapid_override(planner, 50U);
+        return true;
+    case CONSOLE_RT_RAPID_25:
+        planner_set_rapid_override(planner, 25U);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool console_execute(console_t *console, const char *line)
+{
+    if (strncmp(line, "$ECAT", 5) == 0) {
+        if (strcmp(line + 5, "?") == 0) {
+            report_ecat(console->master, console->motion);
+        } else if (strcmp(line + 5, "=R") == 0) {
+            cycle_stats_request_reset(&console->master->stats);
+        } else {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (strcmp(line, "$SAVE") == 0) {
+        /* a save may compact inline, and a page erase stalls the core for tens of ms */
+        if (console->motion->drives_ready || !storage_save(console->config)) {
+            reply_error(CONSOLE_ERROR_STORAGE);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$TASK", 5) == 0) {
+        if (console->scheduler == NULL) {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        }
+        if (strcmp(line + 5, "?") == 0) {
+            report_tasks(console->scheduler);
+        } else if (strcmp(line + 5, "=R") == 0) {
+            scheduler_reset_stats(console->scheduler);
+        } else {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$TEACH", 6) == 0) {
+        if (strcmp(line + 6, "?") == 0) {
+            report_teach(&console->motion->replay);
+        } else if (!teach(console, line + 6)) {
+            reply_error(CONSOLE_ERROR_REPLAY);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$TRACE", 6) == 0) {
+        if (console->trace == NULL) {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        }
+        if (strcmp(line + 6, "?") == 0) {
+            report_trace(console->trace);
+        } else if (line[6] != '=' || !trace_command(console, line + 7)) {
+            reply_error(CONSOLE_ERROR_TRACE);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$REPLAY=", 8) == 0) {
+        if (!replay(console, line + 8)) {
+            reply_error(CONSOLE_ERROR_REPLAY);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    /* feed hold and resume bypass the command queue, queued lines stay planned */
+    if (strcmp(line, "!") == 0) {
+        planner_hold(console->motion->planner);
+        reply_ok();
+        return true;
+    }
+    if (strcmp(line, "~") == 0) {
+        planner_resume(console->motion->planner);
+        reply_ok();
+        return true;
+    }
+    if (strcmp(line, "$OV?") == 0) {
+        report_overrides(console);
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$FO=", 4) == 0 || strncmp(line, "$RO=", 4) == 0) {
+        uint16_t percent;
+        if (!parse_percent(line + 4, &percent)) {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        }
+        if (line[1] == 'F') {
+            planner_set_feed_override(console->motion->planner, percent);
+        } else {
+            planner_set_rapid_override(console->motion->planner, percent);
+        }
+        reply_ok();
+        return true;
+    }
+    if (strcmp(line, "$PRB?") == 0) {
+        report_probe(console);
+        reply_ok();
+        return true;
+    }
+    if (strncmp(line, "$CYCLE", 6) == 0) {
+        if (strcmp(line + 6, "?") == 0) {
+            report_cycle(console);
+        } else if (line[6] != '=') {
+            reply_error(CONSOLE_ERROR_UNKNOWN_COMMAND);
+            return false;
+        } else if (!set_cycle(console, line + 7)) {
+            reply_error(CONSOLE_ERROR_PERIOD_REJECTED);
+            return false;
+        }
+        reply_ok();
+        return true;
+    }
+    if (!command_queue_enqueue(console->queue, line)) {
+        reply_error(CONSOLE_ERROR_QUEUE_FULL);
+        return false;
+    }
+    if (replay_teaching(&console->motion->replay) && !console->teach_closing) {
+        replay_add_line(&console->motion->replay, line);
+    }
+    reply_ok();
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef GCODE_CONSOLE_H
+#define GCODE_CONSOLE_H
+
+#include <stdbool.h>
+#include "core/command_processor.h"
+#include "ethcat/master.h"
+#include "motion/motion_control.h"
+#include "motion/trace.h"
+#include "core/scheduler.h"
+
+#define CONSOLE_ERROR_QUEUE_FULL 1
+#define CONSOLE_ERROR_UNKNOWN_COMMAND 2
+#define CONSOLE_ERROR_PERIOD_REJECTED 3
+#define CONSOLE_ERROR_UNREACHABLE 4
+#define CONSOLE_ERROR_SINGULAR 5
+#define CONSOLE_ERROR_STORAGE 6
+#define CONSOLE_ERROR_REPLAY 7
+#define CONSOLE_ERROR_TRACE 8
+
+/* realtime bytes, handled in the UART receive path without the command queue */
+#define CONSOLE_RT_FEED_HOLD '!'
+#define CONSOLE_RT_CYCLE_START '~'
+#define CONSOLE_RT_FEED_RESET 0x90U
+#define CONSOLE_RT_FEED_PLUS_10 0x91U
+#define CONSOLE_RT_FEED_MINUS_10 0x92U
+#define CONSOLE_RT_FEED_PLUS_1 0x93U
+#define CONSOLE_RT_FEED_MINUS_1 0x94U
+#define CONSOLE_RT_RAPID_100 0x95U
+#define CONSOLE_RT_RAPID_50 0x96U
+#define CONSOLE_RT_RAPID_25 0x97U
+
+typedef struct {
+    command_queue_t *queue;
+    ethcat_master_t *master;
+    motion_controller_t *motion;
+    board_runtime_config_t *config;
+    scheduler_t *scheduler; /* superloop tasks for $TASK, may be NULL */
+    trace_t *trace;         /* scope capture for $TRACE, may be NULL */
+    bool teach_closing;     /* $TEACH=E seen, the recording closes once the queue drains */
+    char line[COMMAND_MAX_LENGTH];
+} console_t;
+
+void console_init(console_t *console, command_queue_t *queue, ethcat_master_t *master, motion_controller_t *motion, board_runtime_config_t *config);
+void console_set_scheduler(console_t *console, scheduler_t *scheduler);
+void console_set_trace(console_t *console, trace_t *trace);
+void console_poll(console_t *console);
+bool console_execute(console_t *console, const char *line);
+bool console_realtime(console_t *console, uint8_t byte);
+
+#endif
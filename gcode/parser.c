@@ -23,7 +23,11 @@ void gcode_parser_init(gcode_parser_t *parser)
     parser->absolute_positioning = true;
     parser->units_inch = false;
     parser->current_feedrate = q16_16_from_float(50.0f);
+    parser->path_accel = q16_16_from_float(GCODE_DEFAULT_ACCEL);
+    parser->path_jerk = q16_16_from_float(GCODE_DEFAULT_JERK);
     parser->last_dwell_ms = 0;
+    parser->pose_sync = false;
+    parser->arc.next = 0;
     for (int i = 0; i < 3; ++i) {
         parser->current_pose.xyz[i] = 0;
     }
@@ -51,9 +55,43 @@ static q16_16_t convert_units(const gcode_parser_t *parser, float value)
     return float_to_q(value * scale);
 }
 
+static gcode_event_t queue_arc(gcode_parser_t *parser, planner_queue_t *planner)
+{
+    gcode_arc_t *arc = &parser->arc;
+    for (; arc->next <= arc->segments; ++arc->next) {
+        float angle = arc->start_angle + arc->sweep * ((float)arc->next / (float)arc->segments);
+        delta_pose_t target = parser->current_pose;
+        target.xyz[0] = float_to_q(arc->center_x + cosf(angle) * arc->radius);
+        target.xyz[1] = float_to_q(arc->center_y + sinf(angle) * arc->radius);
+        if (!planner_push_line(planner, &target, parser->current_feedrate, parser->path_accel, parser->path_jerk)) {
+            if (planner->error == PLANNER_ERROR_QUEUE_FULL) {
+                /* back-pressure, not an error: the rest follows once the planner drains */
+                return GCODE_EVENT_BUSY;
+            }
+            /* segments already queued run, the pose stays where they end */
+            arc->next = 0;
+            return GCODE_EVENT_REJECTED;
+        }
+        parser->current_pose = target;
+    }
+    arc->next = 0;
+    return GCODE_EVENT_NONE;
+}
+
+bool gcode_parser_busy(const gcode_parser_t *parser)
+{
+    return parser->arc.next != 0;
+}
+
+gcode_event_t gcode_parser_resume(gcode_parser_t *parser, planner_queue_t *planner)
+{
+    return gcode_parser_busy(parser) ? queue_arc(parser, planner) : GCODE_EVENT_NONE;
+}
+
 gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line, planner_queue_t *planner)
 {
     int g_code = -1;
+    int g_subcode = 0;
     int m_code = -1;
     float values[8] = {0};
     bool has_value[8] = {false};
@@ -70,7 +108,9 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
         char letter = (char)toupper((unsigned char)line[i]);
         ++i;
         if (letter == 'G') {
-            g_code = (int)parse_float(line, &i);
+            float g_value = parse_float(line, &i);
+            g_code = (int)g_value;
+            g_subcode = (int)((g_value - (float)g_code) * 10.0f + 0.5f);
         } else if (letter == 'M') {
             m_code = (int)parse_float(line, &i);
         } else if (letter == 'X') {
@@ -97,6 +137,12 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
         } else if (letter == 'S') {
             values[4] = parse_float(line, &i);
             has_value[4] = true;
+        } else if (letter == 'H') {
+            values[5] = parse_float(line, &i);
+            has_value[5] = true;
+        } else if (letter == 'R') {
+            values[6] = parse_float(line, &i);
+            has_value[6] = true;
         } else if (letter == 'P') {
             dwell_time = parse_float(line, &i);
         } else {
@@ -110,24 +156,53 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
         parser->current_feedrate = convert_units(parser, values[3] / 60.0f);
     }
 
+    delta_pose_t target = parser->current_pose;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (has_value[axis]) {
+            q16_16_t delta = convert_units(parser, values[axis]);
+            if (parser->absolute_positioning) {
+                target.xyz[axis] = delta;
+            } else {
+                target.xyz[axis] += delta;
+            }
+        }
+    }
+
     switch (g_code) {
     case 0:
-    case 1: {
-        delta_pose_t target = parser->current_pose;
-        for (int axis = 0; axis < 3; ++axis) {
-            if (has_value[axis]) {
-                q16_16_t delta = convert_units(parser, values[axis]);
-                if (parser->absolute_positioning) {
-                    target.xyz[axis] = delta;
-                } else {
-                    target.xyz[axis] += delta;
-                }
-            }
+        if (!planner_push_rapid(planner, &target, parser->current_feedrate, parser->path_accel, parser->path_jerk)) {
+            return GCODE_EVENT_REJECTED;
         }
-        planner_push_line(planner, &target, parser->current_feedrate, q16_16_from_float(1.0f), q16_16_from_float(5.0f));
         parser->current_pose = target;
         return GCODE_EVENT_NONE;
-    }
+    case 1:
+        if (!planner_push_line(planner, &target, parser->current_feedrate, parser->path_accel, parser->path_jerk)) {
+            return GCODE_EVENT_REJECTED;
+        }
+        parser->current_pose = target;
+        return GCODE_EVENT_NONE;
+    case 100:
+        /* pick-and-place arch: lift by H, traverse, lower onto the target, corners blended over R */
+        if (!has_value[5]) {
+            return GCODE_EVENT_NONE;
+        }
+        if (!planner_push_arch(planner, &target, convert_units(parser, values[5]), convert_units(parser, has_value[6] ? values[6] : 0.0f),
+                               parser->current_feedrate, parser->path_accel, parser->path_jerk)) {
+            return GCODE_EVENT_REJECTED;
+        }
+        parser->current_pose = target;
+        return GCODE_EVENT_NONE;
+    case 38:
+        /* G38.2 alarms when nothing is touched, G38.3 does not */
+        if (g_subcode != 2 && g_subcode != 3) {
+            return GCODE_EVENT_NONE;
+        }
+        if (!planner_push_probe(planner, &target, parser->current_feedrate, parser->path_accel, parser->path_jerk, g_subcode == 2)) {
+            return GCODE_EVENT_REJECTED;
+        }
+        parser->current_pose = target;
+        parser->pose_sync = true;
+        return GCODE_EVENT_PROBE;
     case 2:
     case 3: {
         float dir = (g_code == 2) ? -1.0f : 1.0f;
@@ -158,15 +233,8 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
         if (segments < 1) {
             segments = 1;
         }
-        for (int seg = 1; seg <= segments; ++seg) {
-            float angle = start_angle + sweep * ((float)seg / (float)segments);
-            delta_pose_t target = parser->current_pose;
-            target.xyz[0] = float_to_q(center_x + cosf(angle) * radius);
-            target.xyz[1] = float_to_q(center_y + sinf(angle) * radius);
-            planner_push_line(planner, &target, parser->current_feedrate, q16_16_from_float(1.0f), q16_16_from_float(5.0f));
-            parser->current_pose = target;
-        }
-        return GCODE_EVENT_NONE;
+        parser->arc = (gcode_arc_t){center_x, center_y, radius, start_angle, sweep, segments, 1};
+        return queue_arc(parser, planner);
     }
     case 4:
         parser->last_dwell_ms = float_to_q(dwell_time * 1000.0f);
@@ -194,6 +262,14 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
         return GCODE_EVENT_DISABLE_DRIVES;
     case 112:
         return GCODE_EVENT_ESTOP;
+    case 200:
+        /* later moves are relative to the belt, starting where the tool is now */
+        planner_track_conveyor(planner, true);
+        return GCODE_EVENT_NONE;
+    case 201:
+        planner_track_conveyor(planner, false);
+        parser->pose_sync = true;
+        return GCODE_EVENT_NONE;
     default:
         break;
     }
@@ -206,3 +282,15 @@ gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line
 
     return GCODE_EVENT_NONE;
 }
+
+void gcode_parser_set_limits(gcode_parser_t *parser, q16_16_t accel, q16_16_t jerk)
+{
+    parser->path_accel = accel;
+    parser->path_jerk = jerk;
+}
+
+void gcode_parser_sync_pose(gcode_parser_t *parser, const delta_pose_t *pose)
+{
+    parser->current_pose = *pose;
+    parser->pose_sync = false;
+}
@@ -4,23 +4,49 @@
 #include <stdbool.h>
 #include "planner/planner.h"
 
+/* Cartesian caps of queued moves until the board sets its own, m/s^2 and m/s^3 */
+#define GCODE_DEFAULT_ACCEL 1.0f
+#define GCODE_DEFAULT_JERK 5.0f
+
 typedef enum {
     GCODE_EVENT_NONE = 0,
     GCODE_EVENT_ENABLE_DRIVES,
     GCODE_EVENT_DISABLE_DRIVES,
     GCODE_EVENT_ESTOP,
-    GCODE_EVENT_DWELL
+    GCODE_EVENT_DWELL,
+    GCODE_EVENT_PROBE,
+    GCODE_EVENT_REJECTED, /* the planner refused the move, see planner->error */
+    GCODE_EVENT_BUSY      /* the planner queue filled mid-line, gcode_parser_resume() continues it */
 } gcode_event_t;
 
+/* a G2/G3 split into line segments, kept while the planner queue is full */
+typedef struct {
+    float center_x;
+    float center_y;
+    float radius;
+    float start_angle;
+    float sweep;
+    int segments;
+    int next; /* first segment not queued yet, 0 when no arc is pending */
+} gcode_arc_t;
+
 typedef struct {
     bool absolute_positioning;
     bool units_inch;
     q16_16_t current_feedrate;
+    q16_16_t path_accel; /* the joint limits in the planner usually bind first */
+    q16_16_t path_jerk;
     delta_pose_t current_pose;
     q16_16_t last_dwell_ms;
+    bool pose_sync; /* current_pose is provisional until a probe move or belt release completes */
+    gcode_arc_t arc;
 } gcode_parser_t;
 
 void gcode_parser_init(gcode_parser_t *parser);
 gcode_event_t gcode_parser_process_line(gcode_parser_t *parser, const char *line, planner_queue_t *planner);
+bool gcode_parser_busy(const gcode_parser_t *parser);
+gcode_event_t gcode_parser_resume(gcode_parser_t *parser, planner_queue_t *planner);
+void gcode_parser_set_limits(gcode_parser_t *parser, q16_16_t accel, q16_16_t jerk);
+void gcode_parser_sync_pose(gcode_parser_t *parser, const delta_pose_t *pose);
 
 #endif
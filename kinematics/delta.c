@@ -49,39 +49,54 @@ static bool delta_calc_angle(float x0, float y0, float z0, float *theta)
     return true;
 }
 
-bool delta_inverse_kinematics(const delta_pose_t *cart, delta_joint_t *joints)
+static bool joint_angles(float x, float y, float z, float theta[3])
 {
-    if (!delta_within_workspace(cart)) {
+    if (!delta_calc_angle(x, y, z, &theta[0])) {
         return false;
     }
-
-    float x = q_to_float(cart->xyz[0]);
-    float y = q_to_float(cart->xyz[1]);
-    float z = q_to_float(cart->xyz[2]) + q_to_float(s_cfg.z_offset);
-
-    float theta0, theta1, theta2;
-    if (!delta_calc_angle(x, y, z, &theta0)) {
+    if (!delta_calc_angle(x * COS120 + y * SIN120, -x * SIN120 + y * COS120, z, &theta[1])) {
         return false;
     }
-    float x1 = x * COS120 + y * SIN120;
-    float y1 = -x * SIN120 + y * COS120;
-    if (!delta_calc_angle(x1, y1, z, &theta1)) {
+    return delta_calc_angle(x * COS120 - y * SIN120, x * SIN120 + y * COS120, z, &theta[2]);
+}
+
+bool delta_inverse_kinematics(const delta_pose_t *cart, delta_joint_t *joints)
+{
+    if (!delta_within_workspace(cart)) {
         return false;
     }
-    float x2 = x * COS120 - y * SIN120;
-    float y2 = x * SIN120 + y * COS120;
-    if (!delta_calc_angle(x2, y2, z, &theta2)) {
+
+    float theta[3];
+    if (!joint_angles(q_to_float(cart->xyz[0]), q_to_float(cart->xyz[1]), q_to_float(cart->xyz[2]) + q_to_float(s_cfg.z_offset), theta)) {
         return false;
     }
-
-    joints->theta[0] = float_to_q(theta0);
-    joints->theta[1] = float_to_q(theta1);
-    joints->theta[2] = float_to_q(theta2);
+    joints->theta[0] = float_to_q(theta[0]);
+    joints->theta[1] = float_to_q(theta[1]);
+    joints->theta[2] = float_to_q(theta[2]);
     s_last_pose = *cart;
     return true;
 }
 
-
+bool delta_path_derivatives(const float xyz[3], const float direction[3], float step, float first[3], float second[3])
+{
+    /* central differences of the inverse kinematics along the path: the inverse
+     * Jacobian applied to the direction, and the change of that along the path.
+     * Float throughout, the Q16.16 joint resolution is too coarse for the second */
+    float z = xyz[2] + q_to_float(s_cfg.z_offset);
+    float behind[3];
+    float here[3];
+    float ahead[3];
+    if (!joint_angles(xyz[0], xyz[1], z, here) ||
+        !joint_angles(xyz[0] - direction[0] * step, xyz[1] - direction[1] * step, z - direction[2] * step, behind) ||
+        !joint_angles(xyz[0] + direction[0] * step, xyz[1] + direction[1] * step, z + direction[2] * step, ahead)) {
+        return false;
+    }
+    for (int j = 0; j < 3; ++j) {
+        first[j] = (ahead[j] - behind[j]) / (2.0f * step);
+        second[j] = (ahead[j] - 2.0f * here[j] + behind[j]) / (step * step);
+    }
+    return true;
+}
 
 static bool solve_linear3(float A[3][3], const float b[3], float x[3])
 {
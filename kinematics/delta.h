@@ -31,6 +31,7 @@ typedef struct {
 void delta_init(const delta_cfg_t *cfg);
 bool delta_inverse_kinematics(const delta_pose_t *cart, delta_joint_t *joints);
 bool delta_forward_kinematics(const delta_joint_t *joints, delta_pose_t *cart);
+bool delta_path_derivatives(const float xyz[3], const float direction[3], float step, float first[3], float second[3]);
 void delta_compute_jacobian(const delta_joint_t *joints, delta_jacobian_t *out);
 bool delta_within_workspace(const delta_pose_t *cart);
 
@@ -0,0 +1,339 @@
+#define _POSIX_C_SOURCE 200809L
+#include "delta_batch.h"
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DELTA_BATCH_X86 1
+#else
+#define DELTA_BATCH_X86 0
+#endif
+
+typedef size_t (*batch_kernel_t)(const void *geometry, const void *const in[3], void *const out[3], uint8_t *valid, size_t begin, size_t end);
+
+#define DB_CONCAT_(name, suffix) name##_##suffix
+#define DB_CONCAT(name, suffix) DB_CONCAT_(name, suffix)
+
+/* portable reference: one lane, the masks are 0 or 1 */
+#define DB_TARGET
+#define DB_MASK_OR(a, b) ((a) != (DB_T)0 || (b) != (DB_T)0 ? (DB_T)1 : (DB_T)0)
+#define DB_BLEND(m, a, b) ((m) != (DB_T)0 ? (a) : (b))
+#define DB_T float
+#define DB_V float
+#define DB_LANES 1
+#define DB_DOUBLE 0
+#define DB_ATAN_MID 0.4142135623730950
+#define DB_GEOMETRY delta_batch_geometry_f32_t
+#define DB_SET1(a) ((DB_T)(a))
+#define DB_LOAD(p) (*(p))
+#define DB_STORE(p, v) (*(p) = (v))
+#define DB_ADD(a, b) ((a) + (b))
+#define DB_SUB(a, b) ((a) - (b))
+#define DB_MUL(a, b) ((a) * (b))
+#define DB_DIV(a, b) ((a) / (b))
+#define DB_SQRT(a) sqrtf(a)
+#define DB_LT(a, b) ((a) < (b) ? (DB_T)1 : (DB_T)0)
+#define DB_GT(a, b) ((a) > (b) ? (DB_T)1 : (DB_T)0)
+#define DB_NGE(a, b) (!((a) >= (b)) ? (DB_T)1 : (DB_T)0)
+#define DB_MASKBITS(m) ((m) != (DB_T)0 ? 1 : 0)
+#define DB_COS(a) cosf(a)
+#define DB_SIN(a) sinf(a)
+#define DB_NAME(name) DB_CONCAT(name, scalar_f32)
+#include "delta_batch_kernel.h"
+
+#define DB_T double
+#define DB_V double
+#define DB_LANES 1
+#define DB_DOUBLE 1
+#define DB_ATAN_MID 0.66
+#define DB_GEOMETRY delta_batch_geometry_f64_t
+#define DB_SET1(a) ((DB_T)(a))
+#define DB_LOAD(p) (*(p))
+#define DB_STORE(p, v) (*(p) = (v))
+#define DB_ADD(a, b) ((a) + (b))
+#define DB_SUB(a, b) ((a) - (b))
+#define DB_MUL(a, b) ((a) * (b))
+#define DB_DIV(a, b) ((a) / (b))
+#define DB_SQRT(a) sqrt(a)
+#define DB_LT(a, b) ((a) < (b) ? (DB_T)1 : (DB_T)0)
+#define DB_GT(a, b) ((a) > (b) ? (DB_T)1 : (DB_T)0)
+#define DB_NGE(a, b) (!((a) >= (b)) ? (DB_T)1 : (DB_T)0)
+#define DB_MASKBITS(m) ((m) != (DB_T)0 ? 1 : 0)
+#define DB_COS(a) cos(a)
+#define DB_SIN(a) sin(a)
+#define DB_NAME(name) DB_CONCAT(name, scalar_f64)
+#include "delta_batch_kernel.h"
+#undef DB_TARGET
+#undef DB_MASK_OR
+#undef DB_BLEND
+
+#if DELTA_BATCH_X86
+/* bitwise masks; no FMA, every instance rounds the same way as the portable one */
+#define DB_MASK_OR(a, b) DB_OR(a, b)
+#define DB_BLEND(m, a, b) DB_OR(DB_AND(m, a), DB_ANDNOT(m, b))
+#define DB_OR(a, b) _Generic((a), __m128: _mm_or_ps, __m128d: _mm_or_pd, __m256: _mm256_or_ps, __m256d: _mm256_or_pd)(a, b)
+#define DB_AND(a, b) _Generic((a), __m128: _mm_and_ps, __m128d: _mm_and_pd, __m256: _mm256_and_ps, __m256d: _mm256_and_pd)(a, b)
+#define DB_ANDNOT(m, a) _Generic((m), __m128: _mm_andnot_ps, __m128d: _mm_andnot_pd, __m256: _mm256_andnot_ps, __m256d: _mm256_andnot_pd)(m, a)
+
+#define DB_TARGET __attribute__((target("sse2")))
+#define DB_T float
+#define DB_V __m128
+#define DB_LANES 4
+#define DB_DOUBLE 0
+#define DB_ATAN_MID 0.4142135623730950
+#define DB_GEOMETRY delta_batch_geometry_f32_t
+#define DB_SET1(a) _mm_set1_ps((float)(a))
+#define DB_LOAD(p) _mm_loadu_ps(p)
+#define DB_STORE(p, v) _mm_storeu_ps(p, v)
+#define DB_ADD(a, b) _mm_add_ps(a, b)
+#define DB_SUB(a, b) _mm_sub_ps(a, b)
+#define DB_MUL(a, b) _mm_mul_ps(a, b)
+#define DB_DIV(a, b) _mm_div_ps(a, b)
+#define DB_SQRT(a) _mm_sqrt_ps(a)
+#define DB_LT(a, b) _mm_cmplt_ps(a, b)
+#define DB_GT(a, b) _mm_cmpgt_ps(a, b)
+#define DB_NGE(a, b) _mm_cmpnge_ps(a, b)
+#define DB_MASKBITS(m) _mm_movemask_ps(m)
+#define DB_COS(a) cosf(a)
+#define DB_SIN(a) sinf(a)
+#define DB_NAME(name) DB_CONCAT(name, sse2_f32)
+#include "delta_batch_kernel.h"
+
+#define DB_T double
+#define DB_V __m128d
+#define DB_LANES 2
+#define DB_DOUBLE 1
+#define DB_ATAN_MID 0.66
+#define DB_GEOMETRY delta_batch_geometry_f64_t
+#define DB_SET1(a) _mm_set1_pd((double)(a))
+#define DB_LOAD(p) _mm_loadu_pd(p)
+#define DB_STORE(p, v) _mm_storeu_pd(p, v)
+#define DB_ADD(a, b) _mm_add_pd(a, b)
+#define DB_SUB(a, b) _mm_sub_pd(a, b)
+#define DB_MUL(a, b) _mm_mul_pd(a, b)
+#define DB_DIV(a, b) _mm_div_pd(a, b)
+#define DB_SQRT(a) _mm_sqrt_pd(a)
+#define DB_LT(a, b) _mm_cmplt_pd(a, b)
+#define DB_GT(a, b) _mm_cmpgt_pd(a, b)
+#define DB_NGE(a, b) _mm_cmpnge_pd(a, b)
+#define DB_MASKBITS(m) _mm_movemask_pd(m)
+#define DB_COS(a) cos(a)
+#define DB_SIN(a) sin(a)
+#define DB_NAME(name) DB_CONCAT(name, sse2_f64)
+#include "delta_batch_kernel.h"
+#undef DB_TARGET
+
+#define DB_TARGET __attribute__((target("avx2")))
+#define DB_T float
+#define DB_V __m256
+#define DB_LANES 8
+#define DB_DOUBLE 0
+#define DB_ATAN_MID 0.4142135623730950
+#define DB_GEOMETRY delta_batch_geometry_f32_t
+#define DB_SET1(a) _mm256_set1_ps((float)(a))
+#define DB_LOAD(p) _mm256_loadu_ps(p)
+#define DB_STORE(p, v) _mm256_storeu_ps(p, v)
+#define DB_ADD(a, b) _mm256_add_ps(a, b)
+#define DB_SUB(a, b) _mm256_sub_ps(a, b)
+#define DB_MUL(a, b) _mm256_mul_ps(a, b)
+#define DB_DIV(a, b) _mm256_div_ps(a, b)
+#define DB_SQRT(a) _mm256_sqrt_ps(a)
+#define DB_LT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define DB_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define DB_NGE(a, b) _mm256_cmp_ps(a, b, _CMP_NGE_UQ)
+#define DB_MASKBITS(m) _mm256_movemask_ps(m)
+#define DB_COS(a) cosf(a)
+#define DB_SIN(a) sinf(a)
+#define DB_NAME(name) DB_CONCAT(name, avx2_f32)
+#include "delta_batch_kernel.h"
+
+#define DB_T double
+#define DB_V __m256d
+#define DB_LANES 4
+#define DB_DOUBLE 1
+#define DB_ATAN_MID 0.66
+#define DB_GEOMETRY delta_batch_geometry_f64_t
+#define DB_SET1(a) _mm256_set1_pd((double)(a))
+#define DB_LOAD(p) _mm256_loadu_pd(p)
+#define DB_STORE(p, v) _mm256_storeu_pd(p, v)
+#define DB_ADD(a, b) _mm256_add_pd(a, b)
+#define DB_SUB(a, b) _mm256_sub_pd(a, b)
+#define DB_MUL(a, b) _mm256_mul_pd(a, b)
+#define DB_DIV(a, b) _mm256_div_pd(a, b)
+#define DB_SQRT(a) _mm256_sqrt_pd(a)
+#define DB_LT(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define DB_GT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define DB_NGE(a, b) _mm256_cmp_pd(a, b, _CMP_NGE_UQ)
+#define DB_MASKBITS(m) _mm256_movemask_pd(m)
+#define DB_COS(a) cos(a)
+#define DB_SIN(a) sin(a)
+#define DB_NAME(name) DB_CONCAT(name, avx2_f64)
+#include "delta_batch_kernel.h"
+#undef DB_TARGET
+
+static const batch_kernel_t s_inverse_f32[] = {inverse_scalar_f32, inverse_sse2_f32, inverse_avx2_f32};
+static const batch_kernel_t s_forward_f32[] = {forward_scalar_f32, forward_sse2_f32, forward_avx2_f32};
+static const batch_kernel_t s_inverse_f64[] = {inverse_scalar_f64, inverse_sse2_f64, inverse_avx2_f64};
+static const batch_kernel_t s_forward_f64[] = {forward_scalar_f64, forward_sse2_f64, forward_avx2_f64};
+#else
+static const batch_kernel_t s_inverse_f32[] = {inverse_scalar_f32};
+static const batch_kernel_t s_forward_f32[] = {forward_scalar_f32};
+static const batch_kernel_t s_inverse_f64[] = {inverse_scalar_f64};
+static const batch_kernel_t s_forward_f64[] = {forward_scalar_f64};
+#endif
+
+static bool isa_supported(delta_batch_isa_t isa)
+{
+    switch (isa) {
+    case DELTA_BATCH_SCALAR:
+        return true;
+#if DELTA_BATCH_X86
+    case DELTA_BATCH_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case DELTA_BATCH_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static double q_to_double(q16_16_t v)
+{
+    return (double)v / 65536.0;
+}
+
+void delta_batch_init(delta_batch_t *batch, const delta_cfg_t *cfg)
+{
+    /* the same geometry as delta_calc_angle(), e and f are twice the radii */
+    const double tan30 = 0.57735026918962576451;
+    double e = 2.0 * q_to_double(cfg->r_eff);
+    double f = 2.0 * q_to_double(cfg->R_base);
+    delta_batch_geometry_f64_t *g = &batch->f64;
+    g->half_tan30_e = 0.5 * tan30 * e;
+    g->base_y = -0.5 * tan30 * f;
+    g->t = 0.5 * tan30 * (f - e);
+    g->upper = q_to_double(cfg->L_upper);
+    g->lower = q_to_double(cfg->L_lower);
+    g->z_offset = q_to_double(cfg->z_offset);
+    for (int axis = 0; axis < 3; ++axis) {
+        g->soft_min[axis] = q_to_double(cfg->soft_xyz_min[axis]);
+        g->soft_max[axis] = q_to_double(cfg->soft_xyz_max[axis]);
+    }
+    batch->f32.half_tan30_e = (float)g->half_tan30_e;
+    batch->f32.base_y = (float)g->base_y;
+    batch->f32.t = (float)g->t;
+    batch->f32.upper = (float)g->upper;
+    batch->f32.lower = (float)g->lower;
+    batch->f32.z_offset = (float)g->z_offset;
+    for (int axis = 0; axis < 3; ++axis) {
+        batch->f32.soft_min[axis] = (float)g->soft_min[axis];
+        batch->f32.soft_max[axis] = (float)g->soft_max[axis];
+    }
+
+    batch->isa = DELTA_BATCH_SCALAR;
+    for (int isa = DELTA_BATCH_AVX2; isa > DELTA_BATCH_SCALAR; --isa) {
+        if (delta_batch_set_isa(batch, (delta_batch_isa_t)isa)) {
+            break;
+        }
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    delta_batch_set_threads(batch, cpus > 0 ? (unsigned)cpus : 1U);
+}
+
+bool delta_batch_set_isa(delta_batch_t *batch, delta_batch_isa_t isa)
+{
+    if (!isa_supported(isa)) {
+        return false;
+    }
+    batch->isa = isa;
+    return true;
+}
+
+void delta_batch_set_threads(delta_batch_t *batch, unsigned threads)
+{
+    batch->threads = threads == 0U ? 1U : (threads > DELTA_BATCH_MAX_THREADS ? DELTA_BATCH_MAX_THREADS : threads);
+}
+
+typedef struct {
+    batch_kernel_t kernel;
+    const void *geometry;
+    const void *const *in;
+    void *const *out;
+    uint8_t *valid;
+    size_t begin;
+    size_t end;
+    size_t valid_count;
+} batch_job_t;
+
+static void *run_job(void *arg)
+{
+    batch_job_t *job = arg;
+    job->valid_count = job->kernel(job->geometry, job->in, job->out, job->valid, job->begin, job->end);
+    return NULL;
+}
+
+static size_t run(const delta_batch_t *batch, batch_kernel_t kernel, const void *geometry, const void *const in[3], void *const out[3], uint8_t *valid, size_t count)
+{
+    size_t threads = count / DELTA_BATCH_MIN_CHUNK;
+    if (threads > batch->threads) {
+        threads = batch->threads;
+    }
+    if (threads < 1U) {
+        threads = 1U;
+    }
+    /* whole lane groups per thread, only the last chunk has a tail */
+    size_t chunk = ((count + threads - 1U) / threads + 7U) & ~(size_t)7U;
+
+    batch_job_t jobs[DELTA_BATCH_MAX_THREADS];
+    pthread_t ids[DELTA_BATCH_MAX_THREADS];
+    bool started[DELTA_BATCH_MAX_THREADS];
+    for (size_t t = 0U; t < threads; ++t) {
+        size_t begin = t * chunk < count ? t * chunk : count;
+        size_t end = begin + chunk < count ? begin + chunk : count;
+        jobs[t] = (batch_job_t){kernel, geometry, in, out, valid, begin, end, 0U};
+        /* the calling thread takes the first chunk, a failed spawn runs inline */
+        started[t] = t > 0U && pthread_create(&ids[t], NULL, run_job, &jobs[t]) == 0;
+    }
+    run_job(&jobs[0]);
+    size_t total = jobs[0].valid_count;
+    for (size_t t = 1U; t < threads; ++t) {
+        if (started[t]) {
+            pthread_join(ids[t], NULL);
+        } else {
+            run_job(&jobs[t]);
+        }
+        total += jobs[t].valid_count;
+    }
+    return total;
+}
+
+size_t delta_batch_inverse_f32(const delta_batch_t *batch, const float *const xyz[3], float *const theta[3], uint8_t *valid, size_t count)
+{
+    const void *const in[3] = {xyz[0], xyz[1], xyz[2]};
+    void *const out[3] = {theta[0], theta[1], theta[2]};
+    return run(batch, s_inverse_f32[batch->isa], &batch->f32, in, out, valid, count);
+}
+
+size_t delta_batch_forward_f32(const delta_batch_t *batch, const float *const theta[3], float *const xyz[3], uint8_t *valid, size_t count)
+{
+    const void *const in[3] = {theta[0], theta[1], theta[2]};
+    void *const out[3] = {xyz[0], xyz[1], xyz[2]};
+    return run(batch, s_forward_f32[batch->isa], &batch->f32, in, out, valid, count);
+}
+
+size_t delta_batch_inverse_f64(const delta_batch_t *batch, const double *const xyz[3], double *const theta[3], uint8_t *valid, size_t count)
+{
+    const void *const in[3] = {xyz[0], xyz[1], xyz[2]};
+    void *const out[3] = {theta[0], theta[1], theta[2]};
+    return run(batch, s_inverse_f64[batch->isa], &batch->f64, in, out, valid, count);
+}
+
+size_t delta_batch_forward_f64(const delta_batch_t *batch, const double *const theta[3], double *const xyz[3], uint8_t *valid, size_t count)
+{
+    const void *const in[3] = {theta[0], theta[1], theta[2]};
+    void *const out[3] = {xyz[0], xyz[1], xyz[2]};
+    return run(batch, s_forward_f64[batch->isa], &batch->f64, in, out, valid, count);
+}
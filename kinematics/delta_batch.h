@@ -0,0 +1,63 @@
+#ifndef KINEMATICS_DELTA_BATCH_H
+#define KINEMATICS_DELTA_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kinematics/delta.h"
+
+/* Host-only batch kinematics for offline analysis: reachability maps,
+ * workspace scans, job verification. Poses and joints are passed as
+ * structure-of-arrays, x/y/z (m) or theta 0..2 (rad), one array each.
+ * Stateless, the geometry lives in delta_batch_t, not in delta.c */
+
+/* smallest share of a batch worth a thread of its own */
+#define DELTA_BATCH_MIN_CHUNK 4096U
+#define DELTA_BATCH_MAX_THREADS 64U
+
+typedef enum {
+    DELTA_BATCH_SCALAR = 0,
+    DELTA_BATCH_SSE2, /* 4 floats or 2 doubles per lane group */
+    DELTA_BATCH_AVX2  /* 8 floats or 4 doubles */
+} delta_batch_isa_t;
+
+typedef struct {
+    float half_tan30_e; /* effector joint offset along the arm plane */
+    float base_y;       /* shoulder position along the arm plane */
+    float t;            /* shoulder minus effector offset, forward kinematics */
+    float upper;
+    float lower;
+    float z_offset;
+    float soft_min[3];
+    float soft_max[3];
+} delta_batch_geometry_f32_t;
+
+typedef struct {
+    double half_tan30_e;
+    double base_y;
+    double t;
+    double upper;
+    double lower;
+    double z_offset;
+    double soft_min[3];
+    double soft_max[3];
+} delta_batch_geometry_f64_t;
+
+typedef struct {
+    delta_batch_geometry_f32_t f32;
+    delta_batch_geometry_f64_t f64;
+    delta_batch_isa_t isa;
+    unsigned threads;
+} delta_batch_t;
+
+void delta_batch_init(delta_batch_t *batch, const delta_cfg_t *cfg);
+bool delta_batch_set_isa(delta_batch_t *batch, delta_batch_isa_t isa);
+void delta_batch_set_threads(delta_batch_t *batch, unsigned threads);
+
+/* valid[i] is 1 where pose i is inside the soft limits and has a solution,
+ * may be NULL; the return value is the number of valid entries */
+size_t delta_batch_inverse_f32(const delta_batch_t *batch, const float *const xyz[3], float *const theta[3], uint8_t *valid, size_t count);
+size_t delta_batch_forward_f32(const delta_batch_t *batch, const float *const theta[3], float *const xyz[3], uint8_t *valid, size_t count);
+size_t delta_batch_inverse_f64(const delta_batch_t *batch, const double *const xyz[3], double *const theta[3], uint8_t *valid, size_t count);
+size_t delta_batch_forward_f64(const delta_batch_t *batch, const double *const theta[3], double *const xyz[3], uint8_t *valid, size_t count);
+
+#endif
@@ -0,0 +1,247 @@
+/* Kernel template of delta_batch.c, included once per instruction set and
+ * precision. The includer defines DB_T (scalar), DB_V (vector), DB_LANES,
+ * DB_DOUBLE, DB_GEOMETRY, DB_NAME(), DB_TARGET and the DB_* operations;
+ * masks are vectors, DB_BLEND(m, a, b) picks a where m is set, DB_NGE is
+ * true for NaN. The
+ * per-instance parameters are undefined at the end, DB_TARGET, DB_BLEND and
+ * DB_MASK_OR are left to the includer. No include guard on purpose. */
+
+static DB_TARGET DB_V DB_NAME(atan)(DB_V x)
+{
+    DB_V zero = DB_SET1(0.0);
+    DB_V one = DB_SET1(1.0);
+    DB_V negative = DB_LT(x, zero);
+    DB_V ax = DB_BLEND(negative, DB_SUB(zero, x), x);
+    /* Cephes range reduction: atan x = pi/4 + atan((x - 1) / (x + 1)) = pi/2 + atan(-1 / x) */
+    DB_V mid = DB_GT(ax, DB_SET1(DB_ATAN_MID));
+    DB_V big = DB_GT(ax, DB_SET1(2.41421356237309504880));
+    DB_V arg = DB_BLEND(mid, DB_DIV(DB_SUB(ax, one), DB_ADD(ax, one)), ax);
+    arg = DB_BLEND(big, DB_DIV(DB_SUB(zero, one), ax), arg);
+    DB_V base = DB_BLEND(mid, DB_SET1(0.78539816339744830962), zero);
+    base = DB_BLEND(big, DB_SET1(1.57079632679489661923), base);
+    DB_V z = DB_MUL(arg, arg);
+#if DB_DOUBLE
+    DB_V p = DB_SET1(-8.750608600031904122785e-1);
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-1.615753718733365076637e1));
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-7.500855792314704667340e1));
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-1.228866684490136173410e2));
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-6.485021904942025371773e1));
+    DB_V q = DB_ADD(z, DB_SET1(2.485846490142306297962e1));
+    q = DB_ADD(DB_MUL(q, z), DB_SET1(1.650270098316988542046e2));
+    q = DB_ADD(DB_MUL(q, z), DB_SET1(4.328810604912902668951e2));
+    q = DB_ADD(DB_MUL(q, z), DB_SET1(4.853903996359136964868e2));
+    q = DB_ADD(DB_MUL(q, z), DB_SET1(1.945506571482613964425e2));
+    DB_V y = DB_ADD(arg, DB_MUL(DB_MUL(arg, z), DB_DIV(p, q)));
+    /* the low bits of pi/4 and pi/2 */
+    DB_V tail = DB_BLEND(mid, DB_SET1(3.061616997868382943065e-17), zero);
+    y = DB_ADD(y, DB_BLEND(big, DB_SET1(6.123233995736765886130e-17), tail));
+#else
+    DB_V p = DB_SET1(8.05374449538e-2);
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-1.38776856032e-1));
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(1.99777106478e-1));
+    p = DB_ADD(DB_MUL(p, z), DB_SET1(-3.33329491539e-1));
+    DB_V y = DB_ADD(arg, DB_MUL(DB_MUL(p, z), arg));
+#endif
+    DB_V result = DB_ADD(base, y);
+    return DB_BLEND(negative, DB_SUB(zero, result), result);
+}
+
+/* delta_calc_angle() of delta.c, lanes without a solution are flagged in *bad */
+static DB_TARGET DB_V DB_NAME(arm_angle)(const DB_GEOMETRY *g, DB_V x0, DB_V y0, DB_V z0, DB_V *bad)
+{
+    DB_V y1 = DB_SET1(g->base_y);
+    DB_V rf = DB_SET1(g->upper);
+    DB_V re = DB_SET1(g->lower);
+    DB_V one = DB_SET1(1.0);
+    y0 = DB_SUB(y0, DB_SET1(g->half_tan30_e));
+
+    DB_V sum = DB_ADD(DB_ADD(DB_MUL(x0, x0), DB_MUL(y0, y0)), DB_MUL(z0, z0));
+    sum = DB_SUB(DB_SUB(DB_ADD(sum, DB_MUL(rf, rf)), DB_MUL(re, re)), DB_MUL(y1, y1));
+    DB_V a = DB_DIV(sum, DB_MUL(DB_SET1(2.0), z0));
+    DB_V b = DB_DIV(DB_SUB(y1, y0), z0);
+    DB_V bb1 = DB_ADD(DB_MUL(b, b), one);
+    DB_V ab = DB_ADD(a, DB_MUL(b, y1));
+    DB_V discr = DB_SUB(DB_MUL(rf, DB_MUL(rf, bb1)), DB_MUL(ab, ab));
+    /* NaN counts as no solution */
+    DB_V unreachable = DB_NGE(discr, DB_SET1(0.0));
+    *bad = DB_MASK_OR(*bad, unreachable);
+    discr = DB_BLEND(unreachable, DB_SET1(0.0), discr);
+
+    DB_V yj = DB_DIV(DB_SUB(DB_SUB(y1, DB_MUL(a, b)), DB_SQRT(discr)), bb1);
+    DB_V zj = DB_ADD(a, DB_MUL(b, yj));
+    return DB_NAME(atan)(DB_DIV(DB_SUB(DB_SET1(0.0), zj), DB_SUB(y1, yj)));
+}
+
+static DB_TARGET DB_V DB_NAME(outside)(const DB_GEOMETRY *g, const DB_V xyz[3])
+{
+    DB_V bad = DB_SET1(0.0);
+    for (int axis = 0; axis < 3; ++axis) {
+        bad = DB_MASK_OR(bad, DB_LT(xyz[axis], DB_SET1(g->soft_min[axis])));
+        bad = DB_MASK_OR(bad, DB_GT(xyz[axis], DB_SET1(g->soft_max[axis])));
+    }
+    return bad;
+}
+
+static DB_TARGET int DB_NAME(inverse_lanes)(const DB_GEOMETRY *g, const DB_T *const in[3], DB_T *const out[3], size_t i, uint8_t *valid)
+{
+    DB_V xyz[3] = {DB_LOAD(in[0] + i), DB_LOAD(in[1] + i), DB_LOAD(in[2] + i)};
+    DB_V bad = DB_NAME(outside)(g, xyz);
+    DB_V x = xyz[0];
+    DB_V y = xyz[1];
+    DB_V z = DB_ADD(xyz[2], DB_SET1(g->z_offset));
+    DB_V c120 = DB_SET1(-0.5);
+    DB_V s120 = DB_SET1(0.8660254037844386);
+    DB_STORE(out[0] + i, DB_NAME(arm_angle)(g, x, y, z, &bad));
+    DB_STORE(out[1] + i, DB_NAME(arm_angle)(g, DB_ADD(DB_MUL(x, c120), DB_MUL(y, s120)), DB_ADD(DB_MUL(DB_SUB(DB_SET1(0.0), x), s120), DB_MUL(y, c120)), z, &bad));
+    DB_STORE(out[2] + i, DB_NAME(arm_angle)(g, DB_SUB(DB_MUL(x, c120), DB_MUL(y, s120)), DB_ADD(DB_MUL(x, s120), DB_MUL(y, c120)), z, &bad));
+    int bits = DB_MASKBITS(bad);
+    int count = 0;
+    for (int lane = 0; lane < DB_LANES; ++lane) {
+        uint8_t ok = ((bits >> lane) & 1) == 0 ? 1U : 0U;
+        if (valid != NULL) {
+            valid[lane] = ok;
+        }
+        count += ok;
+    }
+    return count;
+}
+
+/* the three elbow spheres intersected in closed form, the lower solution */
+static DB_TARGET int DB_NAME(forward_lanes)(const DB_GEOMETRY *g, const DB_T *const in[3], DB_T *const out[3], size_t i, uint8_t *valid)
+{
+    DB_V zero = DB_SET1(0.0);
+    DB_V rf = DB_SET1(g->upper);
+    DB_V t = DB_SET1(g->t);
+    DB_V tan60 = DB_SET1(1.7320508075688772);
+    DB_V theta[3] = {DB_LOAD(in[0] + i), DB_LOAD(in[1] + i), DB_LOAD(in[2] + i)};
+    DB_V reach[3];
+    DB_V height[3];
+    for (int j = 0; j < 3; ++j) {
+        DB_T c[DB_LANES];
+        DB_T s[DB_LANES];
+        DB_T angle[DB_LANES];
+        DB_STORE(angle, theta[j]);
+        for (int lane = 0; lane < DB_LANES; ++lane) {
+            c[lane] = DB_COS(angle[lane]);
+            s[lane] = DB_SIN(angle[lane]);
+        }
+        reach[j] = DB_ADD(t, DB_MUL(rf, DB_LOAD(c)));
+        height[j] = DB_SUB(zero, DB_MUL(rf, DB_LOAD(s)));
+    }
+    DB_V y1 = DB_SUB(zero, reach[0]);
+    DB_V z1 = height[0];
+    DB_V y2 = DB_MUL(reach[1], DB_SET1(0.5));
+    DB_V x2 = DB_MUL(y2, tan60);
+    DB_V z2 = height[1];
+    DB_V y3 = DB_MUL(reach[2], DB_SET1(0.5));
+    DB_V x3 = DB_SUB(zero, DB_MUL(y3, tan60));
+    DB_V z3 = height[2];
+
+    DB_V dnm = DB_SUB(DB_MUL(DB_SUB(y2, y1), x3), DB_MUL(DB_SUB(y3, y1), x2));
+    DB_V w1 = DB_ADD(DB_MUL(y1, y1), DB_MUL(z1, z1));
+    DB_V w2 = DB_ADD(DB_ADD(DB_MUL(x2, x2), DB_MUL(y2, y2)), DB_MUL(z2, z2));
+    DB_V w3 = DB_ADD(DB_ADD(DB_MUL(x3, x3), DB_MUL(y3, y3)), DB_MUL(z3, z3));
+    DB_V a1 = DB_SUB(DB_MUL(DB_SUB(z2, z1), DB_SUB(y3, y1)), DB_MUL(DB_SUB(z3, z1), DB_SUB(y2, y1)));
+    DB_V b1 = DB_MUL(DB_SET1(-0.5), DB_SUB(DB_MUL(DB_SUB(w2, w1), DB_SUB(y3, y1)), DB_MUL(DB_SUB(w3, w1), DB_SUB(y2, y1))));
+    DB_V a2 = DB_ADD(DB_MUL(DB_SUB(zero, DB_SUB(z2, z1)), x3), DB_MUL(DB_SUB(z3, z1), x2));
+    DB_V b2 = DB_MUL(DB_SET1(0.5), DB_SUB(DB_MUL(DB_SUB(w2, w1), x3), DB_MUL(DB_SUB(w3, w1), x2)));
+    DB_V b2y = DB_SUB(b2, DB_MUL(y1, dnm));
+    DB_V dnm2 = DB_MUL(dnm, dnm);
+
+    DB_V a = DB_ADD(DB_ADD(DB_MUL(a1, a1), DB_MUL(a2, a2)), dnm2);
+    DB_V b = DB_MUL(DB_SET1(2.0), DB_SUB(DB_ADD(DB_MUL(a1, b1), DB_MUL(a2, b2y)), DB_MUL(z1, dnm2)));
+    DB_V c = DB_ADD(DB_ADD(DB_MUL(b2y, b2y), DB_MUL(b1, b1)), DB_MUL(dnm2, DB_SUB(DB_MUL(z1, z1), DB_SET1(g->lower * g->lower))));
+    DB_V d = DB_SUB(DB_MUL(b, b), DB_MUL(DB_MUL(DB_SET1(4.0), a), c));
+    DB_V bad = DB_NGE(d, zero);
+    d = DB_BLEND(bad, zero, d);
+
+    DB_V z0 = DB_MUL(DB_SET1(-0.5), DB_DIV(DB_ADD(b, DB_SQRT(d)), a));
+    DB_V xyz[3] = {DB_DIV(DB_ADD(DB_MUL(a1, z0), b1), dnm), DB_DIV(DB_ADD(DB_MUL(a2, z0), b2), dnm), DB_SUB(z0, DB_SET1(g->z_offset))};
+    bad = DB_MASK_OR(bad, DB_NAME(outside)(g, xyz));
+    for (int axis = 0; axis < 3; ++axis) {
+        DB_STORE(out[axis] + i, xyz[axis]);
+    }
+    int bits = DB_MASKBITS(bad);
+    int count = 0;
+    for (int lane = 0; lane < DB_LANES; ++lane) {
+        uint8_t ok = ((bits >> lane) & 1) == 0 ? 1U : 0U;
+        if (valid != NULL) {
+            valid[lane] = ok;
+        }
+        count += ok;
+    }
+    return count;
+}
+
+typedef int (*DB_NAME(lanes_fn))(const DB_GEOMETRY *g, const DB_T *const in[3], DB_T *const out[3], size_t i, uint8_t *valid);
+
+static DB_TARGET size_t DB_NAME(run)(DB_NAME(lanes_fn) lanes, const DB_GEOMETRY *g, const DB_T *const in[3], DB_T *const out[3], uint8_t *valid, size_t begin, size_t end)
+{
+    size_t count = 0U;
+    size_t i = begin;
+    for (; i + DB_LANES <= end; i += DB_LANES) {
+        count += (size_t)lanes(g, in, out, i, valid != NULL ? valid + i : NULL);
+    }
+    if (i == end) {
+        return count;
+    }
+    /* the tail runs through one padded lane group, the padding repeats the last entry */
+    DB_T pad_in[3][DB_LANES];
+    DB_T pad_out[3][DB_LANES];
+    uint8_t pad_valid[DB_LANES];
+    size_t rest = end - i;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (size_t lane = 0U; lane < DB_LANES; ++lane) {
+            pad_in[axis][lane] = in[axis][lane < rest ? i + lane : end - 1U];
+        }
+    }
+    const DB_T *const tail_in[3] = {pad_in[0], pad_in[1], pad_in[2]};
+    DB_T *const tail_out[3] = {pad_out[0], pad_out[1], pad_out[2]};
+    lanes(g, tail_in, tail_out, 0U, pad_valid);
+    for (size_t lane = 0U; lane < rest; ++lane) {
+        for (int axis = 0; axis < 3; ++axis) {
+            out[axis][i + lane] = pad_out[axis][lane];
+        }
+        if (valid != NULL) {
+            valid[i + lane] = pad_valid[lane];
+        }
+        count += pad_valid[lane];
+    }
+    return count;
+}
+
+static size_t DB_NAME(inverse)(const void *geometry, const void *const in[3], void *const out[3], uint8_t *valid, size_t begin, size_t end)
+{
+    const DB_T *const typed_in[3] = {in[0], in[1], in[2]};
+    DB_T *const typed_out[3] = {out[0], out[1], out[2]};
+    return DB_NAME(run)(DB_NAME(inverse_lanes), geometry, typed_in, typed_out, valid, begin, end);
+}
+
+static size_t DB_NAME(forward)(const void *geometry, const void *const in[3], void *const out[3], uint8_t *valid, size_t begin, size_t end)
+{
+    const DB_T *const typed_in[3] = {in[0], in[1], in[2]};
+    DB_T *const typed_out[3] = {out[0], out[1], out[2]};
+    return DB_NAME(run)(DB_NAME(forward_lanes), geometry, typed_in, typed_out, valid, begin, end);
+}
+
+#undef DB_T
+#undef DB_V
+#undef DB_LANES
+#undef DB_DOUBLE
+#undef DB_ATAN_MID
+#undef DB_GEOMETRY
+#undef DB_NAME
+#undef DB_SET1
+#undef DB_LOAD
+#undef DB_STORE
+#undef DB_ADD
+#undef DB_SUB
+#undef DB_MUL
+#undef DB_DIV
+#undef DB_SQRT
+#undef DB_LT
+#undef DB_GT
+#undef DB_NGE
+#undef DB_MASKBITS
+#undef DB_COS
+#undef DB_SIN
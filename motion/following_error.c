@@ -0,0 +1,89 @@
+#include "following_error.h"
+#include <stddef.h>
+
+void following_error_init(following_error_t *monitor, q16_16_t warning_limit, q16_16_t fault_limit)
+{
+    monitor->warning_limit = warning_limit;
+    monitor->fault_limit = fault_limit;
+    following_error_reset(monitor);
+}
+
+void following_error_reset(following_error_t *monitor)
+{
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        monitor->error[axis] = 0;
+        monitor->peak[axis] = 0;
+    }
+    monitor->feed_scale = Q16_16_ONE;
+    monitor->warning = false;
+    monitor->fault = false;
+    monitor->warning_cycles = 0U;
+}
+
+q16_16_t following_error_max(const following_error_t *monitor)
+{
+    q16_16_t worst = 0;
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        q16_16_t error = q16_16_abs(monitor->error[axis]);
+        if (error > worst) {
+            worst = error;
+        }
+    }
+    return worst;
+}
+
+q16_16_t following_error_peak(const following_error_t *monitor)
+{
+    q16_16_t worst = 0;
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        if (monitor->peak[axis] > worst) {
+            worst = monitor->peak[axis];
+        }
+    }
+    return worst;
+}
+
+static q16_16_t scale_for(const following_error_t *monitor, q16_16_t worst, q16_16_t applied_scale)
+{
+    if (worst > monitor->warning_limit) {
+        /* lag grows with speed: scale down so the error settles at the warning limit */
+        q16_16_t scale = q16_16_mul(applied_scale, q16_16_div(monitor->warning_limit, worst));
+        return scale < FOLLOWING_ERROR_MIN_SCALE ? FOLLOWING_ERROR_MIN_SCALE : scale;
+    }
+    if (worst < monitor->warning_limit - monitor->warning_limit / 4) {
+        q16_16_t scale = applied_scale + FOLLOWING_ERROR_RECOVER_STEP;
+        return scale > Q16_16_ONE ? Q16_16_ONE : scale;
+    }
+    return monitor->feed_scale;
+}
+
+bool following_error_update(following_error_t *monitor, const delta_joint_t *demand, const ethcat_master_t *master, q16_16_t applied_scale)
+{
+    if (monitor->warning_limit == 0 || !master->process_data_valid) {
+        return !monitor->fault;
+    }
+    /* the inputs answer the frame that carried the previous cycle's demand */
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        const ethcat_slave_t *info = &master->slaves[slave];
+        if (info->role != ECAT_ROLE_JOINT || info->axis_index >= DELTA_JOINT_COUNT) {
+            continue;
+        }
+        int axis = info->axis_index;
+        monitor->error[axis] = demand->theta[axis] - info->txpdo.position_actual;
+        q16_16_t error = q16_16_abs(monitor->error[axis]);
+        if (error > monitor->peak[axis]) {
+            monitor->peak[axis] = error;
+        }
+    }
+
+    q16_16_t worst = following_error_max(monitor);
+    monitor->warning = worst > monitor->warning_limit;
+    if (monitor->warning) {
+        monitor->warning_cycles++;
+    }
+    if (monitor->fault_limit != 0 && worst > monitor->fault_limit) {
+        monitor->fault = true;
+    }
+    monitor->feed_scale = scale_for(monitor, worst, applied_scale);
+    return !monitor->fault;
+}
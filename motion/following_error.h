@@ -0,0 +1,31 @@
+#ifndef MOTION_FOLLOWING_ERROR_H
+#define MOTION_FOLLOWING_ERROR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kinematics/delta.h"
+#include "ethcat/master.h"
+
+/* the feed scaler never stops the path on its own, the fault limit does */
+#define FOLLOWING_ERROR_MIN_SCALE (Q16_16_ONE / 10)
+/* per-cycle increase once the error has dropped below the recovery band */
+#define FOLLOWING_ERROR_RECOVER_STEP (Q16_16_ONE / 512)
+
+typedef struct {
+    q16_16_t warning_limit; /* rad, 0 disables the monitor */
+    q16_16_t fault_limit;   /* rad */
+    q16_16_t error[DELTA_JOINT_COUNT];
+    q16_16_t peak[DELTA_JOINT_COUNT];
+    q16_16_t feed_scale;    /* requested planner time scale */
+    bool warning;
+    bool fault;
+    uint32_t warning_cycles;
+} following_error_t;
+
+void following_error_init(following_error_t *monitor, q16_16_t warning_limit, q16_16_t fault_limit);
+void following_error_reset(following_error_t *monitor);
+bool following_error_update(following_error_t *monitor, const delta_joint_t *demand, const ethcat_master_t *master, q16_16_t applied_scale);
+q16_16_t following_error_max(const following_error_t *monitor);
+q16_16_t following_error_peak(const following_error_t *monitor);
+
+#endif
@@ -0,0 +1,145 @@
+#include "input_shaper.h"
+#include <math.h>
+#include <stddef.h>
+
+#define HISTORY_MASK (INPUT_SHAPER_HISTORY - 1U)
+
+void input_shaper_init(input_shaper_t *shaper)
+{
+    shaper->type = INPUT_SHAPER_NONE;
+    for (int axis = 0; axis < 3; ++axis) {
+        shaper->axes[axis].frequency_hz = 0;
+        shaper->axes[axis].damping = 0;
+        shaper->axes[axis].impulse_count = 0;
+    }
+    shaper->delay_ticks = 0U;
+    delta_pose_t origin = {{0, 0, 0}};
+    input_shaper_reset(shaper, &origin);
+}
+
+static bool design_axis(input_shaper_axis_t *axis, input_shaper_type_t type, uint32_t period_us)
+{
+    float frequency = q16_16_to_float(axis->frequency_hz);
+    float zeta = q16_16_to_float(axis->damping);
+    if (type == INPUT_SHAPER_NONE || frequency <= 0.0f) {
+        axis->impulse_count = 0;
+        return true;
+    }
+    if (zeta < 0.0f || zeta >= 1.0f) {
+        return false;
+    }
+    /* impulses at multiples of the damped half period */
+    float root = sqrtf(1.0f - zeta * zeta);
+    float half_period_s = 0.5f / (frequency * root);
+    float k = expf(-zeta * 3.14159265f / root);
+    float amplitude[INPUT_SHAPER_MAX_IMPULSES];
+    int count;
+    switch (type) {
+    case INPUT_SHAPER_ZV:
+        amplitude[0] = 1.0f / (1.0f + k);
+        amplitude[1] = k / (1.0f + k);
+        count = 2;
+        break;
+    case INPUT_SHAPER_ZVD: {
+        float sum = (1.0f + k) * (1.0f + k);
+        amplitude[0] = 1.0f / sum;
+        amplitude[1] = 2.0f * k / sum;
+        amplitude[2] = k * k / sum;
+        count = 3;
+        break;
+    }
+    case INPUT_SHAPER_EI:
+        amplitude[0] = 0.25f * (1.0f + INPUT_SHAPER_EI_TOLERANCE);
+        amplitude[1] = 0.5f * (1.0f - INPUT_SHAPER_EI_TOLERANCE);
+        amplitude[2] = 0.25f * (1.0f + INPUT_SHAPER_EI_TOLERANCE);
+        count = 3;
+        break;
+    default:
+        return false;
+    }
+
+    float ticks_per_second = 1000000.0f / (float)period_us;
+    q16_16_t remaining = Q16_16_ONE;
+    for (int i = 0; i < count; ++i) {
+        float delay = (float)i * half_period_s * ticks_per_second + 0.5f;
+        if (delay >= (float)INPUT_SHAPER_HISTORY) {
+            return false;
+        }
+        axis->delay[i] = (uint16_t)delay;
+        /* the last impulse takes the rounding so the gains sum to exactly one */
+        axis->amplitude[i] = i == count - 1 ? remaining : q16_16_from_float(amplitude[i]);
+        remaining -= axis->amplitude[i];
+    }
+    axis->impulse_count = count;
+    return true;
+}
+
+static bool design(input_shaper_t *shaper, input_shaper_type_t type, uint32_t period_us)
+{
+    if (period_us == 0U) {
+        return false;
+    }
+    input_shaper_axis_t designed[3];
+    uint16_t longest = 0U;
+    for (int axis = 0; axis < 3; ++axis) {
+        designed[axis] = shaper->axes[axis];
+        if (!design_axis(&designed[axis], type, period_us)) {
+            return false;
+        }
+        if (designed[axis].impulse_count > 0 && designed[axis].delay[designed[axis].impulse_count - 1] > longest) {
+            longest = designed[axis].delay[designed[axis].impulse_count - 1];
+        }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        shaper->axes[axis] = designed[axis];
+    }
+    shaper->type = type;
+    shaper->delay_ticks = longest;
+    return true;
+}
+
+bool input_shaper_configure(input_shaper_t *shaper, input_shaper_type_t type, const q16_16_t *frequency_hz, const q16_16_t *damping, uint32_t period_us)
+{
+    input_shaper_t candidate = *shaper;
+    for (int axis = 0; axis < 3; ++axis) {
+        candidate.axes[axis].frequency_hz = frequency_hz[axis];
+        candidate.axes[axis].damping = damping[axis];
+    }
+    if (!design(&candidate, type, period_us)) {
+        return false;
+    }
+    *shaper = candidate;
+    return true;
+}
+
+bool input_shaper_set_period(input_shaper_t *shaper, uint32_t period_us)
+{
+    return design(shaper, shaper->type, period_us);
+}
+
+void input_shaper_reset(input_shaper_t *shaper, const delta_pose_t *pose)
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        for (uint32_t i = 0; i < INPUT_SHAPER_HISTORY; ++i) {
+            shaper->history[axis][i] = pose->xyz[axis];
+        }
+    }
+    shaper->head = 0U;
+}
+
+void input_shaper_apply(input_shaper_t *shaper, const delta_pose_t *in, delta_pose_t *out)
+{
+    shaper->head = (uint16_t)((shaper->head + 1U) & HISTORY_MASK);
+    for (int axis = 0; axis < 3; ++axis) {
+        const input_shaper_axis_t *shape = &shaper->axes[axis];
+        q16_16_t newest = in->xyz[axis];
+        shaper->history[axis][shaper->head] = newest;
+        /* convolve the offsets from the newest sample so a resting input comes out exact */
+        q16_16_t shaped = newest;
+        for (int i = 0; i < shape->impulse_count; ++i) {
+            q16_16_t sample = shaper->history[axis][(shaper->head - shape->delay[i]) & HISTORY_MASK];
+            shaped += q16_16_mul(shape->amplitude[i], sample - newest);
+        }
+        out->xyz[axis] = shaped;
+    }
+}
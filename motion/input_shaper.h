@@ -0,0 +1,41 @@
+#ifndef MOTION_INPUT_SHAPER_H
+#define MOTION_INPUT_SHAPER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kinematics/delta.h"
+
+#define INPUT_SHAPER_MAX_IMPULSES 3
+#define INPUT_SHAPER_HISTORY 512U /* power of two, bounds the longest shaper delay in cycles */
+#define INPUT_SHAPER_EI_TOLERANCE 0.05f
+
+typedef enum {
+    INPUT_SHAPER_NONE = 0,
+    INPUT_SHAPER_ZV,
+    INPUT_SHAPER_ZVD,
+    INPUT_SHAPER_EI
+} input_shaper_type_t;
+
+typedef struct {
+    q16_16_t frequency_hz;
+    q16_16_t damping;
+    q16_16_t amplitude[INPUT_SHAPER_MAX_IMPULSES];
+    uint16_t delay[INPUT_SHAPER_MAX_IMPULSES]; /* cycles */
+    int impulse_count;
+} input_shaper_axis_t;
+
+typedef struct {
+    input_shaper_type_t type;
+    input_shaper_axis_t axes[3];
+    q16_16_t history[3][INPUT_SHAPER_HISTORY];
+    uint16_t head;
+    uint16_t delay_ticks; /* longest impulse delay over all axes */
+} input_shaper_t;
+
+void input_shaper_init(input_shaper_t *shaper);
+bool input_shaper_configure(input_shaper_t *shaper, input_shaper_type_t type, const q16_16_t *frequency_hz, const q16_16_t *damping, uint32_t period_us);
+bool input_shaper_set_period(input_shaper_t *shaper, uint32_t period_us);
+void input_shaper_reset(input_shaper_t *shaper, const delta_pose_t *pose);
+void input_shaper_apply(input_shaper_t *shaper, const delta_pose_t *in, delta_pose_t *out);
+
+#endif
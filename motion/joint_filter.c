@@ -0,0 +1,111 @@
+#include "joint_filter.h"
+#include <stddef.h>
+
+void joint_filter_init(joint_filter_t *filter)
+{
+    filter->notch_hz = 0;
+    filter->notch_q = 0;
+    filter->velocity_hz = 0;
+    biquad_bank_init(&filter->torque, DELTA_JOINT_COUNT);
+    biquad_bank_init(&filter->velocity, DELTA_JOINT_COUNT);
+    joint_filter_reset(filter);
+}
+
+static bool design(joint_filter_t *filter, uint32_t period_us)
+{
+    biquad_bank_t torque;
+    biquad_bank_t velocity;
+    biquad_coeffs_t coeffs;
+    biquad_bank_init(&torque, DELTA_JOINT_COUNT);
+    biquad_bank_init(&velocity, DELTA_JOINT_COUNT);
+    if (filter->notch_hz != 0) {
+        if (!biquad_design(&coeffs, BIQUAD_NOTCH, filter->notch_hz, filter->notch_q, period_us)) {
+            return false;
+        }
+        biquad_bank_add_stage(&torque, &coeffs);
+    }
+    if (filter->velocity_hz != 0) {
+        if (!biquad_design(&coeffs, BIQUAD_LOWPASS, filter->velocity_hz, q16_16_from_float(JOINT_FILTER_VELOCITY_Q), period_us)) {
+            return false;
+        }
+        biquad_bank_add_stage(&velocity, &coeffs);
+    }
+    filter->torque = torque;
+    filter->velocity = velocity;
+    joint_filter_reset(filter);
+    return true;
+}
+
+bool joint_filter_configure(joint_filter_t *filter, q16_16_t notch_hz, q16_16_t notch_q, q16_16_t velocity_hz, uint32_t period_us)
+{
+    joint_filter_t candidate = *filter;
+    candidate.notch_hz = notch_hz;
+    candidate.notch_q = notch_q;
+    candidate.velocity_hz = velocity_hz;
+    if (!design(&candidate, period_us)) {
+        return false;
+    }
+    *filter = candidate;
+    return true;
+}
+
+bool joint_filter_set_period(joint_filter_t *filter, uint32_t period_us)
+{
+    return design(filter, period_us);
+}
+
+void joint_filter_reset(joint_filter_t *filter)
+{
+    biquad_bank_reset(&filter->torque, NULL);
+    biquad_bank_reset(&filter->velocity, NULL);
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        filter->position_previous[axis] = 0;
+        filter->joint_velocity[axis] = 0;
+    }
+    filter->primed = false;
+}
+
+void joint_filter_torque(joint_filter_t *filter, const q16_16_t *torque, q16_16_t *filtered)
+{
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        filtered[axis] = torque[axis];
+    }
+    biquad_bank_process(&filter->torque, filtered, 1U);
+}
+
+void joint_filter_update_velocity(joint_filter_t *filter, const ethcat_master_t *master, uint32_t period_us)
+{
+    if (!master->process_data_valid) {
+        return;
+    }
+    q16_16_t position[DELTA_JOINT_COUNT];
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        position[axis] = filter->position_previous[axis];
+    }
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        const ethcat_slave_t *info = &master->slaves[slave];
+        if (info->role == ECAT_ROLE_JOINT && info->axis_index < DELTA_JOINT_COUNT) {
+            position[info->axis_index] = info->txpdo.position_actual;
+        }
+    }
+    /* the first sample only seeds the difference */
+    if (!filter->primed) {
+        for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+            filter->position_previous[axis] = position[axis];
+        }
+        filter->primed = true;
+        return;
+    }
+    int32_t ticks_per_second = (int32_t)(1000000U / period_us);
+    q16_16_t rate[DELTA_JOINT_COUNT];
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        /* wrap-safe, a multi-turn counter rolling over gives one small step */
+        int32_t step = (int32_t)((uint32_t)position[axis] - (uint32_t)filter->position_previous[axis]);
+        rate[axis] = step * ticks_per_second;
+        filter->position_previous[axis] = position[axis];
+    }
+    biquad_bank_process(&filter->velocity, rate, 1U);
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        filter->joint_velocity[axis] = rate[axis];
+    }
+}
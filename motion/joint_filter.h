@@ -0,0 +1,30 @@
+#ifndef MOTION_JOINT_FILTER_H
+#define MOTION_JOINT_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kinematics/delta.h"
+#include "ethcat/master.h"
+#include "utils/filter.h"
+
+#define JOINT_FILTER_VELOCITY_Q 0.7071f /* Butterworth, no overshoot on a speed step */
+
+typedef struct {
+    q16_16_t notch_hz;    /* arm resonance, 0 passes the torque feed-forward unchanged */
+    q16_16_t notch_q;
+    q16_16_t velocity_hz; /* velocity estimate bandwidth, 0 for the raw difference */
+    biquad_bank_t torque;
+    biquad_bank_t velocity;
+    q16_16_t position_previous[DELTA_JOINT_COUNT];
+    q16_16_t joint_velocity[DELTA_JOINT_COUNT]; /* rad/s from the drives' actual position */
+    bool primed;
+} joint_filter_t;
+
+void joint_filter_init(joint_filter_t *filter);
+bool joint_filter_configure(joint_filter_t *filter, q16_16_t notch_hz, q16_16_t notch_q, q16_16_t velocity_hz, uint32_t period_us);
+bool joint_filter_set_period(joint_filter_t *filter, uint32_t period_us);
+void joint_filter_reset(joint_filter_t *filter);
+void joint_filter_torque(joint_filter_t *filter, const q16_16_t *torque, q16_16_t *filtered);
+void joint_filter_update_velocity(joint_filter_t *filter, const ethcat_master_t *master, uint32_t period_us);
+
+#endif
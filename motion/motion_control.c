@@ -1,6 +1,8 @@
 #include "motion_control.h"
 #include <stddef.h>
+#include "planner/lookahead.h"
 #include "utils/fixed.h"
+#include "utils/timer.h"
 
 void motion_controller_init(motion_controller_t *motion, planner_queue_t *planner, ethcat_master_t *master, cia402_axis_t *axes)
 {
@@ -9,51 +11,535 @@ void motion_controller_init(motion_controller_t *motion, planner_queue_t *planne
     motion->axes = axes;
     for (int i = 0; i < 3; ++i) {
         motion->command_pose.xyz[i] = 0;
+        motion->previous_pose.xyz[i] = 0;
+        motion->shaped_pose.xyz[i] = 0;
         motion->joint_command.theta[i] = 0;
         motion->joint_previous.theta[i] = 0;
         motion->feedforward_torque[i] = 0;
     }
+    for (int i = 0; i < ECAT_MAX_AUX_AXES; ++i) {
+        motion->aux_command[i] = 0;
+        motion->aux_previous[i] = 0;
+    }
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        cia402_axis_set_period(&axes[slave], planner->control_period_us);
+    }
+    motion->drives_ready = false;
+    motion->bus_valid = false;
+    motion->enable_cycles = 0U;
+    probe_init(&motion->probe);
+    following_error_init(&motion->following, 0, 0);
+    input_shaper_init(&motion->shaper);
+    conveyor_sync_init(&motion->conveyor);
+    joint_filter_init(&motion->joint_filter);
+    replay_init(&motion->replay);
 }
 
-static void build_targets(const motion_controller_t *motion, int axis, q16_16_t *targets)
+static void build_targets(const motion_controller_t *motion, q16_16_t position, q16_16_t previous, q16_16_t torque, q16_16_t *targets)
 {
-    targets[0] = motion->joint_command.theta[axis];
-    q16_16_t delta = motion->joint_command.theta[axis] - motion->joint_previous.theta[axis];
-    targets[1] = delta; /* per control period */
-    targets[2] = motion->feedforward_torque[axis];
+    targets[0] = position;
+    q16_16_t delta = position - previous;
+    int32_t ticks_per_second = (int32_t)(1000000U / motion->planner->control_period_us);
+    targets[1] = delta * ticks_per_second; /* per second, independent of the control period */
+    targets[2] = torque;
 }
 
-void motion_controller_tick(motion_controller_t *motion)
+static delta_joint_t actual_joints(const motion_controller_t *motion)
 {
-    delta_pose_t pose;
-    if (!planner_step(motion->planner, &pose)) {
-        pose = motion->command_pose;
+    delta_joint_t actual = motion->joint_command;
+    const ethcat_master_t *master = motion->master;
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        if (master->slaves[slave].role == ECAT_ROLE_JOINT) {
+            actual.theta[master->slaves[slave].axis_index] = master->slaves[slave].txpdo.position_actual;
+        }
     }
+    return actual;
+}
 
-    delta_joint_t joints;
-    if (!delta_inverse_kinematics(&pose, &joints)) {
-        for (int axis = 0; axis < 3; ++axis) {
-            motion->axes[axis].quick_stop = true;
+static void seed_from_drives(motion_controller_t *motion)
+{
+    /* the arm is wherever the drives were enabled: everything downstream starts there */
+    delta_joint_t actual = actual_joints(motion);
+    delta_pose_t here;
+    if (!delta_forward_kinematics(&actual, &here)) {
+        return;
+    }
+    motion->joint_command = actual;
+    motion->joint_previous = actual;
+    motion->command_pose = here;
+    motion->previous_pose = here;
+    motion->shaped_pose = here;
+    planner_abort(motion->planner, &here);
+    input_shaper_reset(&motion->shaper, &here);
+}
+
+static void quick_stop_drives(motion_controller_t *motion)
+{
+    for (int slave = 0; slave < motion->master->slave_count; ++slave) {
+        if (ethcat_master_is_drive(&motion->master->slaves[slave])) {
+            motion->axes[slave].quick_stop = true;
+        }
+    }
+}
+
+static bool update_drives(motion_controller_t *motion)
+{
+    /* all drives advance through the state graph in the same cycle */
+    bool ready = true;
+    bool enabling = false;
+    uint32_t slowest = 0U;
+    ethcat_master_t *master = motion->master;
+    if (!master->process_data_valid) {
+        /* stale statuswords say nothing about the drives now */
+        motion->drives_ready = false;
+        return false;
+    }
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        if (!ethcat_master_is_drive(&master->slaves[slave])) {
+            continue;
+        }
+        cia402_axis_t *axis = &motion->axes[slave];
+        cia402_axis_update(axis, &master->slaves[slave].txpdo);
+        if (!cia402_axis_is_enabled(axis)) {
+            ready = false;
+            enabling = enabling || (axis->enable_request && !axis->enable_timeout && !axis->quick_stop);
+        }
+        if (axis->enabled_after_cycles > slowest) {
+            slowest = axis->enabled_after_cycles;
+        }
+    }
+    if (ready && !motion->drives_ready) {
+        motion->enable_cycles = slowest;
+        seed_from_drives(motion);
+        following_error_reset(&motion->following);
+        joint_filter_reset(&motion->joint_filter);
+    }
+    if (!enabling) {
+        motion->planner->pose_pending = false;
+    }
+    motion->drives_ready = ready;
+    return ready;
+}
+
+static void release_conveyor(motion_controller_t *motion)
+{
+    /* the belt offset becomes part of the machine pose, later moves are in the fixed frame again */
+    conveyor_sync_apply(&motion->conveyor, &motion->command_pose, &motion->command_pose);
+    conveyor_sync_apply(&motion->conveyor, &motion->previous_pose, &motion->previous_pose);
+    planner_abort(motion->planner, &motion->command_pose);
+    input_shaper_reset(&motion->shaper, &motion->command_pose);
+    conveyor_sync_clear(&motion->conveyor);
+    motion->planner->frame = PLANNER_FRAME_FIXED;
+}
+
+static bool belt_in_reach(const motion_controller_t *motion)
+{
+    /* where the belt leaves the tool if tracking is released now */
+    delta_pose_t stop;
+    conveyor_sync_apply_stop(&motion->conveyor, &motion->command_pose, &stop);
+    return lookahead_validate_segment(&stop, &stop) == PLANNER_ERROR_NONE;
+}
+
+static void track_conveyor(motion_controller_t *motion)
+{
+    conveyor_sync_t *conveyor = &motion->conveyor;
+    planner_queue_t *planner = motion->planner;
+    const ethcat_master_t *master = motion->master;
+    if (!conveyor_sync_enabled(conveyor)) {
+        planner->frame = PLANNER_FRAME_FIXED;
+        return;
+    }
+    if (master->input_time_ns != 0ULL) {
+        conveyor_sync_sample(conveyor, master->slaves[conveyor->slave].txpdo.position_actual, master->input_time_ns);
+    }
+    if (planner->frame == PLANNER_FRAME_ENGAGE) {
+        conveyor_sync_engage(conveyor, true);
+        planner->frame = PLANNER_FRAME_CONVEYOR;
+    } else if (planner->frame == PLANNER_FRAME_RELEASE) {
+        conveyor_sync_engage(conveyor, false);
+    }
+    conveyor_sync_step(conveyor, master->time_ns, master->cycle_time_ns);
+    if (planner->frame == PLANNER_FRAME_CONVEYOR && !belt_in_reach(motion)) {
+        /* stop before the belt drags the tool out of reach: hold the path, let the belt go */
+        planner_hold(planner);
+        planner_track_conveyor(planner, false);
+        conveyor_sync_engage(conveyor, false);
+        planner->frame_lost = true;
+    }
+    /* after a lost frame the held queue is dropped, its moves were meant for the belt */
+    bool stopped = planner_is_settled(planner) || (planner->frame_lost && planner->held);
+    if (planner->frame == PLANNER_FRAME_RELEASE && !conveyor_sync_ramping(conveyor) && stopped) {
+        release_conveyor(motion);
+        if (planner->frame_lost) {
+            planner_resume(planner);
         }
+    }
+    delta_pose_t origin = {{0, 0, 0}};
+    conveyor_sync_apply(conveyor, &origin, &planner->frame_offset);
+}
+
+static bool teach_disturbed(const motion_controller_t *motion)
+{
+    /* anything that bends the timing away from the program spoils the recording */
+    const planner_queue_t *planner = motion->planner;
+    return planner->hold_requested || planner->feed_override != 100U || planner->rapid_override != 100U ||
+           planner->feed_scale != Q16_16_ONE || planner->frame != PLANNER_FRAME_FIXED ||
+           planner->probe.state == PLANNER_PROBE_PENDING || !motion->drives_ready;
+}
+
+static void teach_step(motion_controller_t *motion, const delta_pose_t *pose, const delta_joint_t *joints)
+{
+    replay_cache_t *replay = &motion->replay;
+    if (replay->mode != REPLAY_ARMED && replay->mode != REPLAY_RECORDING) {
+        return;
+    }
+    if (teach_disturbed(motion)) {
+        replay_cancel(replay);
         return;
     }
+    bool settled = planner_is_settled(motion->planner);
+    if (replay->mode == REPLAY_ARMED) {
+        if (settled) {
+            /* the last resting setpoint is where a replay has to start from */
+            replay->start = *joints;
+            if (replay->close_requested) {
+                replay_cancel(replay);
+            }
+            return;
+        }
+        replay_record_begin(replay, &replay->start);
+    }
+    if (replay_record(replay, joints) && replay->close_requested && settled) {
+        replay_record_end(replay, pose);
+    }
+}
 
-    for (int axis = 0; axis < 3; ++axis) {
-        const ethcat_txpdo_t *feedback = ethcat_master_get_feedback(motion->master, axis);
-        if (feedback != NULL) {
-            cia402_axis_update(&motion->axes[axis], feedback);
+static void finish_replay(motion_controller_t *motion, const delta_pose_t *at, delta_pose_t *pose, delta_pose_t *shaped)
+{
+    planner_abort(motion->planner, at);
+    input_shaper_reset(&motion->shaper, at);
+    motion->planner->bypassed = false;
+    *pose = *at;
+    *shaped = *at;
+}
+
+static bool replay_step(motion_controller_t *motion, bool ready, delta_pose_t *pose, delta_pose_t *shaped, delta_joint_t *joints)
+{
+    replay_cache_t *replay = &motion->replay;
+    if (replay->play_requested) {
+        replay->play_requested = false;
+        if (!ready || !replay_play_begin(replay)) {
+            motion->planner->bypassed = false;
         }
     }
+    if (replay->mode != REPLAY_PLAYING) {
+        return false;
+    }
+    *joints = motion->joint_command;
+    if (!ready) {
+        /* the drives dropped out, the stream ends where it is */
+        replay_cancel(replay);
+        delta_pose_t here;
+        if (!delta_forward_kinematics(&motion->joint_command, &here)) {
+            here = motion->command_pose;
+        }
+        finish_replay(motion, &here, pose, shaped);
+        return true;
+    }
+    if (!replay_play(replay, joints)) {
+        /* the last frame rests at the taught end pose, the planner takes over from there */
+        finish_replay(motion, &replay->end_pose, pose, shaped);
+        return true;
+    }
+    delta_pose_t rest;
+    if (motion->planner->hold_requested && replay_resting(replay) && delta_forward_kinematics(joints, &rest)) {
+        /* the stream has fixed timing and cannot ramp down: a hold plays on to the
+         * next taught rest and the held planner takes over there */
+        replay_cancel(replay);
+        finish_replay(motion, &rest, pose, shaped);
+        return true;
+    }
+    *pose = motion->command_pose;
+    *shaped = motion->shaped_pose;
+    return true;
+}
+
+static void fault_stop(motion_controller_t *motion)
+{
+    /* the queue and the shaper restart where the arm stopped, not at the setpoint it lagged behind */
+    delta_joint_t actual = actual_joints(motion);
+    delta_pose_t here;
+    if (delta_forward_kinematics(&actual, &here)) {
+        motion->joint_command = actual;
+        motion->joint_previous = actual;
+    } else {
+        here = motion->command_pose;
+    }
+    replay_cancel(&motion->replay);
+    conveyor_sync_clear(&motion->conveyor);
+    motion->planner->frame = PLANNER_FRAME_FIXED;
+    finish_replay(motion, &here, &motion->command_pose, &motion->shaped_pose);
+    motion->previous_pose = here;
+    quick_stop_drives(motion);
+}
 
+static void update_feedforward(motion_controller_t *motion, const delta_pose_t *shaped)
+{
+    /* inertia times the joint acceleration the planned path asks for: its speed
+     * and acceleration through the first and second derivatives of the joint
+     * angles along the block. Arches, probe stops and replays send none */
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        motion->feedforward_torque[j] = 0;
+    }
+    const planner_queue_t *planner = motion->planner;
+    const planner_joint_limits_t *limits = &planner->joint_limits;
+    const planner_block_t *block = planner_active_block(planner);
+    if (shaped == NULL || limits->inertia <= 0.0f || block == NULL || block->arch || block->length <= 0.0f) {
+        return;
+    }
+    float xyz[3];
+    float direction[3];
     for (int axis = 0; axis < 3; ++axis) {
-        motion->joint_previous.theta[axis] = motion->joint_command.theta[axis];
-        motion->joint_command.theta[axis] = joints.theta[axis];
+        xyz[axis] = q16_16_to_float(shaped->xyz[axis]);
+        direction[axis] = q16_16_to_float(block->end.xyz[axis] - block->start.xyz[axis]) / block->length;
+    }
+    float first[3];
+    float second[3];
+    if (!delta_path_derivatives(xyz, direction, LOOKAHEAD_STEP, first, second)) {
+        return;
+    }
+    /* a scale below one warps time, see follow_profile() */
+    float scale = q16_16_to_float(planner->feed_scale < Q16_16_ONE ? planner->feed_scale : Q16_16_ONE);
+    float speed = planner->path_speed * scale;
+    float accel = planner->path_accel * scale * scale;
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        float torque = limits->inertia * (second[j] * speed * speed + first[j] * accel);
+        if (limits->torque > 0.0f) {
+            torque = torque > limits->torque ? limits->torque : (torque < -limits->torque ? -limits->torque : torque);
+        }
+        motion->feedforward_torque[j] = q16_16_from_float(torque);
+    }
+}
+
+static bool bus_lost(motion_controller_t *motion)
+{
+    /* once the bus ran, missing inputs mean a lost drive, not a resting one */
+    bool valid = motion->master->process_data_valid;
+    bool lost = motion->bus_valid && !valid;
+    motion->bus_valid = valid;
+    return lost;
+}
+
+void motion_controller_tick(motion_controller_t *motion)
+{
+    delta_pose_t pose;
+    uint32_t period_us = motion->planner->control_period_us;
+    probe_update(&motion->probe, motion->planner, motion->master, &motion->command_pose, &motion->previous_pose, period_us);
+    if (bus_lost(motion)) {
+        motion->drives_ready = false;
+        fault_stop(motion);
+        return;
+    }
+    bool ready = update_drives(motion);
+    track_conveyor(motion);
+    /* the monitor limits the scale relative to the operator's override */
+    q16_16_t applied = q16_16_div(motion->planner->feed_scale, planner_override(motion->planner));
+    if (ready && !following_error_update(&motion->following, &motion->joint_command, motion->master, applied > Q16_16_ONE ? Q16_16_ONE : applied)) {
+        fault_stop(motion);
+        return;
+    }
+    planner_set_feed_scale(motion->planner, motion->following.feed_scale);
+    if (ready) {
+        joint_filter_update_velocity(&motion->joint_filter, motion->master, period_us);
+    }
+    delta_pose_t shaped;
+    delta_joint_t joints;
+    bool planned = false;
+    if (!replay_step(motion, ready, &pose, &shaped, &joints)) {
+        if (!ready) {
+            /* nothing is planned before Operation Enabled, the setpoints follow the drives
+             * so that enabling does not jump; the poses are seeded once they are ready */
+            pose = motion->command_pose;
+            shaped = motion->shaped_pose;
+            joints = motion->master->process_data_valid ? actual_joints(motion) : motion->joint_command;
+            motion->joint_command = joints;
+        } else {
+            planned = !probe_stop_step(&motion->probe, motion->planner, &pose, period_us);
+            if (planned && !planner_step(motion->planner, &pose)) {
+                pose = motion->command_pose;
+            }
+            input_shaper_apply(&motion->shaper, &pose, &shaped);
+            /* the planner works in the belt frame, the joints in the machine frame */
+            conveyor_sync_apply(&motion->conveyor, &shaped, &shaped);
+            if (!delta_inverse_kinematics(&shaped, &joints)) {
+                replay_cancel(&motion->replay);
+                quick_stop_drives(motion);
+                return;
+            }
+            teach_step(motion, &pose, &joints);
+        }
+    }
+    motion->joint_previous = motion->joint_command;
+    motion->joint_command = joints;
+    update_feedforward(motion, planned ? &shaped : NULL);
+    /* the notch keeps the feed-forward from exciting the arm resonance */
+    q16_16_t torque[3];
+    joint_filter_torque(&motion->joint_filter, motion->feedforward_torque, torque);
+
+    ethcat_master_t *master = motion->master;
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        const ethcat_slave_t *info = &master->slaves[slave];
+        if (!ethcat_master_is_drive(info)) {
+            continue;
+        }
+        cia402_axis_t *axis = &motion->axes[slave];
         q16_16_t targets[3];
-        build_targets(motion, axis, targets);
-        cia402_axis_command(&motion->axes[axis], targets, motion->axes[axis].mode);
+        int index = info->axis_index;
+        if (info->role == ECAT_ROLE_JOINT) {
+            build_targets(motion, motion->joint_command.theta[index], motion->joint_previous.theta[index], torque[index], targets);
+        } else {
+            build_targets(motion, motion->aux_command[index], motion->aux_previous[index], 0, targets);
+            motion->aux_previous[index] = motion->aux_command[index];
+        }
+        cia402_axis_command(axis, targets, axis->mode);
         ethcat_rxpdo_t rx;
-        cia402_axis_build_rxpdo(&motion->axes[axis], &rx);
-        ethcat_master_set_target(motion->master, axis, &rx);
+        cia402_axis_build_rxpdo(axis, &rx);
+        rx.touch_probe_function = info->role == ECAT_ROLE_JOINT ? motion->probe.function : 0U;
+        ethcat_master_set_target(master, slave, &rx);
     }
+    motion->previous_pose = motion->command_pose;
     motion->command_pose = pose;
+    motion->shaped_pose = shaped;
+}
+
+bool motion_controller_set_conveyor(motion_controller_t *motion, int aux_axis, const q16_16_t *direction, q16_16_t scale, uint32_t latency_us)
+{
+    if (motion->planner->frame != PLANNER_FRAME_FIXED) {
+        return false;
+    }
+    int slave = ethcat_master_find_slave(motion->master, ECAT_ROLE_AUX_AXIS, aux_axis);
+    conveyor_sync_configure(&motion->conveyor, slave, direction, scale, latency_us * 1000U);
+    return conveyor_sync_enabled(&motion->conveyor);
+}
+
+bool motion_controller_set_joint_filter(motion_controller_t *motion, q16_16_t notch_hz, q16_16_t notch_q, q16_16_t velocity_hz)
+{
+    return joint_filter_configure(&motion->joint_filter, notch_hz, notch_q, velocity_hz, motion->planner->control_period_us);
+}
+
+void motion_controller_set_aux_target(motion_controller_t *motion, int aux_axis, q16_16_t position)
+{
+    if (aux_axis >= 0 && aux_axis < ECAT_MAX_AUX_AXES) {
+        motion->aux_command[aux_axis] = position;
+    }
+}
+
+bool motion_controller_set_input_shaper(motion_controller_t *motion, input_shaper_type_t type, const q16_16_t *frequency_hz, const q16_16_t *damping)
+{
+    /* the filter history must hold a resting setpoint */
+    if (!planner_is_settled(motion->planner) ||
+        !input_shaper_configure(&motion->shaper, type, frequency_hz, damping, motion->planner->control_period_us)) {
+        return false;
+    }
+    input_shaper_reset(&motion->shaper, &motion->command_pose);
+    planner_set_output_delay(motion->planner, motion->shaper.delay_ticks);
+    return true;
+}
+
+void motion_controller_set_following_limits(motion_controller_t *motion, q16_16_t warning, q16_16_t fault)
+{
+    following_error_init(&motion->following, warning, fault);
+}
+
+bool motion_controller_teach(motion_controller_t *motion, uint32_t config_hash)
+{
+    if (motion->replay.mode != REPLAY_IDLE || !motion->drives_ready || !planner_is_settled(motion->planner)) {
+        return false;
+    }
+    motion->replay.start = motion->joint_command;
+    replay_arm(&motion->replay, config_hash);
+    return true;
+}
+
+bool motion_controller_end_teach(motion_controller_t *motion)
+{
+    if (!replay_teaching(&motion->replay)) {
+        return false;
+    }
+    motion->replay.close_requested = true;
+    return true;
+}
+
+bool motion_controller_replay(motion_controller_t *motion, uint32_t program_hash, uint32_t config_hash)
+{
+    /* replayed as taught: no overrides, no hold, no belt frame */
+    planner_queue_t *planner = motion->planner;
+    if (!motion->drives_ready || !planner_is_settled(planner) || planner->hold_requested ||
+        planner->feed_override != 100U || planner->rapid_override != 100U || planner->frame != PLANNER_FRAME_FIXED ||
+        !replay_matches(&motion->replay, program_hash, config_hash, &motion->joint_command)) {
+        return false;
+    }
+    planner->bypassed = true;
+    motion->replay.play_requested = true;
+    return true;
+}
+
+uint32_t motion_controller_enable_time_us(const motion_controller_t *motion)
+{
+    return motion->enable_cycles * motion->planner->control_period_us;
+}
+
+static bool period_supported(uint32_t period_us)
+{
+    return period_us >= CONTROL_PERIOD_MIN_US && period_us <= CONTROL_PERIOD_MAX_US &&
+           (CONTROL_PERIOD_MAX_US % period_us) == 0U;
+}
+
+static bool tick_cost_fits(const motion_controller_t *motion, uint32_t period_us)
+{
+    const cycle_stats_t *stats = &motion->master->stats;
+    const histogram_t *tick = &stats->hist[CYCLE_STAT_TICK_DURATION];
+    const histogram_t *latency = &stats->hist[CYCLE_STAT_ISR_LATENCY];
+    if (tick->count == 0U) {
+        /* nothing measured yet: only allow slowing down */
+        return period_us >= motion->planner->control_period_us;
+    }
+    uint64_t cost_ns = (uint64_t)tick->max + latency->max;
+    uint64_t budget_ns = (uint64_t)period_us * 1000U * CONTROL_TICK_BUDGET_PERCENT / 100U;
+    return cost_ns <= budget_ns;
+}
+
+bool motion_controller_set_period(motion_controller_t *motion, uint32_t period_us)
+{
+    /* a taught or replayed stream is bound to the period it was taught at;
+     * enabled drives would see 0x60C2 change under a running CSP stream */
+    if (motion->drives_ready || motion->replay.mode != REPLAY_IDLE || !period_supported(period_us) || !tick_cost_fits(motion, period_us)) {
+        return false;
+    }
+    uint32_t previous = motion->planner->control_period_us;
+    if (!planner_set_period(motion->planner, period_us)) {
+        return false;
+    }
+    if (!input_shaper_set_period(&motion->shaper, period_us)) {
+        planner_set_period(motion->planner, previous);
+        return false;
+    }
+    if (!joint_filter_set_period(&motion->joint_filter, period_us)) {
+        planner_set_period(motion->planner, previous);
+        input_shaper_set_period(&motion->shaper, previous);
+        return false;
+    }
+    if (!ethcat_master_set_cycle_time(motion->master, period_us * 1000U)) {
+        planner_set_period(motion->planner, previous);
+        input_shaper_set_period(&motion->shaper, previous);
+        joint_filter_set_period(&motion->joint_filter, previous);
+        return false;
+    }
+    input_shaper_reset(&motion->shaper, &motion->command_pose);
+    planner_set_output_delay(motion->planner, motion->shaper.delay_ticks);
+    for (int slave = 0; slave < motion->master->slave_count; ++slave) {
+        cia402_axis_set_period(&motion->axes[slave], period_us);
+    }
+    timer_set_tick_period_us(period_us);
+    return true;
 }
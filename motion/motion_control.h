@@ -5,18 +5,47 @@
 #include "kinematics/delta.h"
 #include "cia402/cia402.h"
 #include "ethcat/master.h"
+#include "probe.h"
+#include "following_error.h"
+#include "input_shaper.h"
+#include "joint_filter.h"
+#include "replay.h"
+#include "sync.h"
 
 typedef struct {
     planner_queue_t *planner;
     ethcat_master_t *master;
     cia402_axis_t *axes;
     delta_pose_t command_pose;
+    delta_pose_t previous_pose;
     delta_joint_t joint_command;
     delta_joint_t joint_previous;
-    q16_16_t feedforward_torque[3];
+    q16_16_t feedforward_torque[3]; /* N m, reflected inertia times the planned joint acceleration */
+    q16_16_t aux_command[ECAT_MAX_AUX_AXES];
+    q16_16_t aux_previous[ECAT_MAX_AUX_AXES];
+    probe_t probe;
+    following_error_t following;
+    input_shaper_t shaper;
+    delta_pose_t shaped_pose; /* setpoint after input shaping and the belt offset, what the joints follow */
+    conveyor_sync_t conveyor;
+    joint_filter_t joint_filter; /* torque feed-forward notch, joint velocity estimate */
+    replay_cache_t replay;       /* taught program, streamed without planner or kinematics */
+    bool drives_ready;
+    bool bus_valid;         /* process data arrived in the last cycle */
+    uint32_t enable_cycles; /* slowest drive's time to Operation Enabled */
 } motion_controller_t;
 
 void motion_controller_init(motion_controller_t *motion, planner_queue_t *planner, ethcat_master_t *master, cia402_axis_t *axes);
 void motion_controller_tick(motion_controller_t *motion);
+bool motion_controller_set_period(motion_controller_t *motion, uint32_t period_us);
+void motion_controller_set_following_limits(motion_controller_t *motion, q16_16_t warning, q16_16_t fault);
+bool motion_controller_set_input_shaper(motion_controller_t *motion, input_shaper_type_t type, const q16_16_t *frequency_hz, const q16_16_t *damping);
+bool motion_controller_set_joint_filter(motion_controller_t *motion, q16_16_t notch_hz, q16_16_t notch_q, q16_16_t velocity_hz);
+bool motion_controller_set_conveyor(motion_controller_t *motion, int aux_axis, const q16_16_t *direction, q16_16_t scale, uint32_t latency_us);
+void motion_controller_set_aux_target(motion_controller_t *motion, int aux_axis, q16_16_t position);
+bool motion_controller_teach(motion_controller_t *motion, uint32_t config_hash);
+bool motion_controller_end_teach(motion_controller_t *motion);
+bool motion_controller_replay(motion_controller_t *motion, uint32_t program_hash, uint32_t config_hash);
+uint32_t motion_controller_enable_time_us(const motion_controller_t *motion);
 
 #endif
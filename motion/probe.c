@@ -0,0 +1,131 @@
+#include "probe.h"
+#include <math.h>
+#include <stddef.h>
+
+void probe_init(probe_t *probe)
+{
+    probe->phase = PROBE_PHASE_IDLE;
+    probe->function = 0U;
+    for (int axis = 0; axis < 3; ++axis) {
+        probe->stop_pose.xyz[axis] = 0;
+        probe->direction[axis] = 0.0f;
+    }
+    probe->speed = 0.0f;
+    probe->accel = 0.0f;
+    probe->accel_limit = 0.0f;
+    probe->jerk_limit = 0.0f;
+}
+
+static bool read_latch(const ethcat_master_t *master, delta_joint_t *joints)
+{
+    int latched = 0;
+    for (int slave = 0; slave < master->slave_count; ++slave) {
+        const ethcat_slave_t *info = &master->slaves[slave];
+        if (info->role != ECAT_ROLE_JOINT || info->axis_index >= DELTA_JOINT_COUNT) {
+            continue;
+        }
+        uint16_t status = info->txpdo.touch_probe_status;
+        if ((status & (PROBE_STATUS_ENABLED | PROBE_STATUS_POSITIVE_STORED)) != (PROBE_STATUS_ENABLED | PROBE_STATUS_POSITIVE_STORED)) {
+            return false;
+        }
+        joints->theta[info->axis_index] = info->txpdo.touch_probe_position;
+        ++latched;
+    }
+    return latched == DELTA_JOINT_COUNT;
+}
+
+static void start_stop(probe_t *probe, const planner_block_t *block, const delta_pose_t *current, const delta_pose_t *previous, uint32_t period_us)
+{
+    float period_s = (float)period_us * 1e-6f;
+    float step[3];
+    float length = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        step[axis] = q16_16_to_float(current->xyz[axis] - previous->xyz[axis]);
+        length += step[axis] * step[axis];
+    }
+    length = sqrtf(length);
+    for (int axis = 0; axis < 3; ++axis) {
+        probe->direction[axis] = length > 0.0f ? step[axis] / length : 0.0f;
+    }
+    probe->speed = length / period_s;
+    probe->accel = 0.0f;
+    probe->accel_limit = block != NULL ? q16_16_to_float(block->accel) : 1.0f;
+    probe->jerk_limit = block != NULL ? q16_16_to_float(block->jerk) : 5.0f;
+    probe->stop_pose = *current;
+    probe->phase = PROBE_PHASE_STOPPING;
+}
+
+void probe_update(probe_t *probe, planner_queue_t *planner, const ethcat_master_t *master, const delta_pose_t *current, const delta_pose_t *previous, uint32_t period_us)
+{
+    const planner_block_t *block = planner_active_block(planner);
+    switch (probe->phase) {
+    case PROBE_PHASE_IDLE:
+        if (block != NULL && block->probe) {
+            /* armed together with the first setpoint of the probing move */
+            probe->function = PROBE_FUNCTION_ARM;
+            probe->phase = PROBE_PHASE_ARMED;
+        }
+        break;
+    case PROBE_PHASE_ARMED: {
+        delta_joint_t latched;
+        if (read_latch(master, &latched)) {
+            /* the drives latched the encoders at the edge: accuracy is not tied to the cycle */
+            delta_pose_t contact;
+            if (delta_forward_kinematics(&latched, &contact)) {
+                planner->probe.contact = contact;
+            } else {
+                planner->probe.contact = *current;
+            }
+            probe->function = 0U;
+            start_stop(probe, block, current, previous, period_us);
+        } else if ((block == NULL && planner_is_settled(planner)) || (block != NULL && !block->probe)) {
+            /* with setpoint filtering the axes reach the probe target only once the output settles */
+            probe->function = 0U;
+            probe->phase = PROBE_PHASE_IDLE;
+            planner->probe.contact = planner->current_pose;
+            planner->probe.state = PLANNER_PROBE_MISSED;
+        }
+        break;
+    }
+    case PROBE_PHASE_STOPPING:
+    default:
+        break;
+    }
+}
+
+bool probe_stop_step(probe_t *probe, planner_queue_t *planner, delta_pose_t *pose, uint32_t period_us)
+{
+    if (probe->phase != PROBE_PHASE_STOPPING) {
+        return false;
+    }
+    /* jerk-limited stop: build deceleration up, then release it so speed and
+     * acceleration reach zero together */
+    float dt = (float)period_us * 1e-6f;
+    float release = probe->jerk_limit > 0.0f ? (probe->accel * probe->accel) / (2.0f * probe->jerk_limit) : 0.0f;
+    if (probe->speed <= release) {
+        probe->accel += probe->jerk_limit * dt;
+        if (probe->accel > 0.0f) {
+            probe->accel = 0.0f;
+        }
+    } else {
+        probe->accel -= probe->jerk_limit * dt;
+        if (probe->accel < -probe->accel_limit) {
+            probe->accel = -probe->accel_limit;
+        }
+    }
+    probe->speed += probe->accel * dt;
+    bool done = probe->speed <= 0.0f || probe->jerk_limit <= 0.0f;
+    if (done) {
+        probe->speed = 0.0f;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        probe->stop_pose.xyz[axis] += q16_16_from_float(probe->direction[axis] * probe->speed * dt);
+    }
+    *pose = probe->stop_pose;
+    if (done) {
+        probe->phase = PROBE_PHASE_IDLE;
+        planner_abort(planner, &probe->stop_pose);
+        planner->probe.state = PLANNER_PROBE_TRIGGERED;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef MOTION_PROBE_H
+#define MOTION_PROBE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "planner/planner.h"
+#include "ethcat/master.h"
+
+/* 0x60B8: probe 1 enabled, first event only, latch on the positive edge */
+#define PROBE_FUNCTION_ARM 0x0011U
+/* 0x60B9: probe 1 enabled, positive edge position stored */
+#define PROBE_STATUS_ENABLED 0x0001U
+#define PROBE_STATUS_POSITIVE_STORED 0x0002U
+
+typedef enum {
+    PROBE_PHASE_IDLE = 0,
+    PROBE_PHASE_ARMED,
+    PROBE_PHASE_STOPPING
+} probe_phase_t;
+
+typedef struct {
+    probe_phase_t phase;
+    uint16_t function;
+    delta_pose_t stop_pose;
+    float direction[3];
+    float speed;
+    float accel;
+    float accel_limit;
+    float jerk_limit;
+} probe_t;
+
+void probe_init(probe_t *probe);
+void probe_update(probe_t *probe, planner_queue_t *planner, const ethcat_master_t *master, const delta_pose_t *current, const delta_pose_t *previous, uint32_t period_us);
+bool probe_stop_step(probe_t *probe, planner_queue_t *planner, delta_pose_t *pose, uint32_t period_us);
+
+#endif
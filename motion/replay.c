@@ -0,0 +1,336 @@
+#include "replay.h"
+#include <string.h>
+
+#define REPLAY_FNV_PRIME 0x01000193UL
+
+uint32_t replay_hash(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0U; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * REPLAY_FNV_PRIME;
+    }
+    return hash;
+}
+
+void replay_init(replay_cache_t *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->mode = REPLAY_IDLE;
+}
+
+void replay_arm(replay_cache_t *cache, uint32_t config_hash)
+{
+    cache->valid = false;
+    cache->close_requested = false;
+    cache->play_requested = false;
+    cache->program_hash = REPLAY_HASH_SEED;
+    cache->config_hash = config_hash;
+    cache->frames = 0U;
+    cache->length = 0U;
+    cache->mode = REPLAY_ARMED;
+}
+
+void replay_add_line(replay_cache_t *cache, const char *line)
+{
+    /* line by line, so "G1 X1" + "Y2" and "G1 X1Y2" differ */
+    cache->program_hash = replay_hash(cache->program_hash, line, strlen(line));
+    cache->program_hash = replay_hash(cache->program_hash, "\n", 1U);
+}
+
+bool replay_teaching(const replay_cache_t *cache)
+{
+    return (cache->mode == REPLAY_ARMED || cache->mode == REPLAY_RECORDING) && !cache->close_requested;
+}
+
+static void reset_codec(replay_cache_t *cache)
+{
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        cache->position[j] = cache->start.theta[j];
+        cache->velocity[j] = 0;
+    }
+    cache->zero_run = 0U;
+    cache->cursor = 0U;
+    cache->frame = 0U;
+}
+
+void replay_record_begin(replay_cache_t *cache, const delta_joint_t *rest)
+{
+    cache->start = *rest;
+    cache->frames = 0U;
+    cache->length = 0U;
+    reset_codec(cache);
+    cache->mode = REPLAY_RECORDING;
+}
+
+/* Frame classes, chosen by the largest velocity change of the frame:
+ *   0aaaaabb bbbccccc            three 5-bit changes
+ *   100nnnnn                     n + 1 frames without a change
+ *   101aaaaa aabbbbbb bccccccc   three 7-bit changes
+ *   110xxxxx + three varints     anything larger
+ *   111ttttt                     changes of -1..1, t in base 3
+ * Q16.16 setpoints through the kinematics jitter by a few LSB every tick,
+ * the 2-byte class carries most of a move */
+#define REPLAY_RUN_MAX 32U
+#define REPLAY_TAG_RUN 0x80U
+#define REPLAY_TAG_WIDE 0xA0U
+#define REPLAY_TAG_ESCAPE 0xC0U
+#define REPLAY_TAG_TINY 0xE0U
+#define REPLAY_TAG_MASK 0xE0U
+
+static bool put_byte(replay_cache_t *cache, uint8_t byte)
+{
+    if (cache->length >= REPLAY_BUFFER_BYTES) {
+        return false;
+    }
+    cache->data[cache->length++] = byte;
+    return true;
+}
+
+static bool get_byte(replay_cache_t *cache, uint8_t *byte)
+{
+    if (cache->cursor >= cache->length) {
+        return false;
+    }
+    *byte = cache->data[cache->cursor++];
+    return true;
+}
+
+static bool put_varint(replay_cache_t *cache, uint32_t value)
+{
+    do {
+        uint8_t byte = (uint8_t)(value & 0x7FU);
+        value >>= 7;
+        if (!put_byte(cache, (uint8_t)(byte | (value != 0U ? 0x80U : 0U)))) {
+            return false;
+        }
+    } while (value != 0U);
+    return true;
+}
+
+static bool get_varint(replay_cache_t *cache, uint32_t *value)
+{
+    *value = 0U;
+    for (unsigned shift = 0U; shift < 32U; shift += 7U) {
+        uint8_t byte;
+        if (!get_byte(cache, &byte)) {
+            return false;
+        }
+        *value |= (uint32_t)(byte & 0x7FU) << shift;
+        if ((byte & 0x80U) == 0U) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1U);
+}
+
+static uint32_t pack(const int32_t *change, unsigned bits)
+{
+    uint32_t mask = (1UL << bits) - 1U;
+    return (((uint32_t)change[0] & mask) << (2U * bits)) | (((uint32_t)change[1] & mask) << bits) | ((uint32_t)change[2] & mask);
+}
+
+static void unpack(uint32_t packed, unsigned bits, int32_t *change)
+{
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        uint32_t field = (packed >> ((unsigned)(DELTA_JOINT_COUNT - 1 - j) * bits)) & ((1UL << bits) - 1U);
+        uint32_t sign = 1UL << (bits - 1U);
+        change[j] = (int32_t)(field ^ sign) - (int32_t)sign;
+    }
+}
+
+static bool flush_run(replay_cache_t *cache)
+{
+    while (cache->zero_run > 0U) {
+        uint32_t run = cache->zero_run < REPLAY_RUN_MAX ? cache->zero_run : REPLAY_RUN_MAX;
+        if (!put_byte(cache, (uint8_t)(REPLAY_TAG_RUN | (run - 1U)))) {
+            return false;
+        }
+        cache->zero_run -= run;
+    }
+    return true;
+}
+
+static bool put_frame(replay_cache_t *cache, const int32_t *change)
+{
+    int32_t largest = 0;
+    bool tiny = true;
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        /* two's complement range, -16..15 fits 5 bits */
+        int32_t magnitude = change[j] < 0 ? -(change[j] + 1) : change[j];
+        if (magnitude > largest) {
+            largest = magnitude;
+        }
+        tiny = tiny && change[j] >= -1 && change[j] <= 1;
+    }
+    if (tiny) {
+        uint32_t code = (uint32_t)(change[0] + 1) * 9U + (uint32_t)(change[1] + 1) * 3U + (uint32_t)(change[2] + 1);
+        return put_byte(cache, (uint8_t)(REPLAY_TAG_TINY | code));
+    }
+    if (largest < 16) {
+        uint32_t packed = pack(change, 5U);
+        return put_byte(cache, (uint8_t)(packed >> 8)) && put_byte(cache, (uint8_t)packed);
+    }
+    if (largest < 64) {
+        uint32_t packed = pack(change, 7U);
+        return put_byte(cache, (uint8_t)(REPLAY_TAG_WIDE | (packed >> 16))) &&
+               put_byte(cache, (uint8_t)(packed >> 8)) && put_byte(cache, (uint8_t)packed);
+    }
+    bool stored = put_byte(cache, REPLAY_TAG_ESCAPE);
+    for (int j = 0; j < DELTA_JOINT_COUNT && stored; ++j) {
+        stored = put_varint(cache, zigzag(change[j]));
+    }
+    return stored;
+}
+
+static bool get_frame(replay_cache_t *cache, int32_t *change)
+{
+    uint8_t tag;
+    uint8_t next[2];
+    if (cache->zero_run > 0U) {
+        cache->zero_run--;
+        return true;
+    }
+    if (!get_byte(cache, &tag)) {
+        return false;
+    }
+    if ((tag & 0x80U) == 0U) {
+        if (!get_byte(cache, &next[0])) {
+            return false;
+        }
+        unpack(((uint32_t)tag << 8) | next[0], 5U, change);
+        return true;
+    }
+    switch (tag & REPLAY_TAG_MASK) {
+    case REPLAY_TAG_RUN:
+        cache->zero_run = tag & 0x1FU; /* this frame is the first of the run */
+        return true;
+    case REPLAY_TAG_WIDE:
+        if (!get_byte(cache, &next[0]) || !get_byte(cache, &next[1])) {
+            return false;
+        }
+        unpack(((uint32_t)(tag & 0x1FU) << 16) | ((uint32_t)next[0] << 8) | next[1], 7U, change);
+        return true;
+    case REPLAY_TAG_TINY: {
+        uint32_t code = tag & 0x1FU;
+        change[0] = (int32_t)(code / 9U) - 1;
+        change[1] = (int32_t)(code / 3U % 3U) - 1;
+        change[2] = (int32_t)(code % 3U) - 1;
+        return code < 27U;
+    }
+    default:
+        for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+            uint32_t value;
+            if (!get_varint(cache, &value)) {
+                return false;
+            }
+            change[j] = unzigzag(value);
+        }
+        return true;
+    }
+}
+
+bool replay_record(replay_cache_t *cache, const delta_joint_t *joints)
+{
+    if (cache->mode != REPLAY_RECORDING) {
+        return false;
+    }
+    int32_t change[DELTA_JOINT_COUNT];
+    bool still = true;
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        /* wrapping arithmetic, the decoder wraps the same way */
+        int32_t velocity = (int32_t)((uint32_t)joints->theta[j] - (uint32_t)cache->position[j]);
+        change[j] = (int32_t)((uint32_t)velocity - (uint32_t)cache->velocity[j]);
+        still = still && change[j] == 0;
+        cache->position[j] = joints->theta[j];
+        cache->velocity[j] = velocity;
+    }
+    cache->frames++;
+    if (still) {
+        cache->zero_run++;
+        return true;
+    }
+    if (!flush_run(cache) || !put_frame(cache, change)) {
+        /* too long for the buffer, the program runs planned as before */
+        replay_cancel(cache);
+        return false;
+    }
+    return true;
+}
+
+bool replay_record_end(replay_cache_t *cache, const delta_pose_t *end_pose)
+{
+    if (cache->mode != REPLAY_RECORDING || cache->frames == 0U || !flush_run(cache)) {
+        replay_cancel(cache);
+        return false;
+    }
+    cache->end_pose = *end_pose;
+    cache->close_requested = false;
+    cache->valid = true;
+    cache->mode = REPLAY_IDLE;
+    return true;
+}
+
+void replay_cancel(replay_cache_t *cache)
+{
+    if (cache->mode == REPLAY_ARMED || cache->mode == REPLAY_RECORDING) {
+        cache->valid = false;
+    }
+    cache->close_requested = false;
+    cache->play_requested = false;
+    cache->mode = REPLAY_IDLE;
+}
+
+bool replay_matches(const replay_cache_t *cache, uint32_t program_hash, uint32_t config_hash, const delta_joint_t *current)
+{
+    /* the stream is absolute, it only fits where the program started */
+    return cache->valid && cache->mode == REPLAY_IDLE &&
+           cache->program_hash == program_hash && cache->config_hash == config_hash &&
+           memcmp(current, &cache->start, sizeof(*current)) == 0;
+}
+
+bool replay_play_begin(replay_cache_t *cache)
+{
+    if (!cache->valid || cache->mode != REPLAY_IDLE) {
+        return false;
+    }
+    reset_codec(cache);
+    cache->mode = REPLAY_PLAYING;
+    return true;
+}
+
+bool replay_play(replay_cache_t *cache, delta_joint_t *joints)
+{
+    int32_t change[DELTA_JOINT_COUNT] = {0};
+    if (cache->mode != REPLAY_PLAYING || cache->frame >= cache->frames || !get_frame(cache, change)) {
+        cache->mode = REPLAY_IDLE;
+        return false;
+    }
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        cache->velocity[j] = (int32_t)((uint32_t)cache->velocity[j] + (uint32_t)change[j]);
+        cache->position[j] = (q16_16_t)((uint32_t)cache->position[j] + (uint32_t)cache->velocity[j]);
+        joints->theta[j] = cache->position[j];
+    }
+    cache->frame++;
+    return true;
+}
+
+bool replay_resting(const replay_cache_t *cache)
+{
+    /* the last frame played repeated the one before: the taught program stood still there */
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        if (cache->velocity[j] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
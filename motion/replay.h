@@ -0,0 +1,59 @@
+#ifndef MOTION_REPLAY_H
+#define MOTION_REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "board/config.h"
+#include "kinematics/delta.h"
+
+/* Teach-and-replay cache: the joint setpoints a program produced, one frame
+ * per control tick, stored as second differences. Constant-velocity and
+ * resting stretches collapse into run lengths, accelerating joints cost a
+ * zigzag varint each. Keyed by a hash of the program text and the config */
+
+#define REPLAY_BUFFER_BYTES 16384U
+#define REPLAY_HASH_SEED 0x811C9DC5UL /* FNV-1a offset basis */
+
+typedef enum {
+    REPLAY_IDLE = 0,
+    REPLAY_ARMED,     /* teaching, waiting for the first move */
+    REPLAY_RECORDING,
+    REPLAY_PLAYING
+} replay_mode_t;
+
+typedef struct {
+    replay_mode_t mode;
+    bool valid;            /* a complete program is cached */
+    bool close_requested;  /* the taught program is fully queued, stop once settled */
+    bool play_requested;
+    uint32_t program_hash;
+    uint32_t config_hash;
+    uint32_t frames;
+    uint32_t length;       /* encoded bytes */
+    delta_joint_t start;   /* resting setpoint the program starts from */
+    delta_pose_t end_pose; /* where the planner continues after a replay */
+    /* encoder or decoder state */
+    q16_16_t position[DELTA_JOINT_COUNT];
+    int32_t velocity[DELTA_JOINT_COUNT];
+    uint32_t zero_run;
+    uint32_t cursor;
+    uint32_t frame;
+    uint8_t data[REPLAY_BUFFER_BYTES];
+} replay_cache_t;
+
+uint32_t replay_hash(uint32_t hash, const void *data, size_t length);
+void replay_init(replay_cache_t *cache);
+void replay_arm(replay_cache_t *cache, uint32_t config_hash);
+void replay_add_line(replay_cache_t *cache, const char *line);
+bool replay_teaching(const replay_cache_t *cache);
+void replay_record_begin(replay_cache_t *cache, const delta_joint_t *rest);
+bool replay_record(replay_cache_t *cache, const delta_joint_t *joints);
+bool replay_record_end(replay_cache_t *cache, const delta_pose_t *end_pose);
+void replay_cancel(replay_cache_t *cache);
+bool replay_matches(const replay_cache_t *cache, uint32_t program_hash, uint32_t config_hash, const delta_joint_t *current);
+bool replay_play_begin(replay_cache_t *cache);
+bool replay_play(replay_cache_t *cache, delta_joint_t *joints);
+bool replay_resting(const replay_cache_t *cache);
+
+#endif
@@ -0,0 +1,177 @@
+#include "sync.h"
+#include <stddef.h>
+#include <math.h>
+
+void conveyor_sync_init(conveyor_sync_t *sync)
+{
+    sync->slave = -1;
+    for (int i = 0; i < 3; ++i) {
+        sync->direction[i] = 0;
+    }
+    sync->scale = 0;
+    sync->latency_ns = 0U;
+    sync->counts = 0;
+    sync->origin = 0;
+    sync->last_raw = 0;
+    sync->sample_time_ns = 0ULL;
+    sync->position = 0.0f;
+    sync->velocity = 0.0f;
+    sync->lead_position = 0.0f;
+    sync->have_sample = false;
+    sync->stale = false;
+    sync->engaged = false;
+    conveyor_sync_clear(sync);
+}
+
+void conveyor_sync_configure(conveyor_sync_t *sync, int slave, const q16_16_t *direction, q16_16_t scale, uint32_t latency_ns)
+{
+    conveyor_sync_init(sync);
+    if (slave < 0 || direction == NULL || scale == 0) {
+        return;
+    }
+    float length = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float component = q16_16_to_float(direction[i]);
+        length += component * component;
+    }
+    if (length <= 0.0f) {
+        return;
+    }
+    length = sqrtf(length);
+    for (int i = 0; i < 3; ++i) {
+        sync->direction[i] = q16_16_from_float(q16_16_to_float(direction[i]) / length);
+    }
+    sync->slave = slave;
+    sync->scale = scale;
+    sync->latency_ns = latency_ns;
+}
+
+bool conveyor_sync_enabled(const conveyor_sync_t *sync)
+{
+    return sync->slave >= 0;
+}
+
+static float counts_to_m(const conveyor_sync_t *sync, int64_t counts)
+{
+    return (float)counts / 65536.0f * q16_16_to_float(sync->scale);
+}
+
+static void rebase(conveyor_sync_t *sync)
+{
+    /* float resolution degrades with distance: keep the estimate near the origin */
+    if (fabsf(sync->position) < CONVEYOR_REBASE_M) {
+        return;
+    }
+    int64_t shift = (int64_t)(sync->position / q16_16_to_float(sync->scale) * 65536.0f);
+    float moved = counts_to_m(sync, shift);
+    sync->origin += shift;
+    sync->position -= moved;
+    sync->lead_position -= moved;
+}
+
+void conveyor_sync_sample(conveyor_sync_t *sync, q16_16_t raw, uint64_t sample_time_ns)
+{
+    if (!sync->have_sample) {
+        sync->counts = 0;
+        sync->origin = 0;
+        sync->last_raw = raw;
+        sync->sample_time_ns = sample_time_ns;
+        sync->position = 0.0f;
+        sync->velocity = 0.0f;
+        sync->lead_position = 0.0f;
+        sync->have_sample = true;
+        return;
+    }
+    if (sample_time_ns <= sync->sample_time_ns) {
+        return; /* same latch seen again */
+    }
+    /* the drive position wraps, the difference of two samples does not */
+    sync->counts += (int32_t)((uint32_t)raw - (uint32_t)sync->last_raw);
+    sync->last_raw = raw;
+
+    float dt = (float)(sample_time_ns - sync->sample_time_ns) * 1e-9f;
+    float predicted = sync->position + sync->velocity * dt;
+    float residual = counts_to_m(sync, sync->counts - sync->origin) - predicted;
+    sync->position = predicted + CONVEYOR_ALPHA * residual;
+    sync->velocity += CONVEYOR_BETA * residual / dt;
+    sync->sample_time_ns = sample_time_ns;
+    sync->stale = false;
+    rebase(sync);
+}
+
+void conveyor_sync_engage(conveyor_sync_t *sync, bool engage)
+{
+    sync->engaged = engage;
+}
+
+bool conveyor_sync_ramping(const conveyor_sync_t *sync)
+{
+    return sync->engaged ? sync->phase < 1.0f : sync->phase > 0.0f;
+}
+
+static float coast_s(float lead_s, float fresh_s)
+{
+    /* past the fresh horizon the estimate decelerates linearly to rest, the frame never stops dead */
+    float ramp_s = (float)CONVEYOR_RAMP_MS * 1e-3f;
+    if (lead_s <= fresh_s) {
+        return lead_s;
+    }
+    float t = lead_s - fresh_s < ramp_s ? lead_s - fresh_s : ramp_s;
+    return fresh_s + t - t * t / (2.0f * ramp_s);
+}
+
+void conveyor_sync_step(conveyor_sync_t *sync, uint64_t now_ns, uint32_t cycle_ns)
+{
+    if (!sync->have_sample) {
+        return;
+    }
+    /* the setpoint computed now is executed a cycle later and the drive lags
+     * it by its own latency: aim at where the belt will be by then */
+    uint64_t limit = (uint64_t)cycle_ns * CONVEYOR_STALE_CYCLES;
+    uint64_t age = now_ns > sync->sample_time_ns ? now_ns - sync->sample_time_ns : 0ULL;
+    sync->stale = age > limit;
+    float lead_s = (float)(age + cycle_ns + sync->latency_ns) * 1e-9f;
+    float fresh_s = (float)(limit + cycle_ns + sync->latency_ns) * 1e-9f;
+    float lead = sync->position + sync->velocity * coast_s(lead_s, fresh_s);
+
+    float step = (float)cycle_ns / ((float)CONVEYOR_RAMP_MS * 1e6f);
+    if (sync->engaged) {
+        sync->phase = sync->phase + step > 1.0f ? 1.0f : sync->phase + step;
+    } else {
+        sync->phase = sync->phase - step < 0.0f ? 0.0f : sync->phase - step;
+    }
+    /* smoothstep: the frame velocity ramps with bounded acceleration */
+    sync->weight = sync->phase * sync->phase * (3.0f - 2.0f * sync->phase);
+    sync->offset += sync->weight * (lead - sync->lead_position);
+    sync->lead_position = lead;
+}
+
+static void shift(const conveyor_sync_t *sync, float offset, const delta_pose_t *in, delta_pose_t *out)
+{
+    for (int i = 0; i < 3; ++i) {
+        out->xyz[i] = in->xyz[i] + q16_16_from_float(offset * q16_16_to_float(sync->direction[i]));
+    }
+}
+
+void conveyor_sync_apply(const conveyor_sync_t *sync, const delta_pose_t *in, delta_pose_t *out)
+{
+    shift(sync, sync->offset, in, out);
+}
+
+void conveyor_sync_apply_stop(const conveyor_sync_t *sync, const delta_pose_t *in, delta_pose_t *out)
+{
+    /* released now, the weight ramps down from its phase: the belt still carries
+     * the frame by v * ramp * (p^3 - p^4 / 2), the integral of the smoothstep */
+    float ramp_s = (float)CONVEYOR_RAMP_MS * 1e-3f;
+    float p = sync->phase;
+    float coast = sync->velocity * ramp_s * (p * p * p - 0.5f * p * p * p * p);
+    float margin = sync->velocity < 0.0f ? -CONVEYOR_REACH_MARGIN_M : CONVEYOR_REACH_MARGIN_M;
+    shift(sync, sync->offset + coast + margin, in, out);
+}
+
+void conveyor_sync_clear(conveyor_sync_t *sync)
+{
+    sync->offset = 0.0f;
+    sync->weight = 0.0f;
+    sync->phase = 0.0f;
+}
@@ -0,0 +1,51 @@
+#ifndef MOTION_SYNC_H
+#define MOTION_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kinematics/delta.h"
+
+/* alpha-beta gains of the belt estimator, per DC-timestamped sample */
+#define CONVEYOR_ALPHA 0.5f
+#define CONVEYOR_BETA 0.1f
+/* engaging and releasing blend the belt velocity in over this time */
+#define CONVEYOR_RAMP_MS 100U
+/* without a fresh sample for this many cycles the estimate decelerates to rest over CONVEYOR_RAMP_MS */
+#define CONVEYOR_STALE_CYCLES 10U
+/* tracking is released while the stop pose is still this far inside reach, m */
+#define CONVEYOR_REACH_MARGIN_M 0.005f
+/* the estimate is rebased once it drifts this far from the count origin, m */
+#define CONVEYOR_REBASE_M 1.0f
+
+typedef struct {
+    int slave;                /* bus index of the belt encoder drive, -1 disables tracking */
+    q16_16_t direction[3];    /* unit vector of belt travel in machine coordinates */
+    q16_16_t scale;           /* m per position unit */
+    uint32_t latency_ns;      /* drive response behind the commanded setpoint */
+    int64_t counts;           /* unwrapped raw position */
+    int64_t origin;           /* counts the estimate is relative to */
+    q16_16_t last_raw;
+    uint64_t sample_time_ns;  /* DC latch time of the last sample */
+    float position;           /* m from origin at sample_time_ns */
+    float velocity;           /* m/s */
+    float lead_position;      /* extrapolated to setpoint execution, last cycle */
+    float offset;             /* m travelled by the tracking frame */
+    float weight;             /* 0..1, share of the belt motion the frame follows */
+    float phase;              /* 0..1 through the engage or release ramp */
+    bool have_sample;
+    bool stale;
+    bool engaged;
+} conveyor_sync_t;
+
+void conveyor_sync_init(conveyor_sync_t *sync);
+void conveyor_sync_configure(conveyor_sync_t *sync, int slave, const q16_16_t *direction, q16_16_t scale, uint32_t latency_ns);
+bool conveyor_sync_enabled(const conveyor_sync_t *sync);
+void conveyor_sync_sample(conveyor_sync_t *sync, q16_16_t raw, uint64_t sample_time_ns);
+void conveyor_sync_engage(conveyor_sync_t *sync, bool engage);
+bool conveyor_sync_ramping(const conveyor_sync_t *sync);
+void conveyor_sync_step(conveyor_sync_t *sync, uint64_t now_ns, uint32_t cycle_ns);
+void conveyor_sync_apply(const conveyor_sync_t *sync, const delta_pose_t *in, delta_pose_t *out);
+void conveyor_sync_apply_stop(const conveyor_sync_t *sync, const delta_pose_t *in, delta_pose_t *out);
+void conveyor_sync_clear(conveyor_sync_t *sync);
+
+#endif
@@ -0,0 +1,242 @@
+#include "trace.h"
+#include "utils/crc16.h"
+#include <string.h>
+
+#define TRACE_HEADER_BYTES 14U
+
+void trace_init(trace_t *trace)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->state = TRACE_IDLE;
+}
+
+trace_state_t trace_state(const trace_t *trace)
+{
+    return (trace_state_t)__atomic_load_n(&trace->state, __ATOMIC_ACQUIRE);
+}
+
+static const q16_16_t *resolve(const motion_controller_t *motion, const trace_channel_t *channel)
+{
+    if (channel->signal == TRACE_SIGNAL_POSE) {
+        return channel->index < 3U ? &motion->command_pose.xyz[channel->index] : NULL;
+    }
+    if (channel->index >= DELTA_JOINT_COUNT) {
+        return NULL;
+    }
+    if (channel->signal == TRACE_SIGNAL_FOLLOWING_ERROR) {
+        return &motion->following.error[channel->index];
+    }
+    /* the rest comes straight from the process data the drive saw or sent */
+    int slave = ethcat_master_find_slave(motion->master, ECAT_ROLE_JOINT, channel->index);
+    if (slave < 0) {
+        return NULL;
+    }
+    const ethcat_slave_t *info = &motion->master->slaves[slave];
+    switch ((trace_signal_t)channel->signal) {
+    case TRACE_SIGNAL_POSITION_COMMAND:
+        return &info->rxpdo.target_position;
+    case TRACE_SIGNAL_POSITION_ACTUAL:
+        return &info->txpdo.position_actual;
+    case TRACE_SIGNAL_VELOCITY_COMMAND:
+        return &info->rxpdo.target_velocity;
+    case TRACE_SIGNAL_VELOCITY_ACTUAL:
+        return &info->txpdo.velocity_actual;
+    case TRACE_SIGNAL_TORQUE_COMMAND:
+        return &info->rxpdo.target_torque;
+    case TRACE_SIGNAL_TORQUE_ACTUAL:
+        return &info->txpdo.torque_actual;
+    default:
+        return NULL;
+    }
+}
+
+bool trace_configure(trace_t *trace, const motion_controller_t *motion, const trace_channel_t *channels, int count)
+{
+    const q16_16_t *source[TRACE_MAX_CHANNELS];
+    if (trace_state(trace) == TRACE_ARMED || trace_state(trace) == TRACE_TRIGGERED ||
+        count <= 0 || count > TRACE_MAX_CHANNELS) {
+        return false;
+    }
+    for (int c = 0; c < count; ++c) {
+        source[c] = resolve(motion, &channels[c]);
+        if (source[c] == NULL) {
+            return false;
+        }
+    }
+    /* a new layout invalidates the last capture */
+    __atomic_store_n(&trace->state, TRACE_IDLE, __ATOMIC_RELEASE);
+    trace->dump_offset = 0U;
+    trace->dump_length = 0U;
+    for (int c = 0; c < count; ++c) {
+        trace->channels[c] = channels[c];
+        trace->source[c] = source[c];
+    }
+    trace->channel_count = (uint8_t)count;
+    if (trace->trigger_channel >= count) {
+        trace->trigger = TRACE_TRIGGER_MANUAL;
+        trace->trigger_channel = 0U;
+    }
+    return true;
+}
+
+bool trace_set_trigger(trace_t *trace, trace_trigger_t trigger, int channel, q16_16_t level)
+{
+    bool edge = trigger == TRACE_TRIGGER_RISING || trigger == TRACE_TRIGGER_FALLING;
+    if (trace_state(trace) == TRACE_ARMED || trace_state(trace) == TRACE_TRIGGERED || trigger > TRACE_TRIGGER_FALLING ||
+        (edge && (channel < 0 || channel >= trace->channel_count))) {
+        return false;
+    }
+    trace->trigger = (uint8_t)trigger;
+    trace->trigger_channel = edge ? (uint8_t)channel : 0U;
+    trace->trigger_level = level;
+    return true;
+}
+
+bool trace_arm(trace_t *trace, uint16_t pre, uint32_t period_us)
+{
+    if (trace->channel_count == 0U || trace_state(trace) == TRACE_ARMED || trace_state(trace) == TRACE_TRIGGERED) {
+        return false;
+    }
+    uint16_t depth = (uint16_t)(TRACE_BUFFER_WORDS / trace->channel_count);
+    if (pre >= depth) {
+        return false;
+    }
+    trace->depth = depth;
+    trace->pre = pre;
+    trace->period_us = period_us;
+    trace->head = 0U;
+    trace->captured = 0U;
+    trace->remaining = 0U;
+    trace->dump_offset = 0U;
+    trace->dump_length = 0U;
+    __atomic_store_n(&trace->trigger_requested, 0U, __ATOMIC_RELAXED);
+    __atomic_store_n(&trace->state, TRACE_ARMED, __ATOMIC_RELEASE);
+    return true;
+}
+
+void trace_trigger(trace_t *trace)
+{
+    __atomic_store_n(&trace->trigger_requested, 1U, __ATOMIC_RELAXED);
+}
+
+void trace_stop(trace_t *trace)
+{
+    __atomic_store_n(&trace->state, TRACE_IDLE, __ATOMIC_RELEASE);
+    trace->dump_offset = 0U;
+    trace->dump_length = 0U;
+}
+
+static bool triggered(trace_t *trace, const int32_t *sample, bool fault)
+{
+    q16_16_t value = sample[trace->trigger_channel];
+    q16_16_t last = trace->last;
+    trace->last = value;
+    if (__atomic_load_n(&trace->trigger_requested, __ATOMIC_RELAXED) != 0U) {
+        return true;
+    }
+    switch ((trace_trigger_t)trace->trigger) {
+    case TRACE_TRIGGER_FAULT:
+        return fault;
+    case TRACE_TRIGGER_RISING:
+        return trace->captured > 1U && last < trace->trigger_level && value >= trace->trigger_level;
+    case TRACE_TRIGGER_FALLING:
+        return trace->captured > 1U && last > trace->trigger_level && value <= trace->trigger_level;
+    default:
+        return false;
+    }
+}
+
+void trace_sample(trace_t *trace, bool fault)
+{
+    uint32_t state = __atomic_load_n(&trace->state, __ATOMIC_ACQUIRE);
+    if (state != TRACE_ARMED && state != TRACE_TRIGGERED) {
+        return;
+    }
+    int32_t *slot = &trace->data[trace->head];
+    for (uint8_t c = 0U; c < trace->channel_count; ++c) {
+        slot[c] = *trace->source[c];
+    }
+    trace->head += trace->channel_count;
+    if (trace->head >= (uint32_t)trace->depth * trace->channel_count) {
+        trace->head = 0U;
+    }
+    if (trace->captured < trace->depth) {
+        trace->captured++;
+    }
+    if (state == TRACE_ARMED) {
+        /* not before the pre-trigger history is complete; the sample that triggers is the first after it */
+        if (triggered(trace, slot, fault) && trace->captured > trace->pre) {
+            trace->remaining = (uint32_t)(trace->depth - trace->pre) - 1U;
+            state = TRACE_TRIGGERED;
+        }
+    } else {
+        trace->remaining--;
+    }
+    if (state == TRACE_TRIGGERED && trace->remaining == 0U) {
+        state = TRACE_DONE;
+    }
+    __atomic_store_n(&trace->state, state, __ATOMIC_RELEASE);
+}
+
+bool trace_dump_begin(trace_t *trace)
+{
+    if (trace_state(trace) != TRACE_DONE) {
+        return false;
+    }
+    trace->dump_length = TRACE_HEADER_BYTES + 2U * trace->channel_count +
+                         4U * (uint32_t)trace->depth * trace->channel_count + 2U;
+    trace->dump_offset = 0U;
+    trace->dump_crc = 0xFFFFU;
+    return true;
+}
+
+static uint8_t dump_byte(const trace_t *trace, uint32_t offset)
+{
+    uint32_t channels = trace->channel_count;
+    if (offset < TRACE_HEADER_BYTES) {
+        /* "TRC" version count trigger pre:16 depth:16 period_us:32, little-endian */
+        uint8_t header[TRACE_HEADER_BYTES] = {
+            (uint8_t)TRACE_MAGIC[0], (uint8_t)TRACE_MAGIC[1], (uint8_t)TRACE_MAGIC[2], TRACE_VERSION,
+            (uint8_t)channels, trace->trigger,
+            (uint8_t)trace->pre, (uint8_t)(trace->pre >> 8),
+            (uint8_t)trace->depth, (uint8_t)(trace->depth >> 8),
+            (uint8_t)trace->period_us, (uint8_t)(trace->period_us >> 8),
+            (uint8_t)(trace->period_us >> 16), (uint8_t)(trace->period_us >> 24)};
+        return header[offset];
+    }
+    offset -= TRACE_HEADER_BYTES;
+    if (offset < 2U * channels) {
+        const trace_channel_t *channel = &trace->channels[offset / 2U];
+        return (offset & 1U) == 0U ? channel->signal : channel->index;
+    }
+    offset -= 2U * channels;
+    /* the ring is full once a capture is done, the oldest sample sits at head */
+    uint32_t word = (trace->head + offset / 4U) % ((uint32_t)trace->depth * channels);
+    return (uint8_t)((uint32_t)trace->data[word] >> (8U * (offset % 4U)));
+}
+
+bool trace_dumping(const trace_t *trace)
+{
+    return trace->dump_offset < trace->dump_length;
+}
+
+size_t trace_dump_read(trace_t *trace, uint8_t *out, size_t size)
+{
+    size_t count = 0U;
+    if (trace_state(trace) != TRACE_DONE) {
+        return 0U;
+    }
+    while (count < size && trace->dump_offset < trace->dump_length) {
+        uint32_t crc_at = trace->dump_length - 2U;
+        uint8_t byte;
+        if (trace->dump_offset < crc_at) {
+            byte = dump_byte(trace, trace->dump_offset);
+            trace->dump_crc = crc16_ccitt(&byte, 1U, trace->dump_crc);
+        } else {
+            byte = (uint8_t)(trace->dump_crc >> (8U * (trace->dump_offset - crc_at)));
+        }
+        out[count++] = byte;
+        trace->dump_offset++;
+    }
+    return count;
+}
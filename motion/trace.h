@@ -0,0 +1,87 @@
+#ifndef MOTION_TRACE_H
+#define MOTION_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "motion_control.h"
+
+/* Triggered scope capture for drive tuning. The Sync0 path copies one word
+ * per channel through pointers resolved at configure time into a ring; the
+ * background arms it, and once the post-trigger samples are in, streams the
+ * capture as a binary dump. Single producer, single consumer: the state
+ * word hands the ring over, nothing else is shared while a capture runs */
+
+#define TRACE_MAX_CHANNELS 8
+#define TRACE_BUFFER_WORDS 2048U /* 8 KB, 256 samples at 8 channels */
+#define TRACE_MAGIC "TRC"
+#define TRACE_VERSION 1U
+
+typedef enum {
+    TRACE_SIGNAL_POSITION_COMMAND = 0, /* joint, rad */
+    TRACE_SIGNAL_POSITION_ACTUAL,
+    TRACE_SIGNAL_VELOCITY_COMMAND,     /* joint, rad/s */
+    TRACE_SIGNAL_VELOCITY_ACTUAL,
+    TRACE_SIGNAL_TORQUE_COMMAND,       /* joint, feed-forward after the notch */
+    TRACE_SIGNAL_TORQUE_ACTUAL,
+    TRACE_SIGNAL_FOLLOWING_ERROR,      /* joint, rad */
+    TRACE_SIGNAL_POSE,                 /* commanded tool pose, axis 0..2, m */
+    TRACE_SIGNAL_COUNT
+} trace_signal_t;
+
+typedef enum {
+    TRACE_TRIGGER_MANUAL = 0, /* only trace_trigger() */
+    TRACE_TRIGGER_FAULT,
+    TRACE_TRIGGER_RISING,     /* channel crosses the level upwards */
+    TRACE_TRIGGER_FALLING
+} trace_trigger_t;
+
+typedef enum {
+    TRACE_IDLE = 0,
+    TRACE_ARMED,     /* filling the pre-trigger history, watching the trigger */
+    TRACE_TRIGGERED, /* recording the post-trigger samples */
+    TRACE_DONE       /* the ring belongs to the background again */
+} trace_state_t;
+
+typedef struct {
+    uint8_t signal; /* trace_signal_t */
+    uint8_t index;  /* joint or axis */
+} trace_channel_t;
+
+typedef struct {
+    uint32_t state; /* trace_state_t, handed over with acquire/release */
+    uint32_t trigger_requested;
+    trace_channel_t channels[TRACE_MAX_CHANNELS];
+    const q16_16_t *source[TRACE_MAX_CHANNELS];
+    uint8_t channel_count;
+    uint8_t trigger;         /* trace_trigger_t */
+    uint8_t trigger_channel;
+    q16_16_t trigger_level;
+    uint16_t depth;          /* samples in the ring */
+    uint16_t pre;            /* samples kept before the trigger */
+    uint32_t period_us;
+    /* written by the sampler only */
+    uint32_t head;           /* next word */
+    uint32_t captured;
+    uint32_t remaining;      /* post-trigger samples still to come */
+    q16_16_t last;           /* trigger channel, previous sample */
+    /* dump */
+    uint32_t dump_offset;    /* bytes already streamed, 0 when idle */
+    uint32_t dump_length;
+    uint16_t dump_crc;
+    int32_t data[TRACE_BUFFER_WORDS];
+} trace_t;
+
+void trace_init(trace_t *trace);
+bool trace_configure(trace_t *trace, const motion_controller_t *motion, const trace_channel_t *channels, int count);
+bool trace_set_trigger(trace_t *trace, trace_trigger_t trigger, int channel, q16_16_t level);
+bool trace_arm(trace_t *trace, uint16_t pre, uint32_t period_us);
+void trace_trigger(trace_t *trace);
+void trace_stop(trace_t *trace);
+trace_state_t trace_state(const trace_t *trace);
+void trace_sample(trace_t *trace, bool fault);
+bool trace_dump_begin(trace_t *trace);
+bool trace_dumping(const trace_t *trace);
+size_t trace_dump_read(trace_t *trace, uint8_t *out, size_t size);
+
+#endif
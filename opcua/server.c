@@ -0,0 +1,1561 @@
+#if defined(HOST_OS)
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "server.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+static cnc_status_t s_status;
+static uint64_t s_status_time = 0U; /* UA DateTime of the snapshot */
+
+#if defined(HOST_OS)
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UA_GOOD 0x00000000UL
+#define UA_BAD_DECODING_ERROR 0x80070000UL
+#define UA_BAD_SERVICE_UNSUPPORTED 0x800B0000UL
+#define UA_BAD_NOTHING_TO_DO 0x800F0000UL
+#define UA_BAD_TOO_MANY_OPERATIONS 0x80100000UL
+#define UA_BAD_SECURE_CHANNEL_ID_INVALID 0x80220000UL
+#define UA_BAD_SESSION_ID_INVALID 0x80250000UL
+#define UA_BAD_SESSION_NOT_ACTIVATED 0x80270000UL
+#define UA_BAD_SUBSCRIPTION_ID_INVALID 0x80280000UL
+#define UA_BAD_NODE_ID_UNKNOWN 0x80340000UL
+#define UA_BAD_ATTRIBUTE_ID_INVALID 0x80350000UL
+#define UA_BAD_MONITORED_ITEM_ID_INVALID 0x80420000UL
+#define UA_BAD_FILTER_UNSUPPORTED 0x80440000UL
+#define UA_BAD_FILTER_NOT_ALLOWED 0x80450000UL
+#define UA_BAD_SECURITY_POLICY_REJECTED 0x80550000UL
+#define UA_BAD_TOO_MANY_SESSIONS 0x80560000UL
+#define UA_BAD_TOO_MANY_SUBSCRIPTIONS 0x80770000UL
+#define UA_BAD_TOO_MANY_PUBLISH_REQUESTS 0x80780000UL
+#define UA_BAD_NO_SUBSCRIPTION 0x80790000UL
+#define UA_BAD_TCP_MESSAGE_TYPE_INVALID 0x807E0000UL
+#define UA_BAD_TCP_MESSAGE_TOO_LARGE 0x80800000UL
+#define UA_BAD_DEADBAND_FILTER_INVALID 0x808E0000UL
+#define UA_BAD_TOO_MANY_MONITORED_ITEMS 0x80DB0000UL
+
+/* binary encoding ids of the services, namespace 0 */
+#define UA_ID_SERVICE_FAULT 397U
+#define UA_ID_GET_ENDPOINTS 428U
+#define UA_ID_OPEN_CHANNEL 446U
+#define UA_ID_CREATE_SESSION 461U
+#define UA_ID_ACTIVATE_SESSION 467U
+#define UA_ID_CLOSE_SESSION 473U
+#define UA_ID_READ 631U
+#define UA_ID_DATA_CHANGE_FILTER 724U
+#define UA_ID_CREATE_ITEMS 751U
+#define UA_ID_DELETE_ITEMS 781U
+#define UA_ID_CREATE_SUBSCRIPTION 787U
+#define UA_ID_DATA_CHANGE_NOTIFICATION 811U
+#define UA_ID_PUBLISH 826U
+#define UA_ID_DELETE_SUBSCRIPTIONS 847U
+#define UA_RESPONSE(request) ((request) + 3U)
+
+#define UA_BOOLEAN 1U
+#define UA_BYTE 3U
+#define UA_INT32 6U
+#define UA_UINT32 7U
+#define UA_DOUBLE 11U
+#define UA_NODE_ID 17U
+#define UA_QUALIFIED_NAME 20U
+#define UA_LOCALIZED_TEXT 21U
+
+#define UA_ATTRIBUTE_NODE_ID 1U
+#define UA_ATTRIBUTE_NODE_CLASS 2U
+#define UA_ATTRIBUTE_BROWSE_NAME 3U
+#define UA_ATTRIBUTE_DISPLAY_NAME 4U
+#define UA_ATTRIBUTE_VALUE 13U
+#define UA_ATTRIBUTE_DATA_TYPE 14U
+#define UA_ATTRIBUTE_ACCESS_LEVEL 17U
+#define UA_ATTRIBUTE_USER_ACCESS_LEVEL 18U
+
+#define UA_TIMESTAMPS_SOURCE 0U
+#define UA_TIMESTAMPS_SERVER 1U
+#define UA_TIMESTAMPS_BOTH 2U
+#define UA_MONITORING_REPORTING 2U
+#define UA_DEADBAND_NONE 0U
+#define UA_DEADBAND_ABSOLUTE 1U
+#define UA_SECURITY_MODE_NONE 1U
+#define UA_NONCE_LENGTH 32U
+#define UA_HEADER_SIZE 8U
+#define UA_EPOCH_OFFSET_S 11644473600ULL /* 1601-01-01 to 1970-01-01 */
+
+static const char s_policy_none[] = "http://opcfoundation.org/UA/SecurityPolicy#None";
+static const char s_transport_profile[] = "http://opcfoundation.org/UA-Profile/Transport/uatcp-uasc-uabinary";
+
+typedef enum {
+    FIELD_STATE = 0,
+    FIELD_DRIVES_ENABLED,
+    FIELD_ALARM_ACTIVE,
+    FIELD_DRIVES_READY,
+    FIELD_POSITION,
+    FIELD_JOINT_POSITION,
+    FIELD_FOLLOWING_ERROR,
+    FIELD_CYCLES,
+    FIELD_MISSED_CYCLES,
+    FIELD_LOST_FRAMES,
+    FIELD_FOLLOWING_WARNINGS
+} ua_field_t;
+
+typedef struct {
+    uint32_t id;
+    const char *name;
+    uint8_t type;
+    uint8_t field;
+    uint8_t index;
+} ua_node_t;
+
+static const ua_node_t s_nodes[] = {
+    {OPCUA_NODE_STATE, "State", UA_INT32, FIELD_STATE, 0U},
+    {OPCUA_NODE_DRIVES_ENABLED, "DrivesEnabled", UA_BOOLEAN, FIELD_DRIVES_ENABLED, 0U},
+    {OPCUA_NODE_ALARM_ACTIVE, "AlarmActive", UA_BOOLEAN, FIELD_ALARM_ACTIVE, 0U},
+    {OPCUA_NODE_DRIVES_READY, "DrivesReady", UA_BOOLEAN, FIELD_DRIVES_READY, 0U},
+    {OPCUA_NODE_POSITION + 0U, "PositionX", UA_DOUBLE, FIELD_POSITION, 0U},
+    {OPCUA_NODE_POSITION + 1U, "PositionY", UA_DOUBLE, FIELD_POSITION, 1U},
+    {OPCUA_NODE_POSITION + 2U, "PositionZ", UA_DOUBLE, FIELD_POSITION, 2U},
+    {OPCUA_NODE_JOINT_POSITION + 0U, "Joint1Position", UA_DOUBLE, FIELD_JOINT_POSITION, 0U},
+    {OPCUA_NODE_JOINT_POSITION + 1U, "Joint2Position", UA_DOUBLE, FIELD_JOINT_POSITION, 1U},
+    {OPCUA_NODE_JOINT_POSITION + 2U, "Joint3Position", UA_DOUBLE, FIELD_JOINT_POSITION, 2U},
+    {OPCUA_NODE_FOLLOWING_ERROR + 0U, "Joint1FollowingError", UA_DOUBLE, FIELD_FOLLOWING_ERROR, 0U},
+    {OPCUA_NODE_FOLLOWING_ERROR + 1U, "Joint2FollowingError", UA_DOUBLE, FIELD_FOLLOWING_ERROR, 1U},
+    {OPCUA_NODE_FOLLOWING_ERROR + 2U, "Joint3FollowingError", UA_DOUBLE, FIELD_FOLLOWING_ERROR, 2U},
+    {OPCUA_NODE_CYCLES, "Cycles", UA_UINT32, FIELD_CYCLES, 0U},
+    {OPCUA_NODE_MISSED_CYCLES, "MissedCycles", UA_UINT32, FIELD_MISSED_CYCLES, 0U},
+    {OPCUA_NODE_LOST_FRAMES, "LostFrames", UA_UINT32, FIELD_LOST_FRAMES, 0U},
+    {OPCUA_NODE_FOLLOWING_WARNINGS, "FollowingWarnings", UA_UINT32, FIELD_FOLLOWING_WARNINGS, 0U},
+};
+
+#define NODE_COUNT (sizeof(s_nodes) / sizeof(s_nodes[0]))
+
+typedef struct {
+    uint32_t id; /* 0 = free */
+    uint32_t client_handle;
+    const ua_node_t *node;
+    bool reporting;
+    uint32_t interval_ms;
+    uint64_t next_sample_ns;
+    double deadband; /* absolute, 0 reports every change */
+    double reported; /* last value queued for the client */
+    bool sampled;
+    bool pending;
+    uint64_t source_time;
+} ua_item_t;
+
+typedef struct {
+    uint32_t id; /* 0 = free */
+    uint32_t interval_ms;
+    uint32_t keepalive_count;
+    uint32_t lifetime_count;
+    uint32_t max_notifications; /* 0 = unlimited */
+    bool enabled;
+    uint64_t next_publish_ns;
+    uint32_t idle_intervals;    /* since the last message, for keep-alives */
+    uint32_t starved_intervals; /* with nothing to answer on, for the lifetime */
+    uint32_t sequence;          /* next notification message */
+    ua_item_t items[OPCUA_MAX_ITEMS];
+} ua_subscription_t;
+
+typedef struct {
+    uint32_t request_id;
+    uint32_t handle;
+    uint32_t acknowledgements;
+} ua_publish_t;
+
+typedef struct {
+    int fd; /* -1 = free */
+    bool failed;
+    bool acknowledged; /* HEL answered */
+    uint32_t channel_id;
+    uint32_t token_id;
+    uint32_t sequence;
+    uint32_t send_limit;
+    uint32_t session_id; /* 0 = none */
+    uint32_t auth_token;
+    bool activated;
+    char endpoint[128];
+    uint8_t rx[OPCUA_BUFFER_SIZE];
+    size_t rx_length;
+    ua_subscription_t subscriptions[OPCUA_MAX_SUBSCRIPTIONS];
+    ua_publish_t publish[OPCUA_MAX_PUBLISH_REQUESTS];
+    uint8_t publish_count;
+} ua_connection_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+    bool error;
+} ua_reader_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t length;
+    bool error;
+} ua_writer_t;
+
+typedef struct {
+    uint16_t ns;
+    uint32_t id;
+    bool numeric;
+} ua_node_id_t;
+
+typedef struct {
+    ua_node_id_t token;
+    uint32_t handle;
+} ua_request_header_t;
+
+static int s_listen_fd = -1;
+static uint16_t s_port = 0U;
+static uint32_t s_next_id = 1U;
+static ua_connection_t s_connections[OPCUA_MAX_CONNECTIONS];
+static uint8_t s_tx[OPCUA_BUFFER_SIZE];
+
+static uint64_t ua_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec + UA_EPOCH_OFFSET_S) * 10000000ULL + (uint64_t)ts.tv_nsec / 100U;
+}
+
+static uint32_t next_id(void)
+{
+    uint32_t id = s_next_id++;
+    if (s_next_id == 0U) {
+        s_next_id = 1U;
+    }
+    return id;
+}
+
+/* decoding, little-endian; a short buffer latches the error flag */
+
+static const uint8_t *take(ua_reader_t *r, size_t count)
+{
+    if (r->error || r->length - r->position < count) {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t *p = r->data + r->position;
+    r->position += count;
+    return p;
+}
+
+static uint8_t get_u8(ua_reader_t *r)
+{
+    const uint8_t *p = take(r, 1U);
+    return p != NULL ? p[0] : 0U;
+}
+
+static uint16_t get_u16(ua_reader_t *r)
+{
+    const uint8_t *p = take(r, 2U);
+    return p != NULL ? (uint16_t)(p[0] | (p[1] << 8)) : 0U;
+}
+
+static uint32_t get_u32(ua_reader_t *r)
+{
+    const uint8_t *p = take(r, 4U);
+    return p != NULL ? (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24) : 0U;
+}
+
+static uint64_t get_u64(ua_reader_t *r)
+{
+    uint64_t low = get_u32(r);
+    return low | ((uint64_t)get_u32(r) << 32);
+}
+
+static double get_f64(ua_reader_t *r)
+{
+    uint64_t bits = get_u64(r);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static size_t get_string(ua_reader_t *r, const uint8_t **text)
+{
+    int32_t length = (int32_t)get_u32(r);
+    *text = NULL;
+    if (length <= 0) {
+        return 0U;
+    }
+    *text = take(r, (size_t)length);
+    return *text != NULL ? (size_t)length : 0U;
+}
+
+static void skip_string(ua_reader_t *r)
+{
+    const uint8_t *text;
+    get_string(r, &text);
+}
+
+static ua_node_id_t get_node_id(ua_reader_t *r)
+{
+    ua_node_id_t node = {0U, 0U, true};
+    uint8_t encoding = get_u8(r);
+    switch (encoding & 0x3FU) {
+    case 0x00U:
+        node.id = get_u8(r);
+        break;
+    case 0x01U:
+        node.ns = get_u8(r);
+        node.id = get_u16(r);
+        break;
+    case 0x02U:
+        node.ns = get_u16(r);
+        node.id = get_u32(r);
+        break;
+    case 0x03U:
+    case 0x05U:
+        node.ns = get_u16(r);
+        node.numeric = false;
+        skip_string(r);
+        break;
+    case 0x04U:
+        node.ns = get_u16(r);
+        node.numeric = false;
+        take(r, 16U);
+        break;
+    default:
+        r->error = true;
+        break;
+    }
+    /* expanded node id flags */
+    if ((encoding & 0x80U) != 0U) {
+        skip_string(r);
+    }
+    if ((encoding & 0x40U) != 0U) {
+        get_u32(r);
+    }
+    return node;
+}
+
+static bool node_is(const ua_node_id_t *node, uint16_t ns, uint32_t id)
+{
+    return node->numeric && node->ns == ns && node->id == id;
+}
+
+static ua_node_id_t get_extension_object(ua_reader_t *r, ua_reader_t *body)
+{
+    ua_node_id_t type = get_node_id(r);
+    uint8_t encoding = get_u8(r);
+    body->data = NULL;
+    body->length = 0U;
+    body->position = 0U;
+    body->error = false;
+    if (encoding == 1U || encoding == 2U) {
+        body->length = get_string(r, &body->data);
+    }
+    return type;
+}
+
+static void get_request_header(ua_reader_t *r, ua_request_header_t *header)
+{
+    ua_reader_t additional;
+    header->token = get_node_id(r);
+    get_u64(r); /* timestamp */
+    header->handle = get_u32(r);
+    get_u32(r); /* return diagnostics */
+    skip_string(r);
+    get_u32(r); /* timeout hint */
+    get_extension_object(r, &additional);
+}
+
+/* encoding */
+
+static uint8_t *reserve(ua_writer_t *w, size_t count)
+{
+    if (w->error || w->size - w->length < count) {
+        w->error = true;
+        return NULL;
+    }
+    uint8_t *p = w->data + w->length;
+    w->length += count;
+    return p;
+}
+
+static void put_u8(ua_writer_t *w, uint8_t value)
+{
+    uint8_t *p = reserve(w, 1U);
+    if (p != NULL) {
+        p[0] = value;
+    }
+}
+
+static void put_u16(ua_writer_t *w, uint16_t value)
+{
+    put_u8(w, (uint8_t)value);
+    put_u8(w, (uint8_t)(value >> 8));
+}
+
+static void put_u32(ua_writer_t *w, uint32_t value)
+{
+    put_u16(w, (uint16_t)value);
+    put_u16(w, (uint16_t)(value >> 16));
+}
+
+static void put_u64(ua_writer_t *w, uint64_t value)
+{
+    put_u32(w, (uint32_t)value);
+    put_u32(w, (uint32_t)(value >> 32));
+}
+
+static void put_f64(ua_writer_t *w, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u64(w, bits);
+}
+
+static void patch_u32(ua_writer_t *w, size_t at, uint32_t value)
+{
+    if (!w->error) {
+        for (int i = 0; i < 4; ++i) {
+            w->data[at + (size_t)i] = (uint8_t)(value >> (8 * i));
+        }
+    }
+}
+
+static void put_bytes(ua_writer_t *w, const void *data, size_t length)
+{
+    put_u32(w, (uint32_t)length);
+    uint8_t *p = reserve(w, length);
+    if (p != NULL) {
+        memcpy(p, data, length);
+    }
+}
+
+static void put_string(ua_writer_t *w, const char *text)
+{
+    if (text == NULL) {
+        put_u32(w, 0xFFFFFFFFUL);
+        return;
+    }
+    put_bytes(w, text, strlen(text));
+}
+
+static void put_node_id(ua_writer_t *w, uint16_t ns, uint32_t id)
+{
+    if (ns == 0U && id <= 0xFFU) {
+        put_u8(w, 0x00U);
+        put_u8(w, (uint8_t)id);
+    } else if (ns <= 0xFFU && id <= 0xFFFFU) {
+        put_u8(w, 0x01U);
+        put_u8(w, (uint8_t)ns);
+        put_u16(w, (uint16_t)id);
+    } else {
+        put_u8(w, 0x02U);
+        put_u16(w, ns);
+        put_u32(w, id);
+    }
+}
+
+static void put_null_extension_object(ua_writer_t *w)
+{
+    put_node_id(w, 0U, 0U);
+    put_u8(w, 0U);
+}
+
+static void put_response_header(ua_writer_t *w, uint32_t handle, uint32_t status)
+{
+    put_u64(w, ua_now());
+    put_u32(w, handle);
+    put_u32(w, status);
+    put_u8(w, 0U);  /* no diagnostics */
+    put_u32(w, 0U); /* string table */
+    put_null_extension_object(w);
+}
+
+/* transport */
+
+static void close_connection(ua_connection_t *c)
+{
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void transmit(ua_connection_t *c, ua_writer_t *w)
+{
+    if (w->error || w->length > c->send_limit) {
+        c->failed = true;
+        return;
+    }
+    patch_u32(w, 4U, (uint32_t)w->length);
+    /* a client that cannot keep up is dropped, the poll never blocks */
+    ssize_t sent = send(c->fd, w->data, w->length, MSG_NOSIGNAL);
+    if (sent < 0 || (size_t)sent != w->length) {
+        c->failed = true;
+    }
+}
+
+static void begin_transport(ua_writer_t *w, const char *type)
+{
+    w->data = s_tx;
+    w->size = sizeof(s_tx);
+    w->length = 0U;
+    w->error = false;
+    uint8_t *p = reserve(w, 4U);
+    memcpy(p, type, 3U);
+    p[3] = 'F';
+    put_u32(w, 0U); /* size, patched */
+}
+
+static void send_error(ua_connection_t *c, uint32_t status, const char *reason)
+{
+    ua_writer_t w;
+    begin_transport(&w, "ERR");
+    put_u32(&w, status);
+    put_string(&w, reason);
+    transmit(c, &w);
+    c->failed = true;
+}
+
+static void begin_message(ua_connection_t *c, ua_writer_t *w, uint32_t request_id, uint32_t type)
+{
+    begin_transport(w, "MSG");
+    put_u32(w, c->channel_id);
+    put_u32(w, c->token_id);
+    put_u32(w, ++c->sequence);
+    put_u32(w, request_id);
+    put_node_id(w, 0U, type);
+}
+
+static void send_fault(ua_connection_t *c, uint32_t request_id, uint32_t handle, uint32_t status)
+{
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_ID_SERVICE_FAULT);
+    put_response_header(&w, handle, status);
+    transmit(c, &w);
+}
+
+/* address space */
+
+static const ua_node_t *find_node(const ua_node_id_t *id)
+{
+    if (!id->numeric || id->ns != 1U) {
+        return NULL;
+    }
+    for (size_t i = 0U; i < NODE_COUNT; ++i) {
+        if (s_nodes[i].id == id->id) {
+            return &s_nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static double node_value(const ua_node_t *node, const cnc_status_t *status)
+{
+    switch ((ua_field_t)node->field) {
+    case FIELD_STATE:
+        return (double)status->state;
+    case FIELD_DRIVES_ENABLED:
+        return status->drives_enabled ? 1.0 : 0.0;
+    case FIELD_ALARM_ACTIVE:
+        return status->alarm_active ? 1.0 : 0.0;
+    case FIELD_DRIVES_READY:
+        return status->drives_ready ? 1.0 : 0.0;
+    case FIELD_POSITION:
+        return (double)status->position[node->index] / 65536.0;
+    case FIELD_JOINT_POSITION:
+        return (double)status->joint_position[node->index] / 65536.0;
+    case FIELD_FOLLOWING_ERROR:
+        return (double)status->following_error[node->index] / 65536.0;
+    case FIELD_CYCLES:
+        return (double)status->cycles;
+    case FIELD_MISSED_CYCLES:
+        return (double)status->missed_cycles;
+    case FIELD_LOST_FRAMES:
+        return (double)status->lost_frames;
+    case FIELD_FOLLOWING_WARNINGS:
+    default:
+        return (double)status->following_warnings;
+    }
+}
+
+static void put_variant(ua_writer_t *w, const ua_node_t *node, double value)
+{
+    put_u8(w, node->type);
+    switch (node->type) {
+    case UA_BOOLEAN:
+        put_u8(w, value != 0.0 ? 1U : 0U);
+        break;
+    case UA_INT32:
+        put_u32(w, (uint32_t)(int32_t)value);
+        break;
+    case UA_UINT32:
+        put_u32(w, (uint32_t)value);
+        break;
+    default:
+        put_f64(w, value);
+        break;
+    }
+}
+
+static void put_value(ua_writer_t *w, const ua_node_t *node, double value, uint64_t source_time, uint32_t timestamps)
+{
+    bool source = timestamps == UA_TIMESTAMPS_SOURCE || timestamps == UA_TIMESTAMPS_BOTH;
+    bool server = timestamps == UA_TIMESTAMPS_SERVER || timestamps == UA_TIMESTAMPS_BOTH;
+    put_u8(w, (uint8_t)(0x01U | (source ? 0x04U : 0U) | (server ? 0x08U : 0U)));
+    put_variant(w, node, value);
+    if (source) {
+        put_u64(w, source_time);
+    }
+    if (server) {
+        put_u64(w, ua_now());
+    }
+}
+
+static void put_bad_value(ua_writer_t *w, uint32_t status)
+{
+    put_u8(w, 0x02U);
+    put_u32(w, status);
+}
+
+static void put_attribute(ua_writer_t *w, const ua_node_id_t *id, uint32_t attribute, uint32_t timestamps)
+{
+    const ua_node_t *node = find_node(id);
+    if (node == NULL) {
+        put_bad_value(w, UA_BAD_NODE_ID_UNKNOWN);
+        return;
+    }
+    switch (attribute) {
+    case UA_ATTRIBUTE_VALUE:
+        put_value(w, node, node_value(node, &s_status), s_status_time, timestamps);
+        return;
+    case UA_ATTRIBUTE_NODE_ID:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_NODE_ID);
+        put_node_id(w, 1U, node->id);
+        return;
+    case UA_ATTRIBUTE_NODE_CLASS:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_INT32);
+        put_u32(w, 2U); /* Variable */
+        return;
+    case UA_ATTRIBUTE_BROWSE_NAME:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_QUALIFIED_NAME);
+        put_u16(w, 1U);
+        put_string(w, node->name);
+        return;
+    case UA_ATTRIBUTE_DISPLAY_NAME:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_LOCALIZED_TEXT);
+        put_u8(w, 0x02U);
+        put_string(w, node->name);
+        return;
+    case UA_ATTRIBUTE_DATA_TYPE:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_NODE_ID);
+        put_node_id(w, 0U, node->type); /* the built-in type ids are the DataType node ids */
+        return;
+    case UA_ATTRIBUTE_ACCESS_LEVEL:
+    case UA_ATTRIBUTE_USER_ACCESS_LEVEL:
+        put_u8(w, 0x01U);
+        put_u8(w, UA_BYTE);
+        put_u8(w, 0x01U); /* CurrentRead */
+        return;
+    default:
+        put_bad_value(w, UA_BAD_ATTRIBUTE_ID_INVALID);
+        return;
+    }
+}
+
+static void put_endpoint(ua_writer_t *w, const ua_connection_t *c)
+{
+    put_string(w, c->endpoint);
+    /* ApplicationDescription */
+    put_string(w, "urn:delta-cnc:controller");
+    put_string(w, "urn:delta-cnc");
+    put_u8(w, 0x02U);
+    put_string(w, "Delta CNC controller");
+    put_u32(w, 0U); /* Server */
+    put_string(w, NULL);
+    put_string(w, NULL);
+    put_u32(w, 1U);
+    put_string(w, c->endpoint);
+    put_string(w, NULL); /* no certificate */
+    put_u32(w, UA_SECURITY_MODE_NONE);
+    put_string(w, s_policy_none);
+    /* one anonymous UserTokenPolicy */
+    put_u32(w, 1U);
+    put_string(w, "anonymous");
+    put_u32(w, 0U);
+    put_string(w, NULL);
+    put_string(w, NULL);
+    put_string(w, NULL);
+    put_string(w, s_transport_profile);
+    put_u8(w, 0U);
+}
+
+static void put_nonce(ua_writer_t *w, uint32_t seed)
+{
+    /* SecurityPolicy None signs nothing, the nonce only has to be present */
+    uint8_t nonce[UA_NONCE_LENGTH];
+    uint32_t x = seed ^ (uint32_t)ua_now();
+    for (size_t i = 0U; i < sizeof(nonce); ++i) {
+        x = x * 1664525U + 1013904223U;
+        nonce[i] = (uint8_t)(x >> 24);
+    }
+    put_bytes(w, nonce, sizeof(nonce));
+}
+
+/* sessions and services */
+
+static uint32_t session_status(const ua_connection_t *c, const ua_request_header_t *header)
+{
+    if (c->session_id == 0U || !node_is(&header->token, 1U, c->auth_token)) {
+        return UA_BAD_SESSION_ID_INVALID;
+    }
+    return c->activated ? UA_GOOD : UA_BAD_SESSION_NOT_ACTIVATED;
+}
+
+static ua_subscription_t *find_subscription(ua_connection_t *c, uint32_t id)
+{
+    for (int i = 0; i < OPCUA_MAX_SUBSCRIPTIONS; ++i) {
+        if (id != 0U && c->subscriptions[i].id == id) {
+            return &c->subscriptions[i];
+        }
+    }
+    return NULL;
+}
+
+static bool has_subscriptions(const ua_connection_t *c)
+{
+    for (int i = 0; i < OPCUA_MAX_SUBSCRIPTIONS; ++i) {
+        if (c->subscriptions[i].id != 0U) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void flush_publish_requests(ua_connection_t *c, uint32_t status)
+{
+    for (uint8_t i = 0U; i < c->publish_count; ++i) {
+        send_fault(c, c->publish[i].request_id, c->publish[i].handle, status);
+    }
+    c->publish_count = 0U;
+}
+
+static uint32_t clamp_interval(double requested_ms)
+{
+    if (!(requested_ms >= (double)OPCUA_MIN_INTERVAL_MS)) {
+        return OPCUA_MIN_INTERVAL_MS;
+    }
+    if (requested_ms >= (double)OPCUA_MAX_INTERVAL_MS) {
+        return OPCUA_MAX_INTERVAL_MS;
+    }
+    /* sampling runs on whole milliseconds, rounded up so it is never faster than asked */
+    return (uint32_t)ceil(requested_ms);
+}
+
+static void get_endpoints(ua_connection_t *c, uint32_t request_id, const ua_request_header_t *header)
+{
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_GET_ENDPOINTS));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, 1U);
+    put_endpoint(&w, c);
+    transmit(c, &w);
+}
+
+static void create_session(ua_connection_t *c, uint32_t request_id, const ua_request_header_t *header)
+{
+    if (c->session_id != 0U) {
+        send_fault(c, request_id, header->handle, UA_BAD_TOO_MANY_SESSIONS);
+        return;
+    }
+    c->session_id = next_id();
+    c->auth_token = (c->session_id * 2654435761UL) ^ (uint32_t)ua_now();
+    c->activated = false;
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_CREATE_SESSION));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_node_id(&w, 1U, c->session_id);
+    put_node_id(&w, 1U, c->auth_token);
+    put_f64(&w, (double)OPCUA_SESSION_TIMEOUT_MS);
+    put_nonce(&w, c->auth_token);
+    put_string(&w, NULL); /* no certificate */
+    put_u32(&w, 1U);
+    put_endpoint(&w, c);
+    put_u32(&w, 0U); /* software certificates */
+    put_string(&w, NULL);
+    put_string(&w, NULL);
+    put_u32(&w, OPCUA_BUFFER_SIZE);
+    transmit(c, &w);
+}
+
+static void activate_session(ua_connection_t *c, uint32_t request_id, const ua_request_header_t *header)
+{
+    /* anonymous only, the identity token is not inspected */
+    if (c->session_id == 0U || !node_is(&header->token, 1U, c->auth_token)) {
+        send_fault(c, request_id, header->handle, UA_BAD_SESSION_ID_INVALID);
+        return;
+    }
+    c->activated = true;
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_ACTIVATE_SESSION));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_nonce(&w, c->auth_token);
+    put_u32(&w, 0U);
+    put_u32(&w, 0U);
+    transmit(c, &w);
+}
+
+static void close_session(ua_connection_t *c, uint32_t request_id, const ua_request_header_t *header)
+{
+    flush_publish_requests(c, UA_BAD_SESSION_ID_INVALID);
+    memset(c->subscriptions, 0, sizeof(c->subscriptions));
+    c->session_id = 0U;
+    c->activated = false;
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_CLOSE_SESSION));
+    put_response_header(&w, header->handle, UA_GOOD);
+    transmit(c, &w);
+}
+
+static void read_service(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header)
+{
+    get_f64(r); /* max age, every read is of the latest snapshot */
+    uint32_t timestamps = get_u32(r);
+    int32_t count = (int32_t)get_u32(r);
+    if (r->error || count <= 0) {
+        send_fault(c, request_id, header->handle, r->error ? UA_BAD_DECODING_ERROR : UA_BAD_NOTHING_TO_DO);
+        return;
+    }
+    if (count > OPCUA_MAX_OPERATIONS) {
+        send_fault(c, request_id, header->handle, UA_BAD_TOO_MANY_OPERATIONS);
+        return;
+    }
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_READ));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, (uint32_t)count);
+    for (int32_t i = 0; i < count; ++i) {
+        ua_node_id_t id = get_node_id(r);
+        uint32_t attribute = get_u32(r);
+        skip_string(r); /* index range */
+        get_u16(r);     /* data encoding */
+        skip_string(r);
+        if (r->error) {
+            send_fault(c, request_id, header->handle, UA_BAD_DECODING_ERROR);
+            return;
+        }
+        put_attribute(&w, &id, attribute, timestamps);
+    }
+    put_u32(&w, 0U);
+    transmit(c, &w);
+}
+
+static void create_subscription(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header, uint64_t now_ns)
+{
+    double interval = get_f64(r);
+    uint32_t lifetime = get_u32(r);
+    uint32_t keepalive = get_u32(r);
+    uint32_t max_notifications = get_u32(r);
+    bool enabled = get_u8(r) != 0U;
+    get_u8(r); /* priority */
+    if (r->error) {
+        send_fault(c, request_id, header->handle, UA_BAD_DECODING_ERROR);
+        return;
+    }
+    ua_subscription_t *sub = NULL;
+    for (int i = 0; i < OPCUA_MAX_SUBSCRIPTIONS && sub == NULL; ++i) {
+        if (c->subscriptions[i].id == 0U) {
+            sub = &c->subscriptions[i];
+        }
+    }
+    if (sub == NULL) {
+        send_fault(c, request_id, header->handle, UA_BAD_TOO_MANY_SUBSCRIPTIONS);
+        return;
+    }
+    memset(sub, 0, sizeof(*sub));
+    sub->id = next_id();
+    sub->interval_ms = clamp_interval(interval);
+    sub->keepalive_count = keepalive == 0U ? 10U : (keepalive > 1000U ? 1000U : keepalive);
+    sub->lifetime_count = lifetime < 3U * sub->keepalive_count ? 3U * sub->keepalive_count : lifetime;
+    sub->max_notifications = max_notifications;
+    sub->enabled = enabled;
+    sub->next_publish_ns = now_ns + (uint64_t)sub->interval_ms * 1000000U;
+    sub->sequence = 1U;
+
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_CREATE_SUBSCRIPTION));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, sub->id);
+    put_f64(&w, (double)sub->interval_ms);
+    put_u32(&w, sub->lifetime_count);
+    put_u32(&w, sub->keepalive_count);
+    transmit(c, &w);
+}
+
+static uint32_t configure_filter(ua_item_t *item, const ua_node_id_t *type, ua_reader_t *body)
+{
+    item->deadband = 0.0;
+    if (node_is(type, 0U, 0U)) {
+        return UA_GOOD;
+    }
+    if (!node_is(type, 0U, UA_ID_DATA_CHANGE_FILTER)) {
+        return UA_BAD_FILTER_UNSUPPORTED;
+    }
+    get_u32(body); /* trigger, the values carry no status of their own */
+    uint32_t deadband_type = get_u32(body);
+    double deadband = get_f64(body);
+    if (body->error) {
+        return UA_BAD_DECODING_ERROR;
+    }
+    if (deadband_type == UA_DEADBAND_NONE) {
+        return UA_GOOD;
+    }
+    if (item->node->type == UA_BOOLEAN) {
+        return UA_BAD_FILTER_NOT_ALLOWED;
+    }
+    /* percent deadbands need an EURange, none of the variables has one */
+    if (deadband_type != UA_DEADBAND_ABSOLUTE || !(deadband >= 0.0)) {
+        return UA_BAD_DEADBAND_FILTER_INVALID;
+    }
+    item->deadband = deadband;
+    return UA_GOOD;
+}
+
+static ua_item_t *free_item(ua_subscription_t *sub)
+{
+    for (int i = 0; i < OPCUA_MAX_ITEMS; ++i) {
+        if (sub->items[i].id == 0U) {
+            return &sub->items[i];
+        }
+    }
+    return NULL;
+}
+
+static void create_items(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header, uint64_t now_ns)
+{
+    ua_subscription_t *sub = find_subscription(c, get_u32(r));
+    get_u32(r); /* timestamps, notifications always carry the source timestamp */
+    int32_t count = (int32_t)get_u32(r);
+    if (r->error || sub == NULL || count <= 0 || count > OPCUA_MAX_OPERATIONS) {
+        send_fault(c, request_id, header->handle,
+                   r->error ? UA_BAD_DECODING_ERROR : sub == NULL ? UA_BAD_SUBSCRIPTION_ID_INVALID :
+                   count <= 0 ? UA_BAD_NOTHING_TO_DO : UA_BAD_TOO_MANY_OPERATIONS);
+        return;
+    }
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_CREATE_ITEMS));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, (uint32_t)count);
+    for (int32_t i = 0; i < count; ++i) {
+        ua_node_id_t id = get_node_id(r);
+        uint32_t attribute = get_u32(r);
+        skip_string(r);
+        get_u16(r);
+        skip_string(r);
+        uint32_t mode = get_u32(r);
+        uint32_t client_handle = get_u32(r);
+        double sampling = get_f64(r);
+        ua_reader_t filter;
+        ua_node_id_t filter_type = get_extension_object(r, &filter);
+        get_u32(r); /* queue size, one value per item */
+        get_u8(r);
+        if (r->error) {
+            send_fault(c, request_id, header->handle, UA_BAD_DECODING_ERROR);
+            return;
+        }
+
+        ua_item_t candidate;
+        memset(&candidate, 0, sizeof(candidate));
+        candidate.node = find_node(&id);
+        uint32_t status = UA_GOOD;
+        ua_item_t *item = free_item(sub);
+        if (candidate.node == NULL) {
+            status = UA_BAD_NODE_ID_UNKNOWN;
+        } else if (attribute != UA_ATTRIBUTE_VALUE) {
+            status = UA_BAD_ATTRIBUTE_ID_INVALID;
+        } else if (item == NULL) {
+            status = UA_BAD_TOO_MANY_MONITORED_ITEMS;
+        } else {
+            status = configure_filter(&candidate, &filter_type, &filter);
+        }
+        if (status == UA_GOOD) {
+            candidate.id = next_id();
+            candidate.client_handle = client_handle;
+            candidate.reporting = mode == UA_MONITORING_REPORTING;
+            /* -1 asks for the publishing interval */
+            candidate.interval_ms = sampling < 0.0 ? sub->interval_ms : clamp_interval(sampling);
+            candidate.next_sample_ns = now_ns;
+            *item = candidate;
+        }
+        put_u32(&w, status);
+        put_u32(&w, status == UA_GOOD ? candidate.id : 0U);
+        put_f64(&w, status == UA_GOOD ? (double)candidate.interval_ms : 0.0);
+        put_u32(&w, 1U);
+        put_null_extension_object(&w);
+    }
+    put_u32(&w, 0U);
+    transmit(c, &w);
+}
+
+static void delete_items(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header)
+{
+    ua_subscription_t *sub = find_subscription(c, get_u32(r));
+    int32_t count = (int32_t)get_u32(r);
+    if (r->error || sub == NULL || count <= 0 || count > OPCUA_MAX_OPERATIONS) {
+        send_fault(c, request_id, header->handle,
+                   r->error ? UA_BAD_DECODING_ERROR : sub == NULL ? UA_BAD_SUBSCRIPTION_ID_INVALID :
+                   count <= 0 ? UA_BAD_NOTHING_TO_DO : UA_BAD_TOO_MANY_OPERATIONS);
+        return;
+    }
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_DELETE_ITEMS));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, (uint32_t)count);
+    for (int32_t i = 0; i < count; ++i) {
+        uint32_t id = get_u32(r);
+        uint32_t status = UA_BAD_MONITORED_ITEM_ID_INVALID;
+        for (int k = 0; k < OPCUA_MAX_ITEMS; ++k) {
+            if (id != 0U && sub->items[k].id == id) {
+                memset(&sub->items[k], 0, sizeof(sub->items[k]));
+                status = UA_GOOD;
+            }
+        }
+        put_u32(&w, status);
+    }
+    put_u32(&w, 0U);
+    transmit(c, &w);
+}
+
+static void delete_subscriptions(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header)
+{
+    int32_t count = (int32_t)get_u32(r);
+    if (r->error || count <= 0 || count > OPCUA_MAX_OPERATIONS) {
+        send_fault(c, request_id, header->handle, r->error ? UA_BAD_DECODING_ERROR : count <= 0 ? UA_BAD_NOTHING_TO_DO : UA_BAD_TOO_MANY_OPERATIONS);
+        return;
+    }
+    ua_writer_t w;
+    begin_message(c, &w, request_id, UA_RESPONSE(UA_ID_DELETE_SUBSCRIPTIONS));
+    put_response_header(&w, header->handle, UA_GOOD);
+    put_u32(&w, (uint32_t)count);
+    for (int32_t i = 0; i < count; ++i) {
+        ua_subscription_t *sub = find_subscription(c, get_u32(r));
+        if (sub != NULL) {
+            memset(sub, 0, sizeof(*sub));
+        }
+        put_u32(&w, sub != NULL ? UA_GOOD : UA_BAD_SUBSCRIPTION_ID_INVALID);
+    }
+    put_u32(&w, 0U);
+    transmit(c, &w);
+    if (!has_subscriptions(c)) {
+        flush_publish_requests(c, UA_BAD_NO_SUBSCRIPTION);
+    }
+}
+
+static void publish_service(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, const ua_request_header_t *header)
+{
+    /* nothing is kept for republishing, acknowledgements only need an answer */
+    int32_t acknowledgements = (int32_t)get_u32(r);
+    for (int32_t i = 0; i < acknowledgements && !r->error; ++i) {
+        get_u64(r);
+    }
+    if (r->error || acknowledgements > OPCUA_MAX_OPERATIONS) {
+        send_fault(c, request_id, header->handle, UA_BAD_DECODING_ERROR);
+        return;
+    }
+    if (!has_subscriptions(c)) {
+        send_fault(c, request_id, header->handle, UA_BAD_NO_SUBSCRIPTION);
+        return;
+    }
+    if (c->publish_count >= OPCUA_MAX_PUBLISH_REQUESTS) {
+        send_fault(c, request_id, header->handle, UA_BAD_TOO_MANY_PUBLISH_REQUESTS);
+        return;
+    }
+    ua_publish_t *slot = &c->publish[c->publish_count++];
+    slot->request_id = request_id;
+    slot->handle = header->handle;
+    slot->acknowledgements = acknowledgements > 0 ? (uint32_t)acknowledgements : 0U;
+}
+
+static void handle_service(ua_connection_t *c, ua_reader_t *r, uint32_t request_id, uint64_t now_ns)
+{
+    ua_node_id_t type = get_node_id(r);
+    ua_request_header_t header;
+    get_request_header(r, &header);
+    if (r->error || !type.numeric || type.ns != 0U) {
+        send_fault(c, request_id, header.handle, UA_BAD_DECODING_ERROR);
+        return;
+    }
+    switch (type.id) {
+    case UA_ID_GET_ENDPOINTS:
+        get_endpoints(c, request_id, &header);
+        return;
+    case UA_ID_CREATE_SESSION:
+        create_session(c, request_id, &header);
+        return;
+    case UA_ID_ACTIVATE_SESSION:
+        activate_session(c, request_id, &header);
+        return;
+    default:
+        break;
+    }
+    uint32_t status = session_status(c, &header);
+    if (status != UA_GOOD) {
+        send_fault(c, request_id, header.handle, status);
+        return;
+    }
+    switch (type.id) {
+    case UA_ID_CLOSE_SESSION:
+        close_session(c, request_id, &header);
+        break;
+    case UA_ID_READ:
+        read_service(c, r, request_id, &header);
+        break;
+    case UA_ID_CREATE_SUBSCRIPTION:
+        create_subscription(c, r, request_id, &header, now_ns);
+        break;
+    case UA_ID_CREATE_ITEMS:
+        create_items(c, r, request_id, &header, now_ns);
+        break;
+    case UA_ID_DELETE_ITEMS:
+        delete_items(c, r, request_id, &header);
+        break;
+    case UA_ID_DELETE_SUBSCRIPTIONS:
+        delete_subscriptions(c, r, request_id, &header);
+        break;
+    case UA_ID_PUBLISH:
+        publish_service(c, r, request_id, &header);
+        break;
+    default:
+        send_fault(c, request_id, header.handle, UA_BAD_SERVICE_UNSUPPORTED);
+        break;
+    }
+}
+
+static void hello(ua_connection_t *c, ua_reader_t *r)
+{
+    get_u32(r); /* protocol version */
+    uint32_t receive = get_u32(r);
+    get_u32(r);
+    get_u32(r);
+    get_u32(r);
+    const uint8_t *url;
+    size_t length = get_string(r, &url);
+    if (r->error || c->acknowledged) {
+        send_error(c, UA_BAD_TCP_MESSAGE_TYPE_INVALID, "unexpected HEL");
+        return;
+    }
+    if (length >= sizeof(c->endpoint)) {
+        length = sizeof(c->endpoint) - 1U;
+    }
+    if (url != NULL) {
+        memcpy(c->endpoint, url, length);
+    }
+    c->endpoint[length] = '\0';
+    c->send_limit = receive < OPCUA_BUFFER_SIZE ? receive : OPCUA_BUFFER_SIZE;
+    c->acknowledged = true;
+
+    ua_writer_t w;
+    begin_transport(&w, "ACK");
+    put_u32(&w, 0U);
+    put_u32(&w, OPCUA_BUFFER_SIZE);
+    put_u32(&w, c->send_limit);
+    put_u32(&w, OPCUA_BUFFER_SIZE);
+    put_u32(&w, 1U); /* single-chunk messages */
+    transmit(c, &w);
+}
+
+static void open_channel(ua_connection_t *c, ua_reader_t *r)
+{
+    uint32_t channel = get_u32(r);
+    const uint8_t *policy;
+    size_t policy_length = get_string(r, &policy);
+    skip_string(r); /* sender certificate */
+    skip_string(r); /* receiver thumbprint */
+    get_u32(r);     /* sequence number */
+    uint32_t request_id = get_u32(r);
+    ua_node_id_t type = get_node_id(r);
+    ua_request_header_t header;
+    get_request_header(r, &header);
+    get_u32(r); /* client protocol version */
+    uint32_t request_type = get_u32(r);
+    uint32_t mode = get_u32(r);
+    skip_string(r); /* client nonce */
+    uint32_t lifetime = get_u32(r);
+    if (r->error || !node_is(&type, 0U, UA_ID_OPEN_CHANNEL)) {
+        send_error(c, UA_BAD_DECODING_ERROR, "malformed OPN");
+        return;
+    }
+    if (policy == NULL || policy_length != sizeof(s_policy_none) - 1U ||
+        memcmp(policy, s_policy_none, policy_length) != 0 || mode != UA_SECURITY_MODE_NONE) {
+        send_error(c, UA_BAD_SECURITY_POLICY_REJECTED, "only SecurityPolicy None");
+        return;
+    }
+    if (request_type == 0U && c->channel_id == 0U) {
+        c->channel_id = next_id();
+        c->token_id = 1U;
+    } else if (request_type == 1U && channel == c->channel_id && c->channel_id != 0U) {
+        c->token_id++;
+    } else {
+        send_error(c, UA_BAD_SECURE_CHANNEL_ID_INVALID, "bad channel");
+        return;
+    }
+
+    ua_writer_t w;
+    begin_transport(&w, "OPN");
+    put_u32(&w, c->channel_id);
+    put_string(&w, s_policy_none);
+    put_string(&w, NULL);
+    put_string(&w, NULL);
+    put_u32(&w, ++c->sequence);
+    put_u32(&w, request_id);
+    put_node_id(&w, 0U, UA_RESPONSE(UA_ID_OPEN_CHANNEL));
+    put_response_header(&w, header.handle, UA_GOOD);
+    put_u32(&w, 0U);
+    put_u32(&w, c->channel_id);
+    put_u32(&w, c->token_id);
+    put_u64(&w, ua_now());
+    put_u32(&w, lifetime < 10000U ? 10000U : (lifetime > 3600000U ? 3600000U : lifetime));
+    put_string(&w, NULL); /* server nonce */
+    transmit(c, &w);
+}
+
+static void handle_message(ua_connection_t *c, const uint8_t *message, size_t length, uint64_t now_ns)
+{
+    ua_reader_t r = {message, length, UA_HEADER_SIZE, false};
+    if (message[3] != 'F') {
+        /* one chunk per message was negotiated; an abort chunk just drops the message */
+        if (message[3] != 'A') {
+            send_error(c, UA_BAD_TCP_MESSAGE_TOO_LARGE, "chunking not supported");
+        }
+        return;
+    }
+    if (memcmp(message, "HEL", 3U) == 0) {
+        hello(c, &r);
+        return;
+    }
+    if (!c->acknowledged) {
+        send_error(c, UA_BAD_TCP_MESSAGE_TYPE_INVALID, "HEL expected");
+        return;
+    }
+    if (memcmp(message, "OPN", 3U) == 0) {
+        open_channel(c, &r);
+        return;
+    }
+    if (memcmp(message, "CLO", 3U) == 0) {
+        c->failed = true;
+        return;
+    }
+    if (memcmp(message, "MSG", 3U) != 0) {
+        send_error(c, UA_BAD_TCP_MESSAGE_TYPE_INVALID, "unknown message type");
+        return;
+    }
+    uint32_t channel = get_u32(&r);
+    get_u32(&r); /* token, one at a time and no keys behind it */
+    get_u32(&r); /* sequence number */
+    uint32_t request_id = get_u32(&r);
+    if (r.error || channel == 0U || channel != c->channel_id) {
+        send_error(c, UA_BAD_SECURE_CHANNEL_ID_INVALID, "bad channel");
+        return;
+    }
+    handle_service(c, &r, request_id, now_ns);
+}
+
+static void receive(ua_connection_t *c, uint64_t now_ns)
+{
+    while (!c->failed) {
+        ssize_t got = recv(c->fd, c->rx + c->rx_length, sizeof(c->rx) - c->rx_length, 0);
+        if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            c->failed = true;
+            return;
+        }
+        if (got < 0) {
+            return;
+        }
+        c->rx_length += (size_t)got;
+        while (c->rx_length >= UA_HEADER_SIZE && !c->failed) {
+            uint32_t size = (uint32_t)c->rx[4] | ((uint32_t)c->rx[5] << 8) | ((uint32_t)c->rx[6] << 16) | ((uint32_t)c->rx[7] << 24);
+            if (size < UA_HEADER_SIZE || size > sizeof(c->rx)) {
+                send_error(c, UA_BAD_TCP_MESSAGE_TOO_LARGE, "message too large");
+                return;
+            }
+            if (c->rx_length < size) {
+                break;
+            }
+            handle_message(c, c->rx, size, now_ns);
+            memmove(c->rx, c->rx + size, c->rx_length - size);
+            c->rx_length -= size;
+        }
+    }
+}
+
+/* sampling and notifications */
+
+static void sample(ua_subscription_t *sub, uint64_t now_ns)
+{
+    for (int i = 0; i < OPCUA_MAX_ITEMS; ++i) {
+        ua_item_t *item = &sub->items[i];
+        if (item->id == 0U || now_ns < item->next_sample_ns) {
+            continue;
+        }
+        uint64_t interval_ns = (uint64_t)item->interval_ms * 1000000U;
+        item->next_sample_ns += interval_ns;
+        if (item->next_sample_ns <= now_ns) {
+            item->next_sample_ns = now_ns + interval_ns;
+        }
+        double value = node_value(item->node, &s_status);
+        bool changed = !item->sampled ||
+                       (item->deadband > 0.0 ? fabs(value - item->reported) > item->deadband : value != item->reported);
+        if (changed) {
+            /* queue size 1: a newer sample replaces one not yet published */
+            item->reported = value;
+            item->sampled = true;
+            item->pending = true;
+            item->source_time = s_status_time;
+        }
+    }
+}
+
+static uint32_t pending_items(const ua_subscription_t *sub)
+{
+    uint32_t count = 0U;
+    for (int i = 0; i < OPCUA_MAX_ITEMS; ++i) {
+        if (sub->items[i].id != 0U && sub->items[i].pending && sub->items[i].reporting) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void send_notification(ua_connection_t *c, ua_subscription_t *sub, bool keepalive)
+{
+    ua_publish_t request = c->publish[0];
+    memmove(&c->publish[0], &c->publish[1], (size_t)(c->publish_count - 1U) * sizeof(c->publish[0]));
+    c->publish_count--;
+
+    ua_writer_t w;
+    begin_message(c, &w, request.request_id, UA_RESPONSE(UA_ID_PUBLISH));
+    put_response_header(&w, request.handle, UA_GOOD);
+    put_u32(&w, sub->id);
+    put_u32(&w, 0U); /* available sequence numbers */
+    size_t more_at = w.length;
+    put_u8(&w, 0U);
+    /* a keep-alive announces the next sequence number without using it */
+    put_u32(&w, sub->sequence);
+    put_u64(&w, ua_now());
+    if (keepalive) {
+        put_u32(&w, 0U);
+    } else {
+        put_u32(&w, 1U);
+        put_node_id(&w, 0U, UA_ID_DATA_CHANGE_NOTIFICATION);
+        put_u8(&w, 1U);
+        size_t body_at = w.length;
+        put_u32(&w, 0U);
+        size_t count_at = w.length;
+        put_u32(&w, 0U);
+        uint32_t count = 0U;
+        bool more = false;
+        for (int i = 0; i < OPCUA_MAX_ITEMS; ++i) {
+            ua_item_t *item = &sub->items[i];
+            if (item->id == 0U || !item->pending || !item->reporting) {
+                continue;
+            }
+            /* leave room for the tail of the message */
+            if ((sub->max_notifications != 0U && count >= sub->max_notifications) || w.length + 64U > c->send_limit) {
+                more = true;
+                break;
+            }
+            put_u32(&w, item->client_handle);
+            put_value(&w, item->node, item->reported, item->source_time, UA_TIMESTAMPS_BOTH);
+            item->pending = false;
+            count++;
+        }
+        put_u32(&w, 0U); /* diagnostic infos */
+        patch_u32(&w, count_at, count);
+        patch_u32(&w, body_at, (uint32_t)(w.length - body_at - 4U));
+        if (more && !w.error) {
+            w.data[more_at] = 1U;
+        }
+        sub->sequence = sub->sequence == 0xFFFFFFFFUL ? 1U : sub->sequence + 1U;
+    }
+    put_u32(&w, request.acknowledgements);
+    for (uint32_t i = 0U; i < request.acknowledgements; ++i) {
+        put_u32(&w, UA_GOOD);
+    }
+    put_u32(&w, 0U);
+    transmit(c, &w);
+}
+
+static void publish_due(ua_connection_t *c, uint64_t now_ns)
+{
+    for (int i = 0; i < OPCUA_MAX_SUBSCRIPTIONS; ++i) {
+        ua_subscription_t *sub = &c->subscriptions[i];
+        if (sub->id == 0U) {
+            continue;
+        }
+        sample(sub, now_ns);
+        if (now_ns < sub->next_publish_ns) {
+            continue;
+        }
+        uint64_t interval_ns = (uint64_t)sub->interval_ms * 1000000U;
+        sub->next_publish_ns += interval_ns;
+        if (sub->next_publish_ns <= now_ns) {
+            sub->next_publish_ns = now_ns + interval_ns;
+        }
+        bool notify = sub->enabled && pending_items(sub) > 0U;
+        bool keepalive = !notify && ++sub->idle_intervals >= sub->keepalive_count;
+        if (!notify && !keepalive) {
+            continue;
+        }
+        if (c->publish_count == 0U) {
+            /* the client stopped asking: the subscription expires after its lifetime */
+            if (++sub->starved_intervals >= sub->lifetime_count) {
+                memset(sub, 0, sizeof(*sub));
+            }
+            continue;
+        }
+        send_notification(c, sub, keepalive);
+        sub->idle_intervals = 0U;
+        sub->starved_intervals = 0U;
+    }
+}
+
+static void accept_clients(void)
+{
+    for (;;) {
+        int fd = accept(s_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        ua_connection_t *slot = NULL;
+        for (int i = 0; i < OPCUA_MAX_CONNECTIONS && slot == NULL; ++i) {
+            if (s_connections[i].fd < 0) {
+                slot = &s_connections[i];
+            }
+        }
+        int one = 1;
+        if (slot == NULL || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0) {
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        close_connection(slot);
+        slot->fd = fd;
+        slot->send_limit = OPCUA_BUFFER_SIZE;
+    }
+}
+
+bool opcua_server_start(const storage_params_t *params)
+{
+    opcua_server_stop();
+    if (params->opcua_port == 0U) {
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(params->opcua_port);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(fd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, OPCUA_MAX_CONNECTIONS) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != 0) {
+        close(fd);
+        return false;
+    }
+    s_listen_fd = fd;
+    s_port = params->opcua_port;
+    return true;
+}
+
+void opcua_server_stop(void)
+{
+    for (int i = 0; i < OPCUA_MAX_CONNECTIONS; ++i) {
+        /* before the first start the table is zeroed, fd 0 is not ours */
+        s_connections[i].fd = s_listen_fd >= 0 ? s_connections[i].fd : -1;
+        close_connection(&s_connections[i]);
+    }
+    if (s_listen_fd >= 0) {
+        close(s_listen_fd);
+    }
+    s_listen_fd = -1;
+    s_port = 0U;
+}
+
+uint16_t opcua_server_port(void)
+{
+    return s_port;
+}
+
+void opcua_server_publish(const cnc_status_t *status)
+{
+    /* one copy per snapshot whatever the number of clients, sampling works on it later */
+    s_status = *status;
+    s_status_time = ua_now();
+}
+
+void opcua_server_poll(uint64_t now_ns)
+{
+    if (s_listen_fd < 0) {
+        return;
+    }
+    accept_clients();
+    for (int i = 0; i < OPCUA_MAX_CONNECTIONS; ++i) {
+        ua_connection_t *c = &s_connections[i];
+        if (c->fd < 0) {
+            continue;
+        }
+        receive(c, now_ns);
+        if (!c->failed && c->activated) {
+            publish_due(c, now_ns);
+        }
+        if (c->failed) {
+            close_connection(c);
+        }
+    }
+}
+
+#else
+
+/* no TCP/IP stack on the target, the MAC belongs to EtherCAT */
+
+bool opcua_server_start(const storage_params_t *params)
+{
+    (void)params;
+    return false;
+}
+
+void opcua_server_stop(void)
+{
+}
+
+uint16_t opcua_server_port(void)
+{
+    return 0U;
+}
+
+void opcua_server_publish(const cnc_status_t *status)
+{
+    s_status = *status;
+    s_status_time++;
+}
+
+void opcua_server_poll(uint64_t now_ns)
+{
+    (void)now_ns;
+}
+
+#endif
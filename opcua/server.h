@@ -0,0 +1,44 @@
+#ifndef OPCUA_SERVER_H
+#define OPCUA_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "core/cnc_state.h"
+#include "storage/storage.h"
+
+/* Minimal OPC UA binary server (opc.tcp, SecurityPolicy None, anonymous):
+ * sessions, Read, subscriptions with monitored items, sampling intervals
+ * and absolute deadbands. The telemetry is a flat set of variables in
+ * namespace 1 fed from the cnc_state snapshot. Host builds only, the
+ * STM32 has no TCP/IP stack next to EtherCAT */
+
+#define OPCUA_MAX_CONNECTIONS 4
+#define OPCUA_MAX_SUBSCRIPTIONS 2   /* per session */
+#define OPCUA_MAX_ITEMS 32          /* per subscription */
+#define OPCUA_MAX_PUBLISH_REQUESTS 4
+#define OPCUA_MAX_OPERATIONS 64     /* nodes per Read or CreateMonitoredItems */
+#define OPCUA_BUFFER_SIZE 8192U     /* one chunk per message */
+#define OPCUA_MIN_INTERVAL_MS 10U
+#define OPCUA_MAX_INTERVAL_MS 60000U
+#define OPCUA_SESSION_TIMEOUT_MS 60000U
+
+/* namespace 1 variables */
+#define OPCUA_NODE_STATE 1U
+#define OPCUA_NODE_DRIVES_ENABLED 2U
+#define OPCUA_NODE_ALARM_ACTIVE 3U
+#define OPCUA_NODE_DRIVES_READY 4U
+#define OPCUA_NODE_POSITION 10U        /* +0..2, X Y Z */
+#define OPCUA_NODE_JOINT_POSITION 20U  /* +joint */
+#define OPCUA_NODE_FOLLOWING_ERROR 30U /* +joint */
+#define OPCUA_NODE_CYCLES 40U
+#define OPCUA_NODE_MISSED_CYCLES 41U
+#define OPCUA_NODE_LOST_FRAMES 42U
+#define OPCUA_NODE_FOLLOWING_WARNINGS 43U
+
+bool opcua_server_start(const storage_params_t *params);
+void opcua_server_stop(void);
+uint16_t opcua_server_port(void);
+void opcua_server_publish(const cnc_status_t *status);
+void opcua_server_poll(uint64_t now_ns);
+
+#endif
@@ -0,0 +1,233 @@
+#if defined(HOST_OS)
+#define _GNU_SOURCE /* CPU affinity */
+#endif
+#include "osal.h"
+#include <string.h>
+
+#if defined(HOST_OS)
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+bool osal_init(bool lock_memory)
+{
+    if (!lock_memory) {
+        return true;
+    }
+    /* no page faults once running: everything mapped now and later stays resident */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return false;
+    }
+    volatile uint8_t stack[OSAL_PREFAULT_STACK_BYTES];
+    memset((void *)stack, 0, sizeof(stack));
+    return true;
+}
+
+static void *thread_start(void *arg)
+{
+    osal_thread_t *thread = (osal_thread_t *)arg;
+    thread->entry(thread->arg);
+    return NULL;
+}
+
+static bool spawn(osal_thread_t *thread, const osal_thread_attr_t *attr, bool realtime)
+{
+    pthread_attr_t attributes;
+    if (pthread_attr_init(&attributes) != 0) {
+        return false;
+    }
+    bool ok = true;
+    if (attr->stack_bytes != 0U) {
+        size_t bytes = attr->stack_bytes < (size_t)PTHREAD_STACK_MIN ? (size_t)PTHREAD_STACK_MIN : attr->stack_bytes;
+        ok = pthread_attr_setstacksize(&attributes, bytes) == 0;
+    }
+    if (ok && realtime) {
+        struct sched_param param;
+        int highest = sched_get_priority_max(SCHED_FIFO);
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = attr->priority > highest ? highest : attr->priority;
+        ok = pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED) == 0 &&
+             pthread_attr_setschedpolicy(&attributes, SCHED_FIFO) == 0 &&
+             pthread_attr_setschedparam(&attributes, &param) == 0;
+    }
+    if (ok && attr->cpu != OSAL_CPU_ANY) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(attr->cpu, &cpus);
+        ok = pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus) == 0;
+    }
+    int result = ok ? pthread_create(&thread->handle, &attributes, thread_start, thread) : EINVAL;
+    pthread_attr_destroy(&attributes);
+    if (result == EPERM && realtime) {
+        /* no CAP_SYS_NICE or RT budget: still run, the caller sees realtime == false */
+        return spawn(thread, attr, false);
+    }
+    thread->started = result == 0;
+    thread->realtime = thread->started && realtime;
+    return thread->started;
+}
+
+bool osal_thread_create(osal_thread_t *thread, const osal_thread_attr_t *attr, osal_entry_t entry, void *arg)
+{
+    static const osal_thread_attr_t defaults = {OSAL_PRIORITY_NORMAL, OSAL_CPU_ANY, 0U};
+    if (attr == NULL) {
+        attr = &defaults;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (entry == NULL || (attr->cpu != OSAL_CPU_ANY && (attr->cpu < 0 || attr->cpu >= cpus || attr->cpu >= CPU_SETSIZE))) {
+        return false;
+    }
+    memset(thread, 0, sizeof(*thread));
+    thread->entry = entry;
+    thread->arg = arg;
+    return spawn(thread, attr, attr->priority != OSAL_PRIORITY_NORMAL);
+}
+
+bool osal_thread_join(osal_thread_t *thread)
+{
+    if (!thread->started || pthread_join(thread->handle, NULL) != 0) {
+        return false;
+    }
+    thread->started = false;
+    return true;
+}
+
+bool osal_mutex_init(osal_mutex_t *mutex)
+{
+    /* priority inheritance, a background holder cannot stall the control thread behind a third one */
+    pthread_mutexattr_t attributes;
+    if (pthread_mutexattr_init(&attributes) != 0) {
+        return false;
+    }
+    bool ok = pthread_mutexattr_setprotocol(&attributes, PTHREAD_PRIO_INHERIT) == 0 &&
+              pthread_mutex_init(&mutex->handle, &attributes) == 0;
+    pthread_mutexattr_destroy(&attributes);
+    return ok;
+}
+
+void osal_mutex_lock(osal_mutex_t *mutex)
+{
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void osal_mutex_unlock(osal_mutex_t *mutex)
+{
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void osal_mutex_destroy(osal_mutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->handle);
+}
+
+uint64_t osal_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t osal_sleep_until_ns(uint64_t deadline_ns)
+{
+    /* absolute, so time spent before the call does not stretch the period */
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    uint64_t now = osal_clock_ns();
+    return now > deadline_ns ? now - deadline_ns : 0U;
+}
+
+#else
+
+#include "utils/timer.h"
+
+bool osal_init(bool lock_memory)
+{
+    (void)lock_memory;
+    return true;
+}
+
+bool osal_thread_create(osal_thread_t *thread, const osal_thread_attr_t *attr, osal_entry_t entry, void *arg)
+{
+    /* the superloop is the only thread */
+    (void)attr;
+    (void)entry;
+    (void)arg;
+    memset(thread, 0, sizeof(*thread));
+    return false;
+}
+
+bool osal_thread_join(osal_thread_t *thread)
+{
+    (void)thread;
+    return false;
+}
+
+bool osal_mutex_init(osal_mutex_t *mutex)
+{
+    mutex->unused = 0U;
+    return true;
+}
+
+void osal_mutex_lock(osal_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+void osal_mutex_unlock(osal_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+void osal_mutex_destroy(osal_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+uint64_t osal_clock_ns(void)
+{
+    return timer_get_ns();
+}
+
+uint64_t osal_sleep_until_ns(uint64_t deadline_ns)
+{
+    /* any interrupt ends a wfi, go back to sleep until the deadline; not an idle
+     * hook for the scheduler, which must see those interrupts */
+    uint64_t now = timer_get_ns();
+    while (now < deadline_ns) {
+        timer_idle_until_ns(deadline_ns);
+        now = timer_get_ns();
+    }
+    return now - deadline_ns;
+}
+
+#endif
+
+void osal_timer_start(osal_timer_t *timer, uint64_t period_ns)
+{
+    timer->period_ns = period_ns;
+    timer->next_ns = osal_clock_ns() + period_ns;
+    timer->overruns = 0U;
+    histogram_reset(&timer->latency);
+}
+
+bool osal_timer_wait(osal_timer_t *timer)
+{
+    uint64_t late = osal_sleep_until_ns(timer->next_ns);
+    histogram_record(&timer->latency, late > UINT32_MAX ? UINT32_MAX : (uint32_t)late);
+    timer->next_ns += timer->period_ns;
+    /* the deadlines stay on the start grid; releases already past are dropped, not bunched */
+    uint64_t now = osal_clock_ns();
+    if (timer->next_ns > now) {
+        return true;
+    }
+    uint64_t lost = (now - timer->next_ns) / timer->period_ns + 1U;
+    timer->next_ns += lost * timer->period_ns;
+    timer->overruns += (uint32_t)lost;
+    return false;
+}
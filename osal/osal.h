@@ -0,0 +1,68 @@
+#ifndef OSAL_OSAL_H
+#define OSAL_OSAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "utils/histogram.h"
+
+#if defined(HOST_OS)
+#include <pthread.h>
+#endif
+
+/* OS abstraction for running the controller core as a process: threads,
+ * mutexes, a monotonic clock and periodic timers on absolute deadlines.
+ * The Linux backend gives threads SCHED_FIFO and a CPU, locks memory and
+ * records how late every timed wakeup was. Bare metal has one thread,
+ * the superloop, and sleeps on the timer */
+
+#define OSAL_PRIORITY_NORMAL 0U      /* default time-sharing policy */
+#define OSAL_CPU_ANY (-1)
+#define OSAL_PREFAULT_STACK_BYTES 65536U
+
+typedef void (*osal_entry_t)(void *arg);
+
+typedef struct {
+    uint8_t priority;   /* SCHED_FIFO 1..99, OSAL_PRIORITY_NORMAL for none */
+    int cpu;            /* pinned core or OSAL_CPU_ANY */
+    size_t stack_bytes; /* 0 for the default */
+} osal_thread_attr_t;
+
+typedef struct {
+#if defined(HOST_OS)
+    pthread_t handle;
+#endif
+    osal_entry_t entry;
+    void *arg;
+    bool started;
+    bool realtime; /* the priority was granted; without the privilege the thread runs time-shared */
+} osal_thread_t;
+
+typedef struct {
+#if defined(HOST_OS)
+    pthread_mutex_t handle;
+#else
+    uint8_t unused;
+#endif
+} osal_mutex_t;
+
+typedef struct {
+    uint64_t period_ns;
+    uint64_t next_ns;   /* absolute deadline of the next release */
+    uint32_t overruns;  /* releases lost because a wait started after its deadline */
+    histogram_t latency; /* ns between the deadline and the wakeup */
+} osal_timer_t;
+
+bool osal_init(bool lock_memory);
+bool osal_thread_create(osal_thread_t *thread, const osal_thread_attr_t *attr, osal_entry_t entry, void *arg);
+bool osal_thread_join(osal_thread_t *thread);
+bool osal_mutex_init(osal_mutex_t *mutex);
+void osal_mutex_lock(osal_mutex_t *mutex);
+void osal_mutex_unlock(osal_mutex_t *mutex);
+void osal_mutex_destroy(osal_mutex_t *mutex);
+uint64_t osal_clock_ns(void);
+uint64_t osal_sleep_until_ns(uint64_t deadline_ns);
+void osal_timer_start(osal_timer_t *timer, uint64_t period_ns);
+bool osal_timer_wait(osal_timer_t *timer);
+
+#endif
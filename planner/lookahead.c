@@ -0,0 +1,266 @@
+#include "lookahead.h"
+#include "s_curve.h"
+#include <math.h>
+#include <stddef.h>
+
+static float min_f(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+static float max_f(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+static float joint_accel_limit(const planner_joint_limits_t *limits)
+{
+    float accel = limits->acceleration;
+    if (limits->torque > 0.0f && limits->inertia > 0.0f) {
+        float from_torque = limits->torque / limits->inertia;
+        accel = accel > 0.0f ? min_f(accel, from_torque) : from_torque;
+    }
+    return accel;
+}
+
+void lookahead_bound_block(const planner_joint_limits_t *limits, planner_block_t *block)
+{
+    float direction[3];
+    float length = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        direction[axis] = q16_16_to_float(block->end.xyz[axis] - block->start.xyz[axis]);
+        length += direction[axis] * direction[axis];
+    }
+    length = sqrtf(length);
+    block->length = length;
+    block->travelled = 0.0f;
+    block->max_speed = q16_16_to_float(block->feedrate);
+    block->speed_limit = block->max_speed * (float)PLANNER_FEED_OVERRIDE_MAX / 100.0f;
+    block->max_accel = block->accel > 0 ? q16_16_to_float(block->accel) : LOOKAHEAD_UNLIMITED_ACCEL;
+    block->max_jerk = block->jerk > 0 ? q16_16_to_float(block->jerk) : LOOKAHEAD_UNLIMITED_JERK;
+    if (limits->velocity <= 0.0f || length <= 0.0f) {
+        return;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        direction[axis] /= length;
+    }
+
+    /* phase plane along the block: joint speed is theta' s_dot, joint
+     * acceleration theta' s_ddot + theta'' s_dot^2 */
+    float first[LOOKAHEAD_SAMPLES + 1][3];
+    float second[LOOKAHEAD_SAMPLES + 1][3];
+    bool valid[LOOKAHEAD_SAMPLES + 1];
+    float joint_accel = joint_accel_limit(limits);
+    float speed = block->speed_limit;
+    for (int i = 0; i <= LOOKAHEAD_SAMPLES; ++i) {
+        float u = (float)i / (float)LOOKAHEAD_SAMPLES;
+        float xyz[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            xyz[axis] = q16_16_to_float(block->start.xyz[axis]) + direction[axis] * length * u;
+        }
+        valid[i] = delta_path_derivatives(xyz, direction, LOOKAHEAD_STEP, first[i], second[i]);
+        if (!valid[i]) {
+            continue;
+        }
+        for (int j = 0; j < 3; ++j) {
+            if (fabsf(first[i][j]) > 0.0f) {
+                speed = min_f(speed, limits->velocity / fabsf(first[i][j]));
+            }
+            /* the centripetal term may use at most half of the joint acceleration */
+            if (joint_accel > 0.0f && fabsf(second[i][j]) > 0.0f) {
+                speed = min_f(speed, sqrtf(0.5f * joint_accel / fabsf(second[i][j])));
+            }
+        }
+    }
+    /* the acceleration bound below leaves room for the centripetal term at the override ceiling */
+    block->speed_limit = speed;
+    block->max_speed = min_f(block->max_speed, speed);
+    if (joint_accel <= 0.0f) {
+        return;
+    }
+    float accel = block->max_accel;
+    for (int i = 0; i <= LOOKAHEAD_SAMPLES; ++i) {
+        if (!valid[i]) {
+            continue;
+        }
+        for (int j = 0; j < 3; ++j) {
+            if (fabsf(first[i][j]) > 0.0f) {
+                accel = min_f(accel, (joint_accel - fabsf(second[i][j]) * speed * speed) / fabsf(first[i][j]));
+            }
+        }
+    }
+    block->max_accel = accel;
+}
+
+static planner_error_t validate_pose(const float xyz[3], const float direction[3], float *curvature)
+{
+    delta_pose_t pose = {{q16_16_from_float(xyz[0]), q16_16_from_float(xyz[1]), q16_16_from_float(xyz[2])}};
+    float first[3];
+    float second[3];
+    if (!delta_within_workspace(&pose) || !delta_path_derivatives(xyz, direction, LOOKAHEAD_CHECK_STEP, first, second)) {
+        return PLANNER_ERROR_UNREACHABLE;
+    }
+    *curvature = 0.0f;
+    for (int j = 0; j < 3; ++j) {
+        if (fabsf(first[j]) > LOOKAHEAD_SINGULAR_GAIN) {
+            return PLANNER_ERROR_SINGULAR;
+        }
+        if (fabsf(second[j]) > *curvature) {
+            *curvature = fabsf(second[j]);
+        }
+    }
+    return PLANNER_ERROR_NONE;
+}
+
+planner_error_t lookahead_validate_segment(const delta_pose_t *start, const delta_pose_t *end)
+{
+    float origin[3];
+    float direction[3] = {0.0f, 0.0f, 1.0f};
+    float length = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        origin[axis] = q16_16_to_float(start->xyz[axis]);
+        length += q16_16_to_float(end->xyz[axis] - start->xyz[axis]) * q16_16_to_float(end->xyz[axis] - start->xyz[axis]);
+    }
+    length = sqrtf(length);
+    if (length > 0.0f) {
+        for (int axis = 0; axis < 3; ++axis) {
+            direction[axis] = q16_16_to_float(end->xyz[axis] - start->xyz[axis]) / length;
+        }
+    }
+    /* the target first: a move that ends out of reach says so, not that it
+     * passed the singular rim on the way */
+    float xyz[3];
+    float curvature;
+    for (int axis = 0; axis < 3; ++axis) {
+        xyz[axis] = origin[axis] + direction[axis] * length;
+    }
+    planner_error_t error = validate_pose(xyz, direction, &curvature);
+    if (error != PLANNER_ERROR_NONE) {
+        return error;
+    }
+
+    /* a straight line in joint space between samples misses the true joint
+     * path by h^2 |theta''| / 8: space the samples so that stays in tolerance */
+    for (float s = 0.0f; s < length;) {
+        for (int axis = 0; axis < 3; ++axis) {
+            xyz[axis] = origin[axis] + direction[axis] * s;
+        }
+        error = validate_pose(xyz, direction, &curvature);
+        if (error != PLANNER_ERROR_NONE) {
+            return error;
+        }
+        float spacing = LOOKAHEAD_MAX_SPACING;
+        if (curvature > 0.0f) {
+            spacing = min_f(spacing, sqrtf(8.0f * LOOKAHEAD_CHORD_TOLERANCE / curvature));
+        }
+        s += spacing > LOOKAHEAD_MIN_SPACING ? spacing : LOOKAHEAD_MIN_SPACING;
+    }
+    return PLANNER_ERROR_NONE;
+}
+
+static float junction_speed(const planner_block_t *prev, const planner_block_t *block)
+{
+    if (prev->arch || block->arch) {
+        return 0.0f;
+    }
+    q16_16_t diff_prev[3];
+    q16_16_t diff_curr[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        diff_prev[axis] = prev->end.xyz[axis] - prev->start.xyz[axis];
+        diff_curr[axis] = block->end.xyz[axis] - block->start.xyz[axis];
+    }
+    q16_16_t dot = 0;
+    q16_16_t mag_prev = 0;
+    q16_16_t mag_curr = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        dot += q16_16_mul(diff_prev[axis], diff_curr[axis]);
+        mag_prev += q16_16_mul(diff_prev[axis], diff_prev[axis]);
+        mag_curr += q16_16_mul(diff_curr[axis], diff_curr[axis]);
+    }
+    q16_16_t denom = q16_16_mul(q16_16_sqrt(mag_prev), q16_16_sqrt(mag_curr));
+    q16_16_t cos_theta = denom != 0 ? q16_16_div(dot, denom) : Q16_16_ONE;
+    q16_16_t smoothing = q16_16_clamp(q16_16_from_float(0.5f * (1.0f - q16_16_to_float(cos_theta))), 0, Q16_16_ONE);
+    float corner = q16_16_to_float(q16_16_mul(prev->feedrate, Q16_16_ONE - smoothing));
+    return min_f(corner, min_f(prev->max_speed, block->max_speed));
+}
+
+float lookahead_block_time(float length, float entry, float exit, float max_speed, float max_accel, float max_jerk)
+{
+    /* estimate: ramp between entry and exit, then up from the faster one and
+     * back over what is left, as two jerk-limited ramps */
+    float low = min_f(entry, exit);
+    float high = entry > exit ? entry : exit;
+    float spare = length - s_curve_ramp_distance(low, high, max_accel, max_jerk);
+    float peak = min_f(max_speed, s_curve_ramp_speed(high, 0.5f * spare, max_accel, max_jerk));
+    if (peak < high) {
+        peak = high;
+    }
+    if (peak <= 0.0f) {
+        return 0.0f;
+    }
+    float ramps = s_curve_ramp_distance(entry, peak, max_accel, max_jerk) + s_curve_ramp_distance(peak, exit, max_accel, max_jerk);
+    float cruise = length - ramps;
+    return s_curve_ramp_time(entry, peak, max_accel, max_jerk) + s_curve_ramp_time(peak, exit, max_accel, max_jerk) +
+           (cruise > 0.0f ? cruise / peak : 0.0f);
+}
+
+static uint16_t previous_index(uint16_t index)
+{
+    return (uint16_t)((index + PLANNER_QUEUE_LENGTH - 1U) % PLANNER_QUEUE_LENGTH);
+}
+
+void lookahead_plan(planner_queue_t *planner)
+{
+    if (planner->head == planner->tail) {
+        return;
+    }
+    /* backward: the queue ends at rest, each entry is what the block can still
+     * brake from. Speeds change along jerk-limited ramps that start and end
+     * without acceleration, as follow_profile() drives them */
+    float exit = 0.0f;
+    uint16_t index = previous_index(planner->head);
+    while (true) {
+        planner_block_t *block = &planner->blocks[index];
+        if (block->arch) {
+            exit = 0.0f;
+        }
+        float entry = block->arch ? 0.0f : min_f(block->max_speed, s_curve_ramp_speed(exit, block->length, block->max_accel, block->max_jerk));
+        if (index == planner->tail) {
+            block->exit_velocity = q16_16_from_float(exit);
+            block->entry_velocity = q16_16_from_float(min_f(entry, planner->path_speed));
+            break;
+        }
+        const planner_block_t *prev = &planner->blocks[previous_index(index)];
+        entry = min_f(entry, junction_speed(prev, block));
+        block->exit_velocity = q16_16_from_float(exit);
+        block->entry_velocity = q16_16_from_float(entry);
+        exit = entry;
+        index = previous_index(index);
+    }
+
+    /* forward: from the speed the path moves at, each exit is what the block can reach */
+    float speed = planner->path_speed;
+    for (index = planner->tail; index != planner->head; index = (uint16_t)((index + 1U) % PLANNER_QUEUE_LENGTH)) {
+        planner_block_t *block = &planner->blocks[index];
+        if (block->arch) {
+            speed = 0.0f;
+            continue;
+        }
+        bool active = index == planner->tail && block->active;
+        float entry = active ? speed : min_f(q16_16_to_float(block->entry_velocity), speed);
+        float remaining = block->length - block->travelled;
+        float reach = s_curve_ramp_speed(entry, remaining, block->max_accel, block->max_jerk);
+        if (active) {
+            /* mid-ramp, the speed still rises until the acceleration is eased out */
+            float accel = planner->path_accel;
+            reach = max_f(reach, entry + 0.5f * accel * fabsf(accel) / block->max_jerk);
+        }
+        reach = min_f(q16_16_to_float(block->exit_velocity), reach);
+        block->entry_velocity = q16_16_from_float(entry);
+        block->exit_velocity = q16_16_from_float(reach);
+        float time_s = lookahead_block_time(remaining, entry, reach, block->max_speed, block->max_accel, block->max_jerk);
+        uint32_t ticks = (uint32_t)ceilf(time_s / ((float)planner->control_period_us * 1e-6f)) + 1U;
+        block->total_ticks = (block->active ? block->tick_index : 0U) + ticks;
+        speed = reach;
+    }
+}
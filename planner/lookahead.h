@@ -0,0 +1,29 @@
+#ifndef PLANNER_LOOKAHEAD_H
+#define PLANNER_LOOKAHEAD_H
+
+#include "planner.h"
+
+/* points along a block where the joint Jacobian is evaluated */
+#define LOOKAHEAD_SAMPLES 8
+/* path step of the central differences through the inverse kinematics, m */
+#define LOOKAHEAD_STEP 0.005f
+/* acceleration used for blocks queued without one, m/s^2 */
+#define LOOKAHEAD_UNLIMITED_ACCEL 1.0e6f
+/* jerk used for blocks queued without one, m/s^3 */
+#define LOOKAHEAD_UNLIMITED_JERK 1.0e9f
+/* enqueue validation: joint-space chord error allowed between samples, rad */
+#define LOOKAHEAD_CHORD_TOLERANCE 0.001f
+/* widest and narrowest sample spacing along a validated move, m */
+#define LOOKAHEAD_MAX_SPACING 0.01f
+#define LOOKAHEAD_MIN_SPACING 0.0002f
+/* difference step of the validation, short so poses next to the workspace edge pass */
+#define LOOKAHEAD_CHECK_STEP 0.001f
+/* joint rate per path rate above which a pose counts as singular, rad/m */
+#define LOOKAHEAD_SINGULAR_GAIN 40.0f
+
+void lookahead_bound_block(const planner_joint_limits_t *limits, planner_block_t *block);
+planner_error_t lookahead_validate_segment(const delta_pose_t *start, const delta_pose_t *end);
+void lookahead_plan(planner_queue_t *planner);
+float lookahead_block_time(float length, float entry, float exit, float max_speed, float max_accel, float max_jerk);
+
+#endif
@@ -1,15 +1,10 @@
 #include "planner.h"
+#include "lookahead.h"
+#include <math.h>
 #include <stddef.h>
+#include <string.h>
 #include "utils/fixed.h"
 
-static uint16_t planner_count(const planner_queue_t *planner)
-{
-    if (planner->head >= planner->tail) {
-        return (uint16_t)(planner->head - planner->tail);
-    }
-    return (uint16_t)(PLANNER_QUEUE_LENGTH - planner->tail + planner->head);
-}
-
 void planner_init(planner_queue_t *planner, uint32_t control_period_us)
 {
     planner->head = planner->tail = 0U;
@@ -17,6 +12,29 @@ void planner_init(planner_queue_t *planner, uint32_t control_period_us)
     for (int i = 0; i < 3; ++i) {
         planner->current_pose.xyz[i] = 0;
     }
+    planner->probe.state = PLANNER_PROBE_NONE;
+    planner->probe.error_on_miss = false;
+    planner->probe.contact = planner->current_pose;
+    planner->frame = PLANNER_FRAME_FIXED;
+    planner->frame_offset = planner->current_pose;
+    planner->frame_lost = false;
+    planner->joint_limits = (planner_joint_limits_t){0.0f, 0.0f, 0.0f, 0.0f};
+    planner->check_reach = false;
+    planner->error = PLANNER_ERROR_NONE;
+    planner->path_speed = 0.0f;
+    planner->path_accel = 0.0f;
+    planner->feed_scale = Q16_16_ONE;
+    planner->feed_scale_target = Q16_16_ONE;
+    planner->feed_override = 100U;
+    planner->rapid_override = 100U;
+    planner->scale_value = 1.0f;
+    planner->scale_rate = 0.0f;
+    planner->hold_requested = false;
+    planner->held = false;
+    planner->output_delay_ticks = 0U;
+    planner->settle_ticks = 0U;
+    planner->bypassed = false;
+    planner->pose_pending = false;
 }
 
 bool planner_is_empty(const planner_queue_t *planner)
@@ -24,53 +42,73 @@ bool planner_is_empty(const planner_queue_t *planner)
     return planner->head == planner->tail;
 }
 
-static bool planner_full(const planner_queue_t *planner)
+bool planner_is_settled(const planner_queue_t *planner)
+{
+    /* the filtered setpoint keeps moving for the output delay after the last block */
+    return planner_is_empty(planner) && planner->settle_ticks == 0U;
+}
+
+void planner_set_joint_limits(planner_queue_t *planner, const planner_joint_limits_t *limits)
+{
+    /* applies to blocks queued from now on */
+    planner->joint_limits = *limits;
+}
+
+void planner_set_reach_check(planner_queue_t *planner, bool enabled)
+{
+    /* needs delta_init(), off for planners that only shape Cartesian paths */
+    planner->check_reach = enabled;
+}
+
+void planner_set_output_delay(planner_queue_t *planner, uint16_t ticks)
+{
+    planner->output_delay_ticks = ticks;
+    planner->settle_ticks = ticks;
+}
+
+bool planner_set_period(planner_queue_t *planner, uint32_t control_period_us)
+{
+    /* queued blocks carry tick counts computed for the old period */
+    if (control_period_us == 0U || !planner_is_settled(planner)) {
+        return false;
+    }
+    planner->control_period_us = control_period_us;
+    return true;
+}
+
+bool planner_is_full(const planner_queue_t *planner)
 {
     return ((planner->head + 1U) % PLANNER_QUEUE_LENGTH) == planner->tail;
 }
 
-static void planner_recalculate(planner_queue_t *planner)
+static bool reject(planner_queue_t *planner, planner_error_t error)
+{
+    planner->error = error;
+    return false;
+}
+
+static bool reachable(planner_queue_t *planner, const delta_pose_t *from, const delta_pose_t *to)
 {
-    uint16_t count = planner_count(planner);
-    if (count < 2U) {
-        return;
+    /* unreachable moves are refused here, the control tick never meets them */
+    if (!planner->check_reach) {
+        return true;
     }
-    uint16_t idx = planner->tail;
-    planner_block_t *prev = NULL;
-    for (uint16_t i = 0; i < count; ++i) {
-        planner_block_t *block = &planner->blocks[idx];
-        if (prev != NULL) {
-            q16_16_t diff_prev[3];
-            q16_16_t diff_curr[3];
-            for (int axis = 0; axis < 3; ++axis) {
-                diff_prev[axis] = prev->end.xyz[axis] - prev->start.xyz[axis];
-                diff_curr[axis] = block->end.xyz[axis] - block->start.xyz[axis];
-            }
-            q16_16_t dot = 0;
-            q16_16_t mag_prev = 0;
-            q16_16_t mag_curr = 0;
-            for (int axis = 0; axis < 3; ++axis) {
-                dot += q16_16_mul(diff_prev[axis], diff_curr[axis]);
-                mag_prev += q16_16_mul(diff_prev[axis], diff_prev[axis]);
-                mag_curr += q16_16_mul(diff_curr[axis], diff_curr[axis]);
-            }
-            q16_16_t denom = q16_16_mul(q16_16_sqrt(mag_prev), q16_16_sqrt(mag_curr));
-            q16_16_t cos_theta = denom != 0 ? q16_16_div(dot, denom) : Q16_16_ONE;
-            q16_16_t smoothing = q16_16_clamp(q16_16_from_float(0.5f * (1.0f - q16_16_to_float(cos_theta))), 0, Q16_16_ONE);
-            q16_16_t reduced = q16_16_mul(prev->feedrate, Q16_16_ONE - smoothing);
-            prev->exit_velocity = reduced;
-            block->entry_velocity = reduced;
+    planner_error_t error = lookahead_validate_segment(from, to);
+    if (error == PLANNER_ERROR_NONE && planner->frame != PLANNER_FRAME_FIXED) {
+        /* belt-frame poses run with the belt offset added, at least the one reached by now */
+        delta_pose_t start;
+        delta_pose_t end;
+        for (int i = 0; i < 3; ++i) {
+            start.xyz[i] = from->xyz[i] + planner->frame_offset.xyz[i];
+            end.xyz[i] = to->xyz[i] + planner->frame_offset.xyz[i];
         }
-        prev = block;
-        idx = (uint16_t)((idx + 1U) % PLANNER_QUEUE_LENGTH);
+        error = lookahead_validate_segment(&start, &end);
     }
+    return error == PLANNER_ERROR_NONE || reject(planner, error);
 }
 
-bool planner_push_line(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk)
+static void queue_line(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk)
 {
-    if (planner_full(planner)) {
-        return false;
-    }
     planner_block_t *block = &planner->blocks[planner->head];
     block->start = planner->current_pose;
     block->end = *target;
@@ -80,70 +118,500 @@ bool planner_push_line(planner_queue_t *planner, const delta_pose_t *target, q16
     block->accel = accel;
     block->jerk = jerk;
     block->tick_index = 0U;
+    block->tick_fraction = 0U;
     block->active = false;
+    block->probe = false;
+    block->rapid = false;
+    block->arch = false;
 
-    q16_16_t diff_sq = 0;
-    for (int axis = 0; axis < 3; ++axis) {
-        q16_16_t diff = block->end.xyz[axis] - block->start.xyz[axis];
-        diff_sq += q16_16_mul(diff, diff);
+    lookahead_bound_block(&planner->joint_limits, block);
+    planner->head = (uint16_t)((planner->head + 1U) % PLANNER_QUEUE_LENGTH);
+    lookahead_plan(planner);
+    planner->current_pose = block->end;
+}
+
+bool planner_push_line(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk)
+{
+    if (planner_is_full(planner)) {
+        return reject(planner, PLANNER_ERROR_QUEUE_FULL);
     }
-    q16_16_t distance = q16_16_sqrt(diff_sq);
-    if (distance == 0) {
+    if (!reachable(planner, &planner->current_pose, target)) {
+        return false;
+    }
+    queue_line(planner, target, feedrate, accel, jerk);
+    planner->error = PLANNER_ERROR_NONE;
+    return true;
+}
+
+bool planner_push_rapid(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk)
+{
+    if (!planner_push_line(planner, target, feedrate, accel, jerk)) {
+        return false;
+    }
+    uint16_t last = (uint16_t)((planner->head + PLANNER_QUEUE_LENGTH - 1U) % PLANNER_QUEUE_LENGTH);
+    planner->blocks[last].rapid = true;
+    return true;
+}
+
+static float min_f(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+static float max_f(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+static void bound_leg(const planner_queue_t *planner, const delta_pose_t *from, const delta_pose_t *to, float *speed, float *accel)
+{
+    /* an arch leg is a straight move, bounded by the joints like a line block */
+    planner_block_t leg;
+    memset(&leg, 0, sizeof(leg));
+    leg.start = *from;
+    leg.end = *to;
+    leg.feedrate = q16_16_from_float(*speed);
+    leg.accel = q16_16_from_float(*accel);
+    lookahead_bound_block(&planner->joint_limits, &leg);
+    *speed = min_f(*speed, leg.max_speed);
+    *accel = min_f(*accel, leg.max_accel);
+}
+
+bool planner_push_arch(planner_queue_t *planner, const delta_pose_t *target, q16_16_t lift, q16_16_t radius, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk)
+{
+    delta_pose_t start = planner->current_pose;
+    float dx = q16_16_to_float(target->xyz[0] - start.xyz[0]);
+    float dy = q16_16_to_float(target->xyz[1] - start.xyz[1]);
+    float start_z = q16_16_to_float(start.xyz[2]);
+    float end_z = q16_16_to_float(target->xyz[2]);
+    float top = (start_z > end_z ? start_z : end_z) + q16_16_to_float(lift);
+    float length = sqrtf(dx * dx + dy * dy);
+    float v = q16_16_to_float(feedrate);
+    float a = q16_16_to_float(accel);
+    float j = q16_16_to_float(jerk);
+
+    /* the arch stays inside the box of its three legs, not on the chord */
+    delta_pose_t rise_top = start;
+    delta_pose_t fall_top = *target;
+    rise_top.xyz[2] = fall_top.xyz[2] = q16_16_from_float(top);
+    if (lift >= 0) {
+        /* one bound for all legs, the corners blend two of them */
+        bound_leg(planner, &start, &rise_top, &v, &a);
+        bound_leg(planner, &rise_top, &fall_top, &v, &a);
+        bound_leg(planner, &fall_top, target, &v, &a);
+    }
+
+    planner_arch_t shape;
+    if (lift < 0 || !s_curve_plan(&shape.rise, top - start_z, v, a, j) ||
+        !s_curve_plan(&shape.traverse, length, v, a, j) || !s_curve_plan(&shape.fall, top - end_z, v, a, j)) {
+        return false;
+    }
+    shape.direction[0] = length > 0.0f ? dx / length : 0.0f;
+    shape.direction[1] = length > 0.0f ? dy / length : 0.0f;
+    /* the traverse starts while the rise still has the corner radius to go and
+     * the fall starts with the corner radius of traverse left */
+    float corner = min_f(q16_16_to_float(radius), min_f(min_f(top - start_z, top - end_z), 0.5f * length));
+    if (corner < 0.0f) {
+        corner = 0.0f;
+    }
+    shape.traverse_start = s_curve_time_at(&shape.rise, shape.rise.distance - corner);
+    shape.fall_start = shape.traverse_start + s_curve_time_at(&shape.traverse, length - corner);
+    float duration = shape.fall_start + s_curve_duration(&shape.fall);
+    float traverse_end = shape.traverse_start + s_curve_duration(&shape.traverse);
+    if (traverse_end > duration) {
+        duration = traverse_end;
+    }
+
+    if (planner_is_full(planner)) {
+        return reject(planner, PLANNER_ERROR_QUEUE_FULL);
+    }
+    if (!reachable(planner, &start, &rise_top) || !reachable(planner, &rise_top, &fall_top) || !reachable(planner, &fall_top, target)) {
+        return false;
+    }
+    queue_line(planner, target, feedrate, accel, jerk);
+    planner->error = PLANNER_ERROR_NONE;
+    uint16_t last = (uint16_t)((planner->head + PLANNER_QUEUE_LENGTH - 1U) % PLANNER_QUEUE_LENGTH);
+    planner_block_t *block = &planner->blocks[last];
+    float period = (float)planner->control_period_us * 1e-6f;
+    block->arch = true;
+    block->shape = shape;
+    block->entry_velocity = block->exit_velocity = 0;
+    block->total_ticks = (uint32_t)ceilf(duration / period);
+    if (block->total_ticks == 0U) {
         block->total_ticks = 1U;
-    } else {
-        float period = (float)planner->control_period_us / 1000000.0f;
-        float time_s = q16_16_to_float(distance) / q16_16_to_float(feedrate);
-        uint32_t ticks = (uint32_t)(time_s / period);
-        if (ticks == 0U) {
-            ticks = 1U;
-        }
-        block->total_ticks = ticks;
     }
+    lookahead_plan(planner);
+    return true;
+}
 
-    planner->head = (uint16_t)((planner->head + 1U) % PLANNER_QUEUE_LENGTH);
-    planner_recalculate(planner);
+static void arch_pose(const planner_block_t *block, float t, delta_pose_t *pose)
+{
+    const planner_arch_t *shape = &block->shape;
+    float across = s_curve_position(&shape->traverse, t - shape->traverse_start);
+    float height = s_curve_position(&shape->rise, t) - s_curve_position(&shape->fall, t - shape->fall_start);
+    pose->xyz[0] = block->start.xyz[0] + q16_16_from_float(shape->direction[0] * across);
+    pose->xyz[1] = block->start.xyz[1] + q16_16_from_float(shape->direction[1] * across);
+    pose->xyz[2] = block->start.xyz[2] + q16_16_from_float(height);
+}
+
+bool planner_push_probe(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk, bool error_on_miss)
+{
+    if (planner->probe.state == PLANNER_PROBE_PENDING || !planner_push_line(planner, target, feedrate, accel, jerk)) {
+        return false;
+    }
+    uint16_t last = (uint16_t)((planner->head + PLANNER_QUEUE_LENGTH - 1U) % PLANNER_QUEUE_LENGTH);
+    planner->blocks[last].probe = true;
+    planner->probe.state = PLANNER_PROBE_PENDING;
+    planner->probe.error_on_miss = error_on_miss;
+    return true;
+}
+
+const planner_block_t *planner_active_block(const planner_queue_t *planner)
+{
+    return planner_is_empty(planner) ? NULL : &planner->blocks[planner->tail];
+}
+
+void planner_set_feed_scale(planner_queue_t *planner, q16_16_t scale)
+{
+    planner->feed_scale_target = q16_16_clamp(scale, 0, Q16_16_ONE);
+}
+
+static uint16_t clamp_percent(uint16_t percent, uint16_t min, uint16_t max)
+{
+    return percent < min ? min : (percent > max ? max : percent);
+}
+
+void planner_set_feed_override(planner_queue_t *planner, uint16_t percent)
+{
+    planner->feed_override = clamp_percent(percent, PLANNER_FEED_OVERRIDE_MIN, PLANNER_FEED_OVERRIDE_MAX);
+}
+
+void planner_set_rapid_override(planner_queue_t *planner, uint16_t percent)
+{
+    planner->rapid_override = clamp_percent(percent, PLANNER_RAPID_OVERRIDE_MIN, PLANNER_RAPID_OVERRIDE_MAX);
+}
+
+q16_16_t planner_override(const planner_queue_t *planner)
+{
+    const planner_block_t *block = planner_active_block(planner);
+    uint16_t percent = block != NULL && block->rapid ? planner->rapid_override : planner->feed_override;
+    return (q16_16_t)(((int32_t)percent << 16) / 100);
+}
+
+static void ramp_feed_scale(planner_queue_t *planner, const planner_block_t *block)
+{
+    /* the scale is a time warp of the block: bounding its rate by accel / feed and
+     * its change by jerk / feed keeps path acceleration and jerk within the block's limits */
+    float dt = (float)planner->control_period_us * 1e-6f;
+    float feed = q16_16_to_float(block->feedrate);
+    float rate_limit = feed > 0.0f ? q16_16_to_float(block->accel) / feed : (float)PLANNER_FEED_SCALE_RATE;
+    float change_limit = feed > 0.0f ? q16_16_to_float(block->jerk) / feed : (float)PLANNER_FEED_SCALE_CHANGE;
+    /* overrides are ramped like any other scale change */
+    float target = planner->hold_requested ? 0.0f : q16_16_to_float(q16_16_mul(planner->feed_scale_target, planner_override(planner)));
+    float error = target - planner->scale_value;
+
+    float desired = sqrtf(2.0f * change_limit * fabsf(error));
+    if (desired > rate_limit) {
+        desired = rate_limit;
+    }
+    if (error < 0.0f) {
+        desired = -desired;
+    }
+    float change = change_limit * dt;
+    if (desired > planner->scale_rate + change) {
+        desired = planner->scale_rate + change;
+    } else if (desired < planner->scale_rate - change) {
+        desired = planner->scale_rate - change;
+    }
+    planner->scale_rate = desired;
+    planner->scale_value += desired * dt;
+    if ((error >= 0.0f && planner->scale_value >= target) || (error <= 0.0f && planner->scale_value <= target)) {
+        planner->scale_value = target;
+        planner->scale_rate = 0.0f;
+    }
+    planner->feed_scale = q16_16_from_float(planner->scale_value);
+    if (planner->feed_scale != 0) {
+        planner->settle_ticks = planner->output_delay_ticks;
+    } else if (planner->settle_ticks > 0U) {
+        planner->settle_ticks--;
+    }
+    planner->held = planner->hold_requested && planner->feed_scale == 0 && planner->settle_ticks == 0U;
+}
+
+static void advance_ticks(planner_queue_t *planner, planner_block_t *block)
+{
+    /* planned time never runs faster than real time, see follow_profile() */
+    q16_16_t scale = planner->feed_scale < Q16_16_ONE ? planner->feed_scale : Q16_16_ONE;
+    uint32_t advance = (uint32_t)block->tick_fraction + (uint32_t)scale;
+    block->tick_index += advance >> 16;
+    block->tick_fraction = (uint16_t)(advance & 0xFFFFU);
+}
+
+static void finish_block(planner_queue_t *planner, const planner_block_t *block)
+{
     planner->current_pose = block->end;
+    planner->tail = (uint16_t)((planner->tail + 1U) % PLANNER_QUEUE_LENGTH);
+}
+
+static float brake_distance(float speed, float accel, float exit, float max_accel, float max_jerk)
+{
+    /* path covered from (speed, accel) until the speed is down to exit with the
+     * acceleration back at zero, braking as late as the jerk allows */
+    float t = fabsf(accel) / max_jerk;
+    if (accel >= 0.0f) {
+        float peak = speed + 0.5f * accel * t;
+        float ease = (speed + (0.5f * accel - max_jerk * t / 6.0f) * t) * t;
+        return ease + (peak > exit ? s_curve_ramp_distance(peak, exit, max_accel, max_jerk) : 0.0f);
+    }
+    /* already braking: the state lies on the ramp that left `start` at zero acceleration,
+     * unless it brakes harder than that ramp ever would and has to ease off now */
+    float start = speed + 0.5f * accel * accel / max_jerk;
+    float ease = (speed + (0.5f * accel + max_jerk * t / 6.0f) * t) * t;
+    if (start <= exit || -accel > sqrtf(max_jerk * (start - exit))) {
+        return ease;
+    }
+    return s_curve_ramp_distance(start, exit, max_accel, max_jerk) - (start - max_jerk * t * t / 6.0f) * t;
+}
+
+static float ease_jerk(float speed, float accel, float goal, float max_jerk)
+{
+    /* once the jerk limit can only just bring the acceleration to zero as the
+     * speed reaches goal, the jerk that does it exactly; zero until then, and
+     * when the goal moved too close for the limit jerk */
+    float gap = goal - speed;
+    if (gap * accel <= 0.0f) {
+        return 0.0f;
+    }
+    float jerk = 0.5f * accel * accel / fabsf(gap);
+    if (jerk < max_jerk || jerk > PLANNER_EASE_SLACK * max_jerk) {
+        return 0.0f;
+    }
+    return accel > 0.0f ? -jerk : jerk;
+}
+
+static float path_advance(float speed, float accel, float jerk, bool ease, float max_accel, float dt, float *next_speed, float *next_accel)
+{
+    /* the jerk acts until the acceleration reaches zero when easing, or the
+     * limit otherwise; the rest of the tick holds it there */
+    float ramp = dt;
+    float hold = 0.0f;
+    if (ease) {
+        ramp = min_f(dt, -accel / jerk);
+    } else if (jerk != 0.0f) {
+        float limit = jerk > 0.0f ? max_accel : -max_accel;
+        if ((limit - accel) / jerk < dt) {
+            ramp = max_f((limit - accel) / jerk, 0.0f);
+            hold = limit;
+        }
+    }
+    float rest = dt - ramp;
+    float step = (speed + (0.5f * accel + jerk * ramp / 6.0f) * ramp) * ramp;
+    float speed_out = speed + (accel + 0.5f * jerk * ramp) * ramp;
+    step += (speed_out + 0.5f * hold * rest) * rest;
+    speed_out += hold * rest;
+    *next_accel = speed_out <= 0.0f ? 0.0f : (ramp < dt ? hold : accel + jerk * dt);
+    *next_speed = max_f(speed_out, 0.0f);
+    return max_f(step, 0.0f);
+}
+
+static float profile_overrun(const planner_block_t *block, float speed, float accel, float jerk, bool ease, float dt, float exit, float remaining)
+{
+    /* how much longer the block would have to be to still end at its exit
+     * after this tick; a tick that ends the block without accelerating fits
+     * too, up to the speed one tick of the jerk limit would still take off */
+    float next_speed;
+    float next_accel;
+    float step = path_advance(speed, accel, jerk, ease, block->max_accel, dt, &next_speed, &next_accel);
+    if (step >= remaining && next_speed <= exit + 0.5f * block->max_jerk * dt * dt && next_accel <= 0.0f) {
+        return 0.0f;
+    }
+    return step + brake_distance(next_speed, next_accel, exit, block->max_accel, block->max_jerk) - remaining;
+}
+
+static bool follow_profile(planner_queue_t *planner, planner_block_t *block, float share, float *leftover)
+{
+    /* the acceleration eases onto the speed target under the block's jerk
+     * limit, and the jerk is lowered as far as needed for the block to still
+     * end at its exit speed with the acceleration back at zero. A scale below
+     * one warps the time step; above one, warping would multiply the
+     * joint-bounded speed and acceleration, so the scale raises the speed
+     * target instead, up to the joint bound. share is the part of the tick
+     * left to this block, leftover what it does not use */
+    float scale = q16_16_to_float(planner->feed_scale);
+    float dt = share * min_f(scale, 1.0f) * (float)planner->control_period_us * 1e-6f;
+    float target = scale > 1.0f ? min_f(block->max_speed * scale, block->speed_limit) : block->max_speed;
+    float exit = q16_16_to_float(block->exit_velocity);
+    float remaining = block->length - block->travelled;
+    float speed = planner->path_speed;
+    float accel = planner->path_accel;
+    float step = 0.0f;
+    bool landing = false;
+    if (dt > 0.0f) {
+        /* last ramp onto the exit speed: the block ends with it, the distance
+         * left over is rounding */
+        float jerk = accel < 0.0f ? ease_jerk(speed, accel, exit, block->max_jerk) : 0.0f;
+        landing = jerk != 0.0f;
+        bool ease = landing;
+        if (!landing) {
+            jerk = ease_jerk(speed, accel, target, block->max_jerk);
+            ease = jerk != 0.0f;
+            if (!ease) {
+                /* below sqrt(2 J |e|) the limit jerk can still ease out onto the target */
+                float error = target - speed;
+                float wanted = min_f(block->max_accel, sqrtf(2.0f * block->max_jerk * fabsf(error)));
+                wanted = error < 0.0f ? -wanted : wanted;
+                jerk = max_f(-block->max_jerk, min_f(block->max_jerk, (wanted - accel) / dt));
+            }
+            if (profile_overrun(block, speed, accel, jerk, ease, dt, exit, remaining) > 0.0f) {
+                float low = -block->max_jerk;
+                float high = max_f(low, jerk);
+                if (profile_overrun(block, speed, accel, low, false, dt, exit, remaining) <= 0.0f) {
+                    for (int i = 0; i < PLANNER_JERK_ITERATIONS; ++i) {
+                        float mid = 0.5f * (low + high);
+                        if (profile_overrun(block, speed, accel, mid, false, dt, exit, remaining) <= 0.0f) {
+                            low = mid;
+                        } else {
+                            high = mid;
+                        }
+                    }
+                } else {
+                    /* nothing fits: the jerk that overruns least, braking
+                     * harder only helps until easing off takes longer */
+                    float lower = low;
+                    float upper = block->max_jerk;
+                    for (int i = 0; i < PLANNER_JERK_ITERATIONS; ++i) {
+                        float third = (upper - lower) / 3.0f;
+                        float early = profile_overrun(block, speed, accel, lower + third, false, dt, exit, remaining);
+                        if (early <= profile_overrun(block, speed, accel, upper - third, false, dt, exit, remaining)) {
+                            upper -= third;
+                        } else {
+                            lower += third;
+                        }
+                    }
+                    /* the least is often at either end of the range */
+                    const float candidates[2] = {0.5f * (lower + upper), block->max_jerk};
+                    float least = profile_overrun(block, speed, accel, low, false, dt, exit, remaining);
+                    for (int i = 0; i < 2; ++i) {
+                        float overrun = profile_overrun(block, speed, accel, candidates[i], false, dt, exit, remaining);
+                        if (overrun < least) {
+                            least = overrun;
+                            low = candidates[i];
+                        }
+                    }
+                }
+                jerk = low;
+                ease = false;
+            }
+        }
+        step = path_advance(speed, accel, jerk, ease, block->max_accel, dt, &speed, &accel);
+        landing = landing && accel != 0.0f;
+        if (landing) {
+            step = min_f(step, max_f(remaining, 0.0f));
+        }
+    }
+    planner->path_speed = speed;
+    planner->path_accel = accel;
+    /* come to rest a rounding error short of the end is arrived too */
+    if (landing || (step < remaining && (speed > 0.0f || step < remaining - PLANNER_LANDING_M))) {
+        block->travelled += step;
+        return false;
+    }
+    block->travelled = block->length;
+    planner->path_speed = min_f(speed, exit);
+    planner->path_accel = 0.0f;
+    *leftover = step > remaining ? share * (step - remaining) / step : 0.0f;
     return true;
 }
 
+static void activate_block(planner_block_t *block)
+{
+    block->active = true;
+    block->tick_index = 0U;
+    block->tick_fraction = 0U;
+    block->travelled = 0.0f;
+}
+
 bool planner_step(planner_queue_t *planner, delta_pose_t *pose_out)
 {
     if (planner_is_empty(planner)) {
+        /* nothing moves, the scale can jump; blocks queued during a hold start from standstill */
+        planner->feed_scale = planner->hold_requested ? 0 : q16_16_mul(planner->feed_scale_target, planner_override(planner));
+        planner->scale_value = q16_16_to_float(planner->feed_scale);
+        planner->scale_rate = 0.0f;
+        planner->path_speed = 0.0f;
+        planner->path_accel = 0.0f;
+        if (planner->settle_ticks > 0U) {
+            planner->settle_ticks--;
+        }
+        planner->held = planner->hold_requested && planner->settle_ticks == 0U;
         *pose_out = planner->current_pose;
         return false;
     }
     planner_block_t *block = &planner->blocks[planner->tail];
+    ramp_feed_scale(planner, block);
     if (!block->active) {
-        block->active = true;
-        block->tick_index = 0U;
-    }
-    uint32_t index = block->tick_index;
-    uint32_t total = block->total_ticks;
-    q16_16_t u = (q16_16_t)((index << 16) / (total == 0U ? 1U : total));
-    q16_16_t progress;
-    bool low_buffer = planner_count(planner) < 2U;
-    if (low_buffer) {
-        progress = u;
-    } else {
-        q16_16_t u2 = q16_16_mul(u, u);
-        q16_16_t u3 = q16_16_mul(u2, u);
-        progress = q16_16_mul(q16_16_from_int(3), u2) - q16_16_mul(q16_16_from_int(2), u3);
+        activate_block(block);
     }
-
+    if (block->arch) {
+        uint64_t elapsed = ((uint64_t)block->tick_index << 16) + block->tick_fraction;
+        float t = (float)elapsed / 65536.0f * (float)planner->control_period_us * 1e-6f;
+        arch_pose(block, t, pose_out);
+        advance_ticks(planner, block);
+        if (block->tick_index >= block->total_ticks) {
+            planner->path_speed = 0.0f;
+            planner->path_accel = 0.0f;
+            finish_block(planner, block);
+        }
+        return true;
+    }
+    float leftover = 0.0f;
+    bool finished = follow_profile(planner, block, 1.0f, &leftover);
+    advance_ticks(planner, block);
+    while (finished) {
+        finish_block(planner, block);
+        *pose_out = block->end;
+        if (planner_is_empty(planner) || planner->blocks[planner->tail].arch) {
+            return true;
+        }
+        /* the rest of the tick is spent on the next block, under its own profile */
+        block = &planner->blocks[planner->tail];
+        activate_block(block);
+        finished = follow_profile(planner, block, leftover, &leftover);
+    }
+    q16_16_t progress = block->length > 0.0f ? q16_16_from_float(block->travelled / block->length) : Q16_16_ONE;
     for (int axis = 0; axis < 3; ++axis) {
         q16_16_t diff = block->end.xyz[axis] - block->start.xyz[axis];
         pose_out->xyz[axis] = block->start.xyz[axis] + q16_16_mul(diff, progress);
     }
-
-    block->tick_index++;
-    if (block->tick_index >= block->total_ticks) {
-        planner->current_pose = block->end;
-        planner->tail = (uint16_t)((planner->tail + 1U) % PLANNER_QUEUE_LENGTH);
-    }
     return true;
 }
 
 void planner_hold(planner_queue_t *planner)
 {
+    /* decelerates inside planner_step, the queue is kept for planner_resume */
+    planner->hold_requested = true;
+}
+
+void planner_resume(planner_queue_t *planner)
+{
+    planner->hold_requested = false;
+    planner->held = false;
+}
+
+void planner_abort(planner_queue_t *planner, const delta_pose_t *pose)
+{
+    /* motion was stopped outside the planner: drop the queue and continue from there */
     planner->head = planner->tail;
+    planner->current_pose = *pose;
+    planner->path_speed = 0.0f;
+    planner->path_accel = 0.0f;
+}
+
+void planner_track_conveyor(planner_queue_t *planner, bool track)
+{
+    if (track && planner->frame != PLANNER_FRAME_CONVEYOR) {
+        planner->frame = PLANNER_FRAME_ENGAGE;
+    } else if (!track && planner->frame != PLANNER_FRAME_FIXED) {
+        planner->frame = PLANNER_FRAME_RELEASE;
+    }
 }
@@ -5,8 +5,41 @@
 #include <stdint.h>
 #include "kinematics/delta.h"
 #include "utils/fixed.h"
+#include "s_curve.h"
 
 #define PLANNER_QUEUE_LENGTH 128
+/* scale rate and rate change used when a block has no feed to derive them from */
+#define PLANNER_FEED_SCALE_RATE 4
+#define PLANNER_FEED_SCALE_CHANGE 20
+#define PLANNER_FEED_OVERRIDE_MIN 10U
+#define PLANNER_FEED_OVERRIDE_MAX 200U
+#define PLANNER_RAPID_OVERRIDE_MIN 10U
+#define PLANNER_RAPID_OVERRIDE_MAX 100U
+/* search steps for the jerk that still lands a block on its exit speed */
+#define PLANNER_JERK_ITERATIONS 16
+/* allowance on the limit jerk for easing out exactly, covers landing between ticks */
+#define PLANNER_EASE_SLACK 1.05f
+/* distance short of the block end that counts as arrived, m; far below one Q16.16 step */
+#define PLANNER_LANDING_M 1.0e-6f
+
+/* pick-and-place arch: vertical and horizontal S-curves overlapped so the
+ * corners blend over the corner radius instead of stopping */
+typedef struct {
+    s_curve_t rise;
+    s_curve_t traverse;
+    s_curve_t fall;
+    float direction[2];
+    float traverse_start; /* s */
+    float fall_start;     /* s */
+} planner_arch_t;
+
+/* per-joint limits the path is parameterized against, a zero velocity disables them */
+typedef struct {
+    float velocity;     /* rad/s */
+    float acceleration; /* rad/s^2 */
+    float torque;       /* N m, bounds acceleration through the reflected inertia */
+    float inertia;      /* kg m^2 */
+} planner_joint_limits_t;
 
 typedef struct {
     delta_pose_t start;
@@ -18,21 +51,99 @@ typedef struct {
     q16_16_t jerk;
     uint32_t total_ticks;
     uint32_t tick_index;
+    uint16_t tick_fraction; /* Q0.16 part of a tick left over by time scaling */
+    float length;           /* m */
+    float max_speed;        /* m/s, feed capped by the joint limits along the block */
+    float speed_limit;      /* m/s, ceiling for feed overrides above 100 %: the joint bound, at most the fastest override */
+    float max_accel;        /* m/s^2 */
+    float max_jerk;         /* m/s^3 */
+    float travelled;        /* m */
     bool active;
+    bool probe;
+    bool rapid;
+    bool arch;
+    planner_arch_t shape;
 } planner_block_t;
 
+typedef enum {
+    PLANNER_PROBE_NONE = 0,
+    PLANNER_PROBE_PENDING,
+    PLANNER_PROBE_TRIGGERED,
+    PLANNER_PROBE_MISSED
+} planner_probe_state_t;
+
+typedef struct {
+    planner_probe_state_t state;
+    bool error_on_miss;
+    delta_pose_t contact;
+} planner_probe_t;
+
+/* why the last push was rejected */
+typedef enum {
+    PLANNER_ERROR_NONE = 0,
+    PLANNER_ERROR_QUEUE_FULL,
+    PLANNER_ERROR_UNREACHABLE, /* a pose along the move has no inverse kinematics solution */
+    PLANNER_ERROR_SINGULAR     /* the move passes too close to a singularity */
+} planner_error_t;
+
+/* coordinate frame the queued poses are in, switched by the motion controller */
+typedef enum {
+    PLANNER_FRAME_FIXED = 0,
+    PLANNER_FRAME_ENGAGE,   /* requested, the belt frame starts at the current pose */
+    PLANNER_FRAME_CONVEYOR,
+    PLANNER_FRAME_RELEASE   /* requested, pending until the belt offset is folded back */
+} planner_frame_t;
+
 typedef struct {
     planner_block_t blocks[PLANNER_QUEUE_LENGTH];
     uint16_t head;
     uint16_t tail;
     delta_pose_t current_pose;
     uint32_t control_period_us;
+    planner_probe_t probe;
+    planner_frame_t frame;
+    delta_pose_t frame_offset;  /* belt offset of the tracking frame, updated by the motion controller */
+    bool frame_lost;            /* tracking was released before the belt carried the tool out of reach */
+    planner_joint_limits_t joint_limits;
+    bool check_reach;           /* validate every pose along a move before queueing it */
+    planner_error_t error;
+    float path_speed;           /* m/s along the path, before time scaling */
+    float path_accel;           /* m/s^2 along the path, zero at every block boundary */
+    q16_16_t feed_scale;        /* ONE = programmed feed; below a time warp, above a higher speed target */
+    q16_16_t feed_scale_target; /* following-error limit, multiplied by the override */
+    uint16_t feed_override;     /* percent */
+    uint16_t rapid_override;    /* percent */
+    float scale_value;
+    float scale_rate;           /* per second */
+    bool hold_requested;
+    bool held;                  /* stopped mid-block, queue intact */
+    uint16_t output_delay_ticks; /* setpoint filtering after the planner, e.g. input shaping */
+    uint16_t settle_ticks;
+    bool bypassed;              /* a replay drives the joints, queued lines wait */
+    bool pose_pending;          /* M17: current_pose is seeded from the drives once they are enabled, lines wait */
 } planner_queue_t;
 
 void planner_init(planner_queue_t *planner, uint32_t control_period_us);
 bool planner_is_empty(const planner_queue_t *planner);
+bool planner_is_settled(const planner_queue_t *planner);
+bool planner_is_full(const planner_queue_t *planner);
+void planner_set_output_delay(planner_queue_t *planner, uint16_t ticks);
+void planner_set_joint_limits(planner_queue_t *planner, const planner_joint_limits_t *limits);
+void planner_set_reach_check(planner_queue_t *planner, bool enabled);
+bool planner_set_period(planner_queue_t *planner, uint32_t control_period_us);
 bool planner_push_line(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk);
+bool planner_push_rapid(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk);
+bool planner_push_arch(planner_queue_t *planner, const delta_pose_t *target, q16_16_t lift, q16_16_t radius, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk);
+bool planner_push_probe(planner_queue_t *planner, const delta_pose_t *target, q16_16_t feedrate, q16_16_t accel, q16_16_t jerk, bool error_on_miss);
+const planner_block_t *planner_active_block(const planner_queue_t *planner);
+void planner_set_feed_scale(planner_queue_t *planner, q16_16_t scale);
+void planner_set_feed_override(planner_queue_t *planner, uint16_t percent);
+void planner_set_rapid_override(planner_queue_t *planner, uint16_t percent);
+q16_16_t planner_override(const planner_queue_t *planner);
 bool planner_step(planner_queue_t *planner, delta_pose_t *pose_out);
 void planner_hold(planner_queue_t *planner);
+void planner_resume(planner_queue_t *planner);
+void planner_abort(planner_queue_t *planner, const delta_pose_t *pose);
+void planner_track_conveyor(planner_queue_t *planner, bool track);
 
 #endif
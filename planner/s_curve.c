@@ -0,0 +1,133 @@
+#include "s_curve.h"
+#include <math.h>
+#include <stddef.h>
+
+static float accel_time(float velocity, float a_max, float j_max)
+{
+    /* duration of the whole acceleration phase up to velocity */
+    if (velocity * j_max >= a_max * a_max) {
+        return velocity / a_max + a_max / j_max;
+    }
+    return 2.0f * sqrtf(velocity / j_max);
+}
+
+bool s_curve_plan(s_curve_t *curve, float distance, float v_max, float a_max, float j_max)
+{
+    curve->distance = distance;
+    curve->jerk = j_max;
+    curve->t_jerk = curve->t_accel = curve->t_cruise = 0.0f;
+    curve->accel = curve->velocity = 0.0f;
+    if (distance <= 0.0f) {
+        return distance == 0.0f;
+    }
+    if (v_max <= 0.0f || a_max <= 0.0f || j_max <= 0.0f) {
+        return false;
+    }
+
+    float velocity = v_max;
+    if (velocity * accel_time(velocity, a_max, j_max) > distance) {
+        /* too short to cruise: the peak velocity is where accel and decel meet */
+        float a_over_j = a_max / j_max;
+        velocity = 0.5f * a_max * (sqrtf(a_over_j * a_over_j + 4.0f * distance / a_max) - a_over_j);
+        if (velocity * j_max < a_max * a_max) {
+            velocity = powf(0.5f * distance * sqrtf(j_max), 2.0f / 3.0f);
+        }
+    }
+    float accel = velocity * j_max >= a_max * a_max ? a_max : sqrtf(velocity * j_max);
+    curve->accel = accel;
+    curve->velocity = velocity;
+    curve->t_jerk = accel / j_max;
+    curve->t_accel = velocity / accel - curve->t_jerk;
+    if (curve->t_accel < 0.0f) {
+        curve->t_accel = 0.0f;
+    }
+    float ramp_distance = velocity * (2.0f * curve->t_jerk + curve->t_accel);
+    curve->t_cruise = distance > ramp_distance ? (distance - ramp_distance) / velocity : 0.0f;
+    return true;
+}
+
+float s_curve_duration(const s_curve_t *curve)
+{
+    return 4.0f * curve->t_jerk + 2.0f * curve->t_accel + curve->t_cruise;
+}
+
+float s_curve_position(const s_curve_t *curve, float t)
+{
+    if (t <= 0.0f || curve->velocity <= 0.0f) {
+        return 0.0f;
+    }
+    if (t >= s_curve_duration(curve)) {
+        return curve->distance;
+    }
+    const float duration[7] = {curve->t_jerk, curve->t_accel, curve->t_jerk, curve->t_cruise, curve->t_jerk, curve->t_accel, curve->t_jerk};
+    const float jerk[7] = {curve->jerk, 0.0f, -curve->jerk, 0.0f, -curve->jerk, 0.0f, curve->jerk};
+    float p = 0.0f;
+    float v = 0.0f;
+    float a = 0.0f;
+    for (int phase = 0; phase < 7; ++phase) {
+        float dt = t < duration[phase] ? t : duration[phase];
+        float j = jerk[phase];
+        p += v * dt + a * dt * dt / 2.0f + j * dt * dt * dt / 6.0f;
+        v += a * dt + j * dt * dt / 2.0f;
+        a += j * dt;
+        t -= dt;
+        if (t <= 0.0f) {
+            break;
+        }
+    }
+    return p > curve->distance ? curve->distance : p;
+}
+
+float s_curve_time_at(const s_curve_t *curve, float position)
+{
+    float low = 0.0f;
+    float high = s_curve_duration(curve);
+    if (position <= 0.0f) {
+        return 0.0f;
+    }
+    if (position >= curve->distance) {
+        return high;
+    }
+    /* position is monotonic in time */
+    for (int i = 0; i < 32; ++i) {
+        float mid = 0.5f * (low + high);
+        if (s_curve_position(curve, mid) < position) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return 0.5f * (low + high);
+}
+
+float s_curve_ramp_time(float from, float to, float a_max, float j_max)
+{
+    return accel_time(fabsf(to - from), a_max, j_max);
+}
+
+float s_curve_ramp_distance(float from, float to, float a_max, float j_max)
+{
+    return 0.5f * (from + to) * s_curve_ramp_time(from, to, a_max, j_max);
+}
+
+float s_curve_ramp_speed(float from, float distance, float a_max, float j_max)
+{
+    if (distance <= 0.0f) {
+        return from;
+    }
+    /* with a constant-acceleration phase the distance is quadratic in the speed */
+    float dv_full = a_max * a_max / j_max; /* smallest change that reaches a_max */
+    float speed = 0.5f * (sqrtf(dv_full * dv_full + 4.0f * (from * from - from * dv_full + 2.0f * a_max * distance)) - dv_full);
+    if (speed - from >= dv_full) {
+        return speed;
+    }
+    /* without one, x = sqrt(dv / j) solves j x^3 + 2 from x = distance */
+    float x;
+    if (from <= 0.0f) {
+        x = cbrtf(distance / j_max);
+    } else {
+        float r = sqrtf(2.0f * from / (3.0f * j_max));
+        x = 2.0f * r * sinhf(asinhf(distance / (j_max * 2.0f * r * r * r)) / 3.0f);
+    }
+    return from + j_max * x * x;
+}
@@ -0,0 +1,31 @@
+#ifndef PLANNER_S_CURVE_H
+#define PLANNER_S_CURVE_H
+
+#include <stdbool.h>
+
+/* time-optimal rest-to-rest move under velocity, acceleration and jerk limits:
+ * jerk phases of t_jerk around a constant-acceleration phase of t_accel, then
+ * a cruise of t_cruise and the mirrored deceleration */
+typedef struct {
+    float distance;
+    float jerk;
+    float t_jerk;
+    float t_accel;
+    float t_cruise;
+    float accel;    /* peak */
+    float velocity; /* peak */
+} s_curve_t;
+
+bool s_curve_plan(s_curve_t *curve, float distance, float v_max, float a_max, float j_max);
+float s_curve_duration(const s_curve_t *curve);
+float s_curve_position(const s_curve_t *curve, float t);
+float s_curve_time_at(const s_curve_t *curve, float position);
+
+/* speed change between two speeds with the acceleration zero at both ends */
+float s_curve_ramp_time(float from, float to, float a_max, float j_max);
+float s_curve_ramp_distance(float from, float to, float a_max, float j_max);
+/* highest speed such a change from `from` reaches within distance; by symmetry
+ * also the highest speed that still brakes to `from` within it */
+float s_curve_ramp_speed(float from, float distance, float a_max, float j_max);
+
+#endif
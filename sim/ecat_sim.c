@@ -0,0 +1,494 @@
+#include "ecat_sim.h"
+#include "drivers/eth_mac.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SIM_ETHERTYPE 0x88A4U
+#define SIM_ETH_HEADER 14U
+#define SIM_FRAME_HEADER 2U
+#define SIM_DATAGRAM_HEADER 10U
+#define SIM_WKC_SIZE 2U
+#define SIM_CMD_FPRD 4U
+#define SIM_CMD_FPWR 5U
+#define SIM_CMD_LRW 12U
+#define SIM_MAILBOX_OUT 0x1000U
+#define SIM_MAILBOX_IN 0x1080U
+#define SIM_MAILBOX_TYPE_COE 0x03U
+#define SIM_COE_SDO_REQUEST 2U
+#define SIM_COE_SDO_RESPONSE 3U
+#define SIM_ABORT_COMMAND 0x05040001U
+#define SIM_ABORT_LENGTH 0x06070010U
+#define SIM_ABORT_NO_OBJECT 0x06020000U
+
+#define SW_NOT_READY 0x0000U
+#define SW_SWITCH_ON_DISABLED 0x0040U
+#define SW_READY_TO_SWITCH_ON 0x0021U
+#define SW_SWITCHED_ON 0x0023U
+#define SW_OPERATION_ENABLED 0x0027U
+#define SW_QUICK_STOP_ACTIVE 0x0007U
+#define SW_FAULT_REACTION 0x000FU
+#define SW_FAULT 0x0008U
+#define SW_VOLTAGE_ENABLED 0x0010U
+#define SW_REMOTE 0x0200U
+
+#define TP_ENABLE 0x0001U
+#define TP_CONTINUOUS 0x0002U
+#define TP_POSITIVE_EDGE 0x0010U
+#define TP_STATUS_ENABLED 0x0001U
+#define TP_STATUS_POSITIVE_STORED 0x0002U
+
+static uint16_t get_u16(const uint8_t *src)
+{
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *src)
+{
+    return (uint32_t)get_u16(src) | ((uint32_t)get_u16(src + 2) << 16);
+}
+
+static void put_u16(uint8_t *dst, uint16_t value)
+{
+    dst[0] = (uint8_t)(value & 0xFFU);
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *dst, uint32_t value)
+{
+    put_u16(dst, (uint16_t)(value & 0xFFFFU));
+    put_u16(dst + 2, (uint16_t)(value >> 16));
+}
+
+static q16_16_t clamp_abs(q16_16_t value, q16_16_t limit)
+{
+    return q16_16_clamp(value, -limit, limit);
+}
+
+static void ring_handler(uint8_t *frame, uint16_t length, void *user)
+{
+    ecat_sim_process_frame((ecat_sim_t *)user, frame, length);
+}
+
+void ecat_sim_init(ecat_sim_t *sim, const ecat_sim_dynamics_t *defaults)
+{
+    memset(sim, 0, sizeof(*sim));
+    for (int i = 0; i < ECAT_MAX_SLAVES; ++i) {
+        sim->slaves[i].dynamics = *defaults;
+        sim->slaves[i].state = CIA402_STATE_NOT_READY;
+        sim->slaves[i].mode = CIA402_MODE_CSP;
+    }
+}
+
+bool ecat_sim_attach(ecat_sim_t *sim, const ethcat_master_t *master)
+{
+    if (master->slave_count <= 0) {
+        return false;
+    }
+    /* the FMMU layout is whatever the master configured during the scan */
+    sim->slave_count = master->slave_count;
+    for (int i = 0; i < master->slave_count; ++i) {
+        const ethcat_slave_t *src = &master->slaves[i];
+        ecat_sim_slave_t *slave = &sim->slaves[i];
+        slave->role = src->role;
+        slave->station_address = src->station_address;
+        slave->output_offset = src->output_offset;
+        slave->output_bytes = src->output_bytes;
+        slave->input_offset = src->input_offset;
+        slave->input_bytes = src->input_bytes;
+    }
+    eth_mac_set_ring_handler(ring_handler, sim);
+    return true;
+}
+
+void ecat_sim_detach(ecat_sim_t *sim)
+{
+    (void)sim;
+    eth_mac_set_ring_handler(NULL, NULL);
+}
+
+void ecat_sim_set_dynamics(ecat_sim_t *sim, int slave, const ecat_sim_dynamics_t *dynamics)
+{
+    if (slave >= 0 && slave < ECAT_MAX_SLAVES) {
+        sim->slaves[slave].dynamics = *dynamics;
+    }
+}
+
+void ecat_sim_inject_emcy(ecat_sim_t *sim, int slave, uint16_t code)
+{
+    if (slave >= 0 && slave < sim->slave_count) {
+        sim->slaves[slave].pending_emcy = code;
+    }
+}
+
+static void latch_probe(ecat_sim_slave_t *slave, q16_16_t fraction)
+{
+    bool armed = (slave->probe_function & (TP_ENABLE | TP_POSITIVE_EDGE)) == (TP_ENABLE | TP_POSITIVE_EDGE);
+    bool stored = (slave->probe_status & TP_STATUS_POSITIVE_STORED) != 0U;
+    if (!armed || (stored && (slave->probe_function & TP_CONTINUOUS) == 0U)) {
+        return;
+    }
+    /* the edge fell inside the last cycle: the encoder is latched between samples */
+    slave->probe_position = slave->previous_position + q16_16_mul(slave->position - slave->previous_position, fraction);
+    slave->probe_status |= TP_STATUS_POSITIVE_STORED;
+}
+
+void ecat_sim_trigger_probe(ecat_sim_t *sim, int slave, q16_16_t fraction)
+{
+    fraction = q16_16_clamp(fraction, 0, Q16_16_ONE);
+    for (int i = 0; i < sim->slave_count; ++i) {
+        if ((slave < 0 || slave == i) && (sim->slaves[i].role == ECAT_ROLE_JOINT || sim->slaves[i].role == ECAT_ROLE_AUX_AXIS)) {
+            latch_probe(&sim->slaves[i], fraction);
+        }
+    }
+}
+
+void ecat_sim_set_inputs(ecat_sim_t *sim, int slave, const uint8_t *data, uint16_t length)
+{
+    if (slave < 0 || slave >= sim->slave_count || length > ECAT_IO_MAX_BYTES) {
+        return;
+    }
+    memcpy(sim->slaves[slave].io_inputs, data, length);
+}
+
+static ecat_sim_object_t *find_object(ecat_sim_slave_t *slave, uint16_t index, uint8_t subindex)
+{
+    for (int i = 0; i < slave->object_count; ++i) {
+        if (slave->objects[i].index == index && slave->objects[i].subindex == subindex) {
+            return &slave->objects[i];
+        }
+    }
+    return NULL;
+}
+
+bool ecat_sim_get_object(const ecat_sim_t *sim, int slave, uint16_t index, uint8_t subindex, uint32_t *value)
+{
+    if (slave < 0 || slave >= sim->slave_count) {
+        return false;
+    }
+    const ecat_sim_slave_t *entry = &sim->slaves[slave];
+    for (int i = 0; i < entry->object_count; ++i) {
+        if (entry->objects[i].index == index && entry->objects[i].subindex == subindex) {
+            *value = entry->objects[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t encode_statusword(const ecat_sim_slave_t *slave)
+{
+    uint16_t sw;
+    switch (slave->state) {
+    case CIA402_STATE_SWITCH_ON_DISABLED:
+        sw = SW_SWITCH_ON_DISABLED;
+        break;
+    case CIA402_STATE_READY_TO_SWITCH_ON:
+        sw = SW_READY_TO_SWITCH_ON | SW_VOLTAGE_ENABLED;
+        break;
+    case CIA402_STATE_SWITCHED_ON:
+        sw = SW_SWITCHED_ON | SW_VOLTAGE_ENABLED;
+        break;
+    case CIA402_STATE_OPERATION_ENABLED:
+        sw = SW_OPERATION_ENABLED | SW_VOLTAGE_ENABLED;
+        break;
+    case CIA402_STATE_QUICK_STOP_ACTIVE:
+        sw = SW_QUICK_STOP_ACTIVE | SW_VOLTAGE_ENABLED;
+        break;
+    case CIA402_STATE_FAULT_REACTION:
+        sw = SW_FAULT_REACTION;
+        break;
+    case CIA402_STATE_FAULT:
+        sw = SW_FAULT;
+        break;
+    case CIA402_STATE_NOT_READY:
+    default:
+        sw = SW_NOT_READY;
+        break;
+    }
+    return (uint16_t)(sw | SW_REMOTE);
+}
+
+static void drive_state_machine(ecat_sim_slave_t *slave, uint16_t controlword)
+{
+    bool fault_reset_edge = (controlword & 0x0080U) != 0U && (slave->controlword & 0x0080U) == 0U;
+    bool shutdown = (controlword & 0x0087U) == 0x0006U;
+    bool switch_on = (controlword & 0x008FU) == 0x0007U;
+    bool enable = (controlword & 0x008FU) == 0x000FU;
+    bool disable_voltage = (controlword & 0x0082U) == 0x0000U;
+    bool quick_stop = (controlword & 0x0086U) == 0x0002U;
+    slave->controlword = controlword;
+
+    if (slave->pending_emcy != 0U && slave->state != CIA402_STATE_FAULT) {
+        slave->emcy_code = slave->pending_emcy;
+        slave->pending_emcy = 0U;
+        slave->state = CIA402_STATE_FAULT_REACTION;
+        return;
+    }
+
+    switch (slave->state) {
+    case CIA402_STATE_NOT_READY:
+        if (slave->age_cycles >= slave->dynamics.boot_cycles) {
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        }
+        break;
+    case CIA402_STATE_SWITCH_ON_DISABLED:
+        if (shutdown) {
+            slave->state = CIA402_STATE_READY_TO_SWITCH_ON;
+        }
+        break;
+    case CIA402_STATE_READY_TO_SWITCH_ON:
+        if (disable_voltage || quick_stop) {
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        } else if (switch_on || enable) {
+            slave->state = CIA402_STATE_SWITCHED_ON;
+        }
+        break;
+    case CIA402_STATE_SWITCHED_ON:
+        if (disable_voltage || quick_stop) {
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        } else if (shutdown) {
+            slave->state = CIA402_STATE_READY_TO_SWITCH_ON;
+        } else if (enable) {
+            slave->state = CIA402_STATE_OPERATION_ENABLED;
+        }
+        break;
+    case CIA402_STATE_OPERATION_ENABLED:
+        if (disable_voltage) {
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        } else if (quick_stop) {
+            slave->state = CIA402_STATE_QUICK_STOP_ACTIVE;
+        } else if (shutdown) {
+            slave->state = CIA402_STATE_READY_TO_SWITCH_ON;
+        } else if (switch_on) {
+            slave->state = CIA402_STATE_SWITCHED_ON;
+        }
+        break;
+    case CIA402_STATE_QUICK_STOP_ACTIVE:
+        if (disable_voltage || slave->velocity == 0) {
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        }
+        break;
+    case CIA402_STATE_FAULT_REACTION:
+        if (slave->velocity == 0) {
+            slave->state = CIA402_STATE_FAULT;
+        }
+        break;
+    case CIA402_STATE_FAULT:
+        if (fault_reset_edge) {
+            slave->emcy_code = 0U;
+            slave->state = CIA402_STATE_SWITCH_ON_DISABLED;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void drive_dynamics(ecat_sim_slave_t *slave)
+{
+    const ecat_sim_dynamics_t *dyn = &slave->dynamics;
+    q16_16_t accel;
+    if (slave->state == CIA402_STATE_OPERATION_ENABLED) {
+        q16_16_t desired = (slave->target - slave->position) / (dyn->lag_cycles == 0U ? 1 : (int32_t)dyn->lag_cycles);
+        accel = clamp_abs(desired - slave->velocity, dyn->max_accel);
+    } else if (slave->state == CIA402_STATE_QUICK_STOP_ACTIVE || slave->state == CIA402_STATE_FAULT_REACTION) {
+        accel = clamp_abs(-slave->velocity, dyn->max_accel);
+    } else {
+        accel = -slave->velocity; /* holding brake */
+    }
+    slave->accel = accel;
+    slave->velocity += accel;
+    slave->previous_position = slave->position;
+    slave->position += slave->velocity;
+}
+
+static uint32_t cycles_per_second(ecat_sim_slave_t *slave)
+{
+    ecat_sim_object_t *value = find_object(slave, 0x60C2U, 0x01U);
+    ecat_sim_object_t *index = find_object(slave, 0x60C2U, 0x02U);
+    if (value == NULL || index == NULL || value->value == 0U) {
+        return 1000U;
+    }
+    uint32_t period_ns = value->value;
+    for (int exponent = (int8_t)index->value; exponent < -9; ++exponent) {
+        period_ns /= 10U;
+    }
+    for (int exponent = (int8_t)index->value; exponent > -9; --exponent) {
+        period_ns *= 10U;
+    }
+    return period_ns == 0U ? 1000U : 1000000000U / period_ns;
+}
+
+static void process_drive(ecat_sim_slave_t *slave, uint8_t *image)
+{
+    const uint8_t *out = image + slave->output_offset;
+    slave->age_cycles++;
+    drive_state_machine(slave, get_u16(out));
+    slave->mode = out[14];
+    if (slave->state == CIA402_STATE_OPERATION_ENABLED) {
+        slave->target = (q16_16_t)get_u32(out + 2);
+    }
+    drive_dynamics(slave);
+
+    uint16_t probe_function = get_u16(out + 15);
+    if ((probe_function & TP_ENABLE) == 0U) {
+        slave->probe_status = 0U;
+    } else if ((slave->probe_function & TP_ENABLE) == 0U) {
+        slave->probe_status = TP_STATUS_ENABLED; /* re-armed: previous latch discarded */
+    }
+    slave->probe_function = probe_function;
+
+    uint8_t *in = image + slave->input_offset;
+    put_u16(in, encode_statusword(slave));
+    put_u32(in + 2, (uint32_t)slave->position);
+    put_u32(in + 6, (uint32_t)(slave->velocity * (int32_t)cycles_per_second(slave)));
+    put_u32(in + 10, (uint32_t)q16_16_mul(slave->accel, slave->dynamics.inertia));
+    in[14] = slave->mode;
+    put_u16(in + 15, slave->emcy_code);
+    put_u16(in + 17, slave->probe_status);
+    put_u32(in + 19, (uint32_t)slave->probe_position);
+}
+
+static uint16_t process_lrw(ecat_sim_t *sim, uint8_t *image, uint32_t address, uint16_t length)
+{
+    uint16_t wkc = 0U;
+    if (address != 0U) {
+        return 0U;
+    }
+    for (int i = 0; i < sim->slave_count; ++i) {
+        ecat_sim_slave_t *slave = &sim->slaves[i];
+        if ((uint32_t)slave->output_offset + slave->output_bytes > length || (uint32_t)slave->input_offset + slave->input_bytes > length) {
+            continue;
+        }
+        if (slave->role == ECAT_ROLE_JOINT || slave->role == ECAT_ROLE_AUX_AXIS) {
+            process_drive(slave, image);
+        } else if (slave->role == ECAT_ROLE_IO) {
+            memcpy(slave->io_outputs, image + slave->output_offset, slave->output_bytes);
+            memcpy(image + slave->input_offset, slave->io_inputs, slave->input_bytes);
+        }
+        wkc = (uint16_t)(wkc + (slave->output_bytes != 0U ? 2U : 0U) + (slave->input_bytes != 0U ? 1U : 0U));
+    }
+    sim->cycles++;
+    return wkc;
+}
+
+static uint8_t object_size(uint16_t index)
+{
+    /* 0x60C2 interpolation period: UNSIGNED8 value and INTEGER8 index; the rest is 32 bit */
+    return index == 0x60C2U ? 1U : 4U;
+}
+
+static uint32_t store_object(ecat_sim_slave_t *slave, uint16_t index, uint8_t subindex, uint32_t value)
+{
+    ecat_sim_object_t *object = find_object(slave, index, subindex);
+    if (object == NULL) {
+        if (slave->object_count >= ECAT_SIM_MAX_OBJECTS) {
+            return SIM_ABORT_NO_OBJECT;
+        }
+        object = &slave->objects[slave->object_count++];
+        object->index = index;
+        object->subindex = subindex;
+    }
+    object->value = value;
+    return 0U;
+}
+
+static uint32_t sdo_download(ecat_sim_slave_t *slave, const uint8_t *data)
+{
+    uint8_t type = (uint8_t)(data[5] & 0x0FU);
+    uint8_t service = (uint8_t)(get_u16(data + 6) >> 12);
+    uint8_t command = data[8];
+    uint16_t index = get_u16(data + 9);
+    if (type != SIM_MAILBOX_TYPE_COE || service != SIM_COE_SDO_REQUEST || (command & 0xE3U) != 0x23U) {
+        /* only expedited downloads are modelled */
+        return SIM_ABORT_COMMAND;
+    }
+    /* a real drive refuses a download whose size does not match the object */
+    uint8_t size = (uint8_t)(4U - ((command >> 2) & 0x03U));
+    if (size != object_size(index)) {
+        return SIM_ABORT_LENGTH;
+    }
+    uint32_t value = get_u32(data + 12);
+    if (size < 4U) {
+        value &= (1U << (8U * size)) - 1U;
+    }
+    return store_object(slave, index, data[11], value);
+}
+
+static uint16_t process_mailbox(ecat_sim_t *sim, uint8_t command, uint16_t station, uint16_t offset, uint8_t *data, uint16_t length)
+{
+    if (length < 16U) {
+        return 0U;
+    }
+    for (int i = 0; i < sim->slave_count; ++i) {
+        ecat_sim_slave_t *slave = &sim->slaves[i];
+        if (slave->station_address != station) {
+            continue;
+        }
+        if (command == SIM_CMD_FPRD && offset == SIM_MAILBOX_IN) {
+            /* an empty mailbox-in is not read: the working counter stays put */
+            if (!slave->mailbox_full) {
+                return 0U;
+            }
+            memcpy(data, slave->mailbox_in, sizeof(slave->mailbox_in));
+            slave->mailbox_full = false;
+            return 1U;
+        }
+        if (command != SIM_CMD_FPWR || offset != SIM_MAILBOX_OUT || slave->mailbox_full) {
+            return 0U;
+        }
+        slave->mailbox_requests++;
+        uint32_t abort_code = sdo_download(slave, data);
+        uint8_t *response = slave->mailbox_in;
+        memset(response, 0, sizeof(slave->mailbox_in));
+        put_u16(response, 10U);
+        response[5] = data[5];
+        response[9] = data[9];
+        response[10] = data[10];
+        response[11] = data[11];
+        if (abort_code != 0U) {
+            slave->mailbox_aborts++;
+            put_u16(response + 6, (uint16_t)(SIM_COE_SDO_REQUEST << 12));
+            response[8] = 0x80U;
+            put_u32(response + 12, abort_code);
+        } else {
+            put_u16(response + 6, (uint16_t)(SIM_COE_SDO_RESPONSE << 12));
+            response[8] = 0x60U;
+        }
+        slave->mailbox_full = true;
+        return 1U;
+    }
+    return 0U;
+}
+
+void ecat_sim_process_frame(ecat_sim_t *sim, uint8_t *frame, uint16_t length)
+{
+    if (length < SIM_ETH_HEADER + SIM_FRAME_HEADER + SIM_DATAGRAM_HEADER + SIM_WKC_SIZE) {
+        return;
+    }
+    if (frame[12] != (uint8_t)(SIM_ETHERTYPE >> 8) || frame[13] != (uint8_t)(SIM_ETHERTYPE & 0xFFU)) {
+        return;
+    }
+    sim->frames++;
+    uint16_t offset = SIM_ETH_HEADER + SIM_FRAME_HEADER;
+    while ((uint32_t)offset + SIM_DATAGRAM_HEADER + SIM_WKC_SIZE <= length) {
+        uint8_t *datagram = frame + offset;
+        uint16_t len_field = get_u16(datagram + 6);
+        uint16_t data_length = (uint16_t)(len_field & 0x07FFU);
+        uint8_t *data = datagram + SIM_DATAGRAM_HEADER;
+        if ((uint32_t)offset + SIM_DATAGRAM_HEADER + data_length + SIM_WKC_SIZE > length) {
+            return;
+        }
+        uint16_t wkc = get_u16(data + data_length);
+        if (datagram[0] == SIM_CMD_LRW) {
+            wkc = (uint16_t)(wkc + process_lrw(sim, data, get_u32(datagram + 2), data_length));
+        } else if (datagram[0] == SIM_CMD_FPWR || datagram[0] == SIM_CMD_FPRD) {
+            wkc = (uint16_t)(wkc + process_mailbox(sim, datagram[0], get_u16(datagram + 2), get_u16(datagram + 4), data, data_length));
+        }
+        put_u16(data + data_length, wkc);
+        if ((len_field & 0x8000U) == 0U) {
+            break;
+        }
+        offset = (uint16_t)(offset + SIM_DATAGRAM_HEADER + data_length + SIM_WKC_SIZE);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SIM_ECAT_SIM_H
+#define SIM_ECAT_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ethcat/master.h"
+#include "cia402/cia402.h"
+
+#define ECAT_SIM_MAX_OBJECTS 24
+
+typedef struct {
+    uint16_t lag_cycles;   /* first-order lag of the drive position loop */
+    q16_16_t max_accel;    /* per cycle^2: the load inertia bounds velocity changes */
+    q16_16_t inertia;      /* reported torque per unit of acceleration */
+    uint16_t boot_cycles;  /* cycles spent in Not Ready to Switch On */
+} ecat_sim_dynamics_t;
+
+typedef struct {
+    uint16_t index;
+    uint8_t subindex;
+    uint32_t value;
+} ecat_sim_object_t;
+
+typedef struct {
+    ecat_slave_role_t role;
+    uint16_t station_address;
+    uint16_t output_offset;
+    uint16_t output_bytes;
+    uint16_t input_offset;
+    uint16_t input_bytes;
+    ecat_sim_dynamics_t dynamics;
+    cia402_state_t state;
+    uint16_t controlword;
+    uint8_t mode;
+    q16_16_t target;
+    q16_16_t position;
+    q16_16_t velocity;
+    q16_16_t accel;
+    uint16_t emcy_code;
+    uint16_t pending_emcy;
+    q16_16_t previous_position;
+    uint16_t probe_function;
+    uint16_t probe_status;
+    q16_16_t probe_position;
+    uint32_t age_cycles;
+    ecat_sim_object_t objects[ECAT_SIM_MAX_OBJECTS];
+    int object_count;
+    uint32_t mailbox_requests;
+    uint32_t mailbox_aborts;
+    uint8_t mailbox_in[16];  /* SDO response waiting for the master's read */
+    bool mailbox_full;
+    uint8_t io_outputs[ECAT_IO_MAX_BYTES];
+    uint8_t io_inputs[ECAT_IO_MAX_BYTES];
+} ecat_sim_slave_t;
+
+typedef struct {
+    ecat_sim_slave_t slaves[ECAT_MAX_SLAVES];
+    int slave_count;
+    uint32_t cycles;
+    uint32_t frames;
+} ecat_sim_t;
+
+void ecat_sim_init(ecat_sim_t *sim, const ecat_sim_dynamics_t *defaults);
+bool ecat_sim_attach(ecat_sim_t *sim, const ethcat_master_t *master);
+void ecat_sim_detach(ecat_sim_t *sim);
+void ecat_sim_set_dynamics(ecat_sim_t *sim, int slave, const ecat_sim_dynamics_t *dynamics);
+void ecat_sim_inject_emcy(ecat_sim_t *sim, int slave, uint16_t code);
+void ecat_sim_trigger_probe(ecat_sim_t *sim, int slave, q16_16_t fraction);
+void ecat_sim_set_inputs(ecat_sim_t *sim, int slave, const uint8_t *data, uint16_t length);
+bool ecat_sim_get_object(const ecat_sim_t *sim, int slave, uint16_t index, uint8_t subindex, uint32_t *value);
+void ecat_sim_process_frame(ecat_sim_t *sim, uint8_t *frame, uint16_t length);
+
+#endif
@@ -0,0 +1,51 @@
+#define _POSIX_C_SOURCE 200112L
+#include "ecat_sim.h"
+#include "board/board.h"
+#include "drivers/eth_mac.h"
+#include <sched.h>
+#include <stdio.h>
+
+/* Stands in for the slave segment on the far end of a veth pair:
+ *   ip link add ecat0 type veth peer name ecat1
+ * the master binds ecat0, this process answers every frame on ecat1 */
+
+static uint8_t s_frame[1518];
+
+int main(int argc, char **argv)
+{
+    const char *interface_name = argc > 1 ? argv[1] : "ecat1";
+
+    board_load_configuration();
+    static ethcat_master_t layout;
+    ethcat_master_init(&layout, &g_board_config);
+    if (!ethcat_master_scan(&layout)) {
+        fprintf(stderr, "ecat_sim_node: no bus layout\n");
+        return 1;
+    }
+
+    eth_mac_config_t mac = {
+        .mac_address = {0x02, 0x00, 0x00, 0x00, 0xEC, 0x01},
+        .phy_address = 0U,
+        .cycle_time_ns = g_board_config.control_period_us * 1000U,
+        .interface_name = interface_name,
+    };
+    eth_mac_init(&mac, NULL, NULL);
+
+    static ecat_sim_t sim;
+    ecat_sim_dynamics_t dynamics = {4U, q16_16_from_float(0.002f), Q16_16_ONE, 100U};
+    ecat_sim_init(&sim, &dynamics);
+    /* the receive path runs the slaves on each frame, it only has to go back */
+    ecat_sim_attach(&sim, &layout);
+    printf("ecat_sim_node: %d slaves on %s\n", sim.slave_count, interface_name);
+    fflush(stdout);
+
+    for (;;) {
+        int length = eth_mac_receive_frame(s_frame, (uint16_t)sizeof(s_frame));
+        if (length > 0) {
+            eth_mac_send_frame(s_frame, (uint16_t)length);
+        } else {
+            /* leave the core to the master when both share one CPU */
+            sched_yield();
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#include "flash.h"
+#include <string.h>
+#if !defined(__ARM_ARCH_7M__)
+#include <stdio.h>
+#endif
+
+#if defined(__ARM_ARCH_7M__)
+#define FLASH_KEYR (*(volatile uint32_t *)0x40022004U)
+#define FLASH_SR (*(volatile uint32_t *)0x4002200CU)
+#define FLASH_CR (*(volatile uint32_t *)0x40022010U)
+#define FLASH_AR (*(volatile uint32_t *)0x40022014U)
+#define FLASH_KEY1 0x45670123U
+#define FLASH_KEY2 0xCDEF89ABU
+#define FLASH_SR_BSY (1UL << 0)
+#define FLASH_SR_PGERR (1UL << 2)
+#define FLASH_SR_WRPRTERR (1UL << 4)
+#define FLASH_SR_EOP (1UL << 5)
+#define FLASH_CR_PG (1UL << 0)
+#define FLASH_CR_PER (1UL << 1)
+#define FLASH_CR_STRT (1UL << 6)
+#define FLASH_CR_LOCK (1UL << 7)
+
+static bool wait_ready(void)
+{
+    while ((FLASH_SR & FLASH_SR_BSY) != 0U) {
+    }
+    bool ok = (FLASH_SR & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) == 0U;
+    FLASH_SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    return ok;
+}
+
+static void unlock(void)
+{
+    if ((FLASH_CR & FLASH_CR_LOCK) != 0U) {
+        FLASH_KEYR = FLASH_KEY1;
+        FLASH_KEYR = FLASH_KEY2;
+    }
+}
+#else
+static uint8_t s_image[FLASH_REGION_SIZE];
+static FILE *s_file = NULL;
+
+static bool write_back(uint32_t offset, uint32_t length)
+{
+    return fseek(s_file, (long)offset, SEEK_SET) == 0 && fwrite(&s_image[offset], 1U, length, s_file) == length &&
+           fflush(s_file) == 0;
+}
+#endif
+
+static bool in_region(uint32_t offset, uint32_t length)
+{
+    return offset <= FLASH_REGION_SIZE && length <= FLASH_REGION_SIZE - offset;
+}
+
+bool flash_open(const char *path)
+{
+#if defined(__ARM_ARCH_7M__)
+    (void)path;
+    return true;
+#else
+    /* a missing or short image reads as erased flash */
+    if (s_file != NULL) {
+        fclose(s_file);
+    }
+    memset(s_image, 0xFF, sizeof(s_image));
+    s_file = fopen(path, "r+b");
+    if (s_file == NULL) {
+        s_file = fopen(path, "w+b");
+        if (s_file == NULL) {
+            return false;
+        }
+    }
+    size_t length = fread(s_image, 1U, sizeof(s_image), s_file);
+    if (length < sizeof(s_image) && !write_back((uint32_t)length, (uint32_t)(sizeof(s_image) - length))) {
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool flash_read(uint32_t offset, void *data, uint32_t length)
+{
+    if (!in_region(offset, length)) {
+        return false;
+    }
+#if defined(__ARM_ARCH_7M__)
+    memcpy(data, (const void *)(uintptr_t)(FLASH_REGION_BASE + offset), length);
+#else
+    memcpy(data, &s_image[offset], length);
+#endif
+    return true;
+}
+
+bool flash_program(uint32_t offset, const void *data, uint32_t length)
+{
+    if (!in_region(offset, length) || (offset % 2U) != 0U || (length % 2U) != 0U) {
+        return false;
+    }
+    const uint8_t *bytes = (const uint8_t *)data;
+#if defined(__ARM_ARCH_7M__)
+    /* the core stalls on instruction fetch while a half-word is written */
+    unlock();
+    bool ok = true;
+    FLASH_CR |= FLASH_CR_PG;
+    for (uint32_t i = 0U; i < length && ok; i += 2U) {
+        uint16_t half = (uint16_t)(bytes[i] | ((uint16_t)bytes[i + 1U] << 8));
+        *(volatile uint16_t *)(uintptr_t)(FLASH_REGION_BASE + offset + i) = half;
+        ok = wait_ready();
+    }
+    FLASH_CR &= ~FLASH_CR_PG;
+    FLASH_CR |= FLASH_CR_LOCK;
+    return ok;
+#else
+    /* like the F1 controller, a half-word is programmed once after an erase */
+    for (uint32_t i = 0U; i < length; i += 2U) {
+        bool erased = s_image[offset + i] == 0xFFU && s_image[offset + i + 1U] == 0xFFU;
+        bool unchanged = bytes[i] == 0xFFU && bytes[i + 1U] == 0xFFU;
+        if (!erased && !unchanged) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0U; i < length; ++i) {
+        s_image[offset + i] &= bytes[i];
+    }
+    return s_file != NULL && write_back(offset, length);
+#endif
+}
+
+bool flash_erase_page(uint16_t page)
+{
+    if (page >= FLASH_PAGE_COUNT) {
+        return false;
+    }
+#if defined(__ARM_ARCH_7M__)
+    /* tens of milliseconds with the core stalled, kept off the motion path */
+    unlock();
+    FLASH_CR |= FLASH_CR_PER;
+    FLASH_AR = FLASH_REGION_BASE + (uint32_t)page * FLASH_PAGE_SIZE;
+    FLASH_CR |= FLASH_CR_STRT;
+    bool ok = wait_ready();
+    FLASH_CR &= ~FLASH_CR_PER;
+    FLASH_CR |= FLASH_CR_LOCK;
+    return ok;
+#else
+    uint32_t offset = (uint32_t)page * FLASH_PAGE_SIZE;
+    memset(&s_image[offset], 0xFF, FLASH_PAGE_SIZE);
+    return s_file != NULL && write_back(offset, FLASH_PAGE_SIZE);
+#endif
+}
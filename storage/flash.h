@@ -0,0 +1,20 @@
+#ifndef STORAGE_FLASH_H
+#define STORAGE_FLASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Parameter flash region: erased bytes read 0xFF, programming only clears
+ * bits, in half-words. On target the last 16 KB of the F107's 256 KB, on
+ * host an image file of the same size */
+#define FLASH_PAGE_SIZE 2048U
+#define FLASH_PAGE_COUNT 8U
+#define FLASH_REGION_SIZE (FLASH_PAGE_SIZE * FLASH_PAGE_COUNT)
+#define FLASH_REGION_BASE 0x0803C000U
+
+bool flash_open(const char *path);
+bool flash_read(uint32_t offset, void *data, uint32_t length);
+bool flash_program(uint32_t offset, const void *data, uint32_t length);
+bool flash_erase_page(uint16_t page);
+
+#endif
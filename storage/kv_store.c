@@ -0,0 +1,432 @@
+#include "kv_store.h"
+#include <stddef.h>
+#include <string.h>
+#include "flash.h"
+#include "utils/crc16.h"
+
+#define PAGE_MAGIC 0x3150564BU /* "KVP1" */
+#define SEQUENCE_UNSET 0xFFFFFFFFU
+#define PAGE_HEADER_SIZE 16U
+#define RECORD_HEADER_SIZE 8U
+#define RECORD_TOMBSTONE 0x8000U /* in the length field, the key is deleted */
+#define NO_PAGE 0xFFU
+
+typedef struct {
+    uint32_t magic;
+    uint32_t erase_count; /* programmed with the magic right after the erase */
+    uint32_t sequence;    /* programmed when the page becomes the head */
+    uint32_t reserved;
+} page_header_t;
+
+/* key and length first, the value, the CRC last: a torn write fails the CRC */
+typedef struct {
+    uint16_t key;
+    uint16_t length;
+    uint16_t crc;
+    uint16_t reserved;
+} record_header_t;
+
+typedef enum {
+    PAGE_DIRTY = 0, /* needs an erase before use */
+    PAGE_CLEAN,     /* erased, header written */
+    PAGE_USED
+} page_state_t;
+
+typedef struct {
+    uint16_t key;
+    uint16_t length;
+    uint16_t offset;
+    uint8_t page;
+    uint8_t reserved;
+} index_entry_t;
+
+static index_entry_t s_index[KV_MAX_KEYS]; /* sorted by key */
+static uint16_t s_key_count = 0U;
+static uint8_t s_state[FLASH_PAGE_COUNT];
+static uint32_t s_sequence[FLASH_PAGE_COUNT];
+static uint32_t s_erase_count[FLASH_PAGE_COUNT];
+static uint8_t s_head = NO_PAGE;
+static uint16_t s_head_offset = 0U;
+static uint32_t s_next_sequence = 0U;
+static uint32_t s_scanned_bytes = 0U;
+static uint32_t s_collections = 0U;
+static bool s_mounted = false;
+
+static uint16_t record_size(uint16_t length)
+{
+    return (uint16_t)(RECORD_HEADER_SIZE + ((length + 3U) & ~3U));
+}
+
+static uint32_t page_address(uint8_t page, uint16_t offset)
+{
+    return (uint32_t)page * FLASH_PAGE_SIZE + offset;
+}
+
+static uint16_t record_crc(const record_header_t *header, const uint8_t *value, uint16_t length)
+{
+    uint16_t crc = crc16_ccitt((const uint8_t *)header, 4U, 0xFFFFU);
+    crc = crc16_ccitt(value, length, crc);
+    /* an erased CRC field never matches */
+    return crc == 0xFFFFU ? 0U : crc;
+}
+
+static uint16_t index_lower_bound(uint16_t key)
+{
+    uint16_t low = 0U;
+    uint16_t high = s_key_count;
+    while (low < high) {
+        uint16_t mid = (uint16_t)((low + high) / 2U);
+        if (s_index[mid].key < key) {
+            low = (uint16_t)(mid + 1U);
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static index_entry_t *index_find(uint16_t key)
+{
+    uint16_t slot = index_lower_bound(key);
+    return slot < s_key_count && s_index[slot].key == key ? &s_index[slot] : NULL;
+}
+
+static bool index_put(uint16_t key, uint16_t length, uint8_t page, uint16_t offset)
+{
+    uint16_t slot = index_lower_bound(key);
+    if (slot >= s_key_count || s_index[slot].key != key) {
+        if (s_key_count >= KV_MAX_KEYS) {
+            return false;
+        }
+        memmove(&s_index[slot + 1U], &s_index[slot], (size_t)(s_key_count - slot) * sizeof(s_index[0]));
+        s_key_count++;
+    }
+    s_index[slot].key = key;
+    s_index[slot].length = length;
+    s_index[slot].page = page;
+    s_index[slot].offset = offset;
+    s_index[slot].reserved = 0U;
+    return true;
+}
+
+static void index_remove(uint16_t key)
+{
+    uint16_t slot = index_lower_bound(key);
+    if (slot < s_key_count && s_index[slot].key == key) {
+        s_key_count--;
+        memmove(&s_index[slot], &s_index[slot + 1U], (size_t)(s_key_count - slot) * sizeof(s_index[0]));
+    }
+}
+
+static uint32_t live_bytes(void)
+{
+    uint32_t total = 0U;
+    for (uint16_t i = 0U; i < s_key_count; ++i) {
+        total += record_size(s_index[i].length);
+    }
+    return total;
+}
+
+static uint8_t free_pages(void)
+{
+    uint8_t count = 0U;
+    for (uint8_t page = 0U; page < FLASH_PAGE_COUNT; ++page) {
+        count = (uint8_t)(count + (s_state[page] != PAGE_USED ? 1U : 0U));
+    }
+    return count;
+}
+
+static uint8_t oldest_page(void)
+{
+    uint8_t oldest = NO_PAGE;
+    for (uint8_t page = 0U; page < FLASH_PAGE_COUNT; ++page) {
+        if (s_state[page] == PAGE_USED && (oldest == NO_PAGE || s_sequence[page] < s_sequence[oldest])) {
+            oldest = page;
+        }
+    }
+    return oldest;
+}
+
+static uint8_t next_page(void)
+{
+    return s_head == NO_PAGE ? 0U : (uint8_t)((s_head + 1U) % FLASH_PAGE_COUNT);
+}
+
+static bool prepare_page(uint8_t page)
+{
+    if (s_state[page] == PAGE_CLEAN) {
+        return true;
+    }
+    if (!flash_erase_page(page)) {
+        return false;
+    }
+    s_erase_count[page]++;
+    page_header_t header = {PAGE_MAGIC, s_erase_count[page], SEQUENCE_UNSET, 0xFFFFFFFFU};
+    if (!flash_program(page_address(page, 0U), &header, (uint32_t)offsetof(page_header_t, sequence))) {
+        return false;
+    }
+    s_state[page] = PAGE_CLEAN;
+    return true;
+}
+
+static bool advance_head(void)
+{
+    /* the ring only ever grows into the page after the head */
+    uint8_t page = next_page();
+    if (s_state[page] == PAGE_USED || !prepare_page(page)) {
+        return false;
+    }
+    uint32_t sequence = s_next_sequence;
+    if (!flash_program(page_address(page, (uint16_t)offsetof(page_header_t, sequence)), &sequence, sizeof(sequence))) {
+        s_state[page] = PAGE_DIRTY;
+        return false;
+    }
+    s_next_sequence++;
+    s_state[page] = PAGE_USED;
+    s_sequence[page] = sequence;
+    s_head = page;
+    s_head_offset = PAGE_HEADER_SIZE;
+    return true;
+}
+
+static bool append(uint16_t key, uint16_t length_field, const void *value, uint16_t length, uint16_t *offset)
+{
+    uint16_t size = record_size(length);
+    if ((s_head == NO_PAGE || s_head_offset + size > FLASH_PAGE_SIZE) && !advance_head()) {
+        return false;
+    }
+    uint8_t record[RECORD_HEADER_SIZE + KV_MAX_VALUE + 4U];
+    memset(record, 0xFF, sizeof(record));
+    record_header_t header = {key, length_field, 0xFFFFU, 0xFFFFU};
+    memcpy(record, &header, sizeof(header));
+    if (length != 0U) {
+        memcpy(&record[RECORD_HEADER_SIZE], value, length);
+    }
+    uint16_t crc = record_crc(&header, &record[RECORD_HEADER_SIZE], length);
+    uint32_t address = page_address(s_head, s_head_offset);
+    *offset = s_head_offset;
+    /* whatever happens below, the space is spent */
+    s_head_offset = (uint16_t)(s_head_offset + size);
+    return flash_program(address, record, 4U) &&
+           (size == RECORD_HEADER_SIZE || flash_program(address + RECORD_HEADER_SIZE, &record[RECORD_HEADER_SIZE], size - RECORD_HEADER_SIZE)) &&
+           flash_program(address + offsetof(record_header_t, crc), &crc, sizeof(crc));
+}
+
+static uint32_t page_live_bytes(uint8_t page)
+{
+    uint32_t total = 0U;
+    for (uint16_t i = 0U; i < s_key_count; ++i) {
+        total += s_index[i].page == page ? record_size(s_index[i].length) : 0U;
+    }
+    return total;
+}
+
+static bool compact(uint8_t tail)
+{
+    /* the oldest page holds nothing a newer page depends on, tombstones included */
+    if (tail == NO_PAGE || tail == s_head) {
+        return false;
+    }
+    uint8_t value[KV_MAX_VALUE];
+    for (uint16_t i = 0U; i < s_key_count; ++i) {
+        index_entry_t *entry = &s_index[i];
+        if (entry->page != tail) {
+            continue;
+        }
+        uint16_t offset;
+        if (!flash_read(page_address(tail, (uint16_t)(entry->offset + RECORD_HEADER_SIZE)), value, entry->length) ||
+            !append(entry->key, entry->length, value, entry->length, &offset)) {
+            return false;
+        }
+        entry->page = s_head;
+        entry->offset = offset;
+    }
+    s_state[tail] = PAGE_DIRTY;
+    s_collections++;
+    return prepare_page(tail);
+}
+
+static bool collect(uint8_t needed)
+{
+    for (uint8_t pass = 0U; free_pages() < needed; ++pass) {
+        if (pass >= 2U * FLASH_PAGE_COUNT || !compact(oldest_page())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint16_t scan_page(uint8_t page)
+{
+    uint8_t value[KV_MAX_VALUE];
+    uint16_t offset = PAGE_HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= FLASH_PAGE_SIZE) {
+        record_header_t header;
+        if (!flash_read(page_address(page, offset), &header, sizeof(header))) {
+            return FLASH_PAGE_SIZE;
+        }
+        s_scanned_bytes += sizeof(header);
+        if (header.key == KV_KEY_INVALID) {
+            break;
+        }
+        uint16_t length = (uint16_t)(header.length & ~RECORD_TOMBSTONE);
+        uint16_t size = record_size(length);
+        if (length > KV_MAX_VALUE || offset + size > FLASH_PAGE_SIZE) {
+            /* torn header: nothing after it can be trusted, the page is closed */
+            return FLASH_PAGE_SIZE;
+        }
+        if (!flash_read(page_address(page, (uint16_t)(offset + RECORD_HEADER_SIZE)), value, length)) {
+            return FLASH_PAGE_SIZE;
+        }
+        s_scanned_bytes += length;
+        if (record_crc(&header, value, length) == header.crc) {
+            if ((header.length & RECORD_TOMBSTONE) != 0U) {
+                index_remove(header.key);
+            } else {
+                index_put(header.key, length, page, offset);
+            }
+        }
+        offset = (uint16_t)(offset + size);
+    }
+    return offset;
+}
+
+bool kv_store_mount(void)
+{
+    s_key_count = 0U;
+    s_head = NO_PAGE;
+    s_head_offset = 0U;
+    s_next_sequence = 0U;
+    s_scanned_bytes = 0U;
+    s_collections = 0U;
+    uint8_t used = 0U;
+    for (uint8_t page = 0U; page < FLASH_PAGE_COUNT; ++page) {
+        page_header_t header;
+        if (!flash_read(page_address(page, 0U), &header, sizeof(header))) {
+            s_mounted = false;
+            return false;
+        }
+        s_scanned_bytes += sizeof(header);
+        bool valid = header.magic == PAGE_MAGIC;
+        s_erase_count[page] = valid ? header.erase_count : 0U;
+        s_sequence[page] = header.sequence;
+        s_state[page] = !valid ? PAGE_DIRTY : (header.sequence == SEQUENCE_UNSET ? PAGE_CLEAN : PAGE_USED);
+        used = (uint8_t)(used + (s_state[page] == PAGE_USED ? 1U : 0U));
+    }
+    /* replay oldest first, a newer record of a key replaces the older */
+    uint32_t last = 0U;
+    for (uint8_t n = 0U; n < used; ++n) {
+        uint8_t page = NO_PAGE;
+        for (uint8_t candidate = 0U; candidate < FLASH_PAGE_COUNT; ++candidate) {
+            if (s_state[candidate] == PAGE_USED && (n == 0U || s_sequence[candidate] > last) &&
+                (page == NO_PAGE || s_sequence[candidate] < s_sequence[page])) {
+                page = candidate;
+            }
+        }
+        last = s_sequence[page];
+        s_head = page;
+        s_head_offset = scan_page(page);
+        s_next_sequence = last + 1U;
+    }
+    s_mounted = true;
+    return true;
+}
+
+bool kv_store_get(uint16_t key, void *value, uint16_t capacity, uint16_t *length)
+{
+    const index_entry_t *entry = s_mounted ? index_find(key) : NULL;
+    if (entry == NULL || entry->length > capacity) {
+        return false;
+    }
+    *length = entry->length;
+    return flash_read(page_address(entry->page, (uint16_t)(entry->offset + RECORD_HEADER_SIZE)), value, entry->length);
+}
+
+uint32_t kv_store_capacity(void)
+{
+    /* the head, the reserve and the page a compaction grows into stay out,
+     * each page may waste up to one record at its end */
+    return (FLASH_PAGE_COUNT - 2U - KV_RESERVE_PAGES) * (FLASH_PAGE_SIZE - PAGE_HEADER_SIZE - record_size(KV_MAX_VALUE));
+}
+
+static bool make_room(uint16_t size)
+{
+    if (s_head != NO_PAGE && s_head_offset + size <= FLASH_PAGE_SIZE) {
+        return true;
+    }
+    /* one free page for the new head, the reserve stays */
+    return collect((uint8_t)(KV_RESERVE_PAGES + 1U));
+}
+
+bool kv_store_set(uint16_t key, const void *value, uint16_t length)
+{
+    if (!s_mounted || key == KV_KEY_INVALID || length > KV_MAX_VALUE) {
+        return false;
+    }
+    const index_entry_t *entry = index_find(key);
+    if (entry != NULL && entry->length == length) {
+        /* rewriting an unchanged value only wears the flash */
+        uint8_t stored[KV_MAX_VALUE];
+        if (flash_read(page_address(entry->page, (uint16_t)(entry->offset + RECORD_HEADER_SIZE)), stored, length) &&
+            memcmp(stored, value, length) == 0) {
+            return true;
+        }
+    }
+    if ((entry == NULL && s_key_count >= KV_MAX_KEYS) ||
+        live_bytes() - (entry != NULL ? record_size(entry->length) : 0U) + record_size(length) > kv_store_capacity()) {
+        return false;
+    }
+    uint16_t offset;
+    if (!make_room(record_size(length)) || !append(key, length, value, length, &offset)) {
+        return false;
+    }
+    return index_put(key, length, s_head, offset);
+}
+
+bool kv_store_delete(uint16_t key)
+{
+    if (!s_mounted || index_find(key) == NULL) {
+        return s_mounted;
+    }
+    uint16_t offset;
+    if (!make_room(RECORD_HEADER_SIZE) || !append(key, RECORD_TOMBSTONE, NULL, 0U, &offset)) {
+        return false;
+    }
+    index_remove(key);
+    return true;
+}
+
+void kv_store_maintain(void)
+{
+    /* background share of the garbage collection, one page per call, so the
+     * erases happen here rather than inside a set */
+    if (!s_mounted) {
+        return;
+    }
+    uint8_t tail = oldest_page();
+    if (free_pages() < KV_RESERVE_PAGES + 2U && tail != s_head &&
+        page_live_bytes(tail) < (FLASH_PAGE_SIZE - PAGE_HEADER_SIZE) / 2U) {
+        compact(tail);
+        return;
+    }
+    uint8_t page = next_page();
+    if (s_state[page] == PAGE_DIRTY) {
+        prepare_page(page);
+    }
+}
+
+void kv_store_get_stats(kv_store_stats_t *stats)
+{
+    stats->keys = s_key_count;
+    stats->live_bytes = live_bytes();
+    stats->free_pages = free_pages();
+    stats->used_pages = (uint8_t)(FLASH_PAGE_COUNT - stats->free_pages);
+    stats->erase_min = UINT32_MAX;
+    stats->erase_max = 0U;
+    for (uint8_t page = 0U; page < FLASH_PAGE_COUNT; ++page) {
+        stats->erase_min = s_erase_count[page] < stats->erase_min ? s_erase_count[page] : stats->erase_min;
+        stats->erase_max = s_erase_count[page] > stats->erase_max ? s_erase_count[page] : stats->erase_max;
+    }
+    stats->scanned_bytes = s_scanned_bytes;
+    stats->collections = s_collections;
+}
@@ -0,0 +1,37 @@
+#ifndef STORAGE_KV_STORE_H
+#define STORAGE_KV_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Log-structured key-value store over the flash pages. Every set appends a
+ * CRC-protected record to the head page; mount rebuilds the RAM index with
+ * one pass over the written part of the log. Pages are used as a ring, the
+ * oldest one is compacted into the head and erased, so every page is erased
+ * in turn whatever keys change */
+
+#define KV_MAX_KEYS 64U
+#define KV_MAX_VALUE 128U
+#define KV_RESERVE_PAGES 1U /* kept erased so garbage collection always has room */
+#define KV_KEY_INVALID 0xFFFFU
+
+typedef struct {
+    uint16_t keys;
+    uint32_t live_bytes;    /* flash taken by the current records */
+    uint8_t used_pages;
+    uint8_t free_pages;
+    uint32_t erase_min;
+    uint32_t erase_max;
+    uint32_t scanned_bytes; /* read by the last mount */
+    uint32_t collections;   /* pages compacted since mount */
+} kv_store_stats_t;
+
+bool kv_store_mount(void);
+bool kv_store_get(uint16_t key, void *value, uint16_t capacity, uint16_t *length);
+bool kv_store_set(uint16_t key, const void *value, uint16_t length);
+bool kv_store_delete(uint16_t key);
+void kv_store_maintain(void);
+uint32_t kv_store_capacity(void);
+void kv_store_get_stats(kv_store_stats_t *stats);
+
+#endif
@@ -0,0 +1,133 @@
+#include "storage.h"
+#include <stddef.h>
+#include <string.h>
+#include "flash.h"
+#include "kv_store.h"
+#include "utils/fixed.h"
+
+typedef struct {
+    uint16_t key; /* stable across firmware versions, never reused */
+    uint16_t offset;
+    uint16_t size;
+} storage_param_t;
+
+#define PARAM(key, field) {key, (uint16_t)offsetof(storage_params_t, field), (uint16_t)sizeof(((storage_params_t *)0)->field)}
+
+static const storage_param_t s_params[] = {
+    PARAM(0x0001U, delta),
+    PARAM(0x0010U, axis_velocity_limit),
+    PARAM(0x0011U, axis_acceleration_limit),
+    PARAM(0x0012U, axis_jerk_limit),
+    PARAM(0x0013U, axis_torque_limit),
+    PARAM(0x0014U, joint_inertia),
+    PARAM(0x0015U, path_acceleration_limit),
+    PARAM(0x0016U, path_jerk_limit),
+    PARAM(0x0020U, following_error_warning),
+    PARAM(0x0021U, following_error_fault),
+    PARAM(0x0030U, input_shaper_type),
+    PARAM(0x0031U, input_shaper_frequency_hz),
+    PARAM(0x0032U, input_shaper_damping),
+    PARAM(0x0040U, conveyor_axis),
+    PARAM(0x0041U, conveyor_direction),
+    PARAM(0x0042U, conveyor_scale),
+    PARAM(0x0043U, conveyor_latency_us),
+    PARAM(0x0050U, torque_notch_hz),
+    PARAM(0x0051U, torque_notch_q),
+    PARAM(0x0052U, velocity_filter_hz),
+    PARAM(0x0060U, default_mode_of_operation),
+    PARAM(0x0061U, control_period_us),
+    PARAM(0x0070U, opcua_port),
+};
+
+#define PARAM_COUNT (sizeof(s_params) / sizeof(s_params[0]))
+
+static bool s_ready = false;
+
+bool storage_init(const char *path)
+{
+    s_ready = flash_open(path) && kv_store_mount();
+    return s_ready;
+}
+
+void storage_defaults(storage_params_t *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->delta.R_base = q16_16_from_float(0.300f);
+    params->delta.r_eff = q16_16_from_float(0.100f);
+    params->delta.L_upper = q16_16_from_float(0.300f);
+    params->delta.L_lower = q16_16_from_float(0.400f);
+    params->delta.z_offset = q16_16_from_float(0.200f);
+    params->delta.soft_xyz_min[0] = q16_16_from_float(-0.200f);
+    params->delta.soft_xyz_min[1] = q16_16_from_float(-0.200f);
+    params->delta.soft_xyz_min[2] = q16_16_from_float(-0.500f);
+    params->delta.soft_xyz_max[0] = q16_16_from_float(0.200f);
+    params->delta.soft_xyz_max[1] = q16_16_from_float(0.200f);
+    params->delta.soft_xyz_max[2] = q16_16_from_float(-0.100f);
+
+    params->axis_velocity_limit = q16_16_from_float(0.150f);
+    params->axis_acceleration_limit = q16_16_from_float(1.000f);
+    params->axis_jerk_limit = q16_16_from_float(5.000f);
+    params->axis_torque_limit = q16_16_from_float(12.000f);
+    params->joint_inertia = q16_16_from_float(0.050f);
+    params->path_acceleration_limit = q16_16_from_float(20.000f);
+    params->path_jerk_limit = q16_16_from_float(500.000f);
+    params->following_error_warning = q16_16_from_float(0.005f);
+    params->following_error_fault = q16_16_from_float(0.020f);
+    params->input_shaper_type = 2U; /* ZVD */
+    for (int axis = 0; axis < 3; ++axis) {
+        /* arm and platform ringing, identified per axis on the machine */
+        params->input_shaper_frequency_hz[axis] = q16_16_from_float(axis == 2 ? 45.0f : 30.0f);
+        params->input_shaper_damping[axis] = q16_16_from_float(0.05f);
+    }
+    params->conveyor_axis = 1U;
+    params->conveyor_direction[0] = Q16_16_ONE;
+    params->conveyor_direction[1] = 0;
+    params->conveyor_direction[2] = 0;
+    params->conveyor_scale = q16_16_from_float(0.050f); /* drive pulley radius, position in rad */
+    params->conveyor_latency_us = 2000U;
+    params->torque_notch_hz = q16_16_from_float(30.0f);
+    params->torque_notch_q = q16_16_from_float(2.0f);
+    params->velocity_filter_hz = q16_16_from_float(100.0f);
+    params->opcua_port = 4840U; /* IANA opc.tcp */
+    params->default_mode_of_operation = 8U; /* CSP */
+    params->control_period_us = CONTROL_PERIOD_US;
+}
+
+bool storage_load(storage_params_t *params)
+{
+    /* fields never saved, or saved with another size, keep their default */
+    storage_defaults(params);
+    if (!s_ready) {
+        return false;
+    }
+    uint8_t *base = (uint8_t *)params;
+    for (size_t i = 0U; i < PARAM_COUNT; ++i) {
+        uint8_t value[KV_MAX_VALUE];
+        uint16_t length = 0U;
+        if (kv_store_get(s_params[i].key, value, sizeof(value), &length) && length == s_params[i].size) {
+            memcpy(base + s_params[i].offset, value, length);
+        }
+    }
+    return true;
+}
+
+bool storage_save(const storage_params_t *params)
+{
+    /* unchanged fields are skipped by the store, a save costs what changed */
+    if (!s_ready) {
+        return false;
+    }
+    const uint8_t *base = (const uint8_t *)params;
+    bool ok = true;
+    for (size_t i = 0U; i < PARAM_COUNT; ++i) {
+        ok = kv_store_set(s_params[i].key, base + s_params[i].offset, s_params[i].size) && ok;
+    }
+    return ok;
+}
+
+void storage_maintain(void)
+{
+    if (s_ready) {
+        kv_store_maintain();
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef STORAGE_STORAGE_H
+#define STORAGE_STORAGE_H
+
+#include <stdbool.h>
+#include "board/config.h"
+
+#define STORAGE_HOST_PATH "delta_params.kv" /* flash image on host, ignored on target */
+
+/* the machine parameters, one key-value record per field; the bus
+ * topology is not stored, it comes from the board */
+typedef board_runtime_config_t storage_params_t;
+
+bool storage_init(const char *path);
+void storage_defaults(storage_params_t *params);
+bool storage_load(storage_params_t *params);
+bool storage_save(const storage_params_t *params);
+void storage_maintain(void);
+
+#endif
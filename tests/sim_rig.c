@@ -0,0 +1,78 @@
+#include "sim_rig.h"
+#include "../drivers/eth_mac.h"
+#include <assert.h>
+#include <string.h>
+
+void sim_rig_configure(sim_rig_t *rig)
+{
+    board_runtime_config_t *config = &rig->config;
+    memset(config, 0, sizeof(*config));
+    config->delta.R_base = q16_16_from_float(0.300f);
+    config->delta.r_eff = q16_16_from_float(0.100f);
+    config->delta.L_upper = q16_16_from_float(0.300f);
+    config->delta.L_lower = q16_16_from_float(0.400f);
+    config->delta.z_offset = q16_16_from_float(0.200f);
+    for (int axis = 0; axis < 3; ++axis) {
+        config->delta.soft_xyz_min[axis] = q16_16_from_float(axis == 2 ? -0.5f : -0.2f);
+        config->delta.soft_xyz_max[axis] = q16_16_from_float(axis == 2 ? -0.1f : 0.2f);
+    }
+    config->control_period_us = 1000U;
+    config->default_mode_of_operation = CIA402_MODE_CSP;
+    config->slave_count = DELTA_JOINT_COUNT;
+    for (int i = 0; i < DELTA_JOINT_COUNT; ++i) {
+        config->slaves[i] = (ecat_slave_descriptor_t){0xabU, 0x1000U + (uint32_t)i, (uint16_t)(i + 1), ECAT_ROLE_JOINT, (uint8_t)i, 0U, 0U};
+    }
+}
+
+void sim_rig_connect(sim_rig_t *rig, const ecat_sim_dynamics_t *dynamics)
+{
+    delta_init(&rig->config.delta);
+    eth_mac_config_t mac = {.mac_address = {0x02, 0, 0, 0, 0, 1}, .phy_address = 0U, .cycle_time_ns = 0U};
+    eth_mac_init(&mac, NULL, NULL);
+    ethcat_master_init(&rig->master, &rig->config);
+    assert(ethcat_master_scan(&rig->master));
+    memset(&rig->sim, 0, sizeof(rig->sim));
+    if (dynamics != NULL) {
+        ecat_sim_init(&rig->sim, dynamics);
+        assert(ecat_sim_attach(&rig->sim, &rig->master));
+    }
+}
+
+void sim_rig_init_motion(sim_rig_t *rig)
+{
+    planner_init(&rig->planner, rig->config.control_period_us);
+    gcode_parser_init(&rig->parser);
+    command_queue_init(&rig->queue);
+    cnc_runtime_init(&rig->runtime);
+    for (int axis = 0; axis < ECAT_MAX_SLAVES; ++axis) {
+        cia402_axis_init(&rig->axes[axis], CIA402_MODE_CSP);
+    }
+    motion_controller_init(&rig->motion, &rig->planner, &rig->master, rig->axes);
+}
+
+void sim_rig_rest(sim_rig_t *rig, const delta_pose_t *start)
+{
+    delta_joint_t joints;
+    assert(delta_inverse_kinematics(start, &joints));
+    for (int axis = 0; axis < rig->sim.slave_count && axis < DELTA_JOINT_COUNT; ++axis) {
+        rig->sim.slaves[axis].position = joints.theta[axis];
+        rig->sim.slaves[axis].previous_position = joints.theta[axis];
+    }
+}
+
+void sim_rig_cycle(sim_rig_t *rig)
+{
+    motion_controller_tick(&rig->motion);
+    ethcat_master_send_process_data(&rig->master);
+    ethcat_master_process(&rig->master);
+    command_processor_step(&rig->queue, &rig->runtime, &rig->parser, &rig->planner, rig->axes, rig->master.slave_count);
+}
+
+void sim_rig_enable(sim_rig_t *rig)
+{
+    assert(command_queue_enqueue(&rig->queue, "M17"));
+    for (int cycles = 0; cycles < 200 && (!rig->motion.drives_ready || rig->planner.pose_pending); ++cycles) {
+        sim_rig_cycle(rig);
+    }
+    assert(rig->motion.drives_ready && !rig->planner.pose_pending);
+}
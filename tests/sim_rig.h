@@ -0,0 +1,36 @@
+#ifndef TESTS_SIM_RIG_H
+#define TESTS_SIM_RIG_H
+
+#include "../core/command_processor.h"
+#include "../sim/ecat_sim.h"
+
+/* Reference delta arm on simulated CiA-402 drives for the motion tests:
+ * configure, adjust the config if needed, connect, init the motion stack,
+ * rest the arm at a start pose and enable it */
+
+typedef struct {
+    board_runtime_config_t config;
+    ethcat_master_t master;
+    ecat_sim_t sim;
+    planner_queue_t planner;
+    motion_controller_t motion;
+    cia402_axis_t axes[ECAT_MAX_SLAVES];
+    command_queue_t queue;
+    gcode_parser_t parser;
+    cnc_runtime_t runtime;
+} sim_rig_t;
+
+/** @brief Reference geometry, 1 ms CSP cycle and one joint drive per arm. */
+void sim_rig_configure(sim_rig_t *rig);
+/** @brief Scan the configured bus and attach the virtual drives, none when @p dynamics is NULL. */
+void sim_rig_connect(sim_rig_t *rig, const ecat_sim_dynamics_t *dynamics);
+/** @brief Initialise planner, parser, command queue and motion controller. */
+void sim_rig_init_motion(sim_rig_t *rig);
+/** @brief Place the virtual drives at @p start, at rest; the controller reads it back on enable. */
+void sim_rig_rest(sim_rig_t *rig, const delta_pose_t *start);
+/** @brief One control cycle: tick, process data exchange, one queued line. */
+void sim_rig_cycle(sim_rig_t *rig);
+/** @brief M17 through the command queue, cycled until the poses are seeded from the drives. */
+void sim_rig_enable(sim_rig_t *rig);
+
+#endif
@@ -0,0 +1,93 @@
+#include "test_suite.h"
+#include "../planner/planner.h"
+#include "../gcode/parser.h"
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+
+static void check_s_curve(float distance)
+{
+    s_curve_t curve;
+    const float v = 2.0f;
+    const float a = 20.0f;
+    const float j = 1000.0f;
+    assert(s_curve_plan(&curve, distance, v, a, j));
+    float duration = s_curve_duration(&curve);
+    const float dt = duration / 400.0f;
+    float p0 = 0.0f;
+    float v0 = 0.0f;
+    for (int i = 1; i <= 400; ++i) {
+        float p = s_curve_position(&curve, (float)i * dt);
+        float vel = (p - p0) / dt;
+        float acc = (vel - v0) / dt;
+        assert(p >= p0 && vel <= v * 1.01f);
+        if (i > 1) {
+            assert(fabsf(acc) <= a * 1.05f);
+        }
+        p0 = p;
+        v0 = vel;
+    }
+    assert(curve.accel <= a && curve.accel <= curve.t_jerk * j * 1.001f);
+    assert(fabsf(p0 - distance) < 1e-5f);
+    assert(fabsf(s_curve_position(&curve, s_curve_time_at(&curve, 0.5f * distance)) - 0.5f * distance) < 1e-5f);
+}
+
+static int run_arch(planner_queue_t *planner, q16_16_t radius, bool *blended)
+{
+    delta_pose_t target = {{q16_16_from_float(0.15f), 0, q16_16_from_float(-0.40f)}};
+    const float lift = 0.025f;
+    assert(planner_push_arch(planner, &target, q16_16_from_float(lift), radius, q16_16_from_float(2.0f), q16_16_from_int(20), q16_16_from_int(1000)));
+    delta_pose_t pose;
+    delta_pose_t previous = planner->current_pose;
+    previous.xyz[0] = q16_16_from_float(-0.15f);
+    int ticks = 0;
+    bool moved_before_top = false;
+    while (planner_step(planner, &pose)) {
+        float z = q16_16_to_float(pose.xyz[2]);
+        assert(z >= -0.4001f && z <= -0.375f + 1e-4f);
+        /* never more than the velocity limit per cycle on each axis */
+        for (int axis = 0; axis < 3; ++axis) {
+            assert(fabsf(q16_16_to_float(pose.xyz[axis] - previous.xyz[axis])) <= 2.0f * 0.001f + 1e-4f);
+        }
+        if (pose.xyz[0] != previous.xyz[0] && z < -0.375f - 0.001f && pose.xyz[0] < 0) {
+            moved_before_top = true;
+        }
+        previous = pose;
+        ++ticks;
+    }
+    *blended = moved_before_top;
+    assert(planner_step(planner, &pose) == false);
+    assert(pose.xyz[0] == target.xyz[0] && pose.xyz[2] == target.xyz[2]);
+    return ticks;
+}
+
+void test_arch(void)
+{
+    check_s_curve(0.305f);
+    check_s_curve(0.025f);
+    check_s_curve(0.001f);
+
+    static planner_queue_t planner;
+    delta_pose_t pick = {{q16_16_from_float(-0.15f), 0, q16_16_from_float(-0.40f)}};
+    bool blended = true;
+    planner_init(&planner, 1000U);
+    planner.current_pose = pick;
+    int stop_and_go = run_arch(&planner, 0, &blended);
+    assert(!blended);
+
+    planner_init(&planner, 1000U);
+    planner.current_pose = pick;
+    int rounded = run_arch(&planner, q16_16_from_float(0.010f), &blended);
+    assert(blended);
+    assert(rounded < stop_and_go);
+
+    /* G100 queues one arch block from the current position */
+    static gcode_parser_t parser;
+    planner_init(&planner, 1000U);
+    gcode_parser_init(&parser);
+    gcode_parser_process_line(&parser, "G100 X0.1 Y0 Z-0.4 H0.02 R0.005 F60", &planner);
+    const planner_block_t *block = planner_active_block(&planner);
+    assert(block != NULL && block->arch && block->shape.fall.distance > 0.41f);
+    gcode_parser_process_line(&parser, "G100 X0.2 Z-0.4", &planner);
+    assert(planner.head == 1U);
+}
@@ -0,0 +1,137 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include <assert.h>
+#include <string.h>
+
+#define DRIVES DELTA_JOINT_COUNT /* the rig configures one drive per joint */
+
+static sim_rig_t s_rig;
+
+static bool all_enabled(void)
+{
+    for (int axis = 0; axis < DRIVES; ++axis) {
+        if (!cia402_axis_is_enabled(&s_rig.axes[axis])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void cycle(void)
+{
+    for (int axis = 0; axis < DRIVES; ++axis) {
+        cia402_axis_update(&s_rig.axes[axis], &s_rig.master.slaves[axis].txpdo);
+        ethcat_rxpdo_t rx;
+        cia402_axis_build_rxpdo(&s_rig.axes[axis], &rx);
+        ethcat_master_set_target(&s_rig.master, axis, &rx);
+    }
+    assert(ethcat_master_send_process_data(&s_rig.master));
+    ethcat_master_process(&s_rig.master);
+}
+
+static void setup(uint16_t boot_cycles)
+{
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {4U, q16_16_from_float(0.002f), Q16_16_ONE, boot_cycles};
+    sim_rig_connect(&s_rig, &dynamics);
+    /* first exchange brings the drives' own statuswords */
+    assert(ethcat_master_send_process_data(&s_rig.master));
+    ethcat_master_process(&s_rig.master);
+    for (int axis = 0; axis < DRIVES; ++axis) {
+        cia402_axis_init(&s_rig.axes[axis], CIA402_MODE_CSP);
+    }
+}
+
+void test_cia402_enable(void)
+{
+    ethcat_txpdo_t feedback;
+    memset(&feedback, 0, sizeof(feedback));
+    cia402_axis_t probe;
+    cia402_axis_init(&probe, CIA402_MODE_CSP);
+    feedback.statusword = 0x0008U;
+    cia402_axis_update(&probe, &feedback);
+    assert(probe.state == CIA402_STATE_FAULT);
+    feedback.statusword = 0x000FU;
+    cia402_axis_update(&probe, &feedback);
+    assert(probe.state == CIA402_STATE_FAULT_REACTION);
+    feedback.statusword = 0x0237U;
+    cia402_axis_update(&probe, &feedback);
+    assert(probe.state == CIA402_STATE_OPERATION_ENABLED);
+    feedback.statusword = 0x0217U;
+    cia402_axis_update(&probe, &feedback);
+    assert(probe.state == CIA402_STATE_QUICK_STOP_ACTIVE);
+
+    /* every axis walks Shutdown -> Switch On -> Enable Operation in parallel */
+    setup(0U);
+    for (int axis = 0; axis < DRIVES; ++axis) {
+        cia402_axis_enable(&s_rig.axes[axis]);
+    }
+    int cycles = 0;
+    while (!all_enabled() && cycles < 20) {
+        cycle();
+        ++cycles;
+    }
+    assert(all_enabled());
+    assert(cycles <= 6);
+    for (int axis = 0; axis < DRIVES; ++axis) {
+        assert(s_rig.axes[axis].enabled_after_cycles != 0U && s_rig.axes[axis].enabled_after_cycles <= 6U);
+    }
+
+    /* a fault is reset by a rising edge and the axis re-enables on its own */
+    ecat_sim_inject_emcy(&s_rig.sim, 1, 0x2310U);
+    bool faulted = false;
+    for (cycles = 0; cycles < 200 && (!faulted || !all_enabled()); ++cycles) {
+        cycle();
+        faulted = faulted || s_rig.axes[1].state == CIA402_STATE_FAULT;
+    }
+    assert(faulted && all_enabled());
+
+    /* a drive stuck in Not Ready to Switch On times out instead of hanging */
+    setup(60000U);
+    cia402_axis_enable(&s_rig.axes[0]);
+    assert(s_rig.axes[0].timeout_cycles == CIA402_TRANSITION_TIMEOUT_MS);
+    for (cycles = 0; cycles < (int)s_rig.axes[0].timeout_cycles + 2; ++cycles) {
+        cycle();
+    }
+    assert(s_rig.axes[0].enable_timeout && !cia402_axis_is_enabled(&s_rig.axes[0]));
+    ecat_sim_detach(&s_rig.sim);
+
+    /* M17 from the boot state: the controller's pose starts at the origin, outside the
+     * workspace, and is only read back from the drives once they are enabled */
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {4U, q16_16_from_float(0.002f), Q16_16_ONE, 3U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    delta_pose_t start = {{q16_16_from_float(0.05f), 0, q16_16_from_float(-0.3f)}};
+    sim_rig_rest(&s_rig, &start);
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    assert(command_queue_enqueue(&s_rig.queue, "G1 Z-0.31 F6"));
+    sim_rig_cycle(&s_rig);
+    for (cycles = 1; cycles < 200 && !s_rig.motion.drives_ready; ++cycles) {
+        sim_rig_cycle(&s_rig);
+        for (int axis = 0; axis < DRIVES; ++axis) {
+            /* the setpoints follow the drives, enabling does not jump */
+            assert(!s_rig.axes[axis].quick_stop);
+            assert(s_rig.master.slaves[axis].rxpdo.target_position == s_rig.sim.slaves[axis].position);
+        }
+    }
+    assert(s_rig.motion.drives_ready && cycles <= 10);
+    const q16_16_t close = q16_16_from_float(1e-4f);
+    for (int i = 0; i < 3; ++i) {
+        assert(q16_16_abs(s_rig.motion.command_pose.xyz[i] - start.xyz[i]) < close);
+        /* the line behind M17 was parsed from the pose read back */
+        q16_16_t end = i == 2 ? q16_16_from_float(-0.31f) : start.xyz[i];
+        assert(q16_16_abs(s_rig.planner.current_pose.xyz[i] - end) < close);
+        assert(q16_16_abs(s_rig.parser.current_pose.xyz[i] - end) < close);
+    }
+    /* and runs from there, not from the origin */
+    for (cycles = 0; cycles < 400 && !planner_is_settled(&s_rig.planner); ++cycles) {
+        sim_rig_cycle(&s_rig);
+        assert(q16_16_abs(s_rig.motion.command_pose.xyz[0] - start.xyz[0]) < close);
+    }
+    for (int i = 0; i < 200; ++i) {
+        sim_rig_cycle(&s_rig);
+    }
+    assert(q16_16_abs(s_rig.motion.command_pose.xyz[2] - q16_16_from_float(-0.31f)) < close);
+    ecat_sim_detach(&s_rig.sim);
+}
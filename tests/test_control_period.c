@@ -0,0 +1,76 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include "../gcode/console.h"
+#include "../drivers/uart.h"
+#include "../utils/timer.h"
+#include <assert.h>
+
+static sim_rig_t s_rig;
+
+static void cycle(void)
+{
+    motion_controller_tick(&s_rig.motion);
+    ethcat_master_send_process_data(&s_rig.master);
+    ethcat_master_process(&s_rig.master);
+}
+
+static void assert_period(uint32_t period_us)
+{
+    assert(s_rig.planner.control_period_us == period_us);
+    assert(s_rig.master.cycle_time_ns == period_us * 1000U);
+    assert(timer_get_tick_period_us() == period_us);
+    /* the enable timeout is a time, not a cycle count */
+    assert(s_rig.axes[0].timeout_cycles * period_us == CIA402_TRANSITION_TIMEOUT_MS * 1000U);
+}
+
+void test_control_period(void)
+{
+    sim_rig_configure(&s_rig);
+    s_rig.config.control_period_us = CONTROL_PERIOD_FAST_US;
+    ecat_sim_dynamics_t dynamics = {2U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.3f)}};
+    sim_rig_rest(&s_rig, &start);
+    console_t console;
+    console_init(&console, &s_rig.queue, &s_rig.master, &s_rig.motion, &s_rig.config);
+
+    /* nothing measured yet: slowing down is allowed, speeding up is not */
+    assert(motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_MAX_US));
+    assert_period(CONTROL_PERIOD_MAX_US);
+    assert(!motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_FAST_US));
+    assert_period(CONTROL_PERIOD_MAX_US);
+
+    /* outside the range or not a divisor of the slowest period */
+    assert(!motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_MIN_US / 2U));
+    assert(!motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_MAX_US * 2U));
+    assert(!motion_controller_set_period(&s_rig.motion, 300U));
+    assert(!console_execute(&console, "$CYCLE=2000"));
+    assert(!console_execute(&console, "$CYCLE=fast"));
+    assert(!console_execute(&console, "$CYCLE="));
+    assert_period(CONTROL_PERIOD_MAX_US);
+
+    /* a measured tick within the budget of the faster period */
+    histogram_record(&s_rig.master.stats.hist[CYCLE_STAT_TICK_DURATION], 50000U);
+    assert(console_execute(&console, "$CYCLE=250"));
+    assert_period(CONTROL_PERIOD_MIN_US);
+    assert(s_rig.config.control_period_us == CONTROL_PERIOD_MIN_US);
+    histogram_record(&s_rig.master.stats.hist[CYCLE_STAT_TICK_DURATION], 200000U);
+    assert(!motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_MIN_US));
+
+    /* enabled drives keep the period they were switched on with */
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        cia402_axis_enable(&s_rig.axes[axis]);
+    }
+    for (int cycles = 0; cycles < 200 && !s_rig.motion.drives_ready; ++cycles) {
+        cycle();
+    }
+    assert(s_rig.motion.drives_ready);
+    assert(!console_execute(&console, "$CYCLE=1000"));
+    assert(!motion_controller_set_period(&s_rig.motion, CONTROL_PERIOD_MAX_US));
+    assert_period(CONTROL_PERIOD_MIN_US);
+    assert(s_rig.config.control_period_us == CONTROL_PERIOD_MIN_US);
+
+    uart_set_realtime_handler(NULL, NULL);
+    timer_set_tick_period_us(CONTROL_PERIOD_US);
+}
@@ -0,0 +1,194 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include "../planner/lookahead.h"
+#include <assert.h>
+#include <math.h>
+
+#define BELT_SPEED 0.2f     /* m/s */
+#define BELT_SCALE 0.05f    /* m per rad of the belt drive */
+#define CYCLE_NS 1000000U
+
+static q16_16_t belt_raw(float metres)
+{
+    return q16_16_from_float(metres / BELT_SCALE);
+}
+
+static void estimator_checks(void)
+{
+    conveyor_sync_t sync;
+    const q16_16_t direction[3] = {Q16_16_ONE, 0, 0};
+    conveyor_sync_configure(&sync, 0, direction, q16_16_from_float(BELT_SCALE), 2000000U);
+    assert(conveyor_sync_enabled(&sync));
+
+    /* a constant belt speed is estimated without lag */
+    for (uint32_t k = 0U; k <= 400U; ++k) {
+        conveyor_sync_sample(&sync, belt_raw(BELT_SPEED * (float)k * 1e-3f), (uint64_t)k * CYCLE_NS);
+    }
+    assert(fabsf(sync.velocity - BELT_SPEED) < 1e-3f);
+    assert(fabsf(sync.position - BELT_SPEED * 0.4f) < 1e-4f);
+
+    /* the lead covers the sample age, the output cycle and the drive latency */
+    conveyor_sync_step(&sync, 401ULL * CYCLE_NS, CYCLE_NS);
+    assert(fabsf(sync.lead_position - BELT_SPEED * (0.401f + 0.001f + 0.002f)) < 2e-4f);
+
+    /* engaging blends the belt velocity in, no offset jump */
+    conveyor_sync_engage(&sync, true);
+    float previous = sync.offset;
+    float max_step = 0.0f;
+    uint32_t k = 401U;
+    while (conveyor_sync_ramping(&sync)) {
+        conveyor_sync_sample(&sync, belt_raw(BELT_SPEED * (float)k * 1e-3f), (uint64_t)k * CYCLE_NS);
+        conveyor_sync_step(&sync, (uint64_t)(k + 1U) * CYCLE_NS, CYCLE_NS);
+        float step = sync.offset - previous;
+        assert(step >= max_step - 1e-6f);
+        max_step = step;
+        previous = sync.offset;
+        ++k;
+    }
+    assert(fabsf(max_step - BELT_SPEED * 1e-3f) < 2e-5f);
+
+    /* a missing encoder ramps the extrapolated belt to rest instead of stopping it dead */
+    float last_step = max_step;
+    float last_offset = sync.offset;
+    float max_change = 0.0f;
+    uint32_t ramp_cycles = CONVEYOR_RAMP_MS * 1000000U / CYCLE_NS;
+    for (uint32_t i = 0U; i < CONVEYOR_STALE_CYCLES + ramp_cycles + 10U; ++i) {
+        conveyor_sync_step(&sync, (uint64_t)(k + 1U + i) * CYCLE_NS, CYCLE_NS);
+        float step = sync.offset - last_offset;
+        assert(step <= last_step + 1e-6f);
+        max_change = fmaxf(max_change, last_step - step);
+        last_step = step;
+        last_offset = sync.offset;
+    }
+    assert(sync.stale && fabsf(last_step) < 1e-7f);
+    assert(max_change < 2.0f * BELT_SPEED * 1e-3f / (float)ramp_cycles);
+
+    /* the drive position wraps, the belt does not */
+    conveyor_sync_configure(&sync, 0, direction, Q16_16_ONE / 64, 0U);
+    q16_16_t raw = INT32_MAX - 200 * 65536;
+    for (uint32_t i = 0U; i <= 200U; ++i) {
+        conveyor_sync_sample(&sync, raw, (uint64_t)i * CYCLE_NS);
+        raw = (q16_16_t)((uint32_t)raw + 2U * 65536U);
+    }
+    assert(fabsf(sync.velocity - (2.0f / 64.0f) * 1000.0f) < 0.5f);
+}
+
+static void belt_rig(sim_rig_t *rig, const delta_pose_t *start)
+{
+    sim_rig_configure(rig);
+    rig->config.slave_count = DELTA_JOINT_COUNT + 1U;
+    rig->config.slaves[3] = (ecat_slave_descriptor_t){0xabU, 0x1020U, 4U, ECAT_ROLE_AUX_AXIS, 1U, 0U, 0U};
+    /* virtual drives for the arm, the belt encoder is written over the aux drive's feedback */
+    ecat_sim_dynamics_t dynamics = {2U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(rig, &dynamics);
+    sim_rig_init_motion(rig);
+    const q16_16_t direction[3] = {Q16_16_ONE, 0, 0};
+    assert(motion_controller_set_conveyor(&rig->motion, 1, direction, q16_16_from_float(BELT_SCALE), 2000U));
+    assert(rig->motion.conveyor.slave == 3);
+    sim_rig_rest(rig, start);
+    sim_rig_enable(rig);
+}
+
+static void belt_tick(sim_rig_t *rig, uint32_t k)
+{
+    /* the belt runs all along, the sample of each cycle is latched one cycle before it is read */
+    ethcat_master_send_process_data(&rig->master);
+    ethcat_master_process(&rig->master);
+    rig->master.input_time_ns = (uint64_t)(k - 1U) * CYCLE_NS;
+    rig->master.time_ns = (uint64_t)k * CYCLE_NS;
+    rig->master.slaves[3].txpdo.position_actual = belt_raw(BELT_SPEED * (float)(k - 1U) * 1e-3f);
+    motion_controller_tick(&rig->motion);
+    command_processor_step(&rig->queue, &rig->runtime, &rig->parser, &rig->planner, rig->axes, DELTA_JOINT_COUNT);
+}
+
+static void tracking_checks(void)
+{
+    static sim_rig_t rig;
+    delta_pose_t start = {{q16_16_from_float(-0.1f), 0, q16_16_from_float(-0.35f)}};
+    belt_rig(&rig, &start);
+    uint32_t k = 1U;
+    #define TICK() belt_tick(&rig, k++)
+    for (int i = 0; i < 300; ++i) {
+        TICK();
+    }
+    assert(rig.motion.conveyor.offset == 0.0f);
+
+    /* M200: the tool is carried along with the belt */
+    assert(command_queue_enqueue(&rig.queue, "M200"));
+    for (int i = 0; i < 400; ++i) {
+        TICK();
+    }
+    assert(rig.planner.frame == PLANNER_FRAME_CONVEYOR);
+    float x0 = q16_16_to_float(rig.motion.shaped_pose.xyz[0]);
+    for (int i = 0; i < 100; ++i) {
+        TICK();
+    }
+    float speed = (q16_16_to_float(rig.motion.shaped_pose.xyz[0]) - x0) / 0.1f;
+    assert(fabsf(speed - BELT_SPEED) < 2e-3f);
+    assert(q16_16_abs(rig.motion.command_pose.xyz[0] - start.xyz[0]) < q16_16_from_float(1e-4f));
+
+    /* M201: the belt offset is folded into the machine pose without a jump */
+    assert(command_queue_enqueue(&rig.queue, "M201"));
+    assert(command_queue_enqueue(&rig.queue, "G1 X-0.1 F1"));
+    TICK();
+    float released = q16_16_to_float(rig.motion.shaped_pose.xyz[0]);
+    int cycles = 0;
+    while (rig.planner.frame != PLANNER_FRAME_FIXED && cycles < 1000) {
+        TICK();
+        ++cycles;
+    }
+    assert(rig.planner.frame == PLANNER_FRAME_FIXED);
+    float stopped = q16_16_to_float(rig.motion.shaped_pose.xyz[0]);
+    assert(stopped > released && stopped - released < BELT_SPEED * 0.1f);
+    assert(fabsf(q16_16_to_float(rig.motion.command_pose.xyz[0]) - stopped) < 1e-4f);
+    /* the parser resumed from the folded pose, the queued move was held back */
+    TICK();
+    assert(fabsf(q16_16_to_float(rig.parser.current_pose.xyz[0]) + 0.1f) < 1e-4f);
+    assert(!planner_is_empty(&rig.planner));
+    #undef TICK
+}
+
+static void reach_checks(void)
+{
+    static sim_rig_t rig;
+    delta_pose_t start = {{q16_16_from_float(0.05f), 0, q16_16_from_float(-0.35f)}};
+    belt_rig(&rig, &start);
+    planner_set_reach_check(&rig.planner, true);
+    uint32_t k = 1U;
+    assert(command_queue_enqueue(&rig.queue, "M200"));
+    for (int i = 0; i < 300; ++i) {
+        belt_tick(&rig, k++);
+    }
+    assert(rig.planner.frame == PLANNER_FRAME_CONVEYOR);
+    float offset = q16_16_to_float(rig.planner.frame_offset.xyz[0]);
+    assert(offset > 0.03f);
+
+    /* a belt-frame move is checked where the belt has taken it, not only in the fixed frame */
+    delta_pose_t target = {{q16_16_from_float(0.19f - offset * 0.5f), 0, start.xyz[2]}};
+    assert(lookahead_validate_segment(&start, &target) == PLANNER_ERROR_NONE);
+    assert(!planner_push_line(&rig.planner, &target, q16_16_from_float(0.05f), q16_16_from_float(1.0f), q16_16_from_float(50.0f)));
+    assert(rig.planner.error == PLANNER_ERROR_UNREACHABLE && planner_is_empty(&rig.planner));
+
+    /* the belt heads for the soft limit: tracking is released with a hold, not a quick stop */
+    assert(command_queue_enqueue(&rig.queue, "G1 X0.06 F0.01"));
+    float max_x = 0.0f;
+    for (int i = 0; i < 1500 && rig.runtime.state != CNC_STATE_ALARM; ++i) {
+        belt_tick(&rig, k++);
+        max_x = fmaxf(max_x, q16_16_to_float(rig.motion.shaped_pose.xyz[0]));
+        for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+            assert(!rig.axes[axis].quick_stop);
+        }
+    }
+    assert(rig.runtime.state == CNC_STATE_ALARM);
+    assert(rig.planner.frame == PLANNER_FRAME_FIXED && planner_is_empty(&rig.planner) && !rig.planner.held);
+    assert(max_x <= 0.2f && rig.motion.drives_ready);
+    belt_tick(&rig, k++);
+    assert(q16_16_abs(rig.parser.current_pose.xyz[0] - rig.motion.command_pose.xyz[0]) < q16_16_from_float(1e-4f));
+}
+
+void test_conveyor(void)
+{
+    estimator_checks();
+    tracking_checks();
+    reach_checks();
+}
@@ -0,0 +1,36 @@
+#include "test_suite.h"
+#include "../ethcat/cycle_stats.h"
+#include "../utils/timer.h"
+#include <assert.h>
+
+void test_cycle_stats(void)
+{
+    histogram_t hist;
+    histogram_reset(&hist);
+    for (uint32_t value = 1U; value <= 1000U; ++value) {
+        histogram_record(&hist, value);
+    }
+    assert(hist.count == 1000U && hist.min == 1U && hist.max == 1000U);
+    uint32_t p50 = histogram_percentile(&hist, 500U);
+    assert(p50 >= 500U && p50 <= 767U);
+    assert(histogram_percentile(&hist, 1000U) == 1000U);
+    assert(histogram_mean(&hist) == 500U);
+
+    cycle_stats_t stats;
+    cycle_stats_init(&stats, 1000000U);
+    uint32_t period = 1000U * TIMER_CYCLES_PER_US;
+    uint32_t now = 0U;
+    for (int cycle = 0; cycle < 10; ++cycle) {
+        now += period;
+        cycle_stats_sync0(&stats, now, now + TIMER_CYCLES_PER_US);
+    }
+    now += 3U * period; /* two Sync0 events never serviced */
+    cycle_stats_sync0(&stats, now, now + TIMER_CYCLES_PER_US);
+    assert(stats.missed_cycles == 2U);
+    assert(stats.hist[CYCLE_STAT_ISR_LATENCY].max == 1000U);
+    assert(stats.hist[CYCLE_STAT_SYNC0_JITTER].count == 10U);
+
+    cycle_stats_request_reset(&stats);
+    cycle_stats_sync0(&stats, now, now);
+    assert(stats.missed_cycles == 0U && stats.hist[CYCLE_STAT_ISR_LATENCY].count == 1U);
+}
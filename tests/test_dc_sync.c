@@ -0,0 +1,31 @@
+#include "test_suite.h"
+#include "../ethcat/dc_sync.h"
+#include <assert.h>
+
+void test_dc_sync(void)
+{
+    const uint32_t port0[3] = {0U, 120U, 240U};
+    const uint32_t port1[3] = {600U, 480U, 360U};
+    int32_t delays[3];
+    dc_sync_t dc;
+    dc_sync_init(&dc, 1000000U);
+    assert(dc_sync_measure_delays(&dc, port0, port1, 3, delays));
+    assert(delays[0] == 0 && delays[1] == 120 && delays[2] == 240);
+    assert(dc.propagation_delay_ns == 300);
+
+    /* local clock runs 50 ppm fast and starts 3 us off the reference; the
+     * measured delay stays applied, so the loop settles that far ahead of it */
+    dc_sync_start(&dc);
+    int64_t phase = 3000;
+    uint64_t cycle_start = 0U;
+    for (int cycle = 0; cycle < 400; ++cycle) {
+        cycle_start += 1000000U;
+        phase += 50;
+        phase += dc_sync_update(&dc, cycle_start + (uint64_t)phase);
+    }
+    assert(dc_sync_is_locked(&dc));
+    assert(dc.offset_ns > -DC_SYNC_LOCK_THRESHOLD_NS && dc.offset_ns < DC_SYNC_LOCK_THRESHOLD_NS);
+    assert(dc.drift_ppb > 45000 && dc.drift_ppb < 55000);
+    assert(dc.propagation_delay_ns == 300);
+    assert(phase - dc.propagation_delay_ns > -DC_SYNC_LOCK_THRESHOLD_NS && phase - dc.propagation_delay_ns < DC_SYNC_LOCK_THRESHOLD_NS);
+}
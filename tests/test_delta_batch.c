@@ -0,0 +1,139 @@
+#include "test_suite.h"
+#include "../kinematics/delta_batch.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define GRID_XY 45
+#define GRID_Z 23
+#define GRID_COUNT (GRID_XY * GRID_XY * GRID_Z)
+
+static float s_xyz[3][GRID_COUNT];
+static double s_xyz_f64[3][GRID_COUNT];
+static float s_theta[3][GRID_COUNT];
+static double s_theta_f64[3][GRID_COUNT];
+static float s_round[3][GRID_COUNT];
+static double s_round_f64[3][GRID_COUNT];
+static uint8_t s_valid[GRID_COUNT];
+static uint8_t s_valid_f64[GRID_COUNT];
+static uint8_t s_round_valid[GRID_COUNT];
+
+static void setup_kinematics(delta_cfg_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->R_base = q16_16_from_float(0.300f);
+    cfg->r_eff = q16_16_from_float(0.100f);
+    cfg->L_upper = q16_16_from_float(0.300f);
+    cfg->L_lower = q16_16_from_float(0.400f);
+    cfg->z_offset = q16_16_from_float(0.200f);
+    for (int axis = 0; axis < 3; ++axis) {
+        cfg->soft_xyz_min[axis] = q16_16_from_float(axis == 2 ? -0.5f : -0.2f);
+        cfg->soft_xyz_max[axis] = q16_16_from_float(axis == 2 ? -0.1f : 0.2f);
+    }
+    delta_init(cfg);
+}
+
+/* a grid a little wider than the soft limits, on Q16.16 values so the scalar
+ * path sees the same poses; z = -z_offset divides by zero in delta.c, kept off the grid */
+static void fill_grid(void)
+{
+    size_t n = 0U;
+    for (int k = 0; k < GRID_Z; ++k) {
+        for (int j = 0; j < GRID_XY; ++j) {
+            for (int i = 0; i < GRID_XY; ++i) {
+                q16_16_t q[3] = {q16_16_from_float(-0.22f + 0.01f * (float)i), q16_16_from_float(-0.22f + 0.01f * (float)j),
+                                 q16_16_from_float(-0.51f + 0.02f * (float)k)};
+                for (int axis = 0; axis < 3; ++axis) {
+                    s_xyz[axis][n] = q16_16_to_float(q[axis]);
+                    s_xyz_f64[axis][n] = (double)q[axis] / 65536.0;
+                }
+                ++n;
+            }
+        }
+    }
+}
+
+static size_t inverse_all(const delta_batch_t *batch)
+{
+    const float *const in[3] = {s_xyz[0], s_xyz[1], s_xyz[2]};
+    float *const out[3] = {s_theta[0], s_theta[1], s_theta[2]};
+    const double *const in_f64[3] = {s_xyz_f64[0], s_xyz_f64[1], s_xyz_f64[2]};
+    double *const out_f64[3] = {s_theta_f64[0], s_theta_f64[1], s_theta_f64[2]};
+    size_t count = delta_batch_inverse_f32(batch, in, out, s_valid, GRID_COUNT);
+    assert(delta_batch_inverse_f64(batch, in_f64, out_f64, s_valid_f64, GRID_COUNT) == count);
+    return count;
+}
+
+void test_delta_batch(void)
+{
+    delta_cfg_t cfg;
+    setup_kinematics(&cfg);
+    fill_grid();
+    delta_batch_t batch;
+    delta_batch_init(&batch, &cfg);
+
+    /* every instruction set and thread count agrees with the scalar path */
+    size_t reference = 0U;
+    for (size_t n = 0U; n < GRID_COUNT; ++n) {
+        delta_pose_t pose = {{q16_16_from_float(s_xyz[0][n]), q16_16_from_float(s_xyz[1][n]), q16_16_from_float(s_xyz[2][n])}};
+        delta_joint_t joints;
+        reference += delta_inverse_kinematics(&pose, &joints) ? 1U : 0U;
+    }
+    assert(reference > GRID_COUNT / 4U && reference < GRID_COUNT);
+    for (int isa = DELTA_BATCH_SCALAR; isa <= DELTA_BATCH_AVX2; ++isa) {
+        if (!delta_batch_set_isa(&batch, (delta_batch_isa_t)isa)) {
+            continue;
+        }
+        for (unsigned threads = 1U; threads <= 4U; threads += 3U) {
+            delta_batch_set_threads(&batch, threads);
+            assert(inverse_all(&batch) == reference);
+            for (size_t n = 0U; n < GRID_COUNT; ++n) {
+                delta_pose_t pose = {{q16_16_from_float(s_xyz[0][n]), q16_16_from_float(s_xyz[1][n]), q16_16_from_float(s_xyz[2][n])}};
+                delta_joint_t joints;
+                bool valid = delta_inverse_kinematics(&pose, &joints);
+                assert(s_valid[n] == valid && s_valid_f64[n] == valid);
+                for (int j = 0; valid && j < 3; ++j) {
+                    float scalar = q16_16_to_float(joints.theta[j]);
+                    assert(fabsf(s_theta[j][n] - scalar) < 2e-5f);
+                    assert(fabs(s_theta_f64[j][n] - (double)scalar) < 1e-4); /* the float scalar path is the coarser one near the rim */
+                }
+            }
+        }
+    }
+
+    /* forward kinematics returns the pose in the working volume; past an
+     * upper arm angle of -90 degrees the scalar atan() folds, keep clear of it */
+    delta_batch_init(&batch, &cfg);
+    inverse_all(&batch);
+    const float *const joints[3] = {s_theta[0], s_theta[1], s_theta[2]};
+    float *const poses[3] = {s_round[0], s_round[1], s_round[2]};
+    const double *const joints_f64[3] = {s_theta_f64[0], s_theta_f64[1], s_theta_f64[2]};
+    double *const poses_f64[3] = {s_round_f64[0], s_round_f64[1], s_round_f64[2]};
+    delta_batch_forward_f32(&batch, joints, poses, s_round_valid, GRID_COUNT);
+    delta_batch_forward_f64(&batch, joints_f64, poses_f64, NULL, GRID_COUNT);
+    size_t checked = 0U;
+    for (size_t n = 0U; n < GRID_COUNT; ++n) {
+        if (!s_valid[n] || s_xyz[2][n] > -0.3f || fabsf(s_theta[0][n]) > 1.3f || fabsf(s_theta[1][n]) > 1.3f || fabsf(s_theta[2][n]) > 1.3f) {
+            continue;
+        }
+        assert(s_round_valid[n] || fabsf(s_xyz[0][n]) > 0.19f || fabsf(s_xyz[1][n]) > 0.19f || s_xyz[2][n] < -0.49f);
+        for (int axis = 0; axis < 3; ++axis) {
+            assert(fabsf(s_round[axis][n] - s_xyz[axis][n]) < 1e-5f);
+            assert(fabs(s_round_f64[axis][n] - s_xyz_f64[axis][n]) < 1e-12);
+        }
+        ++checked;
+    }
+    assert(checked > GRID_COUNT / 4U);
+
+    /* a batch that is not a whole number of lane groups keeps its tail */
+    const float *const in[3] = {s_xyz[0], s_xyz[1], s_xyz[2]};
+    float *const out[3] = {s_round[0], s_round[1], s_round[2]};
+    memset(s_round, 0, sizeof(s_round));
+    size_t tail = delta_batch_inverse_f32(&batch, in, out, NULL, 1003U);
+    size_t expected = 0U;
+    for (size_t n = 0U; n < 1003U; ++n) {
+        expected += s_valid[n];
+        assert(s_round[0][n] == s_theta[0][n] && s_round[2][n] == s_theta[2][n]);
+    }
+    assert(tail == expected && s_round[0][1003] == 0.0f);
+}
@@ -0,0 +1,147 @@
+#include "test_suite.h"
+#include "../sim/ecat_sim.h"
+#include "../drivers/eth_mac.h"
+#include <assert.h>
+#include <string.h>
+
+static ethcat_master_t s_master;
+static ecat_sim_t s_sim;
+
+static void exchange(uint16_t controlword, q16_16_t target)
+{
+    for (int slave = 0; slave < s_master.slave_count; ++slave) {
+        if (!ethcat_master_is_drive(&s_master.slaves[slave])) {
+            continue;
+        }
+        ethcat_rxpdo_t rx = s_master.slaves[slave].rxpdo;
+        rx.controlword = controlword;
+        rx.target_position = target;
+        ethcat_master_set_target(&s_master, slave, &rx);
+    }
+    assert(ethcat_master_send_process_data(&s_master));
+    ethcat_master_process(&s_master);
+}
+
+void test_ecat_sim(void)
+{
+    board_runtime_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.control_period_us = 500U;
+    config.default_mode_of_operation = CIA402_MODE_CSP;
+    config.slave_count = 4U;
+    for (int i = 0; i < 3; ++i) {
+        config.slaves[i] = (ecat_slave_descriptor_t){0xabU, 0x1000U + (uint32_t)i, (uint16_t)(i + 1), ECAT_ROLE_JOINT, (uint8_t)i, 0U, 0U};
+    }
+    config.slaves[3] = (ecat_slave_descriptor_t){0x2U, 0x07113052U, 4U, ECAT_ROLE_IO, 0U, 0U, 2U};
+
+    eth_mac_config_t mac = {.mac_address = {0x02, 0, 0, 0, 0, 1}, .phy_address = 0U, .cycle_time_ns = 0U};
+    eth_mac_init(&mac, NULL, NULL);
+    ethcat_master_init(&s_master, &config);
+    assert(ethcat_master_scan(&s_master));
+
+    ecat_sim_dynamics_t dynamics = {4U, q16_16_from_float(0.002f), Q16_16_ONE, 3U};
+    ecat_sim_init(&s_sim, &dynamics);
+    assert(ecat_sim_attach(&s_sim, &s_master));
+    assert(ethcat_master_configure(&s_master));
+    assert(ethcat_master_sdo_busy(&s_master));
+
+    /* downloads are queued and leave one mailbox frame per cycle; a drained pool only delays them */
+    uint8_t *held_buffers[4];
+    for (int i = 0; i < 4; ++i) {
+        held_buffers[i] = eth_mac_tx_borrow(NULL);
+        assert(held_buffers[i] != NULL);
+    }
+    ethcat_master_process(&s_master);
+    assert(s_sim.frames == 0U && !s_master.mailbox_pending);
+    for (int i = 0; i < 4; ++i) {
+        eth_mac_tx_submit(held_buffers[i], 0U);
+    }
+    for (int cycle = 0; cycle < 40 && ethcat_master_sdo_busy(&s_master); ++cycle) {
+        exchange(0x0000U, 0);
+    }
+    assert(!ethcat_master_sdo_busy(&s_master));
+
+    /* CoE downloads reach the virtual object dictionary: 500 us = 5 * 10^-4 s */
+    uint32_t value = 0U;
+    assert(ecat_sim_get_object(&s_sim, 1, 0x60C2U, 0x01U, &value) && value == 5U);
+    assert(ecat_sim_get_object(&s_sim, 1, 0x60C2U, 0x02U, &value) && (int8_t)value == -4);
+    assert(s_sim.slaves[1].mailbox_aborts == 0U && s_master.sdo_aborts == 0U);
+
+    /* the drive answers through mailbox-in: a wrong size comes back as an abort */
+    assert(ethcat_master_sdo_write(&s_master, 1, 0x60C2U, 0x01U, 2U, 4U));
+    for (int cycle = 0; cycle < 4 && ethcat_master_sdo_busy(&s_master); ++cycle) {
+        exchange(0x0000U, 0);
+    }
+    assert(s_master.sdo_aborts == 1U && s_master.sdo_abort_code == 0x06070010U);
+    assert(s_master.sdo_abort_index == 0x60C2U && s_master.sdo_abort_subindex == 0x01U);
+    assert(!ethcat_master_sdo_read(&s_master, 1, 0x60C2U, 0x01U, &value));
+    assert(ecat_sim_get_object(&s_sim, 1, 0x60C2U, 0x01U, &value) && value == 5U);
+    assert(ethcat_master_sdo_write(&s_master, 1, 0x60C2U, 0x01U, 5U, 1U));
+    for (int cycle = 0; cycle < 4 && ethcat_master_sdo_busy(&s_master); ++cycle) {
+        exchange(0x0000U, 0);
+    }
+    assert(ethcat_master_sdo_read(&s_master, 1, 0x60C2U, 0x01U, &value) && value == 5U);
+    assert(s_master.sdo_aborts == 1U);
+
+    /* the virtual drive only follows the CiA-402 state graph */
+    for (int cycle = 0; cycle < 5; ++cycle) {
+        exchange(0x000FU, 0);
+    }
+    assert(s_master.process_data_valid);
+    assert((s_master.slaves[0].txpdo.statusword & 0x006FU) == 0x0040U);
+    exchange(0x0006U, 0);
+    assert((s_master.slaves[0].txpdo.statusword & 0x006FU) == 0x0021U);
+    exchange(0x000FU, 0);
+    exchange(0x000FU, 0);
+    assert((s_master.slaves[0].txpdo.statusword & 0x006FU) == 0x0027U);
+
+    /* following lag: the actual position trails a step and then settles */
+    q16_16_t target = q16_16_from_float(0.25f);
+    exchange(0x000FU, target);
+    assert(s_master.slaves[0].txpdo.position_actual < target / 2);
+    for (int cycle = 0; cycle < 400; ++cycle) {
+        exchange(0x000FU, target);
+    }
+    assert(q16_16_abs(s_master.slaves[2].txpdo.position_actual - target) < q16_16_from_float(0.001f));
+
+    /* injected EMCY faults the drive until a fault-reset edge */
+    ecat_sim_inject_emcy(&s_sim, 1, 0x7121U);
+    for (int cycle = 0; cycle < 300; ++cycle) {
+        exchange(0x000FU, target);
+    }
+    assert((s_master.slaves[1].txpdo.statusword & 0x004FU) == 0x0008U);
+    assert(s_master.slaves[1].txpdo.emcy_code == 0x7121U);
+    exchange(0x0080U, target);
+    assert((s_master.slaves[1].txpdo.statusword & 0x004FU) == 0x0040U);
+    assert(s_master.slaves[1].txpdo.emcy_code == 0U);
+
+    const uint8_t inputs[2] = {0x5AU, 0xA5U};
+    ecat_sim_set_inputs(&s_sim, 3, inputs, 2U);
+    exchange(0x000FU, target);
+    assert(s_master.slaves[3].io_inputs[0] == 0x5AU && s_master.slaves[3].io_inputs[1] == 0xA5U);
+
+    /* a frame that never returns or returns unanswered leaves the last inputs, flagged stale */
+    assert(ethcat_master_send_process_data(&s_master));
+    assert(ethcat_master_send_process_data(&s_master));
+    assert(!s_master.process_data_valid && s_master.stats.lost_frames == 1U);
+    ethcat_master_process(&s_master);
+    assert(s_master.process_data_valid);
+    ecat_sim_detach(&s_sim);
+    ethcat_txpdo_t held = s_master.slaves[2].txpdo;
+    exchange(0x000FU, -target);
+    assert(!s_master.process_data_valid);
+    assert(s_master.slaves[2].txpdo.statusword == held.statusword && s_master.slaves[2].txpdo.position_actual == held.position_actual);
+
+    /* a joint index past the arm, an aux index past the table or a duplicate fails the scan */
+    static const uint8_t bad_index[3][2] = {{ECAT_ROLE_JOINT, DELTA_JOINT_COUNT}, {ECAT_ROLE_AUX_AXIS, ECAT_MAX_AUX_AXES}, {ECAT_ROLE_JOINT, 1U}};
+    for (int i = 0; i < 3; ++i) {
+        config.slaves[3] = (ecat_slave_descriptor_t){0xabU, 0x2000U, 4U, (ecat_slave_role_t)bad_index[i][0], bad_index[i][1], 0U, 0U};
+        ethcat_master_init(&s_master, &config);
+        assert(!ethcat_master_scan(&s_master));
+        assert(s_master.slaves[3].role == ECAT_ROLE_NONE && s_master.slaves[3].output_bytes == 0U);
+    }
+    config.slaves[3].role = ECAT_ROLE_AUX_AXIS;
+    config.slaves[3].axis_index = 0U;
+    ethcat_master_init(&s_master, &config);
+    assert(ethcat_master_scan(&s_master));
+}
@@ -0,0 +1,92 @@
+#include "test_suite.h"
+#include "../planner/planner.h"
+#include <assert.h>
+#include <math.h>
+
+static float distance(const delta_pose_t *a, const delta_pose_t *b)
+{
+    float sum = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        float diff = q16_16_to_float(a->xyz[axis] - b->xyz[axis]);
+        sum += diff * diff;
+    }
+    return sqrtf(sum);
+}
+
+void test_feed_hold(void)
+{
+    static planner_queue_t planner;
+    const float dt = 0.001f;
+    planner_init(&planner, 1000U);
+    planner.current_pose.xyz[2] = q16_16_from_float(-0.3f);
+    delta_pose_t targets[3] = {
+        {{0, 0, q16_16_from_float(-0.35f)}},
+        {{q16_16_from_float(0.05f), 0, q16_16_from_float(-0.35f)}},
+        {{q16_16_from_float(0.05f), q16_16_from_float(0.05f), q16_16_from_float(-0.35f)}},
+    };
+    for (int i = 0; i < 3; ++i) {
+        assert(planner_push_line(&planner, &targets[i], q16_16_from_float(0.1f), Q16_16_ONE, q16_16_from_int(5)));
+    }
+
+    delta_pose_t previous = {{0, 0, q16_16_from_float(-0.3f)}};
+    delta_pose_t pose;
+    float speed = 0.0f;
+    for (int i = 0; i < 900; ++i) {
+        assert(planner_step(&planner, &pose));
+        speed = distance(&pose, &previous) / dt;
+        previous = pose;
+    }
+    assert(speed > 0.05f);
+
+    /* the hold ramps the speed down instead of dropping it; speeds are taken
+     * over 10 cycles so position quantisation does not dominate */
+    uint16_t tail = planner.tail;
+    planner_hold(&planner);
+    int ticks = 0;
+    float max_change = 0.0f;
+    delta_pose_t window = previous;
+    while (!planner.held && ticks < 2000) {
+        assert(planner_step(&planner, &pose));
+        previous = pose;
+        if (++ticks % 10 == 0) {
+            float next = distance(&pose, &window) / (10.0f * dt);
+            if (fabsf(next - speed) > max_change) {
+                max_change = fabsf(next - speed);
+            }
+            speed = next;
+            window = pose;
+        }
+    }
+    assert(planner.held && ticks > 50);
+    assert(max_change < 0.02f);
+
+    /* frozen mid-block with every queued block still there */
+    const planner_block_t *block = planner_active_block(&planner);
+    assert(planner.tail == tail && block->tick_index > 0U && block->tick_index < block->total_ticks);
+    for (int i = 0; i < 100; ++i) {
+        assert(planner_step(&planner, &pose));
+        assert(distance(&pose, &previous) == 0.0f);
+    }
+    uint16_t queued = (uint16_t)((planner.head + PLANNER_QUEUE_LENGTH - planner.tail) % PLANNER_QUEUE_LENGTH);
+    assert(queued == 3U - tail);
+
+    /* resume continues along the same path to the last target */
+    planner_resume(&planner);
+    speed = 0.0f;
+    max_change = 0.0f;
+    window = previous;
+    for (ticks = 0; !planner_is_empty(&planner) && ticks < 5000;) {
+        planner_step(&planner, &pose);
+        if (++ticks % 10 == 0 && ticks <= 200) {
+            float next = distance(&pose, &window) / (10.0f * dt);
+            if (fabsf(next - speed) > max_change) {
+                max_change = fabsf(next - speed);
+            }
+            speed = next;
+            window = pose;
+        }
+    }
+    assert(planner_is_empty(&planner) && !planner_step(&planner, &pose));
+    assert(max_change < 0.02f);
+    assert(distance(&pose, &targets[2]) < 1e-4f);
+}
@@ -0,0 +1,218 @@
+#include "test_suite.h"
+#include "../utils/filter.h"
+#include "../motion/joint_filter.h"
+#include "sim_rig.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PERIOD_US 1000U
+#define PI 3.14159265358979
+
+/* |H(e^jw)| from the quantized coefficients */
+static double response(const biquad_coeffs_t *c, double frequency_hz)
+{
+    double w = 2.0 * PI * frequency_hz * (double)PERIOD_US * 1e-6;
+    double scale = 1.0 / (double)(1L << BIQUAD_COEFF_BITS);
+    double b[3] = {c->b0 * scale, c->b1 * scale, c->b2 * scale};
+    double a[3] = {1.0, c->a1 * scale, c->a2 * scale};
+    double num_re = b[0] + b[1] * cos(w) + b[2] * cos(2.0 * w);
+    double num_im = -b[1] * sin(w) - b[2] * sin(2.0 * w);
+    double den_re = a[0] + a[1] * cos(w) + a[2] * cos(2.0 * w);
+    double den_im = -a[1] * sin(w) - a[2] * sin(2.0 * w);
+    return sqrt((num_re * num_re + num_im * num_im) / (den_re * den_re + den_im * den_im));
+}
+
+/* steady-state amplitude of a unit sine through the bank, channel 0 */
+static double measure(biquad_bank_t *bank, double frequency_hz)
+{
+    biquad_bank_reset(bank, NULL);
+    double w = 2.0 * PI * frequency_hz * (double)PERIOD_US * 1e-6;
+    double in_phase = 0.0;
+    double quadrature = 0.0;
+    int settle = 4000;
+    /* whole periods of every tested frequency at 1 kHz */
+    int window = 2000;
+    for (int n = 0; n < settle + window; ++n) {
+        q16_16_t frame[BIQUAD_MAX_CHANNELS] = {0};
+        frame[0] = q16_16_from_float((float)sin(w * n));
+        biquad_bank_process(bank, frame, 1U);
+        if (n >= settle) {
+            double y = q16_16_to_float(frame[0]);
+            in_phase += y * sin(w * n);
+            quadrature += y * cos(w * n);
+        }
+    }
+    return 2.0 / window * sqrt(in_phase * in_phase + quadrature * quadrature);
+}
+
+static biquad_bank_t bank_of(biquad_type_t type, float frequency_hz, float q, int stages)
+{
+    biquad_bank_t bank;
+    biquad_coeffs_t coeffs;
+    biquad_bank_init(&bank, 1U);
+    assert(biquad_design(&coeffs, type, q16_16_from_float(frequency_hz), q16_16_from_float(q), PERIOD_US));
+    for (int i = 0; i < stages; ++i) {
+        assert(biquad_bank_add_stage(&bank, &coeffs));
+    }
+    return bank;
+}
+
+void test_filter(void)
+{
+    static const double frequencies[] = {5.0, 10.0, 30.0, 50.0, 100.0, 200.0, 400.0};
+    biquad_coeffs_t coeffs;
+
+    /* designs above Nyquist or without a bandwidth are refused */
+    assert(!biquad_design(&coeffs, BIQUAD_LOWPASS, q16_16_from_int(500), Q16_16_ONE, PERIOD_US));
+    assert(!biquad_design(&coeffs, BIQUAD_NOTCH, q16_16_from_int(30), 0, PERIOD_US));
+    assert(!biquad_design(&coeffs, BIQUAD_BANDPASS, 0, Q16_16_ONE, PERIOD_US));
+
+    /* the fixed-point lowpass follows its own transfer function, -3 dB at the corner */
+    static biquad_bank_t bank;
+    bank = bank_of(BIQUAD_LOWPASS, 100.0f, 0.7071f, 1);
+    for (size_t i = 0; i < sizeof(frequencies) / sizeof(frequencies[0]); ++i) {
+        double expected = response(&bank.stages[0], frequencies[i]);
+        assert(fabs(measure(&bank, frequencies[i]) - expected) < 2e-3);
+    }
+    assert(fabs(response(&bank.stages[0], 100.0) - 0.7071) < 1e-3);
+    /* two stages square it */
+    bank = bank_of(BIQUAD_LOWPASS, 100.0f, 0.7071f, 2);
+    assert(fabs(measure(&bank, 100.0) - 0.5) < 2e-3);
+
+    /* the notch removes the centre and leaves the band around it */
+    bank = bank_of(BIQUAD_NOTCH, 30.0f, 2.0f, 1);
+    assert(measure(&bank, 30.0) < 0.01);
+    assert(fabs(measure(&bank, 5.0) - 1.0) < 0.02 && fabs(measure(&bank, 200.0) - 1.0) < 0.02);
+
+    /* the bandpass peaks at unity on its centre */
+    bank = bank_of(BIQUAD_BANDPASS, 50.0f, 1.0f, 1);
+    assert(fabs(measure(&bank, 50.0) - 1.0) < 3e-3);
+    assert(measure(&bank, 5.0) < 0.15 && measure(&bank, 400.0) < 0.15);
+
+    /* a low corner still settles on the exact input value */
+    bank = bank_of(BIQUAD_LOWPASS, 2.0f, 0.7071f, 2);
+    q16_16_t step = q16_16_from_float(1.2345f);
+    q16_16_t out = 0;
+    for (int n = 0; n < 5000; ++n) {
+        out = step;
+        biquad_bank_process(&bank, &out, 1U);
+    }
+    assert(out == step);
+    /* a reset to a level starts settled there */
+    q16_16_t level = q16_16_from_float(-0.5f);
+    biquad_bank_reset(&bank, &level);
+    out = level;
+    biquad_bank_process(&bank, &out, 1U);
+    assert(out == level);
+
+    /* a block of interleaved frames matches frame by frame, channels stay apart */
+    static biquad_bank_t single;
+    static q16_16_t block[256][4];
+    static q16_16_t frames[256][4];
+    biquad_bank_init(&bank, 4U);
+    assert(biquad_design(&coeffs, BIQUAD_NOTCH, q16_16_from_int(30), q16_16_from_int(2), PERIOD_US));
+    biquad_bank_add_stage(&bank, &coeffs);
+    assert(biquad_design(&coeffs, BIQUAD_LOWPASS, q16_16_from_int(80), Q16_16_ONE, PERIOD_US));
+    biquad_bank_add_stage(&bank, &coeffs);
+    single = bank;
+    for (int n = 0; n < 256; ++n) {
+        for (int channel = 0; channel < 4; ++channel) {
+            block[n][channel] = channel == 2 ? 0 : q16_16_from_float((float)sin(0.1 * n * (channel + 1)));
+            frames[n][channel] = block[n][channel];
+        }
+    }
+    biquad_bank_process(&bank, &block[0][0], 256U);
+    for (int n = 0; n < 256; ++n) {
+        biquad_bank_process(&single, frames[n], 1U);
+    }
+    assert(memcmp(block, frames, sizeof(block)) == 0);
+    for (int n = 0; n < 256; ++n) {
+        assert(block[n][2] == 0);
+    }
+
+    /* joint velocity from the drives' position, a 2 rad/s ramp */
+    static ethcat_master_t master;
+    static joint_filter_t joint;
+    memset(&master, 0, sizeof(master));
+    master.slave_count = DELTA_JOINT_COUNT;
+    master.process_data_valid = true;
+    for (int slave = 0; slave < DELTA_JOINT_COUNT; ++slave) {
+        master.slaves[slave].role = ECAT_ROLE_JOINT;
+        master.slaves[slave].axis_index = (uint8_t)slave;
+    }
+    joint_filter_init(&joint);
+    assert(!joint_filter_configure(&joint, q16_16_from_int(30), 0, q16_16_from_int(100), PERIOD_US));
+    assert(joint_filter_configure(&joint, q16_16_from_int(30), q16_16_from_int(2), q16_16_from_int(100), PERIOD_US));
+    for (int n = 0; n < 500; ++n) {
+        master.slaves[0].txpdo.position_actual = q16_16_from_float(2.0f * (float)n * 1e-3f);
+        master.slaves[1].txpdo.position_actual = q16_16_from_float(-1.0f * (float)n * 1e-3f);
+        joint_filter_update_velocity(&joint, &master, PERIOD_US);
+    }
+    assert(fabsf(q16_16_to_float(joint.joint_velocity[0]) - 2.0f) < 0.01f);
+    assert(fabsf(q16_16_to_float(joint.joint_velocity[1]) + 1.0f) < 0.01f);
+    assert(joint.joint_velocity[2] == 0);
+    /* a constant feed-forward passes the notch unchanged */
+    q16_16_t torque[DELTA_JOINT_COUNT] = {Q16_16_ONE, -Q16_16_ONE, 0};
+    q16_16_t filtered[DELTA_JOINT_COUNT];
+    for (int n = 0; n < 1000; ++n) {
+        joint_filter_torque(&joint, torque, filtered);
+    }
+    assert(filtered[0] == Q16_16_ONE && filtered[1] == -Q16_16_ONE && filtered[2] == 0);
+    /* a new period redesigns both banks */
+    assert(joint_filter_set_period(&joint, 250U));
+    assert(!joint_filter_set_period(&joint, 20000U));
+
+    /* the feed-forward is the reflected inertia times the joint acceleration
+     * of the commanded move; compared over 40-cycle differences so the Q16.16
+     * joint resolution does not dominate */
+    static sim_rig_t rig;
+    sim_rig_configure(&rig);
+    ecat_sim_dynamics_t dynamics = {0U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&rig, &dynamics);
+    sim_rig_init_motion(&rig);
+    const planner_joint_limits_t limits = {0.0f, 0.0f, 0.0f, 0.05f};
+    planner_set_joint_limits(&rig.planner, &limits);
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.3f)}};
+    sim_rig_rest(&rig, &start);
+    sim_rig_enable(&rig);
+    delta_pose_t target = {{q16_16_from_float(0.05f), q16_16_from_float(-0.03f), q16_16_from_float(-0.35f)}};
+    assert(planner_push_line(&rig.planner, &target, q16_16_from_float(0.3f), q16_16_from_int(2), q16_16_from_int(40)));
+    static float command[1000][DELTA_JOINT_COUNT];
+    static float feedforward[1000][DELTA_JOINT_COUNT];
+    int cycles = 0;
+    for (; cycles < 1000 && !planner_is_empty(&rig.planner); ++cycles) {
+        motion_controller_tick(&rig.motion);
+        for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+            command[cycles][j] = q16_16_to_float(rig.motion.joint_command.theta[j]);
+            feedforward[cycles][j] = q16_16_to_float(rig.master.slaves[j].rxpdo.target_torque) / limits.inertia;
+        }
+        ethcat_master_send_process_data(&rig.master);
+        ethcat_master_process(&rig.master);
+    }
+    assert(planner_is_empty(&rig.planner) && cycles < 1000);
+    float peak = 0.0f;
+    float worst = 0.0f;
+    const int span = 40;
+    const float window = (float)span * (float)PERIOD_US * 1e-6f;
+    for (int n = span; n + span < cycles; ++n) {
+        for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+            /* the second difference is the triangle-weighted mean of the acceleration */
+            float accel = (command[n + span][j] - 2.0f * command[n][j] + command[n - span][j]) / (window * window);
+            float mean = 0.0f;
+            for (int k = n - span + 1; k < n + span; ++k) {
+                mean += feedforward[k][j] * (float)(span - abs(k - n)) / (float)(span * span);
+            }
+            peak = fmaxf(peak, fabsf(feedforward[n][j]));
+            worst = fmaxf(worst, fabsf(mean - accel));
+        }
+    }
+    assert(peak > 5.0f);
+    assert(worst < 0.05f * peak);
+    /* at rest there is nothing to feed forward */
+    motion_controller_tick(&rig.motion);
+    for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+        assert(rig.master.slaves[j].rxpdo.target_torque == 0);
+    }
+}
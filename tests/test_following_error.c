@@ -0,0 +1,103 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include <assert.h>
+
+static sim_rig_t s_rig;
+
+static void cycle(void)
+{
+    motion_controller_tick(&s_rig.motion);
+    ethcat_master_send_process_data(&s_rig.master);
+    ethcat_master_process(&s_rig.master);
+}
+
+static void setup(uint16_t lag_cycles, q16_16_t warning, q16_16_t fault)
+{
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {lag_cycles, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    motion_controller_set_following_limits(&s_rig.motion, warning, fault);
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.3f)}};
+    sim_rig_rest(&s_rig, &start);
+    sim_rig_enable(&s_rig);
+}
+
+void test_following_error(void)
+{
+    const q16_16_t warning = q16_16_from_float(0.004f);
+    const q16_16_t fault = q16_16_from_float(0.020f);
+
+    /* a sluggish drive at an aggressive feed: the path slows down instead of faulting */
+    setup(20U, warning, fault);
+    delta_pose_t target = {{0, 0, q16_16_from_float(-0.45f)}};
+    assert(planner_push_line(&s_rig.planner, &target, q16_16_from_float(0.5f), Q16_16_ONE, q16_16_from_int(5)));
+    q16_16_t lowest = Q16_16_ONE;
+    int cycles = 0;
+    while (!planner_is_empty(&s_rig.planner) && cycles < 5000) {
+        cycle();
+        if (s_rig.planner.feed_scale < lowest) {
+            lowest = s_rig.planner.feed_scale;
+        }
+        ++cycles;
+    }
+    assert(planner_is_empty(&s_rig.planner));
+    assert(!s_rig.motion.following.fault);
+    assert(lowest < Q16_16_ONE && s_rig.motion.following.warning_cycles > 0U);
+    assert(following_error_peak(&s_rig.motion.following) < fault);
+    /* the programmed move takes 1000 cycles, scaling stretched it */
+    assert(cycles > 1000);
+
+    for (int i = 0; i < 600; ++i) {
+        cycle();
+    }
+    assert(s_rig.planner.feed_scale == Q16_16_ONE);
+    assert(following_error_max(&s_rig.motion.following) < warning / 4);
+
+    /* a drive that cannot follow at all trips the fault limit and quick stops */
+    setup(20U, warning, warning + warning / 4);
+    assert(planner_push_line(&s_rig.planner, &target, q16_16_from_float(2.0f), Q16_16_ONE, q16_16_from_int(5)));
+    for (cycles = 0; cycles < 800 && !s_rig.motion.following.fault; ++cycles) {
+        cycle();
+    }
+    assert(s_rig.motion.following.fault);
+    for (int i = 0; i < 4; ++i) {
+        cycle();
+    }
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        assert(s_rig.sim.slaves[axis].state != CIA402_STATE_OPERATION_ENABLED);
+    }
+    assert(planner_is_empty(&s_rig.planner));
+
+    /* re-enabled, the first setpoints continue from where the arm stopped */
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        cia402_axis_enable(&s_rig.axes[axis]);
+    }
+    for (cycles = 0; cycles < 200 && !s_rig.motion.drives_ready; ++cycles) {
+        cycle();
+    }
+    assert(s_rig.motion.drives_ready && !s_rig.motion.following.fault);
+    for (int i = 0; i < 5; ++i) {
+        cycle();
+        for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+            q16_16_t jump = s_rig.master.slaves[axis].rxpdo.target_position - s_rig.sim.slaves[axis].position;
+            assert(q16_16_abs(jump) < warning / 4);
+        }
+    }
+
+    /* a bus lost mid-move is a fault too: nothing is invented in place of the feedback */
+    assert(planner_push_line(&s_rig.planner, &target, q16_16_from_float(0.1f), Q16_16_ONE, q16_16_from_int(5)));
+    for (int i = 0; i < 50; ++i) {
+        cycle();
+    }
+    ecat_sim_detach(&s_rig.sim);
+    q16_16_t held = s_rig.master.slaves[0].txpdo.position_actual;
+    cycle();
+    cycle();
+    assert(!s_rig.master.process_data_valid && !s_rig.motion.drives_ready);
+    assert(planner_is_empty(&s_rig.planner));
+    assert(s_rig.master.slaves[0].txpdo.position_actual == held);
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        assert(s_rig.axes[axis].quick_stop);
+    }
+}
@@ -0,0 +1,90 @@
+#include "test_suite.h"
+#include "../motion/input_shaper.h"
+#include "../planner/planner.h"
+#include <assert.h>
+#include <math.h>
+
+/* lightly damped platform mode excited by a fast point-to-point move,
+ * returns the residual vibration amplitude once the setpoint is at rest */
+static float residual(input_shaper_t *shaper, float frequency, float zeta)
+{
+    const float dt = 0.001f;
+    const float omega = 2.0f * 3.14159265f * frequency;
+    delta_pose_t origin = {{0, 0, 0}};
+    input_shaper_reset(shaper, &origin);
+    float x = 0.0f;
+    float v = 0.0f;
+    float previous = 0.0f;
+    float amplitude = 0.0f;
+    for (int tick = 0; tick < 1500; ++tick) {
+        float t = (float)tick * dt;
+        float u = t < 0.1f ? 0.05f * (t / 0.1f - sinf(2.0f * 3.14159265f * t / 0.1f) / (2.0f * 3.14159265f)) : 0.05f;
+        delta_pose_t in = {{q16_16_from_float(u), 0, 0}};
+        delta_pose_t out;
+        input_shaper_apply(shaper, &in, &out);
+        float setpoint = q16_16_to_float(out.xyz[0]);
+        float setpoint_velocity = (setpoint - previous) / dt;
+        previous = setpoint;
+        float accel = -omega * omega * (x - setpoint) - 2.0f * zeta * omega * (v - setpoint_velocity);
+        v += accel * dt;
+        x += v * dt;
+        if (tick > 400 && fabsf(x - 0.05f) > amplitude) {
+            amplitude = fabsf(x - 0.05f);
+        }
+        if (tick == 1499) {
+            assert(out.xyz[0] == q16_16_from_float(0.05f));
+        }
+    }
+    return amplitude;
+}
+
+void test_input_shaper(void)
+{
+    static input_shaper_t shaper;
+    const q16_16_t frequency[3] = {q16_16_from_int(25), q16_16_from_int(25), q16_16_from_int(25)};
+    const q16_16_t damping[3] = {q16_16_from_float(0.02f), q16_16_from_float(0.02f), q16_16_from_float(0.02f)};
+    input_shaper_init(&shaper);
+    float unshaped = residual(&shaper, 25.0f, 0.02f);
+    assert(unshaped > 1e-4f);
+
+    const input_shaper_type_t types[3] = {INPUT_SHAPER_ZV, INPUT_SHAPER_ZVD, INPUT_SHAPER_EI};
+    for (int i = 0; i < 3; ++i) {
+        assert(input_shaper_configure(&shaper, types[i], frequency, damping, 1000U));
+        q16_16_t sum = 0;
+        for (int k = 0; k < shaper.axes[0].impulse_count; ++k) {
+            sum += shaper.axes[0].amplitude[k];
+        }
+        assert(sum == Q16_16_ONE);
+        assert(shaper.delay_ticks == (types[i] == INPUT_SHAPER_ZV ? 20U : 40U));
+        assert(residual(&shaper, 25.0f, 0.02f) < unshaped * 0.1f);
+        /* ZVD and EI tolerate a mode that is off by 15 % */
+        if (types[i] != INPUT_SHAPER_ZV) {
+            assert(residual(&shaper, 28.75f, 0.02f) < unshaped * 0.2f);
+        }
+    }
+
+    /* a mode too slow for the history buffer is rejected, the old design stays */
+    const q16_16_t slow[3] = {q16_16_from_float(0.5f), q16_16_from_float(0.5f), q16_16_from_float(0.5f)};
+    assert(!input_shaper_configure(&shaper, INPUT_SHAPER_ZVD, slow, damping, 1000U));
+    assert(shaper.type == INPUT_SHAPER_EI && shaper.delay_ticks == 40U);
+    assert(input_shaper_set_period(&shaper, 250U) && shaper.delay_ticks == 160U);
+
+    /* the planner reports settled only once the shaped output has caught up */
+    static planner_queue_t planner;
+    planner_init(&planner, 1000U);
+    planner_set_output_delay(&planner, 40U);
+    delta_pose_t target = {{q16_16_from_float(0.01f), 0, 0}};
+    delta_pose_t pose;
+    assert(planner_push_line(&planner, &target, q16_16_from_float(0.1f), Q16_16_ONE, q16_16_from_int(5)));
+    int ticks = 0;
+    while (!planner_is_empty(&planner)) {
+        planner_step(&planner, &pose);
+        ++ticks;
+    }
+    int settle = 0;
+    while (!planner_is_settled(&planner)) {
+        planner_step(&planner, &pose);
+        ++settle;
+    }
+    assert(ticks > 0 && settle == 40);
+}
@@ -0,0 +1,183 @@
+#include "test_suite.h"
+#include "../planner/lookahead.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define WINDOW 10 /* ticks per finite difference, Q16.16 poses are too coarse for single ticks */
+
+static const planner_joint_limits_t s_limits = {2.0f, 40.0f, 5.0f, 0.5f}; /* torque bounds accel at 10 rad/s^2 */
+
+static void setup_kinematics(void)
+{
+    delta_cfg_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.R_base = q16_16_from_float(0.300f);
+    cfg.r_eff = q16_16_from_float(0.100f);
+    cfg.L_upper = q16_16_from_float(0.300f);
+    cfg.L_lower = q16_16_from_float(0.400f);
+    cfg.z_offset = q16_16_from_float(0.200f);
+    for (int axis = 0; axis < 3; ++axis) {
+        cfg.soft_xyz_min[axis] = q16_16_from_float(axis == 2 ? -0.5f : -0.2f);
+        cfg.soft_xyz_max[axis] = q16_16_from_float(axis == 2 ? -0.1f : 0.2f);
+    }
+    delta_init(&cfg);
+}
+
+static delta_pose_t pose_at(float x, float y, float z)
+{
+    delta_pose_t pose = {{q16_16_from_float(x), q16_16_from_float(y), q16_16_from_float(z)}};
+    return pose;
+}
+
+/* runs the queue dry, returns the peak joint speed and acceleration over windows */
+static void run_queue(planner_queue_t *planner, float *peak_speed, float *peak_accel, float *min_speed)
+{
+    float window_s = (float)WINDOW * (float)planner->control_period_us * 1e-6f;
+    float previous[3] = {0};
+    float previous_rate[3] = {0};
+    int windows = 0;
+    *peak_speed = 0.0f;
+    *peak_accel = 0.0f;
+    *min_speed = 1e9f;
+    delta_pose_t pose = planner->current_pose;
+    for (int tick = 0; tick < 20000; ++tick) {
+        bool moving = planner_step(planner, &pose);
+        if (tick % WINDOW != 0) {
+            continue;
+        }
+        delta_joint_t joints;
+        assert(delta_inverse_kinematics(&pose, &joints));
+        float path_speed = 0.0f;
+        for (int j = 0; j < 3; ++j) {
+            float theta = q16_16_to_float(joints.theta[j]);
+            float rate = (theta - previous[j]) / window_s;
+            if (windows >= 1 && fabsf(rate) > *peak_speed) {
+                *peak_speed = fabsf(rate);
+            }
+            if (windows >= 2 && fabsf(rate - previous_rate[j]) / window_s > *peak_accel) {
+                *peak_accel = fabsf(rate - previous_rate[j]) / window_s;
+            }
+            previous[j] = theta;
+            previous_rate[j] = rate;
+        }
+        path_speed = planner->path_speed;
+        if (moving && windows >= 20 && (uint16_t)((planner->tail + 1U) % PLANNER_QUEUE_LENGTH) != planner->head && path_speed < *min_speed) {
+            *min_speed = path_speed;
+        }
+        windows++;
+        if (!moving) {
+            return;
+        }
+    }
+    assert(false);
+}
+
+/* runs the queue dry, returns the peak path acceleration and jerk from the
+ * planner's own path speed; the feed override is raised partway */
+static void run_path(planner_queue_t *planner, float *peak_accel, float *peak_jerk)
+{
+    float dt = (float)planner->control_period_us * 1e-6f;
+    float speed[3] = {0};
+    delta_pose_t pose;
+    *peak_accel = 0.0f;
+    *peak_jerk = 0.0f;
+    for (int tick = 0; planner_step(planner, &pose); ++tick) {
+        assert(tick < 20000);
+        if (tick == 300) {
+            planner_set_feed_override(planner, 150U);
+        }
+        speed[2] = speed[1];
+        speed[1] = speed[0];
+        speed[0] = planner->path_speed;
+        *peak_accel = fmaxf(*peak_accel, fabsf(speed[0] - speed[1]) / dt);
+        *peak_jerk = fmaxf(*peak_jerk, fabsf(speed[0] - 2.0f * speed[1] + speed[2]) / (dt * dt));
+    }
+}
+
+void test_lookahead(void)
+{
+    setup_kinematics();
+    static planner_queue_t planner;
+
+    /* the same feed is allowed in the centre and capped near the workspace edge */
+    planner_init(&planner, 1000U);
+    planner_set_joint_limits(&planner, &s_limits);
+    planner.current_pose = pose_at(-0.05f, 0.0f, -0.45f);
+    delta_pose_t target = pose_at(0.05f, 0.0f, -0.45f);
+    assert(planner_push_line(&planner, &target, q16_16_from_float(5.0f), q16_16_from_int(50), q16_16_from_int(500)));
+    float centre = planner.blocks[planner.tail].max_speed;
+    planner_init(&planner, 1000U);
+    planner_set_joint_limits(&planner, &s_limits);
+    /* near the top the arms approach their stretched-out singularity */
+    planner.current_pose = pose_at(-0.15f, 0.0f, -0.3f);
+    target = pose_at(-0.05f, 0.0f, -0.3f);
+    assert(planner_push_line(&planner, &target, q16_16_from_float(5.0f), q16_16_from_int(50), q16_16_from_int(500)));
+    float edge = planner.blocks[planner.tail].max_speed;
+    assert(centre < 5.0f && edge < 0.5f * centre);
+
+    /* executed, no joint exceeds its limits and the binding one is used up */
+    float peak_speed, peak_accel, min_speed;
+    run_queue(&planner, &peak_speed, &peak_accel, &min_speed);
+    assert(peak_speed <= s_limits.velocity * 1.03f && peak_speed > 0.9f * s_limits.velocity);
+    assert(peak_accel <= 10.0f * 1.1f);
+
+    /* collinear short blocks are joined at speed, the last one ends at rest */
+    planner_init(&planner, 1000U);
+    planner_set_joint_limits(&planner, &s_limits);
+    planner.current_pose = pose_at(-0.1f, 0.0f, -0.45f);
+    for (int i = 1; i <= 20; ++i) {
+        target = pose_at(-0.1f + 0.01f * (float)i, 0.0f, -0.45f);
+        assert(planner_push_line(&planner, &target, q16_16_from_float(5.0f), q16_16_from_int(50), q16_16_from_int(500)));
+    }
+    const planner_block_t *last = &planner.blocks[(planner.head + PLANNER_QUEUE_LENGTH - 1U) % PLANNER_QUEUE_LENGTH];
+    assert(last->exit_velocity == 0 && last->entry_velocity > 0);
+    run_queue(&planner, &peak_speed, &peak_accel, &min_speed);
+    assert(peak_speed <= s_limits.velocity * 1.03f && peak_accel <= 10.0f * 1.1f);
+    assert(min_speed > 0.1f);
+    assert(fabsf(q16_16_to_float(planner.current_pose.xyz[0]) - 0.1f) < 1e-4f);
+
+    /* a 200 % override raises the speed up to the joint bound, never past it */
+    planner_init(&planner, 1000U);
+    planner_set_joint_limits(&planner, &s_limits);
+    planner.current_pose = pose_at(-0.1f, 0.0f, -0.45f);
+    target = pose_at(0.1f, 0.0f, -0.45f);
+    assert(planner_push_line(&planner, &target, q16_16_from_float(0.3f), q16_16_from_int(50), q16_16_from_int(500)));
+    const planner_block_t *block = &planner.blocks[planner.tail];
+    assert(block->max_speed < block->speed_limit && block->speed_limit < 0.6f);
+    planner_set_feed_override(&planner, PLANNER_FEED_OVERRIDE_MAX);
+    run_queue(&planner, &peak_speed, &peak_accel, &min_speed);
+    assert(peak_speed <= s_limits.velocity * 1.03f && peak_speed > 0.9f * s_limits.velocity);
+    assert(peak_accel <= 10.0f * 1.1f);
+
+    /* arches are bounded by the joints as well */
+    planner_init(&planner, 1000U);
+    planner_set_joint_limits(&planner, &s_limits);
+    planner.current_pose = pose_at(-0.1f, 0.0f, -0.45f);
+    target = pose_at(0.1f, 0.0f, -0.45f);
+    assert(planner_push_arch(&planner, &target, q16_16_from_float(0.05f), q16_16_from_float(0.01f), q16_16_from_float(5.0f), q16_16_from_int(50), q16_16_from_int(500)));
+    run_queue(&planner, &peak_speed, &peak_accel, &min_speed);
+    assert(peak_speed <= s_limits.velocity * 1.03f);
+
+    /* speed changes are jerk-limited: from rest, through corners, onto a raised
+     * override and down to the final stop */
+    planner_init(&planner, 1000U);
+    planner.current_pose = pose_at(-0.05f, 0.0f, -0.45f);
+    const delta_pose_t path[4] = {pose_at(0.05f, 0.0f, -0.45f), pose_at(0.05f, 0.05f, -0.45f), pose_at(0.0f, 0.0f, -0.4f),
+                                  pose_at(0.0f, 0.0f, -0.399f)};
+    for (int i = 0; i < 4; ++i) {
+        assert(planner_push_line(&planner, &path[i], q16_16_from_float(0.3f), q16_16_from_int(2), q16_16_from_int(20)));
+    }
+    float path_accel, path_jerk;
+    run_path(&planner, &path_accel, &path_jerk);
+    assert(path_accel <= 2.0f * 1.01f && path_accel > 1.0f);
+    assert(path_jerk <= 20.0f * 1.1f);
+    assert(fabsf(q16_16_to_float(planner.current_pose.xyz[2]) + 0.399f) < 1e-4f);
+
+    /* without joint limits the block keeps its Cartesian feed and acceleration */
+    planner_init(&planner, 1000U);
+    planner.current_pose = pose_at(-0.05f, 0.0f, -0.45f);
+    target = pose_at(0.05f, 0.0f, -0.45f);
+    assert(planner_push_line(&planner, &target, q16_16_from_float(0.1f), Q16_16_ONE, q16_16_from_int(5)));
+    assert(planner.blocks[planner.tail].max_speed == q16_16_to_float(q16_16_from_float(0.1f)) && planner.blocks[planner.tail].max_accel == 1.0f);
+}
@@ -1,6 +1,626 @@
+#define _POSIX_C_SOURCE 200809L
 #include "test_suite.h"
 #include "../opcua/server.h"
+#include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define POLICY_NONE "http://opcfoundation.org/UA/SecurityPolicy#None"
+#define INTERVAL_NS 20000000ULL
+
+/* just enough of an OPC UA client to drive the server from the test */
+
+typedef struct {
+    uint8_t data[OPCUA_BUFFER_SIZE];
+    size_t length;
+    size_t position;
+} message_t;
+
+typedef struct {
+    int fd;
+    uint32_t channel;
+    uint32_t token;
+    uint32_t sequence;
+    uint32_t request_id;
+    uint32_t auth_token;
+} client_t;
+
+static uint64_t s_now = 1000000000ULL;
+static cnc_status_t s_status;
+
+static void put_u8(message_t *m, uint8_t value)
+{
+    assert(m->length < sizeof(m->data));
+    m->data[m->length++] = value;
+}
+
+static void put_u32(message_t *m, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        put_u8(m, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void put_u64(message_t *m, uint64_t value)
+{
+    put_u32(m, (uint32_t)value);
+    put_u32(m, (uint32_t)(value >> 32));
+}
+
+static void put_f64(message_t *m, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u64(m, bits);
+}
+
+static void put_string(message_t *m, const char *text)
+{
+    if (text == NULL) {
+        put_u32(m, 0xFFFFFFFFUL);
+        return;
+    }
+    put_u32(m, (uint32_t)strlen(text));
+    for (const char *p = text; *p != '\0'; ++p) {
+        put_u8(m, (uint8_t)*p);
+    }
+}
+
+static void put_node(message_t *m, uint16_t ns, uint32_t id)
+{
+    put_u8(m, 0x02U);
+    put_u8(m, (uint8_t)ns);
+    put_u8(m, (uint8_t)(ns >> 8));
+    put_u32(m, id);
+}
+
+static uint8_t get_u8(message_t *m)
+{
+    assert(m->position < m->length);
+    return m->data[m->position++];
+}
+
+static uint32_t get_u32(message_t *m)
+{
+    uint32_t value = 0U;
+    for (int i = 0; i < 4; ++i) {
+        value |= (uint32_t)get_u8(m) << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get_u64(message_t *m)
+{
+    uint64_t low = get_u32(m);
+    return low | ((uint64_t)get_u32(m) << 32);
+}
+
+static double get_f64(message_t *m)
+{
+    uint64_t bits = get_u64(m);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t get_node(message_t *m)
+{
+    switch (get_u8(m)) {
+    case 0x00U:
+        return get_u8(m);
+    case 0x01U: {
+        get_u8(m);
+        uint32_t id = get_u8(m);
+        return id | ((uint32_t)get_u8(m) << 8);
+    }
+    default:
+        get_u8(m);
+        get_u8(m);
+        return get_u32(m);
+    }
+}
+
+static void skip_string(message_t *m)
+{
+    int32_t length = (int32_t)get_u32(m);
+    for (int32_t i = 0; i < length; ++i) {
+        get_u8(m);
+    }
+}
+
+static client_t connect_client(void)
+{
+    client_t client;
+    memset(&client, 0, sizeof(client));
+    client.fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(client.fd >= 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(opcua_server_port());
+    assert(connect(client.fd, (const struct sockaddr *)&address, sizeof(address)) == 0);
+    return client;
+}
+
+static void transmit(client_t *client, message_t *m)
+{
+    for (int i = 0; i < 4; ++i) {
+        m->data[4 + i] = (uint8_t)(m->length >> (8 * i));
+    }
+    assert(send(client->fd, m->data, m->length, 0) == (ssize_t)m->length);
+}
+
+/* poll the server until a whole message arrives, false if the server hung up */
+static bool receive(client_t *client, message_t *m)
+{
+    m->length = 0U;
+    m->position = 8U;
+    for (int attempt = 0; attempt < 2000; ++attempt) {
+        opcua_server_poll(s_now);
+        size_t wanted = m->length < 8U ? 8U : (size_t)m->data[4] | ((size_t)m->data[5] << 8) | ((size_t)m->data[6] << 16);
+        ssize_t got = recv(client->fd, m->data + m->length, wanted - m->length, MSG_DONTWAIT);
+        if (got == 0) {
+            return false;
+        }
+        if (got > 0) {
+            m->length += (size_t)got;
+            if (m->length >= 8U && m->length == ((size_t)m->data[4] | ((size_t)m->data[5] << 8) | ((size_t)m->data[6] << 16))) {
+                return true;
+            }
+            continue;
+        }
+        assert(errno == EAGAIN || errno == EWOULDBLOCK);
+        struct timespec pause = {0, 100000};
+        nanosleep(&pause, NULL);
+    }
+    assert(!"no answer from the server");
+    return false;
+}
+
+static void expect_silence(client_t *client)
+{
+    uint8_t byte;
+    opcua_server_poll(s_now);
+    struct timespec pause = {0, 2000000};
+    nanosleep(&pause, NULL);
+    assert(recv(client->fd, &byte, 1U, MSG_DONTWAIT) < 0 && errno == EAGAIN);
+}
+
+static void begin_request(client_t *client, message_t *m, uint32_t type, uint32_t auth_token)
+{
+    m->length = 0U;
+    memcpy(m->data, "MSGF", 4U);
+    m->length = 8U;
+    put_u32(m, client->channel);
+    put_u32(m, client->token);
+    put_u32(m, ++client->sequence);
+    put_u32(m, ++client->request_id);
+    put_node(m, 0U, type);
+    /* RequestHeader */
+    put_node(m, auth_token != 0U ? 1U : 0U, auth_token);
+    put_u64(m, 0U);
+    put_u32(m, client->request_id * 10U);
+    put_u32(m, 0U);
+    put_string(m, NULL);
+    put_u32(m, 10000U);
+    put_node(m, 0U, 0U);
+    put_u8(m, 0U);
+}
+
+/* returns the response type, leaves the reader at the body; status via out */
+static uint32_t response(client_t *client, message_t *m, uint32_t *status)
+{
+    assert(receive(client, m));
+    assert(memcmp(m->data, "MSGF", 4U) == 0);
+    assert(get_u32(m) == client->channel);
+    get_u32(m);
+    get_u32(m);
+    get_u32(m); /* request id */
+    uint32_t type = get_node(m);
+    get_u64(m);
+    get_u32(m);
+    *status = get_u32(m);
+    assert(get_u8(m) == 0U);
+    assert(get_u32(m) == 0U);
+    get_node(m);
+    get_u8(m);
+    return type;
+}
+
+static uint32_t service_fault(client_t *client)
+{
+    message_t m;
+    uint32_t status;
+    assert(response(client, &m, &status) == 397U);
+    return status;
+}
+
+static void send_hello(client_t *client)
+{
+    message_t m;
+    memset(&m, 0, sizeof(m));
+    memcpy(m.data, "HELF", 4U);
+    m.length = 8U;
+    put_u32(&m, 0U);
+    put_u32(&m, 65536U);
+    put_u32(&m, 65536U);
+    put_u32(&m, 0U);
+    put_u32(&m, 0U);
+    put_string(&m, "opc.tcp://localhost:4840");
+    transmit(client, &m);
+    assert(receive(client, &m) && memcmp(m.data, "ACKF", 4U) == 0);
+    get_u32(&m);
+    get_u32(&m);
+    assert(get_u32(&m) == OPCUA_BUFFER_SIZE); /* clamped to what the server has */
+}
+
+static void send_open(client_t *client, const char *policy)
+{
+    message_t m;
+    memset(&m, 0, sizeof(m));
+    memcpy(m.data, "OPNF", 4U);
+    m.length = 8U;
+    put_u32(&m, 0U);
+    put_string(&m, policy);
+    put_string(&m, NULL);
+    put_string(&m, NULL);
+    put_u32(&m, ++client->sequence);
+    put_u32(&m, ++client->request_id);
+    put_node(&m, 0U, 446U);
+    put_node(&m, 0U, 0U);
+    put_u64(&m, 0U);
+    put_u32(&m, 1U);
+    put_u32(&m, 0U);
+    put_string(&m, NULL);
+    put_u32(&m, 10000U);
+    put_node(&m, 0U, 0U);
+    put_u8(&m, 0U);
+    put_u32(&m, 0U);
+    put_u32(&m, 0U); /* issue */
+    put_u32(&m, 1U); /* mode None */
+    put_string(&m, NULL);
+    put_u32(&m, 600000U);
+    transmit(client, &m);
+}
+
+static void open_session(client_t *client)
+{
+    message_t m;
+    send_hello(client);
+    send_open(client, POLICY_NONE);
+    assert(receive(client, &m) && memcmp(m.data, "OPNF", 4U) == 0);
+    client->channel = get_u32(&m);
+    assert(client->channel != 0U);
+    skip_string(&m);
+    skip_string(&m);
+    skip_string(&m);
+    get_u32(&m);
+    get_u32(&m);
+    assert(get_node(&m) == 449U);
+    get_u64(&m);
+    get_u32(&m);
+    assert(get_u32(&m) == 0U);
+    get_u8(&m);
+    get_u32(&m);
+    get_node(&m);
+    get_u8(&m);
+    get_u32(&m);
+    assert(get_u32(&m) == client->channel);
+    client->token = get_u32(&m);
+
+    uint32_t status;
+    begin_request(client, &m, 461U, 0U);
+    put_string(&m, NULL); /* the rest of the request is not inspected */
+    transmit(client, &m);
+    assert(response(client, &m, &status) == 464U && status == 0U);
+    assert(get_node(&m) != 0U);
+    client->auth_token = get_node(&m);
+    assert(get_f64(&m) > 0.0);
+
+    /* nothing but GetEndpoints and sessions before activation */
+    begin_request(client, &m, 631U, client->auth_token);
+    transmit(client, &m);
+    assert(service_fault(client) == 0x80270000UL);
+
+    begin_request(client, &m, 467U, client->auth_token);
+    transmit(client, &m);
+    assert(response(client, &m, &status) == 470U && status == 0U);
+}
+
+static void request_read(client_t *client, const uint32_t *nodes, const uint32_t *attributes, int count, uint32_t auth_token)
+{
+    message_t m;
+    begin_request(client, &m, 631U, auth_token);
+    put_f64(&m, 0.0);
+    put_u32(&m, 2U); /* both timestamps */
+    put_u32(&m, (uint32_t)count);
+    for (int i = 0; i < count; ++i) {
+        put_node(&m, 1U, nodes[i]);
+        put_u32(&m, attributes[i]);
+        put_string(&m, NULL);
+        put_u8(&m, 0U); /* default data encoding */
+        put_u8(&m, 0U);
+        put_string(&m, NULL);
+    }
+    transmit(client, &m);
+}
+
+static uint32_t create_subscription(client_t *client, double interval_ms, uint32_t lifetime, uint32_t keepalive)
+{
+    message_t m;
+    uint32_t status;
+    begin_request(client, &m, 787U, client->auth_token);
+    put_f64(&m, interval_ms);
+    put_u32(&m, lifetime);
+    put_u32(&m, keepalive);
+    put_u32(&m, 0U);
+    put_u8(&m, 1U);
+    put_u8(&m, 0U);
+    transmit(client, &m);
+    assert(response(client, &m, &status) == 790U && status == 0U);
+    uint32_t id = get_u32(&m);
+    assert(id != 0U && get_f64(&m) == interval_ms);
+    assert(get_u32(&m) >= 3U * keepalive && get_u32(&m) == keepalive);
+    return id;
+}
+
+typedef struct {
+    uint32_t node;
+    uint32_t handle;
+    double sampling_ms;
+    uint32_t deadband_type; /* 0xFF: no filter */
+    double deadband;
+} item_request_t;
+
+static void create_items(client_t *client, uint32_t subscription, const item_request_t *items, int count, uint32_t *statuses, double *revised)
+{
+    message_t m;
+    uint32_t status;
+    begin_request(client, &m, 751U, client->auth_token);
+    put_u32(&m, subscription);
+    put_u32(&m, 0U);
+    put_u32(&m, (uint32_t)count);
+    for (int i = 0; i < count; ++i) {
+        put_node(&m, 1U, items[i].node);
+        put_u32(&m, 13U);
+        put_string(&m, NULL);
+        put_u8(&m, 0U); /* default data encoding */
+        put_u8(&m, 0U);
+        put_string(&m, NULL);
+        put_u32(&m, 2U); /* reporting */
+        put_u32(&m, items[i].handle);
+        put_f64(&m, items[i].sampling_ms);
+        if (items[i].deadband_type == 0xFFU) {
+            put_node(&m, 0U, 0U);
+            put_u8(&m, 0U);
+        } else {
+            put_node(&m, 0U, 724U);
+            put_u8(&m, 1U);
+            put_u32(&m, 16U);
+            put_u32(&m, 1U); /* StatusValue */
+            put_u32(&m, items[i].deadband_type);
+            put_f64(&m, items[i].deadband);
+        }
+        put_u32(&m, 1U);
+        put_u8(&m, 1U);
+    }
+    transmit(client, &m);
+    assert(response(client, &m, &status) == 754U && status == 0U);
+    assert(get_u32(&m) == (uint32_t)count);
+    for (int i = 0; i < count; ++i) {
+        statuses[i] = get_u32(&m);
+        assert((get_u32(&m) != 0U) == (statuses[i] == 0U));
+        revised[i] = get_f64(&m);
+        get_u32(&m);
+        get_node(&m);
+        get_u8(&m);
+    }
+}
+
+static void request_publish(client_t *client)
+{
+    message_t m;
+    begin_request(client, &m, 826U, client->auth_token);
+    put_u32(&m, 0U);
+    transmit(client, &m);
+}
+
+typedef struct {
+    uint32_t subscription;
+    uint32_t sequence;
+    uint32_t count; /* 0 for a keep-alive */
+    uint32_t handles[8];
+    double values[8];
+} notification_t;
+
+static notification_t await_notification(client_t *client)
+{
+    message_t m;
+    uint32_t status;
+    notification_t n;
+    memset(&n, 0, sizeof(n));
+    assert(response(client, &m, &status) == 829U && status == 0U);
+    n.subscription = get_u32(&m);
+    get_u32(&m);
+    assert(get_u8(&m) == 0U);
+    n.sequence = get_u32(&m);
+    get_u64(&m);
+    if (get_u32(&m) == 1U) {
+        assert(get_node(&m) == 811U && get_u8(&m) == 1U);
+        get_u32(&m);
+        n.count = get_u32(&m);
+        assert(n.count <= 8U);
+        for (uint32_t i = 0U; i < n.count; ++i) {
+            n.handles[i] = get_u32(&m);
+            assert(get_u8(&m) == 0x0DU); /* value, source and server timestamps */
+            uint8_t type = get_u8(&m);
+            n.values[i] = type == 11U ? get_f64(&m) : type == 1U ? (double)get_u8(&m) : (double)get_u32(&m);
+            assert(get_u64(&m) != 0U && get_u64(&m) != 0U);
+        }
+    }
+    return n;
+}
+
+static void publish_status(void)
+{
+    cnc_state_update(&s_status);
+    cnc_status_t copy = cnc_state_status();
+    opcua_server_publish(&copy);
+}
+
+static void advance(uint32_t intervals)
+{
+    for (uint32_t i = 0U; i < intervals; ++i) {
+        s_now += INTERVAL_NS;
+        opcua_server_poll(s_now);
+    }
+}
+
+static void session_checks(client_t *a)
+{
+    message_t m;
+    uint32_t status;
+    s_status.position[0] = q16_16_from_float(0.1f);
+    s_status.drives_enabled = true;
+    s_status.cycles = 1234U;
+    publish_status();
+
+    uint32_t nodes[] = {OPCUA_NODE_POSITION, 99U, OPCUA_NODE_CYCLES, OPCUA_NODE_DRIVES_ENABLED, OPCUA_NODE_STATE};
+    uint32_t attributes[] = {13U, 13U, 13U, 13U, 99U};
+    request_read(a, nodes, attributes, 5, a->auth_token);
+    assert(response(a, &m, &status) == 634U && status == 0U);
+    assert(get_u32(&m) == 5U);
+    assert(get_u8(&m) == 0x0DU && get_u8(&m) == 11U);
+    assert(fabs(get_f64(&m) - 0.1) < 1e-4);
+    get_u64(&m);
+    get_u64(&m);
+    assert(get_u8(&m) == 0x02U && get_u32(&m) == 0x80340000UL); /* BadNodeIdUnknown */
+    assert(get_u8(&m) == 0x0DU && get_u8(&m) == 7U && get_u32(&m) == 1234U);
+    get_u64(&m);
+    get_u64(&m);
+    assert(get_u8(&m) == 0x0DU && get_u8(&m) == 1U && get_u8(&m) == 1U);
+    get_u64(&m);
+    get_u64(&m);
+    assert(get_u8(&m) == 0x02U && get_u32(&m) == 0x80350000UL); /* BadAttributeIdInvalid */
+
+    /* another session's token is not this one */
+    request_read(a, nodes, attributes, 1, a->auth_token + 1U);
+    assert(service_fault(a) == 0x80250000UL);
+    /* no subscription to publish on */
+    request_publish(a);
+    assert(service_fault(a) == 0x80790000UL);
+}
+
+static void subscription_checks(client_t *a, client_t *b)
+{
+    uint32_t statuses[5];
+    double revised[5];
+    uint32_t sub = create_subscription(a, 20.0, 300U, 3U);
+    item_request_t items[] = {
+        {OPCUA_NODE_POSITION, 1U, -1.0, 1U, 0.01},                  /* absolute deadband, publishing rate */
+        {OPCUA_NODE_JOINT_POSITION, 2U, 5.0, 0xFFU, 0.0},           /* every change, clamped rate */
+        {OPCUA_NODE_DRIVES_ENABLED, 3U, -1.0, 1U, 0.5},             /* no deadband on a Boolean */
+        {OPCUA_NODE_POSITION + 1U, 4U, -1.0, 2U, 5.0},              /* no EURange for a percent deadband */
+        {77U, 5U, -1.0, 0xFFU, 0.0},
+    };
+    create_items(a, sub, items, 5, statuses, revised);
+    assert(statuses[0] == 0U && revised[0] == 20.0);
+    assert(statuses[1] == 0U && revised[1] == (double)OPCUA_MIN_INTERVAL_MS);
+    assert(statuses[2] == 0x80450000UL);
+    assert(statuses[3] == 0x808E0000UL);
+    assert(statuses[4] == 0x80340000UL);
+
+    /* the first publishing interval reports the initial values */
+    request_publish(a);
+    advance(1U);
+    notification_t n = await_notification(a);
+    assert(n.subscription == sub && n.sequence == 1U && n.count == 2U);
+    assert(n.handles[0] == 1U && fabs(n.values[0] - 0.1) < 1e-4);
+    assert(n.handles[1] == 2U && n.values[1] == 0.0);
+
+    /* inside the deadband only the undamped item reports */
+    s_status.position[0] = q16_16_from_float(0.105f);
+    s_status.joint_position[0] = 1;
+    publish_status();
+    request_publish(a);
+    advance(1U);
+    n = await_notification(a);
+    assert(n.sequence == 2U && n.count == 1U && n.handles[0] == 2U);
+
+    /* a queued publish request waits while nothing changes */
+    request_publish(a);
+    advance(1U);
+    expect_silence(a);
+    /* the deadband is measured from the last reported value, 0.1 */
+    s_status.position[0] = q16_16_from_float(0.115f);
+    publish_status();
+    advance(1U);
+    n = await_notification(a);
+    assert(n.sequence == 3U && n.count == 1U && n.handles[0] == 1U && fabs(n.values[0] - 0.115) < 1e-4);
+
+    /* quiet subscriptions send a keep-alive every keepalive_count intervals */
+    request_publish(a);
+    advance(2U);
+    expect_silence(a);
+    advance(1U);
+    n = await_notification(a);
+    assert(n.subscription == sub && n.count == 0U && n.sequence == 4U);
+
+    /* a second client gets its own subscription on the same snapshot */
+    open_session(b);
+    uint32_t other = create_subscription(b, 40.0, 9U, 3U);
+    item_request_t position = {OPCUA_NODE_POSITION, 7U, -1.0, 0xFFU, 0.0};
+    create_items(b, other, &position, 1, statuses, revised);
+    assert(statuses[0] == 0U && revised[0] == 40.0);
+    request_publish(a);
+    request_publish(b);
+    expect_silence(a);
+    s_status.position[0] = q16_16_from_float(0.13f);
+    publish_status();
+    advance(2U);
+    n = await_notification(a);
+    assert(n.count == 1U && n.handles[0] == 1U && fabs(n.values[0] - 0.13) < 1e-4);
+    n = await_notification(b);
+    assert(n.subscription == other && n.count == 1U && n.handles[0] == 7U && fabs(n.values[0] - 0.13) < 1e-4);
+
+    /* without publish requests a subscription lives lifetime_count intervals */
+    advance(2U * 40U);
+    request_publish(b);
+    assert(service_fault(b) == 0x80790000UL);
+
+    /* deleting the last subscription answers the parked publish requests */
+    message_t m;
+    uint32_t status;
+    request_publish(a);
+    begin_request(a, &m, 847U, a->auth_token);
+    put_u32(&m, 2U);
+    put_u32(&m, sub);
+    put_u32(&m, sub + 1000U);
+    transmit(a, &m);
+    assert(response(a, &m, &status) == 850U && status == 0U);
+    assert(get_u32(&m) == 2U && get_u32(&m) == 0U && get_u32(&m) == 0x80280000UL);
+    assert(service_fault(a) == 0x80790000UL);
+}
+
+static void transport_checks(void)
+{
+    /* anything but SecurityPolicy None is refused and the channel dropped */
+    client_t c = connect_client();
+    message_t m;
+    send_hello(&c);
+    send_open(&c, "http://opcfoundation.org/UA/SecurityPolicy#Basic256Sha256");
+    assert(receive(&c, &m) && memcmp(m.data, "ERRF", 4U) == 0);
+    assert(get_u32(&m) == 0x80550000UL);
+    assert(!receive(&c, &m));
+    close(c.fd);
+}
 
 void test_opcua(void)
 {
@@ -10,4 +630,36 @@ void test_opcua(void)
     cnc_state_init();
     cnc_status_t status = cnc_state_status();
     opcua_server_publish(&status);
+
+    assert(opcua_server_port() == params.opcua_port);
+    memset(&s_status, 0, sizeof(s_status));
+    client_t a = connect_client();
+    client_t b = connect_client();
+    open_session(&a);
+    session_checks(&a);
+    subscription_checks(&a, &b);
+    transport_checks();
+
+    /* CloseSession, then CLO ends the connection */
+    message_t m;
+    uint32_t result;
+    begin_request(&a, &m, 473U, a.auth_token);
+    put_u8(&m, 1U);
+    transmit(&a, &m);
+    assert(response(&a, &m, &result) == 476U && result == 0U);
+    request_publish(&a);
+    assert(service_fault(&a) == 0x80250000UL);
+    memset(&m, 0, sizeof(m));
+    memcpy(m.data, "CLOF", 4U);
+    m.length = 8U;
+    put_u32(&m, a.channel);
+    transmit(&a, &m);
+    assert(!receive(&a, &m));
+    close(a.fd);
+    close(b.fd);
+
+    opcua_server_stop();
+    assert(opcua_server_port() == 0U);
+    params.opcua_port = 0U;
+    assert(!opcua_server_start(&params));
 }
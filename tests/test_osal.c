@@ -0,0 +1,76 @@
+#include "test_suite.h"
+#include "../osal/osal.h"
+#include <assert.h>
+
+#define MS 1000000ULL
+
+#define OSAL_TEST_INCREMENTS 20000U
+
+static osal_mutex_t s_mutex;
+static uint32_t s_counter;
+static int s_ran;
+
+static void count_fn(void *arg)
+{
+    (void)arg;
+    for (uint32_t i = 0U; i < OSAL_TEST_INCREMENTS; ++i) {
+        osal_mutex_lock(&s_mutex);
+        s_counter++;
+        osal_mutex_unlock(&s_mutex);
+    }
+}
+
+static void mark_fn(void *arg)
+{
+    s_ran = *(const int *)arg;
+}
+
+void test_osal(void)
+{
+    uint64_t start = osal_clock_ns();
+    assert(osal_clock_ns() >= start);
+    assert(osal_init(false));
+
+    /* two threads share a counter through the mutex */
+    assert(osal_mutex_init(&s_mutex));
+    osal_thread_t first;
+    osal_thread_t second;
+    assert(osal_thread_create(&first, NULL, count_fn, NULL));
+    assert(osal_thread_create(&second, NULL, count_fn, NULL));
+    assert(osal_thread_join(&first) && osal_thread_join(&second));
+    assert(s_counter == 2U * OSAL_TEST_INCREMENTS);
+    assert(!osal_thread_join(&first));
+    osal_mutex_destroy(&s_mutex);
+
+    /* pinned SCHED_FIFO request: runs either way, realtime only with the privilege */
+    int value = 7;
+    osal_thread_attr_t attr = {80U, 0, 0U};
+    assert(osal_thread_create(&first, &attr, mark_fn, &value));
+    assert(osal_thread_join(&first) && s_ran == 7);
+    attr.cpu = 4096;
+    assert(!osal_thread_create(&first, &attr, mark_fn, &value));
+
+    /* a past deadline returns at once with its lateness */
+    uint64_t now = osal_clock_ns();
+    assert(osal_sleep_until_ns(now - MS) >= MS);
+    assert(osal_sleep_until_ns(osal_clock_ns() + MS) < 50U * MS);
+    assert(osal_clock_ns() >= now + MS);
+
+    /* periodic timer keeps absolute deadlines and records every wakeup */
+    osal_timer_t timer;
+    osal_timer_start(&timer, MS);
+    uint64_t first_deadline = timer.next_ns;
+    for (int i = 0; i < 20; ++i) {
+        osal_timer_wait(&timer);
+    }
+    assert(timer.latency.count == 20U);
+    assert((timer.next_ns - first_deadline) % MS == 0U);
+    assert(osal_clock_ns() >= first_deadline + 19U * MS);
+
+    /* a stall drops the lost releases and stays on the grid */
+    uint32_t overruns = timer.overruns;
+    osal_sleep_until_ns(osal_clock_ns() + 5U * MS);
+    assert(!osal_timer_wait(&timer));
+    assert(timer.overruns >= overruns + 4U);
+    assert((timer.next_ns - first_deadline) % MS == 0U);
+}
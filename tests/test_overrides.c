@@ -0,0 +1,83 @@
+#include "test_suite.h"
+#include "../gcode/console.h"
+#include "../drivers/uart.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+static float step_speed(planner_queue_t *planner, delta_pose_t *previous, int ticks)
+{
+    delta_pose_t pose = *previous;
+    for (int i = 0; i < ticks; ++i) {
+        planner_step(planner, &pose);
+    }
+    float sum = 0.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        float diff = q16_16_to_float(pose.xyz[axis] - previous->xyz[axis]);
+        sum += diff * diff;
+    }
+    *previous = pose;
+    return sqrtf(sum) / ((float)ticks * 0.001f);
+}
+
+void test_overrides(void)
+{
+    static planner_queue_t planner;
+    static motion_controller_t motion;
+    static console_t console;
+    planner_init(&planner, 1000U);
+    motion.planner = &planner;
+    uart_init(115200U);
+    console_init(&console, NULL, NULL, &motion, NULL);
+
+    /* realtime bytes change the override without reaching the line buffer */
+    uart_rx_byte(CONSOLE_RT_FEED_PLUS_10);
+    uart_rx_byte(CONSOLE_RT_FEED_PLUS_10);
+    uart_rx_byte(CONSOLE_RT_RAPID_50);
+    assert(planner.feed_override == 120U && planner.rapid_override == 50U);
+    char line[16];
+    assert(uart_read_line(line, (int)sizeof(line)) == 0);
+    const char *text = "G1\n";
+    for (const char *c = text; *c != '\0'; ++c) {
+        uart_rx_byte((uint8_t)*c);
+    }
+    assert(uart_read_line(line, (int)sizeof(line)) == 2 && strcmp(line, "G1") == 0);
+    uart_rx_byte(CONSOLE_RT_FEED_RESET);
+    for (int i = 0; i < 30; ++i) {
+        uart_rx_byte(CONSOLE_RT_FEED_PLUS_10);
+    }
+    assert(planner.feed_override == PLANNER_FEED_OVERRIDE_MAX);
+    uart_rx_byte(CONSOLE_RT_FEED_RESET);
+    uart_rx_byte(CONSOLE_RT_RAPID_100);
+
+    /* a single long line cruises at constant speed once it has accelerated */
+    delta_pose_t previous = planner.current_pose;
+    delta_pose_t target = {{q16_16_from_float(0.2f), 0, 0}};
+    assert(planner_push_line(&planner, &target, q16_16_from_float(0.05f), Q16_16_ONE, q16_16_from_int(5)));
+    step_speed(&planner, &previous, 250);
+    float base = step_speed(&planner, &previous, 100);
+    assert(fabsf(base - 0.05f) < 0.002f);
+
+    /* raising the override ramps the time scale, it does not jump */
+    planner_set_feed_override(&planner, 150U);
+    float first = step_speed(&planner, &previous, 10);
+    assert(first > base && first < 0.07f);
+    step_speed(&planner, &previous, 500);
+    float raised = step_speed(&planner, &previous, 100);
+    assert(fabsf(raised - 0.075f) < 0.002f);
+    assert(fabsf(q16_16_to_float(planner.feed_scale) - 1.5f) < 1e-3f);
+
+    /* rapids use their own override */
+    planner_abort(&planner, &previous);
+    planner_set_feed_override(&planner, 100U);
+    planner_set_rapid_override(&planner, 25U);
+    target.xyz[0] = 0;
+    assert(planner_push_rapid(&planner, &target, q16_16_from_float(0.05f), Q16_16_ONE, q16_16_from_int(5)));
+    step_speed(&planner, &previous, 300);
+    float rapid = step_speed(&planner, &previous, 100);
+    assert(fabsf(rapid - 0.0125f) < 0.001f);
+    assert(q16_16_to_float(planner_override(&planner)) < 0.26f);
+    planner_set_rapid_override(&planner, 1U);
+    assert(planner.rapid_override == PLANNER_RAPID_OVERRIDE_MIN);
+    uart_set_realtime_handler(NULL, NULL);
+}
@@ -0,0 +1,90 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include <assert.h>
+#include <math.h>
+
+static sim_rig_t s_rig;
+
+static float sim_z(bool previous)
+{
+    delta_joint_t joints;
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        joints.theta[axis] = previous ? s_rig.sim.slaves[axis].previous_position : s_rig.sim.slaves[axis].position;
+    }
+    delta_pose_t pose;
+    assert(delta_forward_kinematics(&joints, &pose));
+    return q16_16_to_float(pose.xyz[2]);
+}
+
+static void setup(void)
+{
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {2U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    /* start above the surface with the simulated drives already there */
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.3f)}};
+    sim_rig_rest(&s_rig, &start);
+}
+
+static void cycle(float surface_z, bool *touched)
+{
+    command_processor_step(&s_rig.queue, &s_rig.runtime, &s_rig.parser, &s_rig.planner, s_rig.axes, DELTA_JOINT_COUNT);
+    motion_controller_tick(&s_rig.motion);
+    ethcat_master_send_process_data(&s_rig.master);
+    ethcat_master_process(&s_rig.master);
+    float z_prev = sim_z(true);
+    float z_now = sim_z(false);
+    if (!*touched && z_prev > surface_z && z_now <= surface_z) {
+        ecat_sim_trigger_probe(&s_rig.sim, -1, q16_16_from_float((z_prev - surface_z) / (z_prev - z_now)));
+        *touched = true;
+    }
+}
+
+void test_probe(void)
+{
+    const float surface = -0.36f;
+    setup();
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    assert(command_queue_enqueue(&s_rig.queue, "G38.2 Z-0.46 F12"));
+    assert(command_queue_enqueue(&s_rig.queue, "G1 Z-0.32"));
+    bool touched = false;
+    int cycles = 0;
+    while (s_rig.planner.probe.state != PLANNER_PROBE_TRIGGERED && cycles < 5000) {
+        cycle(surface, &touched);
+        ++cycles;
+    }
+    assert(touched && s_rig.planner.probe.state == PLANNER_PROBE_TRIGGERED);
+
+    /* the latch lands on the surface even though one cycle covers 0.2 mm */
+    float contact = q16_16_to_float(s_rig.planner.probe.contact.xyz[2]);
+    assert(fabsf(contact - surface) < 2e-5f);
+
+    /* the stop overshoots the surface but never reaches the programmed end */
+    float stop = q16_16_to_float(s_rig.planner.current_pose.xyz[2]);
+    assert(stop < surface && stop > -0.46f);
+
+    /* later lines continue from where the probe stopped */
+    for (int i = 0; i < 600; ++i) {
+        cycle(surface, &touched);
+    }
+    assert(s_rig.runtime.state != CNC_STATE_ALARM);
+    assert(fabsf(q16_16_to_float(s_rig.parser.current_pose.xyz[2]) + 0.32f) < 1e-4f);
+
+    /* G38.2 without contact raises an alarm, G38.3 does not */
+    setup();
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    assert(command_queue_enqueue(&s_rig.queue, "G38.3 Z-0.32 F12"));
+    touched = true;
+    for (cycles = 0; cycles < 800; ++cycles) {
+        cycle(surface, &touched);
+    }
+    assert(s_rig.planner.probe.state == PLANNER_PROBE_MISSED && s_rig.runtime.state != CNC_STATE_ALARM);
+    assert(command_queue_enqueue(&s_rig.queue, "G38.2 Z-0.34 F12"));
+    assert(command_queue_enqueue(&s_rig.queue, "G4 P0"));
+    for (cycles = 0; cycles < 800; ++cycles) {
+        cycle(surface, &touched);
+    }
+    assert(s_rig.planner.probe.state == PLANNER_PROBE_MISSED && s_rig.runtime.alarm_active);
+    ecat_sim_detach(&s_rig.sim);
+}
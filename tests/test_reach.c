@@ -0,0 +1,115 @@
+#include "test_suite.h"
+#include "../core/command_processor.h"
+#include "../planner/lookahead.h"
+#include <assert.h>
+#include <string.h>
+
+static void setup_kinematics(void)
+{
+    delta_cfg_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.R_base = q16_16_from_float(0.300f);
+    cfg.r_eff = q16_16_from_float(0.100f);
+    cfg.L_upper = q16_16_from_float(0.300f);
+    cfg.L_lower = q16_16_from_float(0.400f);
+    cfg.z_offset = q16_16_from_float(0.200f);
+    for (int axis = 0; axis < 3; ++axis) {
+        cfg.soft_xyz_min[axis] = q16_16_from_float(axis == 2 ? -0.5f : -0.2f);
+        cfg.soft_xyz_max[axis] = q16_16_from_float(axis == 2 ? -0.1f : 0.2f);
+    }
+    delta_init(&cfg);
+}
+
+static delta_pose_t pose_at(float x, float y, float z)
+{
+    delta_pose_t pose = {{q16_16_from_float(x), q16_16_from_float(y), q16_16_from_float(z)}};
+    return pose;
+}
+
+static planner_error_t check(float x0, float z0, float x1, float z1)
+{
+    delta_pose_t start = pose_at(x0, 0.0f, z0);
+    delta_pose_t end = pose_at(x1, 0.0f, z1);
+    return lookahead_validate_segment(&start, &end);
+}
+
+void test_reach(void)
+{
+    setup_kinematics();
+
+    /* deep in the workspace and along its floor */
+    assert(check(-0.1f, -0.4f, 0.1f, -0.4f) == PLANNER_ERROR_NONE);
+    assert(check(-0.2f, -0.5f, 0.2f, -0.5f) == PLANNER_ERROR_NONE);
+    assert(check(0.0f, -0.45f, 0.0f, -0.45f) == PLANNER_ERROR_NONE);
+    /* past the soft limits, and a target the arms cannot reach */
+    assert(check(0.0f, -0.4f, 0.25f, -0.4f) == PLANNER_ERROR_UNREACHABLE);
+    assert(check(0.0f, -0.28f, -0.12f, -0.28f) == PLANNER_ERROR_UNREACHABLE);
+    /* on the rim of the reachable dome the joints run away */
+    assert(check(0.0f, -0.26f, -0.04f, -0.26f) == PLANNER_ERROR_SINGULAR);
+    /* both ends reachable, the straight line between them is not */
+    assert(check(0.0f, -0.28f, -0.2f, -0.28f) != PLANNER_ERROR_NONE);
+
+    /* a rejected move leaves the queue and its end pose alone */
+    static planner_queue_t planner;
+    planner_init(&planner, 1000U);
+    planner_set_reach_check(&planner, true);
+    planner.current_pose = pose_at(-0.2f, 0.0f, -0.28f);
+    delta_pose_t target = pose_at(0.0f, 0.0f, -0.28f);
+    assert(!planner_push_line(&planner, &target, Q16_16_ONE, Q16_16_ONE, q16_16_from_int(5)));
+    assert(planner.error != PLANNER_ERROR_NONE && planner_is_empty(&planner));
+    assert(planner.current_pose.xyz[0] == q16_16_from_float(-0.2f));
+    /* an arch is checked along its legs, not its chord */
+    planner.current_pose = pose_at(-0.2f, 0.0f, -0.35f);
+    target = pose_at(0.2f, 0.0f, -0.35f);
+    assert(!planner_push_arch(&planner, &target, q16_16_from_float(0.07f), 0, Q16_16_ONE, Q16_16_ONE, q16_16_from_int(5)));
+    assert(planner_push_arch(&planner, &target, q16_16_from_float(0.02f), 0, Q16_16_ONE, Q16_16_ONE, q16_16_from_int(5)));
+    assert(planner.error == PLANNER_ERROR_NONE);
+
+    /* from G-code: the machine alarms, the console gets the reason */
+    static command_queue_t queue;
+    static gcode_parser_t parser;
+    static cnc_runtime_t runtime;
+    planner_init(&planner, 1000U);
+    planner_set_reach_check(&planner, true);
+    gcode_parser_init(&parser);
+    command_queue_init(&queue);
+    cnc_runtime_init(&runtime);
+    delta_pose_t start = pose_at(0.0f, 0.0f, -0.4f);
+    planner.current_pose = start;
+    gcode_parser_sync_pose(&parser, &start);
+    assert(command_queue_enqueue(&queue, "G1 X0.1 F60"));
+    assert(command_queue_enqueue(&queue, "G1 X0.3"));
+    assert(command_processor_step(&queue, &runtime, &parser, &planner, NULL, 0));
+    assert(command_processor_step(&queue, &runtime, &parser, &planner, NULL, 0));
+    assert(runtime.alarm_active && queue.error == PLANNER_ERROR_UNREACHABLE);
+    assert(parser.current_pose.xyz[0] == q16_16_from_float(0.1f));
+    assert(planner.current_pose.xyz[0] == q16_16_from_float(0.1f));
+
+    /* an arc streamed into a nearly full planner waits for room, it does not alarm half-queued */
+    planner_init(&planner, 1000U);
+    planner_set_reach_check(&planner, true);
+    gcode_parser_init(&parser);
+    command_queue_init(&queue);
+    cnc_runtime_init(&runtime);
+    start = pose_at(-0.05f, 0.0f, -0.4f);
+    planner.current_pose = start;
+    gcode_parser_sync_pose(&parser, &start);
+    for (int i = 0; i < 100; ++i) {
+        assert(command_queue_enqueue(&queue, (i % 2) == 0 ? "G1 X-0.049 F60" : "G1 X-0.05"));
+    }
+    assert(command_queue_enqueue(&queue, "G2 X0.05 Y0 I0.05 J0"));
+    bool waited = false;
+    for (int steps = 0; steps < 100000 && queue.head != queue.tail; ++steps) {
+        if (!command_processor_step(&queue, &runtime, &parser, &planner, NULL, 0)) {
+            waited = waited || gcode_parser_busy(&parser);
+            delta_pose_t pose;
+            planner_step(&planner, &pose);
+        }
+        assert(!runtime.alarm_active);
+    }
+    assert(waited && queue.head == queue.tail && !gcode_parser_busy(&parser));
+    assert(planner.error == PLANNER_ERROR_NONE);
+    const q16_16_t close = q16_16_from_float(1e-4f);
+    assert(q16_16_abs(parser.current_pose.xyz[0] - q16_16_from_float(0.05f)) < close && q16_16_abs(parser.current_pose.xyz[1]) < close);
+    assert(q16_16_abs(planner.current_pose.xyz[0] - parser.current_pose.xyz[0]) < close);
+}
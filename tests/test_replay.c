@@ -0,0 +1,201 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define CONFIG_KEY 0x5EEDU
+#define MAX_FRAMES 20000
+
+static sim_rig_t s_rig;
+static replay_cache_t s_cache;
+static delta_joint_t s_frames[MAX_FRAMES];
+
+static void codec_checks(void)
+{
+    /* rest, a smooth move across the wrap of the position register, rest */
+    delta_joint_t rest = {{INT32_MAX - 40000, 0, -65536}};
+    replay_init(&s_cache);
+    replay_arm(&s_cache, CONFIG_KEY);
+    replay_add_line(&s_cache, "G1 X1");
+    replay_record_begin(&s_cache, &rest);
+    uint32_t count = 0U;
+    for (int i = 0; i < 3000; ++i) {
+        float s = i < 500 ? 0.0f : i < 2500 ? 0.5f - 0.5f * cosf(3.14159265f * (float)(i - 500) / 2000.0f) : 1.0f;
+        delta_joint_t joints;
+        joints.theta[0] = (q16_16_t)((uint32_t)rest.theta[0] + (uint32_t)(int32_t)(s * 80000.0f));
+        joints.theta[1] = (q16_16_t)(s * 65536.0f);
+        joints.theta[2] = rest.theta[2];
+        s_frames[count++] = joints;
+        assert(replay_record(&s_cache, &joints));
+    }
+    delta_pose_t end = {{0, 0, q16_16_from_float(-0.4f)}};
+    assert(replay_record_end(&s_cache, &end));
+    assert(s_cache.valid && s_cache.frames == count);
+    /* 12 raw bytes per frame, the encoded stream is a fraction of that */
+    assert(s_cache.length * 8U < count * 12U);
+
+    /* decoded bit for bit */
+    assert(replay_play_begin(&s_cache) && s_cache.mode == REPLAY_PLAYING);
+    delta_joint_t joints;
+    for (uint32_t i = 0U; i < count; ++i) {
+        assert(replay_play(&s_cache, &joints));
+        assert(memcmp(&joints, &s_frames[i], sizeof(joints)) == 0);
+    }
+    assert(!replay_play(&s_cache, &joints) && s_cache.mode == REPLAY_IDLE && s_cache.valid);
+
+    /* only the same program and config from the same start */
+    uint32_t key = s_cache.program_hash;
+    assert(replay_matches(&s_cache, key, CONFIG_KEY, &rest));
+    assert(!replay_matches(&s_cache, key ^ 1U, CONFIG_KEY, &rest));
+    assert(!replay_matches(&s_cache, key, CONFIG_KEY + 1U, &rest));
+    delta_joint_t moved = rest;
+    moved.theta[1] += 1;
+    assert(!replay_matches(&s_cache, key, CONFIG_KEY, &moved));
+    uint32_t other = replay_hash(replay_hash(REPLAY_HASH_SEED, "G1 X", 4U), "1\n", 2U);
+    assert(other == key);
+
+    /* noise does not fit, the cache is dropped instead of truncated */
+    replay_arm(&s_cache, CONFIG_KEY);
+    replay_record_begin(&s_cache, &rest);
+    uint32_t seed = 1U;
+    bool stored = true;
+    for (int i = 0; i < 20000 && stored; ++i) {
+        for (int j = 0; j < DELTA_JOINT_COUNT; ++j) {
+            seed = seed * 1664525U + 1013904223U;
+            joints.theta[j] = (q16_16_t)seed;
+        }
+        stored = replay_record(&s_cache, &joints);
+    }
+    assert(!stored && !s_cache.valid && s_cache.mode == REPLAY_IDLE);
+}
+
+static void setup(void)
+{
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {2U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.35f)}};
+    sim_rig_rest(&s_rig, &start);
+}
+
+static void cycle(void)
+{
+    command_processor_step(&s_rig.queue, &s_rig.runtime, &s_rig.parser, &s_rig.planner, s_rig.axes, DELTA_JOINT_COUNT);
+    motion_controller_tick(&s_rig.motion);
+    ethcat_master_send_process_data(&s_rig.master);
+    ethcat_master_process(&s_rig.master);
+}
+
+static void run(int cycles)
+{
+    for (int i = 0; i < cycles; ++i) {
+        cycle();
+    }
+}
+
+static void teach_line(const char *line)
+{
+    assert(command_queue_enqueue(&s_rig.queue, line));
+    replay_add_line(&s_rig.motion.replay, line);
+}
+
+static void controller_checks(void)
+{
+    replay_cache_t *replay = &s_rig.motion.replay;
+    setup();
+    assert(!motion_controller_teach(&s_rig.motion, CONFIG_KEY)); /* drives are still off */
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    run(200);
+    assert(s_rig.motion.drives_ready);
+
+    /* teaching records the joint setpoints the planner and IK produce */
+    assert(motion_controller_teach(&s_rig.motion, CONFIG_KEY));
+    teach_line("G1 X0.05 Z-0.38 F30");
+    teach_line("G1 X-0.05 Y0.03 F30");
+    teach_line("G1 X0 Y0 Z-0.35 F30");
+    uint32_t count = 0U;
+    for (int i = 0; i < MAX_FRAMES && !replay->valid; ++i) {
+        if (s_rig.queue.head == s_rig.queue.tail && !replay->close_requested && replay->mode == REPLAY_RECORDING) {
+            assert(motion_controller_end_teach(&s_rig.motion));
+        }
+        cycle();
+        if (replay->mode == REPLAY_RECORDING || replay->valid) {
+            s_frames[count++] = s_rig.motion.joint_command;
+        }
+    }
+    assert(replay->valid && replay->frames == count && count > 300U);
+    /* under 2 bytes a frame against 12 raw, kinematics jitter included */
+    assert(replay->length < count * 2U);
+    uint32_t key = replay->program_hash;
+    delta_pose_t end = s_rig.motion.command_pose;
+    assert(memcmp(&end, &replay->end_pose, sizeof(end)) == 0);
+
+    /* the replay streams the same setpoints, the planner does no work */
+    assert(!motion_controller_replay(&s_rig.motion, key ^ 1U, CONFIG_KEY));
+    assert(!motion_controller_replay(&s_rig.motion, key, CONFIG_KEY + 1U));
+    assert(motion_controller_replay(&s_rig.motion, key, CONFIG_KEY));
+    assert(command_queue_enqueue(&s_rig.queue, "G1 X0.02 F30"));
+    for (uint32_t i = 0U; i < count; ++i) {
+        cycle();
+        assert(replay->mode == REPLAY_PLAYING && s_rig.planner.bypassed);
+        assert(memcmp(&s_rig.motion.joint_command, &s_frames[i], sizeof(delta_joint_t)) == 0);
+        assert(planner_is_empty(&s_rig.planner));
+    }
+    /* then the planner and the held-back line continue from the taught end */
+    cycle();
+    assert(replay->mode == REPLAY_IDLE && !s_rig.planner.bypassed);
+    assert(memcmp(&s_rig.planner.current_pose, &end, sizeof(end)) == 0);
+    run(1000);
+    assert(fabsf(q16_16_to_float(s_rig.parser.current_pose.xyz[0]) - 0.02f) < 1e-4f);
+    assert(fabsf(q16_16_to_float(s_rig.planner.current_pose.xyz[0]) - 0.02f) < 1e-4f);
+
+    /* away from the taught start the stream does not fit */
+    assert(!motion_controller_replay(&s_rig.motion, key, CONFIG_KEY));
+    assert(command_queue_enqueue(&s_rig.queue, "G1 X0 F30"));
+    run(1000);
+    assert(motion_controller_replay(&s_rig.motion, key, CONFIG_KEY));
+
+    /* a hold cannot ramp the stream down: it plays on to the next taught rest, no quick stop */
+    run(200);
+    assert(replay->mode == REPLAY_PLAYING);
+    planner_hold(&s_rig.planner);
+    uint32_t played = 0U;
+    while (replay->mode == REPLAY_PLAYING && played < count) {
+        cycle();
+        ++played;
+        if (replay->mode == REPLAY_PLAYING) {
+            assert(memcmp(&s_rig.motion.joint_command, &s_frames[replay->frame - 1U], sizeof(delta_joint_t)) == 0);
+        }
+    }
+    assert(replay->mode == REPLAY_IDLE && replay->valid && !s_rig.planner.bypassed);
+    assert(memcmp(&s_rig.motion.joint_command, &s_rig.motion.joint_previous, sizeof(delta_joint_t)) == 0);
+    delta_pose_t here;
+    assert(delta_forward_kinematics(&s_rig.motion.joint_command, &here));
+    assert(memcmp(&s_rig.planner.current_pose, &here, sizeof(here)) == 0);
+    for (int axis = 0; axis < DELTA_JOINT_COUNT; ++axis) {
+        assert(!s_rig.axes[axis].quick_stop);
+    }
+    run(50);
+    assert(s_rig.planner.hold_requested && memcmp(&s_rig.motion.command_pose, &here, sizeof(here)) == 0);
+    planner_resume(&s_rig.planner);
+
+    /* an override while teaching spoils the recording */
+    setup();
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    run(200);
+    assert(motion_controller_teach(&s_rig.motion, CONFIG_KEY));
+    teach_line("G1 X0.05 F30");
+    run(50);
+    assert(replay->mode == REPLAY_RECORDING);
+    planner_set_feed_override(&s_rig.planner, 50U);
+    cycle();
+    assert(replay->mode == REPLAY_IDLE && !replay->valid);
+}
+
+void test_replay(void)
+{
+    codec_checks();
+    controller_checks();
+}
@@ -16,6 +16,27 @@ int main(void)
     test_opcua();
     test_ethcat();
     test_console();
+    test_dc_sync();
+    test_cycle_stats();
+    test_ecat_sim();
+    test_cia402_enable();
+    test_probe();
+    test_following_error();
+    test_feed_hold();
+    test_overrides();
+    test_input_shaper();
+    test_arch();
+    test_conveyor();
+    test_lookahead();
+    test_reach();
+    test_delta_batch();
+    test_filter();
+    test_scheduler();
+    test_replay();
+    test_trace();
+    test_osal();
+    test_control_period();
+    test_eth_mac();
     puts("[tests] All host tests completed successfully.");
     return 0;
 }
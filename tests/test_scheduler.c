@@ -0,0 +1,171 @@
+#include "test_suite.h"
+#include "../core/scheduler.h"
+#include "../utils/timer.h"
+#include <assert.h>
+#include <string.h>
+
+#define US 1000ULL
+
+static uint64_t s_now;
+static char s_trace[64];
+static size_t s_trace_length;
+static uint64_t s_cost[4];
+static scheduler_t s_scheduler;
+static int s_deadline_task;
+static uint64_t s_oversleep;
+static uint64_t s_step;
+static uint32_t s_idle_calls;
+
+static uint64_t fake_clock(void)
+{
+    return s_now;
+}
+
+static void record(char id)
+{
+    if (s_trace_length + 1U < sizeof(s_trace)) {
+        s_trace[s_trace_length++] = id;
+        s_trace[s_trace_length] = '\0';
+    }
+}
+
+static void task_fn(void *user)
+{
+    int id = (int)(size_t)user;
+    record((char)('a' + id));
+    s_now += s_cost[id];
+}
+
+static uint64_t stepping_clock(void)
+{
+    s_now += s_step;
+    return s_now;
+}
+
+static void fake_idle(uint64_t wake_ns)
+{
+    s_idle_calls++;
+    s_now = wake_ns + s_oversleep;
+}
+
+static void releasing_fn(void *user)
+{
+    task_fn(user);
+    scheduler_release(&s_scheduler, s_deadline_task);
+}
+
+/* runs everything ready at each step of the fake clock */
+static void run_until(uint64_t end, uint64_t step)
+{
+    while (s_now < end) {
+        while (scheduler_dispatch(&s_scheduler)) {
+        }
+        s_now += step;
+    }
+}
+
+void test_scheduler(void)
+{
+    s_now = 1000 * US;
+    memset(s_cost, 0, sizeof(s_cost));
+    s_trace_length = 0U;
+    scheduler_init(&s_scheduler, fake_clock);
+    assert(scheduler_add_periodic(&s_scheduler, "bad", task_fn, NULL, 0U, 1U, 0U) < 0);
+
+    /* the nearest deadline runs first, registration order breaks ties */
+    int slow = scheduler_add_periodic(&s_scheduler, "slow", task_fn, (void *)0, 1000 * US, 1000 * US, 0U);
+    int fast = scheduler_add_periodic(&s_scheduler, "fast", task_fn, (void *)1, 250 * US, 250 * US, 100 * US);
+    int tie = scheduler_add_periodic(&s_scheduler, "tie", task_fn, (void *)2, 250 * US, 250 * US, 0U);
+    assert(slow == 0 && fast == 1 && tie == 2);
+    run_until(s_now + 1000 * US, 10 * US);
+    assert(strcmp(s_trace, "bcabcbcbc") == 0);
+    assert(s_scheduler.tasks[fast].runs == 4U && s_scheduler.tasks[slow].runs == 1U);
+    assert(s_scheduler.tasks[fast].misses == 0U && s_scheduler.tasks[fast].overruns == 0U);
+    /* both periods come due again exactly one slow period later */
+    assert(scheduler_next_release_ns(&s_scheduler) == s_now);
+
+    /* a long background run costs the fast task its deadline and a release, never a burst */
+    s_trace_length = 0U;
+    s_cost[0] = 600 * US;
+    s_cost[1] = 150 * US;
+    run_until(s_now + 1000 * US, 10 * US);
+    assert(s_scheduler.tasks[fast].overruns >= 1U);
+    assert(s_scheduler.tasks[fast].skipped >= 1U);
+    assert(s_scheduler.tasks[fast].max_ns == 150 * US && s_scheduler.tasks[slow].max_ns == 600 * US);
+    assert(s_scheduler.tasks[fast].misses >= 1U);
+    for (size_t i = 1U; i < s_trace_length; ++i) {
+        assert(!(s_trace[i] == 'b' && s_trace[i - 1U] == 'b'));
+    }
+
+    /* a shorter period applies from the next release on */
+    scheduler_reset_stats(&s_scheduler);
+    s_cost[0] = 0U;
+    s_cost[1] = 0U;
+    assert(scheduler_set_period(&s_scheduler, fast, 125 * US, 125 * US, 100 * US));
+    assert(!scheduler_set_period(&s_scheduler, 7, 125 * US, 125 * US, 0U));
+    run_until(s_now + 1000 * US, 5 * US);
+    assert(s_scheduler.tasks[fast].runs >= 8U && s_scheduler.tasks[fast].runs <= 9U);
+    assert(s_scheduler.tasks[fast].overruns == 0U && s_scheduler.tasks[fast].skipped == 0U);
+
+    /* deadline tasks run once per release, before work with later deadlines */
+    scheduler_init(&s_scheduler, fake_clock);
+    s_trace_length = 0U;
+    memset(s_cost, 0, sizeof(s_cost));
+    scheduler_add_periodic(&s_scheduler, "poll", releasing_fn, (void *)0, 1000 * US, 1000 * US, 0U);
+    scheduler_add_periodic(&s_scheduler, "log", task_fn, (void *)1, 1000 * US, 5000 * US, 0U);
+    s_deadline_task = scheduler_add_deadline(&s_scheduler, "parse", task_fn, (void *)3, 200 * US, 50 * US);
+    assert(!scheduler_release(&s_scheduler, 0) && scheduler_release(&s_scheduler, s_deadline_task));
+    assert(scheduler_next_release_ns(&s_scheduler) == 0U);
+    assert(scheduler_dispatch(&s_scheduler) && strcmp(s_trace, "d") == 0);
+    /* released again by the poll task, runs ahead of the log task */
+    run_until(s_now + 10 * US, 10 * US);
+    assert(strcmp(s_trace, "dadb") == 0);
+    assert(s_scheduler.tasks[s_deadline_task].runs == 2U);
+    assert(!scheduler_dispatch(&s_scheduler));
+    /* a late deadline job is counted as a miss */
+    s_cost[3] = 300 * US;
+    scheduler_release(&s_scheduler, s_deadline_task);
+    scheduler_release(&s_scheduler, s_deadline_task);
+    assert(scheduler_dispatch(&s_scheduler));
+    assert(s_scheduler.tasks[s_deadline_task].misses == 1U && s_scheduler.tasks[s_deadline_task].overruns == 1U);
+    assert(s_scheduler.tasks[s_deadline_task].runs == 3U);
+
+    /* the idle hook sleeps to the next release, overshoot is recorded as wake latency */
+    scheduler_init(&s_scheduler, fake_clock);
+    scheduler_set_idle(&s_scheduler, fake_idle);
+    s_trace_length = 0U;
+    scheduler_add_periodic(&s_scheduler, "tick", task_fn, (void *)0, 1000 * US, 1000 * US, 0U);
+    assert(scheduler_dispatch(&s_scheduler));
+    s_oversleep = 30 * US;
+    uint64_t release = scheduler_next_release_ns(&s_scheduler);
+    scheduler_poll(&s_scheduler);
+    assert(s_now == release + 30 * US);
+    assert(s_scheduler.wake_latency.count == 1U && s_scheduler.wake_latency.max == 30 * US);
+    scheduler_poll(&s_scheduler);
+    assert(s_scheduler.tasks[0].runs == 2U);
+    scheduler_reset_stats(&s_scheduler);
+    assert(s_scheduler.wake_latency.count == 0U);
+
+    /* a release falling due between the dispatch and the idle check is run, not slept past */
+    scheduler_init(&s_scheduler, stepping_clock);
+    scheduler_set_idle(&s_scheduler, fake_idle);
+    s_step = 0U;
+    s_oversleep = 0U;
+    scheduler_add_periodic(&s_scheduler, "tick", task_fn, (void *)0, 1000 * US, 1000 * US, 0U);
+    assert(scheduler_dispatch(&s_scheduler));
+    release = scheduler_next_release_ns(&s_scheduler);
+    s_now = release - 15 * US;
+    s_step = 10 * US;
+    s_idle_calls = 0U;
+    scheduler_poll(&s_scheduler);
+    assert(s_idle_calls == 0U && s_now < release + 100 * US);
+    scheduler_poll(&s_scheduler);
+    assert(s_scheduler.tasks[0].runs == 2U && s_scheduler.tasks[0].skipped == 0U);
+    s_step = 0U;
+
+    /* the 64-bit clock is monotonic and agrees with the 32-bit cycle counter */
+    uint64_t before = timer_get_ns();
+    uint32_t cycles = timer_get_cycles();
+    uint64_t after = timer_get_cycles64();
+    assert(after >= before && (uint32_t)(after - cycles) < 1000000U);
+}
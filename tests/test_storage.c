@@ -1,13 +1,118 @@
 #include "test_suite.h"
 #include "../storage/storage.h"
+#include "../storage/kv_store.h"
+#include "../storage/flash.h"
+#include "../gcode/console.h"
+#include "../drivers/uart.h"
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_IMAGE "test.kv"
+
+static uint32_t get_u32(uint16_t key)
+{
+    uint32_t value = 0U;
+    uint16_t length = 0U;
+    assert(kv_store_get(key, &value, sizeof(value), &length) && length == sizeof(value));
+    return value;
+}
 
 void test_storage(void)
 {
+    remove(TEST_IMAGE);
     storage_params_t params;
     storage_defaults(&params);
-    assert(storage_init("test.kv"));
+    assert(storage_init(TEST_IMAGE));
     assert(storage_save(&params));
     storage_params_t loaded;
     assert(storage_load(&loaded));
+    assert(memcmp(&params, &loaded, sizeof(params)) == 0);
+
+    /* a changed field survives a reboot, the rest keep their values */
+    kv_store_stats_t stats;
+    kv_store_get_stats(&stats);
+    uint32_t used = stats.live_bytes;
+    params.control_period_us = CONTROL_PERIOD_FAST_US;
+    params.input_shaper_frequency_hz[2] = q16_16_from_float(52.5f);
+    assert(storage_save(&params));
+    assert(storage_init(TEST_IMAGE));
+    assert(storage_load(&loaded));
+    assert(memcmp(&params, &loaded, sizeof(params)) == 0);
+    kv_store_get_stats(&stats);
+    assert(stats.live_bytes == used);
+
+    /* $SAVE is refused while the drives are enabled */
+    static motion_controller_t motion;
+    console_t console;
+    console_init(&console, NULL, NULL, &motion, &params);
+    motion.drives_ready = true;
+    params.control_period_us = CONTROL_PERIOD_US;
+    assert(!console_execute(&console, "$SAVE"));
+    assert(storage_load(&loaded) && loaded.control_period_us == CONTROL_PERIOD_FAST_US);
+    motion.drives_ready = false;
+    assert(console_execute(&console, "$SAVE"));
+    assert(storage_load(&loaded) && loaded.control_period_us == CONTROL_PERIOD_US);
+    uart_set_realtime_handler(NULL, NULL);
+    params.control_period_us = CONTROL_PERIOD_FAST_US;
+    assert(storage_save(&params));
+
+    /* thousands of parameter writes: the boot scan stays bounded by the
+     * region and every page takes its share of the erases */
+    for (uint32_t n = 0U; n < 20000U; ++n) {
+        uint32_t value = n;
+        assert(kv_store_set((uint16_t)(0x100U + n % 5U), &value, sizeof(value)));
+        if (n % 64U == 0U) {
+            kv_store_maintain();
+        }
+    }
+    kv_store_get_stats(&stats);
+    assert(stats.collections > 0U && stats.erase_max - stats.erase_min <= 1U && stats.erase_min >= 10U);
+    assert(storage_init(TEST_IMAGE));
+    kv_store_get_stats(&stats);
+    assert(stats.scanned_bytes <= FLASH_REGION_SIZE);
+    for (uint16_t key = 0U; key < 5U; ++key) {
+        assert(get_u32((uint16_t)(0x100U + key)) == 19995U + key);
+    }
+    assert(storage_load(&loaded) && memcmp(&params, &loaded, sizeof(params)) == 0);
+
+    /* deleted keys stay deleted, oversized values are refused */
+    assert(kv_store_delete(0x100U));
+    uint8_t big[KV_MAX_VALUE + 1U];
+    memset(big, 0x5A, sizeof(big));
+    assert(!kv_store_set(0x200U, big, sizeof(big)));
+    assert(kv_store_set(0x200U, big, KV_MAX_VALUE));
+    assert(storage_init(TEST_IMAGE));
+    uint32_t value;
+    uint16_t length;
+    assert(!kv_store_get(0x100U, &value, sizeof(value), &length));
+    uint8_t back[KV_MAX_VALUE];
+    assert(kv_store_get(0x200U, back, sizeof(back), &length) && length == KV_MAX_VALUE && memcmp(back, big, length) == 0);
+
+    /* power lost mid-write: on an empty store the first record sits right
+     * after the page header, 16 + 12 bytes, the torn one follows it */
+    remove(TEST_IMAGE);
+    assert(storage_init(TEST_IMAGE));
+    value = 7U;
+    assert(kv_store_set(0x300U, &value, sizeof(value)));
+    uint16_t torn[2] = {0x301U, sizeof(uint32_t)};
+    assert(flash_program(28U, torn, sizeof(torn)));
+    assert(storage_init(TEST_IMAGE));
+    assert(!kv_store_get(0x301U, &value, sizeof(value), &length));
+    assert(get_u32(0x300U) == 7U);
+    /* the next write goes past the torn record */
+    value = 8U;
+    assert(kv_store_set(0x301U, &value, sizeof(value)));
+    /* a header torn before its length closes the page, writing moves on */
+    uint16_t torn_key = 0x302U;
+    assert(flash_program(52U, &torn_key, sizeof(torn_key)));
+    assert(storage_init(TEST_IMAGE));
+    assert(get_u32(0x301U) == 8U && get_u32(0x300U) == 7U);
+    value = 9U;
+    assert(kv_store_set(0x302U, &value, sizeof(value)));
+    kv_store_get_stats(&stats);
+    assert(stats.used_pages == 2U);
+    assert(storage_init(TEST_IMAGE));
+    assert(get_u32(0x302U) == 9U && get_u32(0x301U) == 8U);
+    remove(TEST_IMAGE);
 }
@@ -51,4 +51,109 @@ void test_ethcat(void);
  */
 void test_console(void);
 
+/**
+ * @brief Execute distributed-clock servo lock and drift estimation checks.
+ */
+void test_dc_sync(void);
+
+/**
+ * @brief Execute cycle timing histogram and missed Sync0 accounting checks.
+ */
+void test_cycle_stats(void);
+
+/**
+ * @brief Execute frame-level checks against the virtual CiA-402 slave simulator.
+ */
+void test_ecat_sim(void);
+
+/**
+ * @brief Execute CiA-402 enable sequencer checks against simulated drives.
+ */
+void test_cia402_enable(void);
+
+/**
+ * @brief Execute touch-probe latch and G38 probing checks against simulated drives.
+ */
+void test_probe(void);
+
+/**
+ * @brief Execute following-error monitoring and feed scaling checks against simulated drives.
+ */
+void test_following_error(void);
+
+/**
+ * @brief Execute jerk-limited feed hold and resume checks on the planner queue.
+ */
+void test_feed_hold(void);
+
+/**
+ * @brief Execute feed and rapid override checks including realtime console bytes.
+ */
+void test_overrides(void);
+
+/**
+ * @brief Execute ZV/ZVD/EI input shaper residual vibration checks.
+ */
+void test_input_shaper(void);
+
+/**
+ * @brief Execute S-curve and pick-and-place arch primitive checks.
+ */
+void test_arch(void);
+
+/**
+ * @brief Execute conveyor estimator and belt-frame tracking checks.
+ */
+void test_conveyor(void);
+
+/**
+ * @brief Execute joint-limited path parameterization and look-ahead checks.
+ */
+void test_lookahead(void);
+
+/**
+ * @brief Execute enqueue-time reachability and singularity validation checks.
+ */
+void test_reach(void);
+
+/**
+ * @brief Execute SIMD batch kinematics checks against the scalar path.
+ */
+void test_delta_batch(void);
+
+/**
+ * @brief Execute biquad filter bank frequency response checks.
+ */
+void test_filter(void);
+
+/**
+ * @brief Execute cooperative deadline scheduler checks.
+ */
+void test_scheduler(void);
+
+/**
+ * @brief Execute teach-and-replay codec and streaming checks.
+ */
+void test_replay(void);
+
+/**
+ * @brief Execute triggered trace capture and dump checks.
+ */
+void test_trace(void);
+
+/**
+ * @brief Execute OS abstraction thread, mutex and timer checks.
+ */
+void test_osal(void);
+
+/**
+ * @brief Execute control period and $CYCLE checks.
+ */
+void test_control_period(void);
+
+/**
+ * @brief Execute Ethernet MAC buffer pool checks.
+ */
+void test_eth_mac(void);
+
 #endif /* TESTS_TEST_SUITE_H */
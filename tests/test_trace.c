@@ -0,0 +1,203 @@
+#include "test_suite.h"
+#include "sim_rig.h"
+#include "../gcode/console.h"
+#include "../utils/crc16.h"
+#include <assert.h>
+#include <string.h>
+
+#define CHANNELS 4
+#define MAX_CYCLES 2000
+
+static sim_rig_t s_rig;
+static trace_t s_trace;
+static int32_t s_expected[MAX_CYCLES][CHANNELS];
+static uint8_t s_dump[16U + 2U * CHANNELS + 4U * TRACE_BUFFER_WORDS + 2U];
+
+static void setup(void)
+{
+    sim_rig_configure(&s_rig);
+    ecat_sim_dynamics_t dynamics = {2U, q16_16_from_float(0.01f), Q16_16_ONE, 0U};
+    sim_rig_connect(&s_rig, &dynamics);
+    sim_rig_init_motion(&s_rig);
+    delta_pose_t start = {{0, 0, q16_16_from_float(-0.35f)}};
+    sim_rig_rest(&s_rig, &start);
+    trace_init(&s_trace);
+}
+
+/* one Sync0: the tick, the frame, then the trace as main.c samples it */
+static void cycle(int index, bool fault)
+{
+    command_processor_step(&s_rig.queue, &s_rig.runtime, &s_rig.parser, &s_rig.planner, s_rig.axes, DELTA_JOINT_COUNT);
+    motion_controller_tick(&s_rig.motion);
+    ethcat_master_send_process_data(&s_rig.master);
+    ethcat_master_process(&s_rig.master);
+    trace_sample(&s_trace, fault);
+    if (index >= 0) {
+        s_expected[index][0] = s_rig.master.slaves[0].rxpdo.target_position;
+        s_expected[index][1] = s_rig.master.slaves[0].txpdo.position_actual;
+        s_expected[index][2] = s_rig.motion.following.error[0];
+        s_expected[index][3] = s_rig.motion.command_pose.xyz[2];
+    }
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* streams the dump in uneven chunks, checks framing and CRC, returns the sample block */
+static const uint8_t *dump(uint16_t *pre, uint16_t *depth, uint8_t *trigger)
+{
+    assert(trace_dump_begin(&s_trace) && trace_dumping(&s_trace));
+    size_t length = 0U;
+    size_t chunk = 1U;
+    while (trace_dumping(&s_trace)) {
+        size_t got = trace_dump_read(&s_trace, s_dump + length, chunk);
+        assert(got > 0U && length + got <= sizeof(s_dump));
+        length += got;
+        chunk = chunk * 3U % 61U + 1U;
+    }
+    assert(trace_dump_read(&s_trace, s_dump + length, 8U) == 0U);
+    assert(memcmp(s_dump, TRACE_MAGIC, 3U) == 0 && s_dump[3] == TRACE_VERSION && s_dump[4] == CHANNELS);
+    *trigger = s_dump[5];
+    *pre = (uint16_t)(s_dump[6] | (s_dump[7] << 8));
+    *depth = (uint16_t)(s_dump[8] | (s_dump[9] << 8));
+    assert(read_u32(s_dump + 10) == s_rig.config.control_period_us);
+    assert(s_dump[14] == TRACE_SIGNAL_POSITION_COMMAND && s_dump[15] == 0U);
+    assert(s_dump[20] == TRACE_SIGNAL_POSE && s_dump[21] == 2U);
+    assert(length == 14U + 2U * CHANNELS + 4U * (size_t)*depth * CHANNELS + 2U);
+    uint16_t crc = crc16_ccitt(s_dump, (uint16_t)(length - 2U), 0xFFFFU);
+    assert(s_dump[length - 2U] == (uint8_t)crc && s_dump[length - 1U] == (uint8_t)(crc >> 8));
+    return s_dump + 14U + 2U * CHANNELS;
+}
+
+static void check_samples(const uint8_t *samples, uint16_t depth, int first)
+{
+    for (int s = 0; s < depth; ++s) {
+        for (int c = 0; c < CHANNELS; ++c) {
+            assert((int32_t)read_u32(samples + 4U * (size_t)(s * CHANNELS + c)) == s_expected[first + s][c]);
+        }
+    }
+}
+
+static void capture_checks(void)
+{
+    const trace_channel_t channels[CHANNELS] = {
+        {TRACE_SIGNAL_POSITION_COMMAND, 0U},
+        {TRACE_SIGNAL_POSITION_ACTUAL, 0U},
+        {TRACE_SIGNAL_FOLLOWING_ERROR, 0U},
+        {TRACE_SIGNAL_POSE, 2U},
+    };
+    const trace_channel_t bad[2] = {{TRACE_SIGNAL_TORQUE_ACTUAL, DELTA_JOINT_COUNT}, {TRACE_SIGNAL_POSE, 3U}};
+    setup();
+    assert(!trace_arm(&s_trace, 0U, 1000U)); /* nothing to record yet */
+    assert(!trace_configure(&s_trace, &s_rig.motion, bad, 1));
+    assert(!trace_configure(&s_trace, &s_rig.motion, bad + 1, 1));
+    assert(!trace_configure(&s_trace, &s_rig.motion, channels, TRACE_MAX_CHANNELS + 1));
+    assert(trace_configure(&s_trace, &s_rig.motion, channels, CHANNELS));
+    assert(!trace_set_trigger(&s_trace, TRACE_TRIGGER_RISING, CHANNELS, 0));
+    uint16_t depth = (uint16_t)(TRACE_BUFFER_WORDS / CHANNELS);
+    assert(!trace_arm(&s_trace, depth, 1000U));
+
+    assert(command_queue_enqueue(&s_rig.queue, "M17"));
+    for (int i = 0; i < 200; ++i) {
+        cycle(-1, false);
+    }
+    assert(s_rig.motion.drives_ready);
+
+    /* manual: a request before the pre-trigger history is full waits for it */
+    assert(trace_arm(&s_trace, 100U, s_rig.config.control_period_us));
+    assert(!trace_configure(&s_trace, &s_rig.motion, channels, CHANNELS));
+    assert(!trace_set_trigger(&s_trace, TRACE_TRIGGER_FAULT, 0, 0));
+    int index = 0;
+    for (; index < 50; ++index) {
+        cycle(index, false);
+    }
+    trace_trigger(&s_trace);
+    for (; trace_state(&s_trace) == TRACE_ARMED; ++index) {
+        cycle(index, false);
+    }
+    assert(index == 101);
+    for (; trace_state(&s_trace) == TRACE_TRIGGERED; ++index) {
+        cycle(index, false);
+    }
+    assert(trace_state(&s_trace) == TRACE_DONE && index == depth);
+    cycle(index, false); /* no longer written */
+    uint16_t pre;
+    uint16_t dumped_depth;
+    uint8_t trigger;
+    const uint8_t *samples = dump(&pre, &dumped_depth, &trigger);
+    assert(pre == 100U && dumped_depth == depth && trigger == TRACE_TRIGGER_MANUAL);
+    check_samples(samples, depth, 0);
+
+    /* threshold: the sample after pre is the first below the level, the history runs in the ring */
+    q16_16_t level = q16_16_from_float(-0.36f);
+    assert(trace_set_trigger(&s_trace, TRACE_TRIGGER_FALLING, 3, level));
+    assert(trace_arm(&s_trace, 64U, s_rig.config.control_period_us));
+    for (index = 0; index < 400; ++index) {
+        cycle(index, false);
+    }
+    assert(trace_state(&s_trace) == TRACE_ARMED);
+    assert(command_queue_enqueue(&s_rig.queue, "G1 Z-0.38 F30"));
+    for (; trace_state(&s_trace) != TRACE_DONE && index < MAX_CYCLES; ++index) {
+        cycle(index, false);
+    }
+    assert(trace_state(&s_trace) == TRACE_DONE);
+    samples = dump(&pre, &dumped_depth, &trigger);
+    assert(pre == 64U && trigger == TRACE_TRIGGER_FALLING);
+    check_samples(samples, depth, index - depth);
+    assert((int32_t)read_u32(samples + 4U * (64U * CHANNELS + 3U)) <= level);
+    assert((int32_t)read_u32(samples + 4U * (63U * CHANNELS + 3U)) > level);
+
+    /* fault, and a stop drops the capture */
+    assert(trace_set_trigger(&s_trace, TRACE_TRIGGER_FAULT, 0, 0));
+    assert(trace_arm(&s_trace, 0U, s_rig.config.control_period_us));
+    for (index = 0; index < 20; ++index) {
+        cycle(index, false);
+    }
+    assert(trace_state(&s_trace) == TRACE_ARMED);
+    cycle(index++, true);
+    assert(trace_state(&s_trace) == TRACE_TRIGGERED);
+    trace_stop(&s_trace);
+    assert(trace_state(&s_trace) == TRACE_IDLE && !trace_dump_begin(&s_trace));
+    assert(trace_dump_read(&s_trace, s_dump, 8U) == 0U);
+}
+
+static void console_checks(void)
+{
+    console_t console;
+    console_init(&console, &s_rig.queue, &s_rig.master, &s_rig.motion, &s_rig.config);
+    assert(!console_execute(&console, "$TRACE?")); /* no trace attached */
+    console_set_trace(&console, &s_trace);
+    assert(console_execute(&console, "$TRACE?"));
+    assert(!console_execute(&console, "$TRACE=C:Z0"));
+    assert(!console_execute(&console, "$TRACE=C:P0,"));
+    assert(!console_execute(&console, "$TRACE=C:P0,A9"));
+    assert(console_execute(&console, "$TRACE=C:P0,A0,V1,W1,T2,Q2,E0,C2"));
+    assert(s_trace.channel_count == TRACE_MAX_CHANNELS);
+    assert(s_trace.channels[6].signal == TRACE_SIGNAL_FOLLOWING_ERROR && s_trace.channels[7].signal == TRACE_SIGNAL_POSE);
+    assert(!console_execute(&console, "$TRACE=C:P0,A0,V1,W1,T2,Q2,E0,C2,P1"));
+    assert(!console_execute(&console, "$TRACE=S:8>0.1"));
+    assert(console_execute(&console, "$TRACE=S:7<-0.36"));
+    assert(s_trace.trigger == TRACE_TRIGGER_FALLING && s_trace.trigger_channel == 7U);
+    assert(console_execute(&console, "$TRACE=S:F"));
+    assert(console_execute(&console, "$TRACE=S:M"));
+    assert(!console_execute(&console, "$TRACE=T")); /* not armed */
+    assert(!console_execute(&console, "$TRACE=A:256"));
+    assert(console_execute(&console, "$TRACE=A:10"));
+    assert(!console_execute(&console, "$TRACE=D"));
+    assert(console_execute(&console, "$TRACE=T"));
+    for (int i = 0; i < 300; ++i) {
+        cycle(-1, false);
+    }
+    assert(trace_state(&s_trace) == TRACE_DONE);
+    assert(console_execute(&console, "$TRACE=D") && trace_dumping(&s_trace));
+    assert(console_execute(&console, "$TRACE=X") && !trace_dumping(&s_trace));
+    assert(!console_execute(&console, "$TRACE=Q"));
+}
+
+void test_trace(void)
+{
+    capture_checks();
+    console_checks();
+}
@@ -1,4 +1,8 @@
 #include "filter.h"
+#include <math.h>
+
+#define COEFF_ONE ((int32_t)1 << BIQUAD_COEFF_BITS)
+#define RESIDUE_MASK ((int64_t)COEFF_ONE - 1)
 
 void lp_filter_init(lp_filter_q16_16_t *filter, q16_16_t alpha)
 {
@@ -13,3 +17,119 @@ q16_16_t lp_filter_update(lp_filter_q16_16_t *filter, q16_16_t input)
     filter->value += scaled;
     return filter->value;
 }
+
+static int32_t to_coeff(float value)
+{
+    return (int32_t)lroundf(value * (float)COEFF_ONE);
+}
+
+bool biquad_design(biquad_coeffs_t *coeffs, biquad_type_t type, q16_16_t frequency_hz, q16_16_t q, uint32_t period_us)
+{
+    float frequency = q16_16_to_float(frequency_hz);
+    float quality = q16_16_to_float(q);
+    float period_s = (float)period_us * 1e-6f;
+    if (period_us == 0U || frequency <= 0.0f || quality <= 0.0f || frequency * period_s >= 0.5f) {
+        return false;
+    }
+    /* bilinear transform of the analog prototypes (RBJ cookbook), warped at the design frequency */
+    float w0 = 2.0f * 3.14159265f * frequency * period_s;
+    float cos_w0 = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * quality);
+    float a0 = 1.0f + alpha;
+    float b[3];
+    switch (type) {
+    case BIQUAD_LOWPASS:
+        b[0] = b[2] = 0.5f * (1.0f - cos_w0);
+        b[1] = 1.0f - cos_w0;
+        break;
+    case BIQUAD_NOTCH:
+        b[0] = b[2] = 1.0f;
+        b[1] = -2.0f * cos_w0;
+        break;
+    case BIQUAD_BANDPASS:
+        b[0] = alpha;
+        b[1] = 0.0f;
+        b[2] = -alpha;
+        break;
+    default:
+        return false;
+    }
+    coeffs->a1 = to_coeff(-2.0f * cos_w0 / a0);
+    coeffs->a2 = to_coeff((1.0f - alpha) / a0);
+    coeffs->b0 = to_coeff(b[0] / a0);
+    coeffs->b2 = type == BIQUAD_BANDPASS ? -coeffs->b0 : coeffs->b0;
+    /* b1 takes the rounding: DC passes exactly (lowpass, notch) or not at all (bandpass) */
+    int32_t dc = type == BIQUAD_BANDPASS ? 0 : COEFF_ONE + coeffs->a1 + coeffs->a2;
+    coeffs->b1 = dc - coeffs->b0 - coeffs->b2;
+    return true;
+}
+
+void biquad_bank_init(biquad_bank_t *bank, uint8_t channel_count)
+{
+    bank->stage_count = 0U;
+    bank->channel_count = channel_count > BIQUAD_MAX_CHANNELS ? BIQUAD_MAX_CHANNELS : channel_count;
+    biquad_bank_reset(bank, NULL);
+}
+
+bool biquad_bank_add_stage(biquad_bank_t *bank, const biquad_coeffs_t *coeffs)
+{
+    if (bank->stage_count >= BIQUAD_MAX_STAGES) {
+        return false;
+    }
+    bank->stages[bank->stage_count++] = *coeffs;
+    return true;
+}
+
+void biquad_bank_reset(biquad_bank_t *bank, const q16_16_t *value)
+{
+    /* settled on a constant input, NULL for zero: each stage passes its DC gain on */
+    for (uint8_t channel = 0U; channel < BIQUAD_MAX_CHANNELS; ++channel) {
+        q16_16_t level = value != NULL && channel < bank->channel_count ? value[channel] : 0;
+        for (uint8_t stage = 0U; stage < BIQUAD_MAX_STAGES; ++stage) {
+            biquad_state_t *state = &bank->state[stage][channel];
+            state->x1 = state->x2 = level;
+            if (stage < bank->stage_count) {
+                const biquad_coeffs_t *c = &bank->stages[stage];
+                int64_t gain = (int64_t)c->b0 + c->b1 + c->b2;
+                int64_t denominator = (int64_t)COEFF_ONE + c->a1 + c->a2;
+                level = denominator != 0 ? (q16_16_t)((int64_t)level * gain / denominator) : 0;
+            }
+            state->y1 = state->y2 = level;
+            state->residue = 0;
+        }
+    }
+}
+
+static q16_16_t saturate(int64_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : (q16_16_t)value);
+}
+
+void biquad_bank_process(biquad_bank_t *bank, q16_16_t *samples, size_t frames)
+{
+    /* samples are interleaved frame by frame; stage-major, so a stage's
+     * coefficients stay in registers over the whole block and every channel */
+    uint8_t channels = bank->channel_count;
+    for (uint8_t stage = 0U; stage < bank->stage_count; ++stage) {
+        const biquad_coeffs_t c = bank->stages[stage];
+        biquad_state_t *state = bank->state[stage];
+        q16_16_t *sample = samples;
+        for (size_t frame = 0U; frame < frames; ++frame) {
+            for (uint8_t channel = 0U; channel < channels; ++channel, ++sample) {
+                biquad_state_t *s = &state[channel];
+                q16_16_t x = *sample;
+                int64_t acc = (int64_t)c.b0 * x + (int64_t)c.b1 * s->x1 + (int64_t)c.b2 * s->x2 -
+                              (int64_t)c.a1 * s->y1 - (int64_t)c.a2 * s->y2 + s->residue;
+                /* first-order error feedback: the truncated fraction goes into the
+                 * next output, low cut-offs keep their DC accuracy */
+                q16_16_t y = saturate(acc >> BIQUAD_COEFF_BITS);
+                s->residue = (int32_t)(acc & RESIDUE_MASK);
+                s->x2 = s->x1;
+                s->x1 = x;
+                s->y2 = s->y1;
+                s->y1 = y;
+                *sample = y;
+            }
+        }
+    }
+}
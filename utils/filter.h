@@ -1,14 +1,58 @@
 #ifndef UTILS_FILTER_H
 #define UTILS_FILTER_H
 
+#include <stddef.h>
 #include "fixed.h"
 
+#define BIQUAD_MAX_STAGES 4
+#define BIQUAD_MAX_CHANNELS 8
+/* coefficient fraction bits, Q4.28 holds |a1| < 2 with room; samples up to
+ * +-2^12 in Q16.16 keep the 64-bit accumulator clear of overflow */
+#define BIQUAD_COEFF_BITS 28
+
 typedef struct {
     q16_16_t value;
     q16_16_t alpha;
 } lp_filter_q16_16_t;
 
+typedef enum {
+    BIQUAD_LOWPASS = 0,
+    BIQUAD_NOTCH,
+    BIQUAD_BANDPASS /* unity gain at the centre */
+} biquad_type_t;
+
+/* y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2, a0 normalized to one */
+typedef struct {
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+} biquad_coeffs_t;
+
+typedef struct {
+    q16_16_t x1;
+    q16_16_t x2;
+    q16_16_t y1;
+    q16_16_t y2;
+    int32_t residue; /* fraction dropped by the last output, fed back into the next */
+} biquad_state_t;
+
+/* one cascade shared by up to BIQUAD_MAX_CHANNELS signals, e.g. the joints */
+typedef struct {
+    biquad_coeffs_t stages[BIQUAD_MAX_STAGES];
+    biquad_state_t state[BIQUAD_MAX_STAGES][BIQUAD_MAX_CHANNELS];
+    uint8_t stage_count;
+    uint8_t channel_count;
+} biquad_bank_t;
+
 void lp_filter_init(lp_filter_q16_16_t *filter, q16_16_t alpha);
 q16_16_t lp_filter_update(lp_filter_q16_16_t *filter, q16_16_t input);
 
+bool biquad_design(biquad_coeffs_t *coeffs, biquad_type_t type, q16_16_t frequency_hz, q16_16_t q, uint32_t period_us);
+void biquad_bank_init(biquad_bank_t *bank, uint8_t channel_count);
+bool biquad_bank_add_stage(biquad_bank_t *bank, const biquad_coeffs_t *coeffs);
+void biquad_bank_reset(biquad_bank_t *bank, const q16_16_t *value);
+void biquad_bank_process(biquad_bank_t *bank, q16_16_t *samples, size_t frames);
+
 #endif
@@ -0,0 +1,74 @@
+#include "histogram.h"
+
+static int bucket_index(uint32_t value)
+{
+    if (value < 2U) {
+        return (int)value;
+    }
+    int msb = 31 - __builtin_clz(value);
+    int sub = (int)((value >> (msb - 1)) & 1U);
+    return msb * 2 + sub;
+}
+
+uint32_t histogram_bucket_upper(int bucket)
+{
+    if (bucket < 2) {
+        return (uint32_t)bucket;
+    }
+    int msb = bucket / 2;
+    uint32_t half = 1UL << (msb - 1);
+    uint32_t lower = (1UL << msb) | ((uint32_t)(bucket & 1) * half);
+    return lower + (half - 1U);
+}
+
+void histogram_reset(histogram_t *hist)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        hist->buckets[i] = 0U;
+    }
+    hist->count = 0U;
+    hist->min = UINT32_MAX;
+    hist->max = 0U;
+    hist->sum = 0ULL;
+}
+
+void histogram_record(histogram_t *hist, uint32_t value)
+{
+    hist->buckets[bucket_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint32_t histogram_percentile(const histogram_t *hist, uint32_t per_mille)
+{
+    if (hist->count == 0U) {
+        return 0U;
+    }
+    uint64_t rank = ((uint64_t)hist->count * per_mille + 999U) / 1000U;
+    if (rank == 0U) {
+        rank = 1U;
+    }
+    uint64_t seen = 0U;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = histogram_bucket_upper(i);
+            return upper > hist->max ? hist->max : upper;
+        }
+    }
+    return hist->max;
+}
+
+uint32_t histogram_mean(const histogram_t *hist)
+{
+    if (hist->count == 0U) {
+        return 0U;
+    }
+    return (uint32_t)(hist->sum / hist->count);
+}
@@ -0,0 +1,23 @@
+#ifndef UTILS_HISTOGRAM_H
+#define UTILS_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* two buckets per octave over the full 32-bit range */
+#define HISTOGRAM_BUCKETS 64
+
+typedef struct {
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} histogram_t;
+
+void histogram_reset(histogram_t *hist);
+void histogram_record(histogram_t *hist, uint32_t value);
+uint32_t histogram_percentile(const histogram_t *hist, uint32_t per_mille);
+uint32_t histogram_mean(const histogram_t *hist);
+uint32_t histogram_bucket_upper(int bucket);
+
+#endif
@@ -1,10 +1,46 @@
+#if !defined(__ARM_ARCH_7M__)
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
 #include "timer.h"
 
+#if defined(__ARM_ARCH_7M__)
+#define DEMCR (*(volatile uint32_t *)0xE000EDFCU)
+#define DWT_CTRL (*(volatile uint32_t *)0xE0001000U)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xE0001004U)
+#define DEMCR_TRCENA (1UL << 24)
+#define DWT_CTRL_CYCCNTENA (1UL << 0)
+#define SYST_CSR (*(volatile uint32_t *)0xE000E010U)
+#define SYST_RVR (*(volatile uint32_t *)0xE000E014U)
+#define SYST_CVR (*(volatile uint32_t *)0xE000E018U)
+#define SYST_CSR_ENABLE (1UL << 0)
+#define SYST_CSR_TICKINT (1UL << 1)
+#define SYST_CSR_CLKSOURCE (1UL << 2) /* core clock */
+#define SYST_RVR_MAX 0x00FFFFFFU
+#endif
+
 static volatile uint32_t s_ticks = 0;
+static uint32_t s_tick_period_us = 1000U;
+#if defined(__ARM_ARCH_7M__)
+static uint32_t s_cycles_low = 0U;
+static uint32_t s_cycles_high = 0U;
+#endif
+
+void timer_init(void)
+{
+#if defined(__ARM_ARCH_7M__)
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0U;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+    s_cycles_low = 0U;
+    s_cycles_high = 0U;
+#endif
+}
 
 void timer_tick_isr(void)
 {
     ++s_ticks;
+    (void)timer_get_cycles64();
 }
 
 uint32_t timer_get_ticks(void)
@@ -19,3 +55,88 @@ void timer_delay_ticks(uint32_t ticks)
         /* busy wait for deterministic delay */
     }
 }
+
+void timer_set_tick_period_us(uint32_t period_us)
+{
+    if (period_us != 0U) {
+        s_tick_period_us = period_us;
+    }
+}
+
+uint32_t timer_get_tick_period_us(void)
+{
+    return s_tick_period_us;
+}
+
+uint32_t timer_get_cycles(void)
+{
+#if defined(__ARM_ARCH_7M__)
+    return DWT_CYCCNT;
+#else
+    return (uint32_t)timer_get_cycles64();
+#endif
+}
+
+uint32_t timer_cycles_to_ns(uint32_t cycles)
+{
+    return (uint32_t)(((uint64_t)cycles * 1000U) / TIMER_CYCLES_PER_US);
+}
+
+uint64_t timer_get_cycles64(void)
+{
+#if defined(__ARM_ARCH_7M__)
+    /* the high word is shared with the tick ISR */
+    uint32_t primask;
+    __asm volatile("mrs %0, primask\n\tcpsid i" : "=r"(primask) : : "memory");
+    uint32_t now = DWT_CYCCNT;
+    if (now < s_cycles_low) {
+        ++s_cycles_high;
+    }
+    s_cycles_low = now;
+    uint64_t cycles = ((uint64_t)s_cycles_high << 32) | now;
+    __asm volatile("msr primask, %0" : : "r"(primask) : "memory");
+    return cycles;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+uint64_t timer_get_ns(void)
+{
+    return timer_get_cycles64() * 1000U / TIMER_CYCLES_PER_US;
+}
+
+#if defined(__ARM_ARCH_7M__)
+void SysTick_Handler(void)
+{
+    /* one-shot wake source for timer_idle_until_ns() */
+    SYST_CSR = 0U;
+    (void)timer_get_cycles64();
+}
+#endif
+
+void timer_idle_until_ns(uint64_t wake_ns)
+{
+#if defined(__ARM_ARCH_7M__)
+    /* SysTick wakes the core at the deadline, any other interrupt earlier. Masked so
+     * an interrupt between the check and the WFI still ends the sleep, WFI wakes on pending */
+    __asm volatile("cpsid i" : : : "memory");
+    uint64_t now = timer_get_ns();
+    if (wake_ns > now) {
+        uint64_t cycles = (wake_ns - now) * TIMER_CYCLES_PER_US / 1000U;
+        SYST_CSR = 0U;
+        SYST_RVR = cycles > SYST_RVR_MAX ? SYST_RVR_MAX : (cycles != 0U ? (uint32_t)cycles : 1U);
+        SYST_CVR = 0U;
+        SYST_CSR = SYST_CSR_ENABLE | SYST_CSR_TICKINT | SYST_CSR_CLKSOURCE;
+        __asm volatile("wfi" : : : "memory");
+    }
+    __asm volatile("cpsie i" : : : "memory");
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)(wake_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(wake_ns % 1000000000ULL);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#endif
+}
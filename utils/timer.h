@@ -3,8 +3,24 @@
 
 #include <stdint.h>
 
+#if defined(__ARM_ARCH_7M__)
+#define TIMER_CYCLES_PER_US 72U
+#else
+#define TIMER_CYCLES_PER_US 1000U /* host: monotonic clock counted in ns */
+#endif
+
+void timer_init(void);
 void timer_tick_isr(void);
 uint32_t timer_get_ticks(void);
 void timer_delay_ticks(uint32_t ticks);
+void timer_set_tick_period_us(uint32_t period_us);
+uint32_t timer_get_tick_period_us(void);
+uint32_t timer_get_cycles(void);
+uint32_t timer_cycles_to_ns(uint32_t cycles);
+/* 64-bit time base; on target CYCCNT wraps every minute, so the extension
+ * needs a read at least that often (the tick ISR does one) */
+uint64_t timer_get_cycles64(void);
+uint64_t timer_get_ns(void);
+void timer_idle_until_ns(uint64_t wake_ns);
 
 #endif